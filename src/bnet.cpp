@@ -25,8 +25,11 @@
 #include "bnlsclient.h"
 #include "commandpacket.h"
 #include "config.h"
+#include "crc32.h"
+#include "downloadscheduler.h"
 #include "game_base.h"
 #include "gameprotocol.h"
+#include "gamethread.h"
 #include "ghost.h"
 #include "ghostdb.h"
 #include "language.h"
@@ -133,6 +136,7 @@ CBNET::CBNET(CGHost *nGHost, std::string nServer, std::string nServerAlias, std:
     m_HoldFriends               = nHoldFriends;
     m_HoldClan                  = nHoldClan;
     m_PublicCommands            = nPublicCommands;
+    m_AdminIndex                = std::make_shared<const std::unordered_set<std::string>>();
 }
 
 CBNET::~CBNET()
@@ -241,23 +245,7 @@ std::vector<std::pair<std::string, int>> CBNET::GetAdmins()
     return result;
 }
 
-unsigned int CBNET::SetFD(void *fd, void *send_fd, int *nfds)
-{
-    unsigned int NumFDs = 0;
-
-    if (!m_Socket->HasError() && m_Socket->GetConnected())
-    {
-        m_Socket->SetFD((fd_set *)fd, (fd_set *)send_fd, nfds);
-        NumFDs++;
-
-        if (m_BNLSClient)
-            NumFDs += m_BNLSClient->SetFD(fd, send_fd, nfds);
-    }
-
-    return NumFDs;
-}
-
-bool CBNET::Update(void *fd, void *send_fd)
+bool CBNET::Update()
 {
     //
     // update callables
@@ -448,6 +436,21 @@ bool CBNET::Update(void *fd, void *send_fd)
             i++;
     }
 
+    for (std::vector<PairedCRCBench>::iterator i = m_PairedCRCBenches.begin(); i != m_PairedCRCBenches.end();)
+    {
+        if (i->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        {
+            std::vector<std::string> Results = i->second.get();
+
+            for (std::vector<std::string>::iterator j = Results.begin(); j != Results.end(); j++)
+                QueueChatCommand(*j, i->first, !i->first.empty(), false);
+
+            i = m_PairedCRCBenches.erase(i);
+        }
+        else
+            i++;
+    }
+
     // refresh the admin list every 5 minutes
 
     if (!m_CallableAdminList && GetTime() - m_LastAdminRefreshTime >= 300)
@@ -456,7 +459,7 @@ bool CBNET::Update(void *fd, void *send_fd)
     if (m_CallableAdminList && m_CallableAdminList->GetReady())
     {
         // CONSOLE_Print( "[BNET: " + m_ServerAlias + "] refreshed admin list (" + UTIL_ToString( m_Admins.size( ) ) + " -> " + UTIL_ToString( m_CallableAdminList->GetResult( ).size( ) ) + " admins)" );
-        m_Admins = m_CallableAdminList->GetResult();
+        SetAdmins(m_CallableAdminList->GetResult());
         m_GHost->m_DB->RecoverCallable(m_CallableAdminList);
         delete m_CallableAdminList;
         m_CallableAdminList    = NULL;
@@ -472,10 +475,7 @@ bool CBNET::Update(void *fd, void *send_fd)
     {
         // CONSOLE_Print( "[BNET: " + m_ServerAlias + "] refreshed ban list (" + UTIL_ToString( m_Bans.size( ) ) + " -> " + UTIL_ToString( m_CallableBanList->GetResult( ).size( ) ) + " bans)" );
 
-        for (std::vector<CDBBan *>::iterator i = m_Bans.begin(); i != m_Bans.end(); i++)
-            delete *i;
-
-        m_Bans = m_CallableBanList->GetResult();
+        SetBans(m_CallableBanList->GetResult());
         m_GHost->m_DB->RecoverCallable(m_CallableBanList);
         delete m_CallableBanList;
         m_CallableBanList    = NULL;
@@ -530,7 +530,7 @@ bool CBNET::Update(void *fd, void *send_fd)
     {
         // the socket is connected and everything appears to be working properly
 
-        m_Socket->DoRecv((fd_set *)fd);
+        m_Socket->DoRecv();
         ExtractPackets();
         ProcessPackets();
 
@@ -538,7 +538,7 @@ bool CBNET::Update(void *fd, void *send_fd)
 
         if (m_BNLSClient)
         {
-            if (m_BNLSClient->Update(fd, send_fd))
+            if (m_BNLSClient->Update())
             {
                 CONSOLE_Print("[BNET: " + m_ServerAlias + "] deleting BNLS client");
                 delete m_BNLSClient;
@@ -584,7 +584,7 @@ bool CBNET::Update(void *fd, void *send_fd)
             m_LastNullTime = GetTime();
         }
 
-        m_Socket->DoSend((fd_set *)send_fd);
+        m_Socket->DoSend();
         return m_Exiting;
     }
 
@@ -600,7 +600,7 @@ bool CBNET::Update(void *fd, void *send_fd)
             m_GHost->EventBNETConnected(this);
             m_Socket->PutBytes(m_Protocol->SEND_PROTOCOL_INITIALIZE_SELECTOR());
             m_Socket->PutBytes(m_Protocol->SEND_SID_AUTH_INFO(m_War3Version, m_GHost->m_TFT, m_LocaleID, m_CountryAbbrev, m_Country));
-            m_Socket->DoSend((fd_set *)send_fd);
+            m_Socket->DoSend();
             m_LastNullTime       = GetTime();
             m_LastOutPacketTicks = GetTicks();
 
@@ -634,6 +634,13 @@ bool CBNET::Update(void *fd, void *send_fd)
         if (!m_GHost->m_BindAddress.empty())
             CONSOLE_Print("[BNET: " + m_ServerAlias + "] attempting to bind to address [" + m_GHost->m_BindAddress + "]");
 
+        // see bot_capturebnet, each connection is captured as a new stream
+
+        if (m_GHost->m_Capture && m_GHost->m_CaptureBNET)
+            m_Socket->SetCapture(m_GHost->m_CapturePath + UTIL_FileSafeName("bnet-" + m_GHost->m_RunID + " " + m_ServerAlias + ".ghc"), "SID " + m_ServerAlias + " " + m_Server);
+        else if (m_Socket->GetCapturing())
+            m_Socket->SetCapture(std::string(), std::string());
+
         if (m_ServerIP.empty())
         {
             m_Socket->Connect(m_GHost->m_BindAddress, m_Server, 6112);
@@ -664,45 +671,26 @@ void CBNET::ExtractPackets()
 {
     // extract as many packets as possible from the socket's receive buffer and put them in the m_Packets std::queue
 
-    std::string *RecvBuffer = m_Socket->GetBytes();
-    BYTEARRAY Bytes         = UTIL_CreateByteArray((unsigned char *)RecvBuffer->c_str(), RecvBuffer->size());
-
-    // a packet is at least 4 bytes so loop as long as the buffer contains 4 bytes
+    static const unsigned char Headers[] = {BNET_HEADER_CONSTANT};
+    const unsigned char *Data;
+    uint16_t Length;
+    CTCPSocket::FrameResult Result;
 
-    while (Bytes.size() >= 4)
+    while ((Result = m_Socket->FramePacket(Headers, 1, &Data, &Length)) == CTCPSocket::FRAME_COMPLETE)
     {
-        // byte 0 is always 255
-
-        if (Bytes[0] == BNET_HEADER_CONSTANT)
-        {
-            // bytes 2 and 3 contain the length of the packet
-
-            uint16_t Length = UTIL_ByteArrayToUInt16(Bytes, false, 2);
+        m_Packets.push(new CCommandPacket(BNET_HEADER_CONSTANT, Data[1], Data, Length));
+        m_Socket->ConsumeBytes(Length);
+    }
 
-            if (Length >= 4)
-            {
-                if (Bytes.size() >= Length)
-                {
-                    m_Packets.push(new CCommandPacket(BNET_HEADER_CONSTANT, Bytes[1], BYTEARRAY(Bytes.begin(), Bytes.begin() + Length)));
-                    *RecvBuffer = RecvBuffer->substr(Length);
-                    Bytes       = BYTEARRAY(Bytes.begin() + Length, Bytes.end());
-                }
-                else
-                    return;
-            }
-            else
-            {
-                CONSOLE_Print("[BNET: " + m_ServerAlias + "] error - received invalid packet from battle.net (bad length), disconnecting");
-                m_Socket->Disconnect();
-                return;
-            }
-        }
-        else
-        {
-            CONSOLE_Print("[BNET: " + m_ServerAlias + "] error - received invalid packet from battle.net (bad header constant), disconnecting");
-            m_Socket->Disconnect();
-            return;
-        }
+    if (Result == CTCPSocket::FRAME_BADLENGTH)
+    {
+        CONSOLE_Print("[BNET: " + m_ServerAlias + "] error - received invalid packet from battle.net (bad length), disconnecting");
+        m_Socket->Disconnect();
+    }
+    else if (Result == CTCPSocket::FRAME_BADHEADER)
+    {
+        CONSOLE_Print("[BNET: " + m_ServerAlias + "] error - received invalid packet from battle.net (bad header constant), disconnecting");
+        m_Socket->Disconnect();
     }
 }
 
@@ -1497,6 +1485,32 @@ void CBNET::ProcessChatEvent(CIncomingChatEvent *chatEvent)
                 if (Command == "countbans")
                     m_PairedBanCounts.push_back(PairedBanCount(Whisper ? User : std::string(), m_GHost->m_DB->ThreadedBanCount(m_Server)));
 
+                //
+                // !CRCBENCH
+                //
+
+                if (Command == "crcbench")
+                {
+                    // the benchmark takes a few hundred milliseconds so it runs on its own thread and the results are sent when it's done (see Update)
+                    // it still competes with the games for the CPU while it's running so it's root admin only
+
+                    if (IsRootAdmin(User))
+                    {
+                        std::future<std::vector<std::string>> Benchmark = std::async(std::launch::async, []() {
+                            CCRC32 CRC;
+                            CRC.Initialize();
+                            std::vector<std::string> Results;
+                            Results.push_back(CRC.Benchmark(8 * 1024 * 1024, 4));
+                            Results.push_back(CRC.Benchmark(1442, 20000));
+                            return Results;
+                        });
+
+                        m_PairedCRCBenches.push_back(PairedCRCBench(Whisper ? User : std::string(), std::move(Benchmark)));
+                    }
+                    else
+                        QueueChatCommand(m_GHost->m_Language->YouDontHaveAccessToThatCommand(), User, Whisper, WhisperResponses);
+                }
+
                 //
                 // !DBSTATUS
                 //
@@ -1548,6 +1562,21 @@ void CBNET::ProcessChatEvent(CIncomingChatEvent *chatEvent)
                 // !DOWNLOADS
                 //
 
+                if (Command == "downloads" && Payload.empty())
+                {
+                    // battle.net cuts off long messages (and PvPGN can cut them off even shorter) so the report is split into lines that fit, including the whisper
+
+                    uint32_t MaxLength = m_PasswordHashType == "pvpgn" ? std::min<uint32_t>(m_MaxMessageLength, 255) : 255;
+
+                    if (Whisper || WhisperResponses)
+                        MaxLength -= std::min<uint32_t>(MaxLength / 2, 4 + User.size());
+
+                    std::vector<std::string> Report = m_GHost->m_DownloadScheduler->GetReport(MaxLength);
+
+                    for (std::vector<std::string>::iterator i = Report.begin(); i != Report.end(); i++)
+                        QueueChatCommand(*i, User, Whisper, WhisperResponses);
+                }
+
                 if (Command == "downloads" && !Payload.empty())
                 {
                     uint32_t Downloads = UTIL_ToUInt32(Payload);
@@ -1604,6 +1633,10 @@ void CBNET::ProcessChatEvent(CIncomingChatEvent *chatEvent)
 
                     if (GameNumber < m_GHost->m_Games.size())
                     {
+                        // the game might be running on a game thread so it has to wait while we read and change it
+
+                        CGameThreadLock Lock(m_GHost->m_GameThreads);
+
                         // if the game owner is still in the game only allow the root admin to end the game
 
                         if (m_GHost->m_Games[GameNumber]->GetPlayerFromName(m_GHost->m_Games[GameNumber]->GetOwnerName(), false) && !IsRootAdmin(User))
@@ -1701,7 +1734,10 @@ void CBNET::ProcessChatEvent(CIncomingChatEvent *chatEvent)
                     uint32_t GameNumber = UTIL_ToUInt32(Payload) - 1;
 
                     if (GameNumber < m_GHost->m_Games.size())
+                    {
+                        CGameThreadLock Lock(m_GHost->m_GameThreads);
                         QueueChatCommand(m_GHost->m_Language->GameNumberIs(Payload, m_GHost->m_Games[GameNumber]->GetDescription()), User, Whisper, WhisperResponses);
+                    }
                     else
                         QueueChatCommand(m_GHost->m_Language->GameNumberDoesntExist(Payload), User, Whisper, WhisperResponses);
                 }
@@ -2109,7 +2145,10 @@ void CBNET::ProcessChatEvent(CIncomingChatEvent *chatEvent)
                                     Message = Message.substr(Start);
 
                                 if (GameNumber - 1 < m_GHost->m_Games.size())
-                                    m_GHost->m_Games[GameNumber - 1]->SendAllChat("ADMIN: " + Message);
+                                {
+                                    CBaseGame *Game = m_GHost->m_Games[GameNumber - 1];
+                                    Game->RunOnGameThread([Game, Message] { Game->SendAllChat("ADMIN: " + Message); });
+                                }
                                 else
                                     QueueChatCommand(m_GHost->m_Language->GameNumberDoesntExist(UTIL_ToString(GameNumber)), User, Whisper, WhisperResponses);
                             }
@@ -2131,7 +2170,10 @@ void CBNET::ProcessChatEvent(CIncomingChatEvent *chatEvent)
                             m_GHost->m_CurrentGame->SendAllChat(Payload);
 
                         for (std::vector<CBaseGame *>::iterator i = m_GHost->m_Games.begin(); i != m_GHost->m_Games.end(); i++)
-                            (*i)->SendAllChat("ADMIN: " + Payload);
+                        {
+                            CBaseGame *Game = *i;
+                            Game->RunOnGameThread([Game, Payload] { Game->SendAllChat("ADMIN: " + Payload); });
+                        }
                     }
                     else
                         QueueChatCommand(m_GHost->m_Language->YouDontHaveAccessToThatCommand(), User, Whisper, WhisperResponses);
@@ -2640,15 +2682,12 @@ void CBNET::RequestListUpdates()
 
 bool CBNET::IsAdmin(std::string name)
 {
-    transform(name.begin(), name.end(), name.begin(), (int (*)(int))tolower);
+    // the games on the game threads check their players against the admin list without taking the pool's lock (see gamethread.h)
+    // so they look in whatever index was current when they started and the main thread replaces the whole index whenever it changes
 
-    for (std::vector<std::string>::iterator i = m_Admins.begin(); i != m_Admins.end(); i++)
-    {
-        if (*i == name)
-            return true;
-    }
-
-    return false;
+    transform(name.begin(), name.end(), name.begin(), (int (*)(int))tolower);
+    SharedAdminIndex AdminIndex = std::atomic_load(&m_AdminIndex);
+    return AdminIndex->find(name) != AdminIndex->end();
 }
 
 bool CBNET::IsRootAdmin(std::string name)
@@ -2681,35 +2720,29 @@ bool CBNET::IsLANRootAdmin(std::string name)
 CDBBan *CBNET::IsBannedName(std::string name)
 {
     transform(name.begin(), name.end(), name.begin(), (int (*)(int))tolower);
-
-    // todotodo: optimize this - maybe use a map?
-
-    for (std::vector<CDBBan *>::iterator i = m_Bans.begin(); i != m_Bans.end(); i++)
-    {
-        if ((*i)->GetName() == name)
-            return *i;
-    }
-
-    return NULL;
+    std::unordered_map<std::string, CDBBan *>::iterator Ban = m_BansByName.find(name);
+    return Ban != m_BansByName.end() ? Ban->second : NULL;
 }
 
 CDBBan *CBNET::IsBannedIP(std::string ip)
 {
-    // todotodo: optimize this - maybe use a map?
+    uint32_t IP;
 
-    for (std::vector<CDBBan *>::iterator i = m_Bans.begin(); i != m_Bans.end(); i++)
-    {
-        if ((*i)->GetIP() == ip)
-            return *i;
-    }
+    if (!UTIL_ParseIP(ip, IP))
+        return NULL;
 
-    return NULL;
+    std::unordered_map<uint32_t, CDBBan *>::iterator Ban = m_BansByIP.find(IP);
+    return Ban != m_BansByIP.end() ? Ban->second : NULL;
 }
 
 void CBNET::AddAdmin(std::string name)
 {
     transform(name.begin(), name.end(), name.begin(), (int (*)(int))tolower);
     m_Admins.push_back(name);
+
+    std::shared_ptr<std::unordered_set<std::string>> AdminIndex = std::make_shared<std::unordered_set<std::string>>(*m_AdminIndex);
+    AdminIndex->insert(name);
+    std::atomic_store(&m_AdminIndex, SharedAdminIndex(AdminIndex));
 }
 
 //void CBNET::AddTmpRootAdmin(std::string name)
@@ -2721,7 +2754,16 @@ void CBNET::AddAdmin(std::string name)
 void CBNET::AddBan(std::string name, std::string ip, std::string gamename, std::string admin, std::string reason)
 {
     transform(name.begin(), name.end(), name.begin(), (int (*)(int))tolower);
-    m_Bans.push_back(new CDBBan(m_Server, name, ip, "N/A", gamename, admin, reason));
+    CDBBan *Ban = new CDBBan(m_Server, name, ip, "N/A", gamename, admin, reason);
+    m_Bans.push_back(Ban);
+
+    // the indexes keep the first ban for each name and IP just like the old linear search did
+
+    uint32_t IP;
+    m_BansByName.insert(std::make_pair(name, Ban));
+
+    if (UTIL_ParseIP(ip, IP))
+        m_BansByIP.insert(std::make_pair(IP, Ban));
 }
 
 void CBNET::RemoveAdmin(std::string name)
@@ -2735,19 +2777,89 @@ void CBNET::RemoveAdmin(std::string name)
         else
             i++;
     }
+
+    std::shared_ptr<std::unordered_set<std::string>> AdminIndex = std::make_shared<std::unordered_set<std::string>>(*m_AdminIndex);
+    AdminIndex->erase(name);
+    std::atomic_store(&m_AdminIndex, SharedAdminIndex(AdminIndex));
 }
 
 void CBNET::RemoveBan(std::string name)
 {
     transform(name.begin(), name.end(), name.begin(), (int (*)(int))tolower);
+    std::vector<uint32_t> RemovedIPs;
 
     for (std::vector<CDBBan *>::iterator i = m_Bans.begin(); i != m_Bans.end();)
     {
         if ((*i)->GetName() == name)
+        {
+            uint32_t IP;
+
+            if (UTIL_ParseIP((*i)->GetIP(), IP))
+                RemovedIPs.push_back(IP);
+
             i = m_Bans.erase(i);
+        }
         else
             i++;
     }
+
+    m_BansByName.erase(name);
+
+    // another player might have been banned from the same IP address so look for the next ban to index it under
+
+    for (std::vector<uint32_t>::iterator i = RemovedIPs.begin(); i != RemovedIPs.end(); i++)
+    {
+        m_BansByIP.erase(*i);
+
+        for (std::vector<CDBBan *>::iterator j = m_Bans.begin(); j != m_Bans.end(); j++)
+        {
+            uint32_t IP;
+
+            if (UTIL_ParseIP((*j)->GetIP(), IP) && IP == *i)
+            {
+                m_BansByIP.insert(std::make_pair(IP, *j));
+                break;
+            }
+        }
+    }
+}
+
+void CBNET::SetAdmins(std::vector<std::string> admins)
+{
+    // build the new index first and then swap it in so we never look anything up in a half built index
+
+    SharedAdminIndex AdminIndex = std::make_shared<const std::unordered_set<std::string>>(admins.begin(), admins.end());
+    m_Admins.swap(admins);
+    std::atomic_store(&m_AdminIndex, AdminIndex);
+}
+
+void CBNET::SetBans(std::vector<CDBBan *> bans)
+{
+    // build the new indexes first and then swap them in so we never look anything up in a half built index
+    // the indexes keep the first ban for each name and IP just like the old linear search did
+
+    std::unordered_map<std::string, CDBBan *> BansByName;
+    std::unordered_map<uint32_t, CDBBan *> BansByIP;
+    BansByName.reserve(bans.size());
+    BansByIP.reserve(bans.size());
+
+    for (std::vector<CDBBan *>::iterator i = bans.begin(); i != bans.end(); i++)
+    {
+        uint32_t IP;
+        BansByName.insert(std::make_pair((*i)->GetName(), *i));
+
+        if (UTIL_ParseIP((*i)->GetIP(), IP))
+            BansByIP.insert(std::make_pair(IP, *i));
+    }
+
+    m_Bans.swap(bans);
+    m_BansByName.swap(BansByName);
+    m_BansByIP.swap(BansByIP);
+
+    // bans now holds the old bans
+
+    for (std::vector<CDBBan *>::iterator i = bans.begin(); i != bans.end(); i++)
+        delete *i;
 }
 
 void CBNET::HoldFriends(CBaseGame *game)
@@ -22,6 +22,8 @@
 
 #include "includes.h"
 
+#include <future>
+
 //
 // CBNET
 //
@@ -58,6 +60,8 @@ typedef std::pair<std::string, CCallableBanAdd *> PairedBanAdd;
 typedef std::pair<std::string, CCallableBanRemove *> PairedBanRemove;
 typedef std::pair<std::string, CCallableGamePlayerSummaryCheck *> PairedGPSCheck;
 typedef std::pair<std::string, CCallableDotAPlayerSummaryCheck *> PairedDPSCheck;
+typedef std::pair<std::string, std::future<std::vector<std::string>>> PairedCRCBench;
+typedef std::shared_ptr<const std::unordered_set<std::string>> SharedAdminIndex;
 
 class CBNET
 {
@@ -81,10 +85,16 @@ private:
     std::vector<PairedBanRemove> m_PairedBanRemoves;     // std::vector of paired threaded database ban removes in progress
     std::vector<PairedGPSCheck> m_PairedGPSChecks;       // std::vector of paired threaded database game player summary checks in progress
     std::vector<PairedDPSCheck> m_PairedDPSChecks;       // std::vector of paired threaded database DotA player summary checks in progress
+    std::vector<PairedCRCBench> m_PairedCRCBenches;      // std::vector of paired crc benchmarks running on their own threads (see !crcbench)
     CCallableAdminList *m_CallableAdminList;             // threaded database admin list in progress
     CCallableBanList *m_CallableBanList;                 // threaded database ban list in progress
     std::vector<std::string> m_Admins;                   // std::vector of cached admins
     std::vector<CDBBan *> m_Bans;                        // std::vector of cached bans
+
+    SharedAdminIndex m_AdminIndex;                          // the cached admins indexed by (lower case) name, the game threads read it too so it's never changed, only replaced (see IsAdmin)
+    std::unordered_map<std::string, CDBBan *> m_BansByName; // the first cached ban for each (lower case) name
+    std::unordered_map<uint32_t, CDBBan *> m_BansByIP;      // the first cached ban for each IP address
+
     bool m_Exiting;                                      // set to true and this class will be deleted next update
     std::string m_Server;                                // battle.net server to connect to
     std::string m_ServerIP;                              // battle.net server to connect to (the IP address so we don't have to resolve it every time we connect)
@@ -166,8 +176,7 @@ public:
 
     // processing functions
 
-    unsigned int SetFD(void *fd, void *send_fd, int *nfds);
-    bool Update(void *fd, void *send_fd);
+    bool Update();
     void ExtractPackets();
     void ProcessPackets();
     void ProcessChatEvent(CIncomingChatEvent *chatEvent);
@@ -202,6 +211,8 @@ public:
     void AddBan(std::string name, std::string ip, std::string gamename, std::string admin, std::string reason);
     void RemoveAdmin(std::string name);
     void RemoveBan(std::string name);
+    void SetAdmins(std::vector<std::string> admins);
+    void SetBans(std::vector<CDBBan *> bans);
     void HoldFriends(CBaseGame *game);
     void HoldClan(CBaseGame *game);
 
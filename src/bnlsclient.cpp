@@ -68,18 +68,7 @@ BYTEARRAY CBNLSClient::GetWardenResponse()
     return WardenResponse;
 }
 
-unsigned int CBNLSClient::SetFD(void *fd, void *send_fd, int *nfds)
-{
-    if (!m_Socket->HasError() && m_Socket->GetConnected())
-    {
-        m_Socket->SetFD((fd_set *)fd, (fd_set *)send_fd, nfds);
-        return 1;
-    }
-
-    return 0;
-}
-
-bool CBNLSClient::Update(void *fd, void *send_fd)
+bool CBNLSClient::Update()
 {
     if (m_Socket->HasError())
     {
@@ -95,7 +84,7 @@ bool CBNLSClient::Update(void *fd, void *send_fd)
 
     if (m_Socket->GetConnected())
     {
-        m_Socket->DoRecv((fd_set *)fd);
+        m_Socket->DoRecv();
         ExtractPackets();
         ProcessPackets();
 
@@ -111,7 +100,7 @@ bool CBNLSClient::Update(void *fd, void *send_fd)
             m_OutPackets.pop();
         }
 
-        m_Socket->DoSend((fd_set *)send_fd);
+        m_Socket->DoSend();
         return false;
     }
 
@@ -135,20 +124,20 @@ bool CBNLSClient::Update(void *fd, void *send_fd)
 
 void CBNLSClient::ExtractPackets()
 {
-    std::string *RecvBuffer = m_Socket->GetBytes();
-    BYTEARRAY Bytes         = UTIL_CreateByteArray((unsigned char *)RecvBuffer->c_str(), RecvBuffer->size());
+    // BNLS packets put the length first so we can't use CTCPSocket::FramePacket here
+    // we still read the packets straight out of the socket's receive buffer though
 
-    while (Bytes.size() >= 3)
+    while (m_Socket->GetRecvSize() >= 3)
     {
-        uint16_t Length = UTIL_ByteArrayToUInt16(Bytes, false);
+        const unsigned char *Data = m_Socket->GetRecvData();
+        uint16_t Length           = (uint16_t)(Data[0] | (Data[1] << 8));
 
         if (Length >= 3)
         {
-            if (Bytes.size() >= Length)
+            if (m_Socket->GetRecvSize() >= Length)
             {
-                m_Packets.push(new CCommandPacket(0, Bytes[2], BYTEARRAY(Bytes.begin(), Bytes.begin() + Length)));
-                *RecvBuffer = RecvBuffer->substr(Length);
-                Bytes       = BYTEARRAY(Bytes.begin() + Length, Bytes.end());
+                m_Packets.push(new CCommandPacket(0, Data[2], Data, Length));
+                m_Socket->ConsumeBytes(Length);
             }
             else
                 return;
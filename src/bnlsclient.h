@@ -56,8 +56,7 @@ public:
 
     // processing functions
 
-    unsigned int SetFD(void *fd, void *send_fd, int *nfds);
-    bool Update(void *fd, void *send_fd);
+    bool Update();
     void ExtractPackets();
     void ProcessPackets();
 
@@ -0,0 +1,73 @@
+#include "capture.h"
+
+#include <chrono>
+
+// the capture format doesn't use anything else from GHost++ so ghostcapture can be built from this file and the decoder alone
+
+static void AppendUInt32(std::string &target, uint32_t value)
+{
+    for (uint32_t i = 0; i < 4; i++)
+        target += (char)((value >> (i * 8)) & 0xFF);
+}
+
+static void AppendUInt64(std::string &target, uint64_t value)
+{
+    for (uint32_t i = 0; i < 8; i++)
+        target += (char)((value >> (i * 8)) & 0xFF);
+}
+
+std::string CAPTURE_FileHeader()
+{
+    std::string Header = CAPTURE_MAGIC;
+    AppendUInt32(Header, CAPTURE_VERSION);
+    return Header;
+}
+
+std::string CAPTURE_Record(uint32_t stream, unsigned char type, const unsigned char *data, uint32_t length)
+{
+    std::string Record;
+    Record.reserve(CAPTURE_RECORD_SIZE + length);
+    AppendUInt64(Record, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    AppendUInt32(Record, stream);
+    Record += (char)type;
+    Record.append(3, (char)0);
+    AppendUInt32(Record, length);
+
+    if (length > 0)
+        Record.append((const char *)data, length);
+
+    return Record;
+}
+
+std::string CAPTURE_Restart()
+{
+    return CAPTURE_Record(0, CAPTURE_RESTART, NULL, 0);
+}
+
+std::string CAPTURE_Gap(uint32_t stream, uint32_t records, uint32_t bytes)
+{
+    std::string Lost;
+    AppendUInt32(Lost, records);
+    AppendUInt32(Lost, bytes);
+    return CAPTURE_Record(stream, CAPTURE_GAP, (const unsigned char *)Lost.data(), Lost.size());
+}
+
+std::string CAPTURE_TypeName(unsigned char type)
+{
+    if (type == CAPTURE_OPENED)
+        return "opened";
+    else if (type == CAPTURE_RECEIVED)
+        return "<<<";
+    else if (type == CAPTURE_SENT)
+        return ">>>";
+    else if (type == CAPTURE_RESET)
+        return "reset";
+    else if (type == CAPTURE_CLOSED)
+        return "closed";
+    else if (type == CAPTURE_GAP)
+        return "gap";
+    else if (type == CAPTURE_RESTART)
+        return "restart";
+
+    return "unknown";
+}
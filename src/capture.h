@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+//
+// packet capture format
+//
+
+// CTCPSocket::SetCapture records everything a socket sends and receives in a compact binary format instead of hex dumping it as text like SetLogFile
+// the records are written by the logger's thread (see logger.h) so capturing a busy game doesn't slow down its action ticks
+// a capture file holds any number of streams (one per captured connection) and is decoded offline with ghostcapture (see capturedecoder.cpp)
+// the file header is the magic "GHPC" followed by the format version, it's only written when a file is started (including after it's rotated)
+// when the bot appends to a file it has no open streams in (e.g. one left behind by an earlier run) it writes a restart record first instead, every earlier stream ends there
+// every record is a 20 byte header followed by its data, all numbers are little endian:
+//   8 bytes: the time in microseconds since the epoch
+//   4 bytes: the stream ID
+//   1 byte:  the record type (CAPTURE_OPENED, CAPTURE_RECEIVED, etc...)
+//   3 bytes: reserved (0)
+//   4 bytes: the length of the data
+// the data of a sent or received record is exactly what was passed to or returned by the kernel so the decoder has to reassemble the packets itself
+// if the logger drops records because it can't keep up the socket writes a gap record before its next one so the decoder knows the stream is incomplete
+
+#define CAPTURE_MAGIC "GHPC"
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 8  // the magic and the version
+#define CAPTURE_RECORD_SIZE 20 // the size of a record without its data
+
+#define CAPTURE_OPENED 0   // the stream was started, the data is a description of the connection (e.g. "W3GS Varlock 1.2.3.4")
+#define CAPTURE_RECEIVED 1 // the data was received
+#define CAPTURE_SENT 2     // the data was sent
+#define CAPTURE_RESET 3    // the socket was reset (e.g. a battle.net connection is about to reconnect)
+#define CAPTURE_CLOSED 4   // the stream was stopped or the socket was closed
+#define CAPTURE_GAP 5      // records were dropped before this one, the data is the number of records and the number of bytes of data lost (uint32 each)
+#define CAPTURE_RESTART 6  // the bot started appending to the file again (e.g. it was restarted), the stream ID is 0 and every stream before it has ended
+
+std::string CAPTURE_FileHeader();
+std::string CAPTURE_Record(uint32_t stream, unsigned char type, const unsigned char *data, uint32_t length);
+std::string CAPTURE_Restart();
+std::string CAPTURE_Gap(uint32_t stream, uint32_t records, uint32_t bytes);
+std::string CAPTURE_TypeName(unsigned char type);
@@ -0,0 +1,398 @@
+// ghostcapture decodes the packet capture files written when bot_capture is enabled (see capture.h)
+// the captured data is reassembled into W3GS, GPS, GCBI and SID packets which are printed one per line with the time, stream and direction
+// usage: ghostcapture [-x] [-s <stream>] <file> [<file> ...]
+//   the files are decoded in the order given as one capture so a rotated capture is decoded by listing its pieces oldest first (e.g. x.ghc.2 x.ghc.1 x.ghc)
+//   -x          also print each packet's data in hex
+//   -s <stream> only print the packets of one stream (the stream IDs are printed when the streams are opened)
+
+#include "capture.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#define W3GS_HEADER_CONSTANT 247
+#define GPS_HEADER_CONSTANT 248
+#define GCBI_HEADER_CONSTANT 249
+#define BNET_HEADER_CONSTANT 255
+
+// a captured connection, the received and sent data is buffered separately until there's a complete packet
+
+struct CaptureStream
+{
+    std::string m_Label;
+    std::string m_Received;
+    std::string m_Sent;
+};
+
+static bool gHex          = false;
+static bool gFilterStream = false;
+static uint32_t gStreamID = 0;
+
+static uint16_t ReadUInt16(const unsigned char *data)
+{
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+static uint32_t ReadUInt32(const unsigned char *data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint64_t ReadUInt64(const unsigned char *data)
+{
+    return (uint64_t)ReadUInt32(data) | ((uint64_t)ReadUInt32(data + 4) << 32);
+}
+
+static std::string FormatTime(uint64_t time)
+{
+    time_t Seconds   = (time_t)(time / 1000000);
+    struct tm *Local = localtime(&Seconds);
+    char Buffer[64];
+
+    if (!Local)
+        return "?";
+
+    size_t Length = strftime(Buffer, sizeof(Buffer), "%Y-%m-%d %H:%M:%S", Local);
+    snprintf(Buffer + Length, sizeof(Buffer) - Length, ".%06u", (unsigned int)(time % 1000000));
+    return Buffer;
+}
+
+static std::string FormatHex(const unsigned char *data, uint32_t length)
+{
+    std::string Hex;
+    char Byte[4];
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        snprintf(Byte, sizeof(Byte), i == 0 ? "%02x" : " %02x", data[i]);
+        Hex += Byte;
+    }
+
+    return Hex;
+}
+
+static std::string GetPacketName(unsigned char header, unsigned char id)
+{
+    // the packet IDs are the ones in the protocol classes (gameprotocol.h, gpsprotocol.h, gcbiprotocol.h and bnetprotocol.h)
+
+    const char *Name = NULL;
+
+    if (header == W3GS_HEADER_CONSTANT)
+    {
+        switch (id)
+        {
+        case 1: Name = "W3GS_PING_FROM_HOST"; break;
+        case 4: Name = "W3GS_SLOTINFOJOIN"; break;
+        case 5: Name = "W3GS_REJECTJOIN"; break;
+        case 6: Name = "W3GS_PLAYERINFO"; break;
+        case 7: Name = "W3GS_PLAYERLEAVE_OTHERS"; break;
+        case 8: Name = "W3GS_GAMELOADED_OTHERS"; break;
+        case 9: Name = "W3GS_SLOTINFO"; break;
+        case 10: Name = "W3GS_COUNTDOWN_START"; break;
+        case 11: Name = "W3GS_COUNTDOWN_END"; break;
+        case 12: Name = "W3GS_INCOMING_ACTION"; break;
+        case 15: Name = "W3GS_CHAT_FROM_HOST"; break;
+        case 16: Name = "W3GS_START_LAG"; break;
+        case 17: Name = "W3GS_STOP_LAG"; break;
+        case 28: Name = "W3GS_HOST_KICK_PLAYER"; break;
+        case 30: Name = "W3GS_REQJOIN"; break;
+        case 33: Name = "W3GS_LEAVEGAME"; break;
+        case 35: Name = "W3GS_GAMELOADED_SELF"; break;
+        case 38: Name = "W3GS_OUTGOING_ACTION"; break;
+        case 39: Name = "W3GS_OUTGOING_KEEPALIVE"; break;
+        case 40: Name = "W3GS_CHAT_TO_HOST"; break;
+        case 41: Name = "W3GS_DROPREQ"; break;
+        case 52: Name = "W3GS_CHAT_OTHERS"; break;
+        case 53: Name = "W3GS_PING_FROM_OTHERS"; break;
+        case 54: Name = "W3GS_PONG_TO_OTHERS"; break;
+        case 61: Name = "W3GS_MAPCHECK"; break;
+        case 63: Name = "W3GS_STARTDOWNLOAD"; break;
+        case 66: Name = "W3GS_MAPSIZE"; break;
+        case 67: Name = "W3GS_MAPPART"; break;
+        case 68: Name = "W3GS_MAPPARTOK"; break;
+        case 69: Name = "W3GS_MAPPARTNOTOK"; break;
+        case 70: Name = "W3GS_PONG_TO_HOST"; break;
+        case 72: Name = "W3GS_INCOMING_ACTION2"; break;
+        }
+    }
+    else if (header == GPS_HEADER_CONSTANT)
+    {
+        switch (id)
+        {
+        case 1: Name = "GPS_INIT"; break;
+        case 2: Name = "GPS_RECONNECT"; break;
+        case 3: Name = "GPS_ACK"; break;
+        case 4: Name = "GPS_REJECT"; break;
+        }
+
+        if (!Name && id >= 5 && id <= 14)
+            Name = "GPS_DISCORD_PRESENCE";
+    }
+    else if (header == GCBI_HEADER_CONSTANT)
+    {
+        if (id == 1)
+            Name = "GCBI_INIT";
+    }
+    else if (header == BNET_HEADER_CONSTANT)
+    {
+        switch (id)
+        {
+        case 0: Name = "SID_NULL"; break;
+        case 2: Name = "SID_STOPADV"; break;
+        case 9: Name = "SID_GETADVLISTEX"; break;
+        case 10: Name = "SID_ENTERCHAT"; break;
+        case 12: Name = "SID_JOINCHANNEL"; break;
+        case 14: Name = "SID_CHATCOMMAND"; break;
+        case 15: Name = "SID_CHATEVENT"; break;
+        case 21: Name = "SID_CHECKAD"; break;
+        case 28: Name = "SID_STARTADVEX3"; break;
+        case 33: Name = "SID_DISPLAYAD"; break;
+        case 34: Name = "SID_NOTIFYJOIN"; break;
+        case 37: Name = "SID_PING"; break;
+        case 41: Name = "SID_LOGONRESPONSE"; break;
+        case 69: Name = "SID_NETGAMEPORT"; break;
+        case 80: Name = "SID_AUTH_INFO"; break;
+        case 81: Name = "SID_AUTH_CHECK"; break;
+        case 83: Name = "SID_AUTH_ACCOUNTLOGON"; break;
+        case 84: Name = "SID_AUTH_ACCOUNTLOGONPROOF"; break;
+        case 94: Name = "SID_WARDEN"; break;
+        case 101: Name = "SID_FRIENDSLIST"; break;
+        case 102: Name = "SID_FRIENDSUPDATE"; break;
+        case 125: Name = "SID_CLANMEMBERLIST"; break;
+        case 127: Name = "SID_CLANMEMBERSTATUSCHANGE"; break;
+        }
+    }
+
+    char Unknown[32];
+
+    if (!Name)
+    {
+        snprintf(Unknown, sizeof(Unknown), "UNKNOWN_%02X_%02X", header, id);
+        Name = Unknown;
+    }
+
+    return Name;
+}
+
+static std::string GetPacketDetails(const unsigned char *data, uint16_t length)
+{
+    // the details most useful when tracking down a desync: the send interval and actions of each action packet and each player's checksums
+
+    char Details[128];
+    Details[0] = 0;
+
+    if (data[0] == W3GS_HEADER_CONSTANT && (data[1] == 12 || data[1] == 72) && length >= 6)
+    {
+        // W3GS_INCOMING_ACTION: the send interval, the crc (if there are actions) and the actions (PID, length, action)
+
+        uint32_t NumActions = 0;
+        uint32_t Position   = 8;
+
+        while (Position + 3 <= length)
+        {
+            Position += 3 + ReadUInt16(data + Position + 1);
+            NumActions++;
+        }
+
+        snprintf(Details, sizeof(Details), " interval %ums, %u actions%s", ReadUInt16(data + 4), NumActions, Position > length ? " (truncated)" : "");
+    }
+    else if (data[0] == W3GS_HEADER_CONSTANT && data[1] == 39 && length == 9)
+    {
+        // W3GS_OUTGOING_KEEPALIVE: the player's game state checksum, players whose checksums differ have desynced
+
+        snprintf(Details, sizeof(Details), " checksum %08x", ReadUInt32(data + 5));
+    }
+    else if (data[0] == W3GS_HEADER_CONSTANT && data[1] == 38 && length >= 8)
+    {
+        // W3GS_OUTGOING_ACTION: the crc and the action
+
+        snprintf(Details, sizeof(Details), " %u bytes of actions", length - 8);
+    }
+
+    return Details;
+}
+
+static void DecodeData(uint32_t id, CaptureStream &stream, unsigned char type, uint64_t time)
+{
+    std::string &Buffer = type == CAPTURE_RECEIVED ? stream.m_Received : stream.m_Sent;
+    std::string Prefix  = FormatTime(time) + " [" + std::to_string(id) + "] " + CAPTURE_TypeName(type) + " ";
+
+    // every protocol we speak has the same 4 byte header (header constant, packet ID, uint16 length including the header)
+
+    while (Buffer.size() >= 4)
+    {
+        const unsigned char *Data = (const unsigned char *)Buffer.data();
+        uint16_t Length           = ReadUInt16(Data + 2);
+
+        if ((Data[0] != W3GS_HEADER_CONSTANT && Data[0] != GPS_HEADER_CONSTANT && Data[0] != GCBI_HEADER_CONSTANT && Data[0] != BNET_HEADER_CONSTANT) || Length < 4)
+        {
+            // we can't tell where the next packet starts so print what's left of this chunk and start again with the next one
+
+            std::cout << Prefix << "unframed data (" << Buffer.size() << " bytes)" << std::endl;
+            std::cout << "    " << FormatHex(Data, Buffer.size()) << std::endl;
+            Buffer.clear();
+            return;
+        }
+
+        if (Buffer.size() < Length)
+            return;
+
+        std::cout << Prefix << GetPacketName(Data[0], Data[1]) << " (" << Length << " bytes)" << GetPacketDetails(Data, Length) << std::endl;
+
+        if (gHex)
+            std::cout << "    " << FormatHex(Data, Length) << std::endl;
+
+        Buffer.erase(0, Length);
+    }
+}
+
+static bool DecodeFile(std::string fileName, std::map<uint32_t, CaptureStream> &streams)
+{
+    std::ifstream File(fileName.c_str(), std::ios::in | std::ios::binary);
+
+    if (File.fail())
+    {
+        std::cerr << "unable to open [" << fileName << "]" << std::endl;
+        return false;
+    }
+
+    // the file header is only ever at the start of the file (an earlier run appended to is marked by a restart record) so everything after it is a record
+
+    unsigned char Header[CAPTURE_RECORD_SIZE];
+    std::string Data;
+
+    if (!File.read((char *)Header, CAPTURE_HEADER_SIZE) || memcmp(Header, CAPTURE_MAGIC, 4) != 0)
+    {
+        std::cerr << "[" << fileName << "] isn't a capture file" << std::endl;
+        return false;
+    }
+
+    if (ReadUInt32(Header + 4) != CAPTURE_VERSION)
+    {
+        std::cerr << "[" << fileName << "] is capture format version " << ReadUInt32(Header + 4) << " but this decoder only understands version " << CAPTURE_VERSION << std::endl;
+        return false;
+    }
+
+    while (File.read((char *)Header, CAPTURE_RECORD_SIZE))
+    {
+        uint64_t Time      = ReadUInt64(Header);
+        uint32_t ID        = ReadUInt32(Header + 8);
+        unsigned char Type = Header[12];
+        uint32_t Length    = ReadUInt32(Header + 16);
+        Data.resize(Length);
+
+        if (Length > 0 && !File.read(&Data[0], Length))
+            break;
+
+        if (Type == CAPTURE_RESTART)
+        {
+            // the bot started appending to this file again (e.g. it was restarted), none of the earlier streams go on past here
+
+            std::cout << FormatTime(Time) << " restart" << std::endl;
+
+            for (std::map<uint32_t, CaptureStream>::iterator i = streams.begin(); i != streams.end(); i++)
+            {
+                (*i).second.m_Received.clear();
+                (*i).second.m_Sent.clear();
+            }
+
+            continue;
+        }
+
+        if (gFilterStream && ID != gStreamID)
+            continue;
+
+        CaptureStream &Stream = streams[ID];
+
+        if (Type == CAPTURE_OPENED)
+        {
+            Stream.m_Label = Data;
+            Stream.m_Received.clear();
+            Stream.m_Sent.clear();
+            std::cout << FormatTime(Time) << " [" << ID << "] opened " << Data << std::endl;
+        }
+        else if (Type == CAPTURE_RECEIVED || Type == CAPTURE_SENT)
+        {
+            (Type == CAPTURE_RECEIVED ? Stream.m_Received : Stream.m_Sent) += Data;
+            DecodeData(ID, Stream, Type, Time);
+        }
+        else if (Type == CAPTURE_GAP && Length >= 8)
+        {
+            // the bot dropped some of this stream's records so whatever is buffered can't be joined with what comes next
+
+            std::cout << FormatTime(Time) << " [" << ID << "] gap, " << ReadUInt32((const unsigned char *)Data.data()) << " records (" << ReadUInt32((const unsigned char *)Data.data() + 4) << " bytes of data) lost";
+
+            if (!Stream.m_Received.empty() || !Stream.m_Sent.empty())
+                std::cout << ", discarding " << Stream.m_Received.size() << " bytes received and " << Stream.m_Sent.size() << " bytes sent";
+
+            std::cout << std::endl;
+            Stream.m_Received.clear();
+            Stream.m_Sent.clear();
+        }
+        else
+        {
+            std::cout << FormatTime(Time) << " [" << ID << "] " << CAPTURE_TypeName(Type) << " " << Stream.m_Label << std::endl;
+            Stream.m_Received.clear();
+            Stream.m_Sent.clear();
+        }
+    }
+
+    if (!File.eof())
+        std::cerr << "error reading [" << fileName << "]" << std::endl;
+    else if (File.gcount() > 0)
+        std::cerr << "[" << fileName << "] ends with an incomplete record (the bot might still be writing it)" << std::endl;
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::string> Files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string Arg = argv[i];
+
+        if (Arg == "-x")
+            gHex = true;
+        else if (Arg == "-s" && i + 1 < argc)
+        {
+            gFilterStream = true;
+            gStreamID     = strtoul(argv[++i], NULL, 10);
+        }
+        else
+            Files.push_back(Arg);
+    }
+
+    if (Files.empty())
+    {
+        std::cerr << "usage: ghostcapture [-x] [-s <stream>] <file> [<file> ...]" << std::endl;
+        std::cerr << "  -x          also print each packet's data in hex" << std::endl;
+        std::cerr << "  -s <stream> only print the packets of one stream" << std::endl;
+        std::cerr << "  the files are decoded in order as one capture, list the pieces of a rotated capture oldest first (e.g. x.ghc.2 x.ghc.1 x.ghc)" << std::endl;
+        return 1;
+    }
+
+    // the streams carry on from one file to the next so a packet split across a rotation is still reassembled
+
+    std::map<uint32_t, CaptureStream> Streams;
+    bool Success = true;
+
+    for (std::vector<std::string>::iterator i = Files.begin(); i != Files.end(); i++)
+        Success = DecodeFile(*i, Streams) && Success;
+
+    for (std::map<uint32_t, CaptureStream>::iterator i = Streams.begin(); i != Streams.end(); i++)
+    {
+        if (!(*i).second.m_Received.empty() || !(*i).second.m_Sent.empty())
+            std::cout << "[" << (*i).first << "] " << (*i).second.m_Label << " ends with " << (*i).second.m_Received.size() << " bytes received and " << (*i).second.m_Sent.size() << " bytes sent that don't make a complete packet" << std::endl;
+    }
+
+    return Success ? 0 : 1;
+}
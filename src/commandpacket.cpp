@@ -20,11 +20,18 @@
 
 #include "commandpacket.h"
 #include "ghost.h"
+#include "packetpool.h"
 
 //
 // CCommandPacket
 //
 
+CCommandPacket::CCommandPacket()
+{
+    m_PacketType = 0;
+    m_ID         = 0;
+}
+
 CCommandPacket::CCommandPacket(unsigned char nPacketType, int nID, BYTEARRAY nData)
 {
     m_PacketType = nPacketType;
@@ -32,6 +39,33 @@ CCommandPacket::CCommandPacket(unsigned char nPacketType, int nID, BYTEARRAY nDa
     m_Data       = nData;
 }
 
+CCommandPacket::CCommandPacket(unsigned char nPacketType, int nID, const unsigned char *nData, uint32_t nLength)
+{
+    m_PacketType = nPacketType;
+    m_ID         = nID;
+    m_Data       = BYTEARRAY(nData, nData + nLength);
+}
+
 CCommandPacket::~CCommandPacket()
 {
 }
+
+void CCommandPacket::Set(unsigned char nPacketType, int nID, const unsigned char *nData, uint32_t nLength)
+{
+    // assign reuses m_Data's capacity when this packet came from a CPacketPool
+
+    m_PacketType = nPacketType;
+    m_ID         = nID;
+    m_Data.assign(nData, nData + nLength);
+}
+
+void CCommandPacket::Clear()
+{
+    m_PacketType = 0;
+    m_ID         = 0;
+
+    if (m_Data.capacity() > PACKETPOOL_MAX_CAPACITY)
+        BYTEARRAY().swap(m_Data);
+    else
+        m_Data.clear();
+}
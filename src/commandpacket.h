@@ -34,10 +34,15 @@ private:
     BYTEARRAY m_Data;
 
 public:
+    CCommandPacket();
     CCommandPacket(unsigned char nPacketType, int nID, BYTEARRAY nData);
+    CCommandPacket(unsigned char nPacketType, int nID, const unsigned char *nData, uint32_t nLength);
     ~CCommandPacket();
 
     unsigned char GetPacketType() { return m_PacketType; }
     int GetID() { return m_ID; }
-    BYTEARRAY GetData() { return m_Data; }
+    BYTEARRAY &GetData() { return m_Data; }
+
+    void Set(unsigned char nPacketType, int nID, const unsigned char *nData, uint32_t nLength);
+    void Clear();
 };
@@ -1,16 +1,63 @@
 #include "crc32.h"
 #include "ghost.h"
+#include "util.h"
+
+#include <chrono>
+#include <mutex>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_HAVE_PCLMUL
+#include <immintrin.h>
+#endif
+
+uint32_t CCRC32::ulTable[16][256];
 
 void CCRC32::Initialize()
+{
+    // the tables and the engine choice are the same for every instance so only do the work once
+
+    static std::once_flag InitializeFlag;
+    static int iBestEngine = CRC32_ENGINE_TABLE;
+
+    std::call_once(InitializeFlag, []() {
+        BuildTables();
+
+        // use the highest numbered engine the CPU supports, it isn't timed (see !crcbench for that) but they're numbered from slowest to fastest on typical hardware
+        // each engine is checked against the classic table first so a broken engine can never produce a different crc
+
+        for (int i = CRC32_NUM_ENGINES - 1; i > CRC32_ENGINE_TABLE; i--)
+        {
+            if (GetEngineSupported(i) && SelfTest(i))
+            {
+                iBestEngine = i;
+                break;
+            }
+        }
+
+        CONSOLE_Print("[CRC32] using " + GetEngineName(iBestEngine) + " engine");
+    });
+
+    iEngine = iBestEngine;
+}
+
+void CCRC32::BuildTables()
 {
     for (int iCodes = 0; iCodes <= 0xFF; iCodes++)
     {
-        ulTable[iCodes] = Reflect(iCodes, 8) << 24;
+        ulTable[0][iCodes] = Reflect(iCodes, 8) << 24;
 
         for (int iPos = 0; iPos < 8; iPos++)
-            ulTable[iCodes] = (ulTable[iCodes] << 1) ^ (ulTable[iCodes] & (1 << 31) ? CRC32_POLYNOMIAL : 0);
+            ulTable[0][iCodes] = (ulTable[0][iCodes] << 1) ^ (ulTable[0][iCodes] & (1 << 31) ? CRC32_POLYNOMIAL : 0);
 
-        ulTable[iCodes] = Reflect(ulTable[iCodes], 32);
+        ulTable[0][iCodes] = Reflect(ulTable[0][iCodes], 32);
+    }
+
+    // ulTable[k][n] is the crc of byte n followed by k zero bytes
+
+    for (int iSlice = 1; iSlice < 16; iSlice++)
+    {
+        for (int iCodes = 0; iCodes <= 0xFF; iCodes++)
+            ulTable[iSlice][iCodes] = (ulTable[iSlice - 1][iCodes] >> 8) ^ ulTable[0][ulTable[iSlice - 1][iCodes] & 0xFF];
     }
 }
 
@@ -38,6 +85,250 @@ uint32_t CCRC32::FullCRC(unsigned char *sData, uint32_t ulLength)
 
 void CCRC32::PartialCRC(uint32_t *ulInCRC, unsigned char *sData, uint32_t ulLength)
 {
+    PartialCRC(ulInCRC, sData, ulLength, iEngine);
+}
+
+static inline uint32_t CRC32_Read32(const unsigned char *sData)
+{
+    return (uint32_t)sData[0] | ((uint32_t)sData[1] << 8) | ((uint32_t)sData[2] << 16) | ((uint32_t)sData[3] << 24);
+}
+
+#ifdef CRC32_HAVE_PCLMUL
+
+// folds 16 byte blocks with carry-less multiplication then does a Barrett reduction down to 32 bits
+// this is the algorithm from Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" paper with the constants for the zlib polynomial
+// ulLength must be a multiple of 16 and at least 64
+
+__attribute__((target("sse4.1,pclmul"))) static uint32_t CRC32_PCLMUL(uint32_t ulCRC, const unsigned char *sData, uint32_t ulLength)
+{
+    alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+    alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+    alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+    alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(sData + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(sData + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(sData + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(sData + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(ulCRC));
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+    sData += 64;
+    ulLength -= 64;
+
+    // fold 64 bytes at a time
+
+    while (ulLength >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i *)(sData + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(sData + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(sData + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(sData + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        sData += 64;
+        ulLength -= 64;
+    }
+
+    // fold the four blocks into one
+
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // fold any remaining 16 byte blocks
+
+    while (ulLength >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i *)sData);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        sData += 16;
+        ulLength -= 16;
+    }
+
+    // fold 128 bits down to 64 bits
+
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction down to 32 bits
+
+    x0 = _mm_load_si128((const __m128i *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return _mm_extract_epi32(x1, 1);
+}
+
+#endif
+
+void CCRC32::PartialCRC(uint32_t *ulInCRC, unsigned char *sData, uint32_t ulLength, int iEngine)
+{
+    uint32_t ulCRC = *ulInCRC;
+
+#ifdef CRC32_HAVE_PCLMUL
+    if (iEngine == CRC32_ENGINE_PCLMUL && ulLength >= 64)
+    {
+        uint32_t ulFolded = ulLength & ~15;
+        ulCRC             = CRC32_PCLMUL(ulCRC, sData, ulFolded);
+        sData += ulFolded;
+        ulLength -= ulFolded;
+    }
+#endif
+
+    if (iEngine == CRC32_ENGINE_SLICING16 || iEngine == CRC32_ENGINE_PCLMUL)
+    {
+        while (ulLength >= 16)
+        {
+            uint32_t ulOne   = CRC32_Read32(sData) ^ ulCRC;
+            uint32_t ulTwo   = CRC32_Read32(sData + 4);
+            uint32_t ulThree = CRC32_Read32(sData + 8);
+            uint32_t ulFour  = CRC32_Read32(sData + 12);
+
+            ulCRC = ulTable[15][ulOne & 0xFF] ^ ulTable[14][(ulOne >> 8) & 0xFF] ^ ulTable[13][(ulOne >> 16) & 0xFF] ^ ulTable[12][ulOne >> 24] ^
+                    ulTable[11][ulTwo & 0xFF] ^ ulTable[10][(ulTwo >> 8) & 0xFF] ^ ulTable[9][(ulTwo >> 16) & 0xFF] ^ ulTable[8][ulTwo >> 24] ^
+                    ulTable[7][ulThree & 0xFF] ^ ulTable[6][(ulThree >> 8) & 0xFF] ^ ulTable[5][(ulThree >> 16) & 0xFF] ^ ulTable[4][ulThree >> 24] ^
+                    ulTable[3][ulFour & 0xFF] ^ ulTable[2][(ulFour >> 8) & 0xFF] ^ ulTable[1][(ulFour >> 16) & 0xFF] ^ ulTable[0][ulFour >> 24];
+
+            sData += 16;
+            ulLength -= 16;
+        }
+    }
+
+    if (iEngine != CRC32_ENGINE_TABLE)
+    {
+        while (ulLength >= 8)
+        {
+            uint32_t ulOne = CRC32_Read32(sData) ^ ulCRC;
+            uint32_t ulTwo = CRC32_Read32(sData + 4);
+
+            ulCRC = ulTable[7][ulOne & 0xFF] ^ ulTable[6][(ulOne >> 8) & 0xFF] ^ ulTable[5][(ulOne >> 16) & 0xFF] ^ ulTable[4][ulOne >> 24] ^
+                    ulTable[3][ulTwo & 0xFF] ^ ulTable[2][(ulTwo >> 8) & 0xFF] ^ ulTable[1][(ulTwo >> 16) & 0xFF] ^ ulTable[0][ulTwo >> 24];
+
+            sData += 8;
+            ulLength -= 8;
+        }
+    }
+
     while (ulLength--)
-        *ulInCRC = (*ulInCRC >> 8) ^ ulTable[(*ulInCRC & 0xFF) ^ *sData++];
+        ulCRC = (ulCRC >> 8) ^ ulTable[0][(ulCRC & 0xFF) ^ *sData++];
+
+    *ulInCRC = ulCRC;
+}
+
+std::string CCRC32::GetEngineName(int iEngine)
+{
+    if (iEngine == CRC32_ENGINE_TABLE)
+        return "table";
+    else if (iEngine == CRC32_ENGINE_SLICING8)
+        return "slicing-by-8";
+    else if (iEngine == CRC32_ENGINE_SLICING16)
+        return "slicing-by-16";
+    else if (iEngine == CRC32_ENGINE_PCLMUL)
+        return "pclmul";
+
+    return "unknown";
+}
+
+bool CCRC32::GetEngineSupported(int iEngine)
+{
+    if (iEngine == CRC32_ENGINE_PCLMUL)
+    {
+#ifdef CRC32_HAVE_PCLMUL
+        return __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("pclmul");
+#else
+        return false;
+#endif
+    }
+
+    return iEngine >= CRC32_ENGINE_TABLE && iEngine < CRC32_NUM_ENGINES;
+}
+
+bool CCRC32::SelfTest(int iEngine)
+{
+    // compare against the classic table at every length and alignment the engine treats differently
+
+    unsigned char Data[1024 + 16];
+
+    for (uint32_t i = 0; i < sizeof(Data); i++)
+        Data[i] = (unsigned char)(i * 31 + (i >> 3));
+
+    for (uint32_t Offset = 0; Offset < 16; Offset += 5)
+    {
+        for (uint32_t Length = 0; Length <= 1024; Length += (Length < 200 ? 1 : 97))
+        {
+            uint32_t Expected = 0xFFFFFFFF;
+            uint32_t Actual   = 0xFFFFFFFF;
+
+            PartialCRC(&Expected, Data + Offset, Length, CRC32_ENGINE_TABLE);
+            PartialCRC(&Actual, Data + Offset, Length, iEngine);
+
+            if (Expected != Actual)
+            {
+                CONSOLE_Print("[CRC32] warning - " + GetEngineName(iEngine) + " engine failed its self test, not using it");
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+std::string CCRC32::Benchmark(uint32_t ulLength, uint32_t ulIterations)
+{
+    // time every supported engine crc'ing the same buffer ulIterations times, the results are in MB/sec
+
+    BYTEARRAY Data(ulLength);
+
+    for (uint32_t i = 0; i < Data.size(); i++)
+        Data[i] = (unsigned char)(i * 31 + (i >> 11));
+
+    std::string Result = "CRC32 " + UTIL_ToString(ulLength) + " bytes (MB/sec):";
+
+    for (int i = CRC32_ENGINE_TABLE; i < CRC32_NUM_ENGINES; i++)
+    {
+        if (!GetEngineSupported(i))
+            continue;
+
+        uint32_t ulCRC = 0xFFFFFFFF;
+        std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+        for (uint32_t j = 0; j < ulIterations; j++)
+            PartialCRC(&ulCRC, Data.data(), ulLength, i);
+
+        double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+        uint32_t Speed = Seconds > 0 ? (uint32_t)((double)ulLength * ulIterations / (1024 * 1024) / Seconds) : 0;
+        Result += (i == CRC32_ENGINE_TABLE ? " " : ", ") + GetEngineName(i) + (i == iEngine ? "* " : " ") + UTIL_ToString(Speed);
+    }
+
+    return Result;
 }
@@ -4,14 +4,32 @@
 
 #define CRC32_POLYNOMIAL 0x04c11db7
 
+// the engines all produce identical results, they only differ in speed
+// Initialize picks the highest numbered engine the CPU supports that passes its self test (they're numbered from slowest to fastest on typical hardware)
+
+#define CRC32_ENGINE_TABLE 0     // classic byte at a time table lookup
+#define CRC32_ENGINE_SLICING8 1  // 8 bytes per step using 8 tables
+#define CRC32_ENGINE_SLICING16 2 // 16 bytes per step using 16 tables
+#define CRC32_ENGINE_PCLMUL 3    // carry-less multiplication folding (x86 with SSE4.1 and PCLMULQDQ only)
+#define CRC32_NUM_ENGINES 4
+
 class CCRC32
 {
 public:
     void Initialize();
     uint32_t FullCRC(unsigned char *sData, uint32_t ulLength);
     void PartialCRC(uint32_t *ulInCRC, unsigned char *sData, uint32_t ulLength);
+    static void PartialCRC(uint32_t *ulInCRC, unsigned char *sData, uint32_t ulLength, int iEngine);
+
+    int GetEngine() { return iEngine; }
+    static std::string GetEngineName(int iEngine);
+    static bool GetEngineSupported(int iEngine);
+    std::string Benchmark(uint32_t ulLength, uint32_t ulIterations);
 
 private:
-    uint32_t Reflect(uint32_t ulReflect, char cChar);
-    uint32_t ulTable[256];
+    static void BuildTables();
+    static uint32_t Reflect(uint32_t ulReflect, char cChar);
+    static bool SelfTest(int iEngine);
+    static uint32_t ulTable[16][256]; // ulTable[0] is the classic table, the rest are only used by the slicing engines
+    int iEngine;
 };
@@ -0,0 +1,349 @@
+#include "downloadscheduler.h"
+#include "game_base.h"
+#include "gameplayer.h"
+#include "ghost.h"
+#include "map.h"
+#include "mapdata.h"
+#include "util.h"
+
+//
+// CDownloadScheduler
+//
+
+CDownloadScheduler::CDownloadScheduler(CGHost *nGHost)
+{
+    m_GHost           = nGHost;
+    m_Tokens          = 0;
+    m_VirtualTime     = 0;
+    m_LastUpdateTicks = GetTicks();
+    m_LastReportTicks = GetTicks();
+}
+
+CDownloadScheduler::~CDownloadScheduler()
+{
+}
+
+void CDownloadScheduler::AddDownloader(CBaseGame *game, CGamePlayer *player)
+{
+    Downloader NewDownloader;
+    NewDownloader.m_Game   = game;
+    NewDownloader.m_Player = player;
+    NewDownloader.m_Weight = player->GetReserved() ? DOWNLOAD_WEIGHT_RESERVED : 1;
+    NewDownloader.m_Done   = false;
+    m_Downloaders.push_back(NewDownloader);
+
+    DownloadState *State = player->GetDownloadState();
+
+    if (!State->m_Queued)
+    {
+        State->m_Queued      = true;
+        State->m_QueuedTicks = GetTicks();
+    }
+}
+
+void CDownloadScheduler::RemoveGame(CBaseGame *game)
+{
+    Remove(m_Downloaders, game, NULL);
+    Remove(m_Reported, game, NULL);
+}
+
+void CDownloadScheduler::RemovePlayer(CGamePlayer *player)
+{
+    Remove(m_Downloaders, NULL, player);
+    Remove(m_Reported, NULL, player);
+}
+
+void CDownloadScheduler::Update()
+{
+    uint32_t Ticks    = GetTicks();
+    uint32_t Elapsed  = std::min<uint32_t>(Ticks - m_LastUpdateTicks, 1000);
+    m_LastUpdateTicks = Ticks;
+
+    if (m_Downloaders.empty())
+    {
+        m_Reported.clear();
+        return;
+    }
+
+    // refill the token buckets
+    // they never hold more than DOWNLOAD_BURST ms worth of data (but always at least two parts so low limits still work)
+
+    double Rate       = m_GHost->m_MaxDownloadSpeed * 1024.0;
+    double PlayerRate = m_GHost->m_MaxPlayerDownloadSpeed * 1024.0;
+
+    if (Rate > 0)
+        m_Tokens = std::min(m_Tokens + Rate * Elapsed / 1000, std::max(Rate * DOWNLOAD_BURST / 1000, 2.0 * MAPPART_SIZE));
+
+    Admit();
+
+    for (std::vector<Downloader>::iterator i = m_Downloaders.begin(); i != m_Downloaders.end(); i++)
+    {
+        DownloadState *State = (*i).m_Player->GetDownloadState();
+
+        if (!State->m_Admitted)
+        {
+            (*i).m_Done = true;
+            continue;
+        }
+
+        if (PlayerRate > 0)
+            State->m_Tokens = std::min(State->m_Tokens + PlayerRate * Elapsed / 1000, std::max(PlayerRate * DOWNLOAD_BURST / 1000, 2.0 * MAPPART_SIZE));
+
+        UpdateWindow((*i).m_Player, Ticks);
+    }
+
+    // keep sending the part with the earliest virtual finish time until every downloader's window is full or we're out of tokens
+    // a downloader's finish time advances by the part size divided by its weight each time it's sent a part so everyone gets their share in turn
+    // the virtual time is the start time of the last part sent so downloaders who were idle (e.g. waiting for acks) don't get to catch up in one big burst
+
+    while (Rate == 0 || m_Tokens >= MAPPART_SIZE)
+    {
+        Downloader *Next  = NULL;
+        double NextFinish = 0;
+
+        for (std::vector<Downloader>::iterator i = m_Downloaders.begin(); i != m_Downloaders.end(); i++)
+        {
+            CGamePlayer *Player  = (*i).m_Player;
+            DownloadState *State = Player->GetDownloadState();
+
+            if ((*i).m_Done || Player->GetLastMapPartSent() >= Player->GetLastMapPartAcked() + State->m_Window)
+                continue;
+
+            if (PlayerRate > 0 && State->m_Tokens < MAPPART_SIZE)
+                continue;
+
+            double Finish = std::max(m_VirtualTime, State->m_FinishTag) + MAPPART_SIZE / (*i).m_Weight;
+
+            if (!Next || Finish < NextFinish)
+            {
+                Next       = &(*i);
+                NextFinish = Finish;
+            }
+        }
+
+        if (!Next)
+            break;
+
+        uint32_t Sent = Next->m_Game->SendMapPart(Next->m_Player);
+
+        if (Sent == 0)
+        {
+            // the downloader already has the whole map (it just hasn't acknowledged all of it yet)
+
+            Next->m_Done = true;
+            continue;
+        }
+
+        DownloadState *State = Next->m_Player->GetDownloadState();
+        m_VirtualTime        = std::max(m_VirtualTime, State->m_FinishTag);
+        State->m_FinishTag   = m_VirtualTime + Sent / Next->m_Weight;
+
+        if (Rate > 0)
+            m_Tokens -= Sent;
+
+        if (PlayerRate > 0)
+            State->m_Tokens -= Sent;
+    }
+
+    // the games register their downloaders again on every update
+
+    m_Reported.swap(m_Downloaders);
+    m_Downloaders.clear();
+
+    if (Ticks - m_LastReportTicks >= DOWNLOAD_REPORT_TICKS)
+    {
+        std::vector<std::string> Report = GetReport(0xFFFFFFFF);
+
+        for (std::vector<std::string>::iterator i = Report.begin(); i != Report.end(); i++)
+            CONSOLE_Print("[DOWNLOAD] " + *i);
+
+        m_LastReportTicks = Ticks;
+    }
+}
+
+std::vector<std::string> CDownloadScheduler::GetReport(uint32_t maxLength)
+{
+    // one summary line followed by one line per lobby with downloaders
+    // a lobby with too many downloaders to fit in maxLength is split over as many lines as it takes
+
+    std::vector<std::string> Report;
+    std::vector<CBaseGame *> Games;
+    uint32_t Active  = 0;
+    uint32_t Waiting = 0;
+    double TotalRate = 0;
+
+    for (std::vector<Downloader>::iterator i = m_Reported.begin(); i != m_Reported.end(); i++)
+    {
+        DownloadState *State = (*i).m_Player->GetDownloadState();
+
+        if (State->m_Admitted)
+        {
+            Active++;
+            TotalRate += State->m_AckRate;
+        }
+        else
+            Waiting++;
+
+        if (std::find(Games.begin(), Games.end(), (*i).m_Game) == Games.end())
+            Games.push_back((*i).m_Game);
+    }
+
+    if (m_Reported.empty())
+    {
+        Report.push_back("no map downloads in progress");
+        return Report;
+    }
+
+    std::string Limit = m_GHost->m_MaxDownloadSpeed > 0 ? UTIL_ToString(m_GHost->m_MaxDownloadSpeed) + " KB/sec limit" : "no limit";
+    Report.push_back(UTIL_ToString(Active) + " downloading at " + UTIL_ToString(TotalRate / 1024, 1) + " KB/sec (" + Limit + "), " + UTIL_ToString(Waiting) + " waiting");
+
+    for (std::vector<CBaseGame *>::iterator i = Games.begin(); i != Games.end(); i++)
+    {
+        // the map data is deleted when a game starts
+
+        if (!(*i)->GetMap())
+            continue;
+
+        std::vector<std::string> Players;
+        double GameRate = 0;
+
+        for (std::vector<Downloader>::iterator j = m_Reported.begin(); j != m_Reported.end(); j++)
+        {
+            if ((*j).m_Game != *i)
+                continue;
+
+            CGamePlayer *Player  = (*j).m_Player;
+            DownloadState *State = Player->GetDownloadState();
+            uint32_t MapSize     = (*i)->GetMap()->GetMapDataSize();
+
+            if (State->m_Admitted)
+            {
+                // the eta assumes the downloader keeps going at its current rate
+
+                uint32_t Acked   = std::min(Player->GetLastMapPartAcked(), MapSize);
+                uint32_t Percent = MapSize > 0 ? (uint32_t)((uint64_t)Acked * 100 / MapSize) : 0;
+                std::string ETA  = State->m_AckRate > 0 ? UTIL_ToString((uint32_t)((MapSize - Acked) / State->m_AckRate)) + "s left" : "eta unknown";
+                Players.push_back(Player->GetName() + " " + UTIL_ToString(Percent) + "% " + UTIL_ToString(State->m_AckRate / 1024, 1) + " KB/sec " + ETA);
+                GameRate += State->m_AckRate;
+            }
+            else
+            {
+                // a waiter's position is the number of waiters (in any lobby) who were registered before it plus one
+
+                uint32_t Position = 1;
+
+                for (std::vector<Downloader>::iterator k = m_Reported.begin(); k != m_Reported.end(); k++)
+                {
+                    DownloadState *Other = (*k).m_Player->GetDownloadState();
+
+                    if (!Other->m_Admitted && Other->m_QueuedTicks < State->m_QueuedTicks)
+                        Position++;
+                }
+
+                Players.push_back(Player->GetName() + " waiting (#" + UTIL_ToString(Position) + ")");
+            }
+        }
+
+        std::string Line = "[" + (*i)->GetGameName() + "] " + UTIL_ToString(GameRate / 1024, 1) + " KB/sec: ";
+        bool LineEmpty   = true;
+
+        for (std::vector<std::string>::iterator j = Players.begin(); j != Players.end(); j++)
+        {
+            if (!LineEmpty && Line.size() + 2 + (*j).size() > maxLength)
+            {
+                Report.push_back(Line);
+                Line      = "[" + (*i)->GetGameName() + "] ";
+                LineEmpty = true;
+            }
+
+            Line += (LineEmpty ? std::string() : ", ") + *j;
+            LineEmpty = false;
+        }
+
+        Report.push_back(Line);
+    }
+
+    return Report;
+}
+
+void CDownloadScheduler::Admit()
+{
+    // bot_maxdownloaders applies to the whole bot rather than each lobby so running more lobbies doesn't mean more downloaders
+    // downloaders keep their slot until they finish (or leave), the rest are admitted in the order they were first registered
+
+    uint32_t Admitted = 0;
+
+    for (std::vector<Downloader>::iterator i = m_Downloaders.begin(); i != m_Downloaders.end(); i++)
+    {
+        if ((*i).m_Player->GetDownloadState()->m_Admitted)
+            Admitted++;
+    }
+
+    while (m_GHost->m_MaxDownloaders == 0 || Admitted < m_GHost->m_MaxDownloaders)
+    {
+        DownloadState *Next = NULL;
+
+        for (std::vector<Downloader>::iterator i = m_Downloaders.begin(); i != m_Downloaders.end(); i++)
+        {
+            DownloadState *State = (*i).m_Player->GetDownloadState();
+
+            if (!State->m_Admitted && (!Next || State->m_QueuedTicks < Next->m_QueuedTicks))
+                Next = State;
+        }
+
+        if (!Next)
+            break;
+
+        Next->m_Admitted = true;
+        Admitted++;
+    }
+}
+
+void CDownloadScheduler::UpdateWindow(CGamePlayer *player, uint32_t ticks)
+{
+    DownloadState *State = player->GetDownloadState();
+    uint32_t Acked       = player->GetLastMapPartAcked();
+
+    if (State->m_Window == 0)
+    {
+        // this is the first time we've seen this downloader
+
+        State->m_Window          = DOWNLOAD_MIN_WINDOW * MAPPART_SIZE;
+        State->m_LastAcked       = Acked;
+        State->m_LastSampleTicks = ticks;
+        return;
+    }
+
+    if (ticks - State->m_LastSampleTicks < DOWNLOAD_SAMPLE_TICKS)
+        return;
+
+    double Rate              = Acked > State->m_LastAcked ? (double)(Acked - State->m_LastAcked) * 1000 / (ticks - State->m_LastSampleTicks) : 0;
+    State->m_AckRate         = State->m_AckRate == 0 ? Rate : State->m_AckRate * 0.75 + Rate * 0.25;
+    State->m_LastAcked       = Acked;
+    State->m_LastSampleTicks = ticks;
+
+    // the window is twice the bandwidth delay product, enough to keep the connection busy and let the window double every round trip while the throughput is still growing
+    // anything more would just sit in a std::queue in front of the lobby messages (chat, slot changes, etc...) which is what used to delay them by 30 seconds or more on slow connections
+    // the lowest recent ping is the best guess of the round trip time without our own std::queue in it
+
+    uint32_t RTT = player->GetMinPing();
+
+    if (RTT == 0)
+        RTT = DOWNLOAD_DEFAULT_RTT;
+
+    double Window   = 2 * State->m_AckRate * RTT / 1000;
+    Window          = std::max<double>(Window, DOWNLOAD_MIN_WINDOW * MAPPART_SIZE);
+    Window          = std::min<double>(Window, DOWNLOAD_MAX_WINDOW * MAPPART_SIZE);
+    State->m_Window = (uint32_t)Window;
+}
+
+void CDownloadScheduler::Remove(std::vector<Downloader> &downloaders, CBaseGame *game, CGamePlayer *player)
+{
+    for (std::vector<Downloader>::iterator i = downloaders.begin(); i != downloaders.end();)
+    {
+        if ((game && (*i).m_Game == game) || (player && (*i).m_Player == player))
+            i = downloaders.erase(i);
+        else
+            i++;
+    }
+}
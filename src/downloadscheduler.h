@@ -0,0 +1,76 @@
+#pragma once
+
+#include "includes.h"
+
+//
+// CDownloadScheduler
+//
+
+// decides which downloaders get the next map parts across every lobby the bot is hosting
+// games register their active downloaders during their update and the scheduler sends their parts at the start of the next update
+// at most bot_maxdownloaders of them (across all lobbies) download at once, the rest wait their turn in the order they started
+// each downloader gets an in flight window sized from its measured throughput and base ping so slow clients don't get a huge std::queue of map data
+// the parts are handed out in weighted fair queuing order (reserved players have a double share) from a token bucket holding the bot wide bot_maxdownloadspeed budget
+// each downloader can also have its own token bucket to cap its speed with bot_maxplayerdownloadspeed
+
+#define DOWNLOAD_MIN_WINDOW 16      // smallest in flight window in map parts, also used until we've measured the throughput
+#define DOWNLOAD_MAX_WINDOW 100     // largest in flight window in map parts
+#define DOWNLOAD_DEFAULT_RTT 200    // round trip time in ms to assume until a downloader has been pinged
+#define DOWNLOAD_BURST 250          // the token buckets hold this many ms worth of their rate
+#define DOWNLOAD_SAMPLE_TICKS 250   // measure each downloader's throughput this often
+#define DOWNLOAD_WEIGHT_RESERVED 2  // a reserved player's share of the bandwidth compared to everyone else's
+#define DOWNLOAD_REPORT_TICKS 30000 // print a download report to the console this often while there are downloaders
+
+class CGHost;
+class CBaseGame;
+class CGamePlayer;
+
+// the scheduling state of one downloader, kept in the CGamePlayer so it survives between updates
+
+struct DownloadState
+{
+    double m_Tokens            = 0;     // the downloader's token bucket in bytes (only used with bot_maxplayerdownloadspeed)
+    double m_FinishTag         = 0;     // weighted fair queuing virtual finish time of the last part sent to this downloader
+    double m_AckRate           = 0;     // smoothed bytes per second the downloader has acknowledged
+    uint32_t m_LastAcked       = 0;     // the last mappart acknowledged when the throughput was last measured
+    uint32_t m_LastSampleTicks = 0;     // GetTicks when the throughput was last measured
+    uint32_t m_Window          = 0;     // the current in flight window in bytes
+    uint32_t m_QueuedTicks     = 0;     // GetTicks when the downloader was first registered (its place in the waiting line)
+    bool m_Queued              = false; // if m_QueuedTicks has been set
+    bool m_Admitted            = false; // if the downloader is allowed to download or still waiting for a free downloader slot
+};
+
+class CDownloadScheduler
+{
+private:
+    struct Downloader
+    {
+        CBaseGame *m_Game;
+        CGamePlayer *m_Player;
+        double m_Weight;
+        bool m_Done;
+    };
+
+    CGHost *m_GHost;
+    std::vector<Downloader> m_Downloaders; // downloaders registered since the last update
+    std::vector<Downloader> m_Reported;    // downloaders from the last update, used for the reports since m_Downloaders is only complete once every game has updated
+    double m_Tokens;                       // the bot wide token bucket in bytes
+    double m_VirtualTime;                  // weighted fair queuing virtual time
+    uint32_t m_LastUpdateTicks;
+    uint32_t m_LastReportTicks;
+
+public:
+    CDownloadScheduler(CGHost *nGHost);
+    ~CDownloadScheduler();
+
+    void AddDownloader(CBaseGame *game, CGamePlayer *player);
+    void RemoveGame(CBaseGame *game);
+    void RemovePlayer(CGamePlayer *player);
+    void Update();
+    std::vector<std::string> GetReport(uint32_t maxLength);
+
+private:
+    void Admit();
+    void UpdateWindow(CGamePlayer *player, uint32_t ticks);
+    static void Remove(std::vector<Downloader> &downloaders, CBaseGame *game, CGamePlayer *player);
+};
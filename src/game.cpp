@@ -25,6 +25,7 @@
 #include "gameprotocol.h"
 #include "ghost.h"
 #include "ghostdb.h"
+#include "iptocountry.h"
 #include "language.h"
 #include "map.h"
 #include "packed.h"
@@ -140,7 +141,7 @@ CGame ::~CGame()
     }
 }
 
-bool CGame ::Update(void *fd, void *send_fd)
+bool CGame ::Update()
 {
     // update callables
 
@@ -155,8 +156,7 @@ bool CGame ::Update(void *fd, void *send_fd)
             else
                 SendAllChat(m_GHost->m_Language->UserIsNotBanned(i->second->GetServer(), i->second->GetUser()));
 
-            m_GHost->m_DB->RecoverCallable(i->second);
-            delete i->second;
+            DeleteCallable(i->second);
             i = m_PairedBanChecks.erase(i);
         }
         else
@@ -169,17 +169,21 @@ bool CGame ::Update(void *fd, void *send_fd)
         {
             if (i->second->GetResult())
             {
-                for (std::vector<CBNET *>::iterator j = m_GHost->m_BNETs.begin(); j != m_GHost->m_BNETs.end(); j++)
-                {
-                    if ((*j)->GetServer() == i->second->GetServer())
-                        (*j)->AddBan(i->second->GetUser(), i->second->GetIP(), i->second->GetGameName(), i->second->GetAdmin(), i->second->GetReason());
-                }
+                CGHost *GHost          = m_GHost;
+                CCallableBanAdd *BanAdd = i->second;
+
+                RunOnMainThread([GHost, BanAdd] {
+                    for (std::vector<CBNET *>::iterator j = GHost->m_BNETs.begin(); j != GHost->m_BNETs.end(); j++)
+                    {
+                        if ((*j)->GetServer() == BanAdd->GetServer())
+                            (*j)->AddBan(BanAdd->GetUser(), BanAdd->GetIP(), BanAdd->GetGameName(), BanAdd->GetAdmin(), BanAdd->GetReason());
+                    }
+                });
 
                 SendAllChat(m_GHost->m_Language->PlayerWasBannedByPlayer(i->second->GetServer(), i->second->GetUser(), i->first));
             }
 
-            m_GHost->m_DB->RecoverCallable(i->second);
-            delete i->second;
+            DeleteCallable(i->second);
             i = m_PairedBanAdds.erase(i);
         }
         else
@@ -192,11 +196,16 @@ bool CGame ::Update(void *fd, void *send_fd)
         {
             if (i->second->GetResult())
             {
-                for (std::vector<CBNET *>::iterator j = m_GHost->m_BNETs.begin(); j != m_GHost->m_BNETs.end(); j++)
-                {
-                    if ((*j)->GetServer() == i->second->GetServer())
-                        (*j)->RemoveBan(i->second->GetUser());
-                }
+                CGHost *GHost                 = m_GHost;
+                CCallableBanRemove *BanRemove = i->second;
+
+                RunOnMainThread([GHost, BanRemove] {
+                    for (std::vector<CBNET *>::iterator j = GHost->m_BNETs.begin(); j != GHost->m_BNETs.end(); j++)
+                    {
+                        if ((*j)->GetServer() == BanRemove->GetServer())
+                            (*j)->RemoveBan(BanRemove->GetUser());
+                    }
+                });
             }
 
             CGamePlayer *Player = GetPlayerFromName(i->first, true);
@@ -209,8 +218,7 @@ bool CGame ::Update(void *fd, void *send_fd)
                     SendChat(Player, m_GHost->m_Language->ErrorUnbanningUser(i->second->GetUser()));
             }
 
-            m_GHost->m_DB->RecoverCallable(i->second);
-            delete i->second;
+            DeleteCallable(i->second);
             i = m_PairedBanRemoves.erase(i);
         }
         else
@@ -248,8 +256,7 @@ bool CGame ::Update(void *fd, void *send_fd)
                 }
             }
 
-            m_GHost->m_DB->RecoverCallable(i->second);
-            delete i->second;
+            DeleteCallable(i->second);
             i = m_PairedGPSChecks.erase(i);
         }
         else
@@ -310,15 +317,14 @@ bool CGame ::Update(void *fd, void *send_fd)
                 }
             }
 
-            m_GHost->m_DB->RecoverCallable(i->second);
-            delete i->second;
+            DeleteCallable(i->second);
             i = m_PairedDPSChecks.erase(i);
         }
         else
             i++;
     }
 
-    return CBaseGame ::Update(fd, send_fd);
+    return CBaseGame ::Update();
 }
 
 void CGame ::EventPlayerDeleted(CGamePlayer *player)
@@ -556,7 +562,7 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
                     if (Matches == 0)
                         SendAllChat(m_GHost->m_Language->UnableToBanNoMatchesFound(Victim));
                     else if (Matches == 1)
-                        m_PairedBanAdds.push_back(PairedBanAdd(User, m_GHost->m_DB->ThreadedBanAdd(LastMatch->GetServer(), LastMatch->GetName(), LastMatch->GetIP(), m_GameName, User, Reason)));
+                        BanAdd(User, LastMatch->GetServer(), LastMatch->GetName(), LastMatch->GetIP(), Reason);
                     else
                         SendAllChat(m_GHost->m_Language->UnableToBanFoundMoreThanOneMatch(Victim));
                 }
@@ -568,7 +574,7 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
                     if (Matches == 0)
                         SendAllChat(m_GHost->m_Language->UnableToBanNoMatchesFound(Victim));
                     else if (Matches == 1)
-                        m_PairedBanAdds.push_back(PairedBanAdd(User, m_GHost->m_DB->ThreadedBanAdd(LastMatch->GetJoinedRealm(), LastMatch->GetName(), LastMatch->GetExternalIPString(), m_GameName, User, Reason)));
+                        BanAdd(User, LastMatch->GetJoinedRealm(), LastMatch->GetName(), LastMatch->GetExternalIPString(), Reason);
                     else
                         SendAllChat(m_GHost->m_Language->UnableToBanFoundMoreThanOneMatch(Victim));
                 }
@@ -580,7 +586,7 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
             //
 
             if ((Command == "delban" || Command == "unban") && !Payload.empty())
-                m_PairedBanRemoves.push_back(PairedBanRemove(player->GetName(), m_GHost->m_DB->ThreadedBanRemove(Payload)));
+                BanRemove(player->GetName(), Payload);
 
             //
             // !ANNOUNCE
@@ -686,7 +692,7 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
                 if (m_GHost->m_HideCommands)
                     HideCommand = true;
 
-                m_PairedBanAdds.push_back(PairedBanAdd(User, m_GHost->m_DB->ThreadedBanAdd(m_DBBanLast->GetServer(), m_DBBanLast->GetName(), m_DBBanLast->GetIP(), m_GameName, User, Payload)));
+                BanAdd(User, m_DBBanLast->GetServer(), m_DBBanLast->GetName(), m_DBBanLast->GetIP(), Payload);
             }
 
             //
@@ -729,13 +735,13 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
                             }
                         }
 
-                        SendAllChat(m_GHost->m_Language->CheckedPlayer(LastMatch->GetName(), LastMatch->GetNumPings() > 0 ? UTIL_ToString(LastMatch->GetPing(m_GHost->m_LCPings)) + "ms" : "N/A", m_GHost->m_DBLocal->FromCheck(UTIL_ByteArrayToUInt32(LastMatch->GetExternalIP(), true)), LastMatchAdminCheck || LastMatchRootAdminCheck ? "Yes" : "No", IsOwner(LastMatch->GetName()) ? "Yes" : "No", LastMatch->GetSpoofed() ? "Yes" : "No", LastMatch->GetSpoofedRealm().empty() ? "N/A" : LastMatch->GetSpoofedRealm(), LastMatch->GetReserved() ? "Yes" : "No"));
+                        SendAllChat(m_GHost->m_Language->CheckedPlayer(LastMatch->GetName(), LastMatch->GetNumPings() > 0 ? UTIL_ToString(LastMatch->GetPing(m_GHost->m_LCPings)) + "ms" : "N/A", m_GHost->m_IPToCountry->FromCheck(UTIL_ByteArrayToUInt32(LastMatch->GetExternalIP(), true)), LastMatchAdminCheck || LastMatchRootAdminCheck ? "Yes" : "No", IsOwner(LastMatch->GetName()) ? "Yes" : "No", LastMatch->GetSpoofed() ? "Yes" : "No", LastMatch->GetSpoofedRealm().empty() ? "N/A" : LastMatch->GetSpoofedRealm(), LastMatch->GetReserved() ? "Yes" : "No"));
                     }
                     else
                         SendAllChat(m_GHost->m_Language->UnableToCheckPlayerFoundMoreThanOneMatch(Payload));
                 }
                 else
-                    SendAllChat(m_GHost->m_Language->CheckedPlayer(User, player->GetNumPings() > 0 ? UTIL_ToString(player->GetPing(m_GHost->m_LCPings)) + "ms" : "N/A", m_GHost->m_DBLocal->FromCheck(UTIL_ByteArrayToUInt32(player->GetExternalIP(), true)), AdminCheck || RootAdminCheck ? "Yes" : "No", IsOwner(User) ? "Yes" : "No", player->GetSpoofed() ? "Yes" : "No", player->GetSpoofedRealm().empty() ? "N/A" : player->GetSpoofedRealm(), player->GetReserved() ? "Yes" : "No"));
+                    SendAllChat(m_GHost->m_Language->CheckedPlayer(User, player->GetNumPings() > 0 ? UTIL_ToString(player->GetPing(m_GHost->m_LCPings)) + "ms" : "N/A", m_GHost->m_IPToCountry->FromCheck(UTIL_ByteArrayToUInt32(player->GetExternalIP(), true)), AdminCheck || RootAdminCheck ? "Yes" : "No", IsOwner(User) ? "Yes" : "No", player->GetSpoofed() ? "Yes" : "No", player->GetSpoofedRealm().empty() ? "N/A" : player->GetSpoofedRealm(), player->GetReserved() ? "Yes" : "No"));
             }
 
             //
@@ -748,7 +754,7 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
                     HideCommand = true;
 
                 for (std::vector<CBNET *>::iterator i = m_GHost->m_BNETs.begin(); i != m_GHost->m_BNETs.end(); i++)
-                    m_PairedBanChecks.push_back(PairedBanCheck(User, m_GHost->m_DB->ThreadedBanCheck((*i)->GetServer(), Payload, std::string())));
+                    BanCheck(User, (*i)->GetServer(), Payload);
             }
 
             //
@@ -1057,7 +1063,10 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
                 if (m_GHost->m_HideCommands)
                     HideCommand = true;
 
-                SendAllChat(m_GHost->m_DB->GetStatus());
+                RunOnMainThread([this] {
+                    std::string Status = m_GHost->m_DB->GetStatus();
+                    RunOnGameThread([this, Status] { SendAllChat(Status); });
+                });
             }
 
             //
@@ -1184,7 +1193,7 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
 
                     Froms += (*i)->GetNameTerminated();
                     Froms += ": (";
-                    Froms += m_GHost->m_DBLocal->FromCheck(UTIL_ByteArrayToUInt32((*i)->GetExternalIP(), true));
+                    Froms += m_GHost->m_IPToCountry->FromCheck(UTIL_ByteArrayToUInt32((*i)->GetExternalIP(), true));
                     Froms += ")";
 
                     if (i != m_Players.end() - 1)
@@ -1577,8 +1586,8 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
                             (*i)->QueueEnterChat();
                     }
 
-                    m_CreationTime    = GetTime();
-                    m_LastRefreshTime = GetTime();
+                    m_CreationTime = GetTime();
+                    m_Timers.Schedule(&m_RefreshTimer, GetMicroTicks() + 3000000);
                 }
                 else
                     SendAllChat(m_GHost->m_Language->UnableToCreateGameNameTooLong(Payload));
@@ -1621,8 +1630,8 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
                         // the game creation message will be sent on the next refresh
                     }
 
-                    m_CreationTime    = GetTime();
-                    m_LastRefreshTime = GetTime();
+                    m_CreationTime = GetTime();
+                    m_Timers.Schedule(&m_RefreshTimer, GetMicroTicks() + 3000000);
                 }
                 else
                     SendAllChat(m_GHost->m_Language->UnableToCreateGameNameTooLong(Payload));
@@ -1800,6 +1809,7 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
                 // skip checks and start the game right now
                 m_CountDownStarted = true;
                 m_CountDownCounter = 0;
+                m_Timers.Schedule(&m_CountDownTimer, GetMicroTicks());
             }
             else if (Command == "startn" && m_Players.size() < 2)
                 SendAllChat("Need one more player for start");
@@ -1935,6 +1945,20 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
                 }
             }
 
+            //
+            // !TICKS
+            //
+
+            if (Command == "ticks")
+            {
+                if (m_GHost->m_HideCommands)
+                    HideCommand = true;
+
+                // how late the action packets were sent compared to their deadlines (the game's jitter)
+
+                SendChat(player, "Action ticks: " + m_ActionLateness.GetSummary());
+            }
+
             //
             // !UNHOST
             //
@@ -2041,8 +2065,10 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
                     Name    = Payload.substr(0, MessageStart);
                     Message = Payload.substr(MessageStart + 1);
 
-                    for (std::vector<CBNET *>::iterator i = m_GHost->m_BNETs.begin(); i != m_GHost->m_BNETs.end(); i++)
-                        (*i)->QueueChatCommand(Message, Name, true, false);
+                    RunOnMainThread([this, Name, Message] {
+                        for (std::vector<CBNET *>::iterator i = m_GHost->m_BNETs.begin(); i != m_GHost->m_BNETs.end(); i++)
+                            (*i)->QueueChatCommand(Message, Name, true, false);
+                    });
                 }
 
                 HideCommand = true;
@@ -2124,7 +2150,7 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
     //
 
     if (Command == "checkme")
-        SendChat(player, m_GHost->m_Language->CheckedPlayer(User, player->GetNumPings() > 0 ? UTIL_ToString(player->GetPing(m_GHost->m_LCPings)) + "ms" : "N/A", m_GHost->m_DBLocal->FromCheck(UTIL_ByteArrayToUInt32(player->GetExternalIP(), true)), AdminCheck || RootAdminCheck ? "Yes" : "No", IsOwner(User) ? "Yes" : "No", player->GetSpoofed() ? "Yes" : "No", player->GetSpoofedRealm().empty() ? "N/A" : player->GetSpoofedRealm(), player->GetReserved() ? "Yes" : "No"));
+        SendChat(player, m_GHost->m_Language->CheckedPlayer(User, player->GetNumPings() > 0 ? UTIL_ToString(player->GetPing(m_GHost->m_LCPings)) + "ms" : "N/A", m_GHost->m_IPToCountry->FromCheck(UTIL_ByteArrayToUInt32(player->GetExternalIP(), true)), AdminCheck || RootAdminCheck ? "Yes" : "No", IsOwner(User) ? "Yes" : "No", player->GetSpoofed() ? "Yes" : "No", player->GetSpoofedRealm().empty() ? "N/A" : player->GetSpoofedRealm(), player->GetReserved() ? "Yes" : "No"));
 
     //!ping
 
@@ -2228,9 +2254,9 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
             StatsUser = Payload;
 
         if (player->GetSpoofed() && (AdminCheck || RootAdminCheck || IsOwner(User)))
-            m_PairedGPSChecks.push_back(PairedGPSCheck(std::string(), m_GHost->m_DB->ThreadedGamePlayerSummaryCheck(StatsUser)));
+            GamePlayerSummaryCheck(std::string(), StatsUser);
         else
-            m_PairedGPSChecks.push_back(PairedGPSCheck(User, m_GHost->m_DB->ThreadedGamePlayerSummaryCheck(StatsUser)));
+            GamePlayerSummaryCheck(User, StatsUser);
 
         player->SetStatsSentTime(GetTime());
     }
@@ -2247,9 +2273,9 @@ bool CGame ::EventPlayerBotCommand(CGamePlayer *player, std::string command, std
             StatsUser = Payload;
 
         if (player->GetSpoofed() && (AdminCheck || RootAdminCheck || IsOwner(User)))
-            m_PairedDPSChecks.push_back(PairedDPSCheck(std::string(), m_GHost->m_DB->ThreadedDotAPlayerSummaryCheck(StatsUser)));
+            DotAPlayerSummaryCheck(std::string(), StatsUser);
         else
-            m_PairedDPSChecks.push_back(PairedDPSCheck(User, m_GHost->m_DB->ThreadedDotAPlayerSummaryCheck(StatsUser)));
+            DotAPlayerSummaryCheck(User, StatsUser);
 
         player->SetStatsDotASentTime(GetTime());
     }
@@ -2401,5 +2427,58 @@ bool CGame ::IsGameDataSaved()
 void CGame ::SaveGameData()
 {
     CONSOLE_Print("[GAME: " + m_GameName + "] saving game data to database");
-    m_CallableGameAdd = m_GHost->m_DB->ThreadedGameAdd(m_GHost->m_BNETs.size() == 1 ? m_GHost->m_BNETs[0]->GetServer() : std::string(), m_DBGame->GetMap(), m_GameName, m_OwnerName, m_GameTicks / 1000, m_GameState, m_CreatorName, m_CreatorServer);
+
+    CGHost *GHost             = m_GHost;
+    std::string Server        = m_GHost->m_BNETs.size() == 1 ? m_GHost->m_BNETs[0]->GetServer() : std::string();
+    std::string Map           = m_DBGame->GetMap();
+    std::string GameName      = m_GameName;
+    std::string OwnerName     = m_OwnerName;
+    std::string CreatorName   = m_CreatorName;
+    std::string CreatorServer = m_CreatorServer;
+    uint32_t Duration         = m_GameTicks / 1000;
+    uint32_t GameState        = m_GameState;
+
+    CreateCallable<CCallableGameAdd>([=] { return GHost->m_DB->ThreadedGameAdd(Server, Map, GameName, OwnerName, Duration, GameState, CreatorName, CreatorServer); },
+                                     [this](CCallableGameAdd *Callable) { m_CallableGameAdd = Callable; });
+}
+
+void CGame ::BanAdd(std::string user, std::string server, std::string name, std::string ip, std::string reason)
+{
+    CGHost *GHost        = m_GHost;
+    std::string GameName = m_GameName;
+
+    CreateCallable<CCallableBanAdd>([=] { return GHost->m_DB->ThreadedBanAdd(server, name, ip, GameName, user, reason); },
+                                    [this, user](CCallableBanAdd *Callable) { m_PairedBanAdds.push_back(PairedBanAdd(user, Callable)); });
+}
+
+void CGame ::BanRemove(std::string user, std::string name)
+{
+    CGHost *GHost = m_GHost;
+
+    CreateCallable<CCallableBanRemove>([=] { return GHost->m_DB->ThreadedBanRemove(name); },
+                                       [this, user](CCallableBanRemove *Callable) { m_PairedBanRemoves.push_back(PairedBanRemove(user, Callable)); });
+}
+
+void CGame ::BanCheck(std::string user, std::string server, std::string name)
+{
+    CGHost *GHost = m_GHost;
+
+    CreateCallable<CCallableBanCheck>([=] { return GHost->m_DB->ThreadedBanCheck(server, name, std::string()); },
+                                      [this, user](CCallableBanCheck *Callable) { m_PairedBanChecks.push_back(PairedBanCheck(user, Callable)); });
+}
+
+void CGame ::GamePlayerSummaryCheck(std::string user, std::string name)
+{
+    CGHost *GHost = m_GHost;
+
+    CreateCallable<CCallableGamePlayerSummaryCheck>([=] { return GHost->m_DB->ThreadedGamePlayerSummaryCheck(name); },
+                                                    [this, user](CCallableGamePlayerSummaryCheck *Callable) { m_PairedGPSChecks.push_back(PairedGPSCheck(user, Callable)); });
+}
+
+void CGame ::DotAPlayerSummaryCheck(std::string user, std::string name)
+{
+    CGHost *GHost = m_GHost;
+
+    CreateCallable<CCallableDotAPlayerSummaryCheck>([=] { return GHost->m_DB->ThreadedDotAPlayerSummaryCheck(name); },
+                                                    [this, user](CCallableDotAPlayerSummaryCheck *Callable) { m_PairedDPSChecks.push_back(PairedDPSCheck(user, Callable)); });
 }
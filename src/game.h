@@ -61,11 +61,19 @@ public:
     CGame(CGHost *nGHost, CMap *nMap, CSaveGame *nSaveGame, uint16_t nHostPort, unsigned char nGameState, std::string nGameName, std::string nOwnerName, std::string nCreatorName, std::string nCreatorServer);
     virtual ~CGame();
 
-    virtual bool Update(void *fd, void *send_fd);
+    virtual bool Update();
     virtual void EventPlayerDeleted(CGamePlayer *player);
     virtual void EventPlayerAction(CGamePlayer *player, CIncomingAction *action);
     virtual bool EventPlayerBotCommand(CGamePlayer *player, std::string command, std::string payload);
     virtual void EventGameStarted();
     virtual bool IsGameDataSaved();
     virtual void SaveGameData();
+
+    // database functions (the callables are created on the main thread, see CBaseGame::CreateCallable)
+
+    virtual void BanAdd(std::string user, std::string server, std::string name, std::string ip, std::string reason);
+    virtual void BanRemove(std::string user, std::string name);
+    virtual void BanCheck(std::string user, std::string server, std::string name);
+    virtual void GamePlayerSummaryCheck(std::string user, std::string name);
+    virtual void DotAPlayerSummaryCheck(std::string user, std::string name);
 };
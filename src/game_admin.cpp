@@ -22,8 +22,10 @@
 #include "game_admin.h"
 #include "bnet.h"
 #include "config.h"
+#include "downloadscheduler.h"
 #include "gameplayer.h"
 #include "gameprotocol.h"
+#include "gamethread.h"
 #include "ghost.h"
 #include "ghostdb.h"
 #include "language.h"
@@ -72,7 +74,7 @@ CAdminGame::~CAdminGame()
         m_GHost->m_Callables.push_back(i->second);
 }
 
-bool CAdminGame::Update(void *fd, void *send_fd)
+bool CAdminGame::Update()
 {
     //
     // update callables
@@ -259,7 +261,7 @@ bool CAdminGame::Update(void *fd, void *send_fd)
     // reset the last reserved seen timer since the admin game should never be considered abandoned
 
     m_LastReservedSeen = GetTime();
-    return CBaseGame::Update(fd, send_fd);
+    return CBaseGame::Update();
 }
 
 void CAdminGame::SendAdminChat(std::string message)
@@ -757,6 +759,16 @@ bool CAdminGame::EventPlayerBotCommand(CGamePlayer *player, std::string command,
         // !DOWNLOADS
         //
 
+        if (Command == "downloads" && Payload.empty())
+        {
+            // chat messages are cut off at 254 characters (see SendChat) so the report is split into lines that fit
+
+            std::vector<std::string> Report = m_GHost->m_DownloadScheduler->GetReport(254);
+
+            for (std::vector<std::string>::iterator i = Report.begin(); i != Report.end(); i++)
+                SendChat(player, *i);
+        }
+
         if (Command == "downloads" && !Payload.empty())
         {
             uint32_t Downloads = UTIL_ToUInt32(Payload);
@@ -800,6 +812,9 @@ bool CAdminGame::EventPlayerBotCommand(CGamePlayer *player, std::string command,
 
             if (GameNumber < m_GHost->m_Games.size())
             {
+                // the game might be running on a game thread so it has to wait while we read and change it
+
+                CGameThreadLock Lock(m_GHost->m_GameThreads);
                 SendChat(player, m_GHost->m_Language->EndingGame(m_GHost->m_Games[GameNumber]->GetDescription()));
                 CONSOLE_Print("[GAME: " + m_GHost->m_Games[GameNumber]->GetGameName() + "] is over (admin ended game)");
                 m_GHost->m_Games[GameNumber]->StopPlayers("was disconnected (admin ended game)");
@@ -865,7 +880,10 @@ bool CAdminGame::EventPlayerBotCommand(CGamePlayer *player, std::string command,
             uint32_t GameNumber = UTIL_ToUInt32(Payload) - 1;
 
             if (GameNumber < m_GHost->m_Games.size())
+            {
+                CGameThreadLock Lock(m_GHost->m_GameThreads);
                 SendChat(player, m_GHost->m_Language->GameNumberIs(Payload, m_GHost->m_Games[GameNumber]->GetDescription()));
+            }
             else
                 SendChat(player, m_GHost->m_Language->GameNumberDoesntExist(Payload));
         }
@@ -1188,7 +1206,10 @@ bool CAdminGame::EventPlayerBotCommand(CGamePlayer *player, std::string command,
                         Message = Message.substr(Start);
 
                     if (GameNumber - 1 < m_GHost->m_Games.size())
-                        m_GHost->m_Games[GameNumber - 1]->SendAllChat("ADMIN: " + Message);
+                    {
+                        CBaseGame *Game = m_GHost->m_Games[GameNumber - 1];
+                        Game->RunOnGameThread([Game, Message] { Game->SendAllChat("ADMIN: " + Message); });
+                    }
                     else
                         SendChat(player, m_GHost->m_Language->GameNumberDoesntExist(UTIL_ToString(GameNumber)));
                 }
@@ -1205,7 +1226,10 @@ bool CAdminGame::EventPlayerBotCommand(CGamePlayer *player, std::string command,
                 m_GHost->m_CurrentGame->SendAllChat(Payload);
 
             for (std::vector<CBaseGame *>::iterator i = m_GHost->m_Games.begin(); i != m_GHost->m_Games.end(); i++)
-                (*i)->SendAllChat("ADMIN: " + Payload);
+            {
+                CBaseGame *Game = *i;
+                Game->RunOnGameThread([Game, Payload] { Game->SendAllChat("ADMIN: " + Payload); });
+            }
         }
 
         //
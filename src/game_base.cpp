@@ -21,12 +21,16 @@
 #include "game_base.h"
 #include "bnet.h"
 #include "config.h"
+#include "downloadscheduler.h"
 #include "gameplayer.h"
 #include "gameprotocol.h"
+#include "gamethread.h"
 #include "gpsprotocol.h"
 #include "gcbiprotocol.h"
 #include "ghost.h"
 #include "ghostdb.h"
+#include "ipblacklist.h"
+#include "iptocountry.h"
 #include "language.h"
 #include "map.h"
 #include "packed.h"
@@ -79,6 +83,7 @@ CBaseGame::CBaseGame(CGHost *nGHost, CMap *nMap, CSaveGame *nSaveGame, uint16_t
     m_GameState      = nGameState;
     m_VirtualHostPID = 255;
     m_FakePlayerPID  = 255;
+    m_Thread         = NULL;
 
     // wait time of 1 minute  = 0 empty actions required
     // wait time of 2 minutes = 1 empty action required
@@ -110,24 +115,19 @@ CBaseGame::CBaseGame(CGHost *nGHost, CMap *nMap, CSaveGame *nSaveGame, uint16_t
     m_SyncCounter                   = 0;
     m_GameTicks                     = 0;
     m_CreationTime                  = GetTime();
-    m_LastPingTime                  = GetTime();
-    m_LastRefreshTime               = GetTime();
-    m_LastDownloadTicks             = GetTime();
-    m_DownloadCounter               = 0;
     m_LastDownloadCounterResetTicks = GetTicks();
-    m_LastAnnounceTime              = 0;
     m_AnnounceInterval              = 0;
     m_LastAutoStartTime             = GetTime();
     m_LastAuthCheckTime             = GetTime();
     m_AutoStartPlayers              = 0;
-    m_LastCountDownTicks            = 0;
     m_CountDownCounter              = 0;
     m_StartedLoadingTicks           = 0;
     m_StartPlayers                  = 0;
     m_LastLagScreenResetTime        = 0;
     m_LastActionSentTicks           = 0;
-    m_LastActionLateBy              = 0;
     m_StartedLaggingTime            = 0;
+    m_StartedLaggingTicks           = 0;
+    m_LagScreenTicks                = 0;
     m_LastLagScreenTime             = 0;
     m_LastReservedSeen              = GetTime();
     m_StartedKickVoteTime           = 0;
@@ -155,6 +155,12 @@ CBaseGame::CBaseGame(CGHost *nGHost, CMap *nMap, CSaveGame *nSaveGame, uint16_t
     //dance init
     m_StartedDanceTime = 0;
 
+    // the ping and refresh timers run for the whole game, the others are scheduled when they're needed
+
+    uint64_t Now = GetMicroTicks();
+    m_Timers.Schedule(&m_PingTimer, Now + 5000000);
+    m_Timers.Schedule(&m_RefreshTimer, Now + 3000000);
+
     if (m_SaveGame)
     {
         m_EnforceSlots = m_SaveGame->GetSlots();
@@ -182,47 +188,6 @@ CBaseGame::CBaseGame(CGHost *nGHost, CMap *nMap, CSaveGame *nSaveGame, uint16_t
 
     m_GameSlotsStatuses[0] = "1";
 
-    if (!m_GHost->m_IPBlackListFile.empty())
-    {
-        std::ifstream in;
-        in.open(m_GHost->m_IPBlackListFile.c_str());
-
-        if (in.fail())
-            CONSOLE_Print("[GAME: " + m_GameName + "] error loading IP blacklist file [" + m_GHost->m_IPBlackListFile + "]");
-        else
-        {
-            CONSOLE_Print("[GAME: " + m_GameName + "] loading IP blacklist file [" + m_GHost->m_IPBlackListFile + "]");
-            std::string Line;
-
-            while (!in.eof())
-            {
-                getline(in, Line);
-
-                // ignore blank lines and comments
-
-                if (Line.empty() || Line[0] == '#')
-                    continue;
-
-                // remove newlines and partial newlines to help fix issues with Windows formatted files on Linux systems
-
-                Line.erase(remove(Line.begin(), Line.end(), ' '), Line.end());
-                Line.erase(remove(Line.begin(), Line.end(), '\r'), Line.end());
-                Line.erase(remove(Line.begin(), Line.end(), '\n'), Line.end());
-
-                // ignore lines that don't look like IP addresses
-
-                if (Line.find_first_not_of("1234567890.") != std::string::npos)
-                    continue;
-
-                m_IPBlackList.insert(Line);
-            }
-
-            in.close();
-
-            CONSOLE_Print("[GAME: " + m_GameName + "] loaded " + UTIL_ToString(m_IPBlackList.size()) + " lines from IP blacklist file");
-        }
-    }
-
     // start listening for connections
 
     if (!m_GHost->m_BindAddress.empty())
@@ -230,7 +195,7 @@ CBaseGame::CBaseGame(CGHost *nGHost, CMap *nMap, CSaveGame *nSaveGame, uint16_t
     else
         CONSOLE_Print("[GAME: " + m_GameName + "] attempting to bind to all available addresses");
 
-    if (m_Socket->Listen(m_GHost->m_BindAddress, m_HostPort))
+    if (m_Socket->Listen(m_GHost->m_BindAddress, m_HostPort, m_GHost->m_ListenBacklog))
         CONSOLE_Print("[GAME: " + m_GameName + "] listening on port " + UTIL_ToString(m_HostPort));
     else
     {
@@ -268,6 +233,10 @@ CBaseGame::CBaseGame(CGHost *nGHost, CMap *nMap, CSaveGame *nSaveGame, uint16_t
 
 CBaseGame::~CBaseGame()
 {
+    m_GHost->m_DownloadScheduler->RemoveGame(this);
+
+    if (m_ActionLateness.GetCount() > 0)
+        CONSOLE_Print("[GAME: " + m_GameName + "] action timer lateness: " + m_ActionLateness.GetSummary());
 
     //broadcaster
     if (m_GHost->m_TCPStatus && m_GHost->m_StatusBroadcaster != NULL)
@@ -289,7 +258,7 @@ CBaseGame::~CBaseGame()
     */
 
     // save replay
-    // todotodo: put this in a thread
+    // building, compressing and writing the replay happens on a background thread, CGHost reports when it's done
 
     if (m_Replay && (m_GameLoading || m_GameLoaded))
     {
@@ -316,8 +285,9 @@ CBaseGame::~CBaseGame()
 
         //if (mins > 10)
         //{
-            m_Replay->BuildReplay(m_GameName, m_StatString, m_GHost->m_ReplayWar3Version, m_GHost->m_ReplayBuildNumber);
-            m_Replay->Save(m_GHost->m_TFT, m_GHost->m_ReplayPath + std::string(Time2) + "\\" + UTIL_FileSafeName(std::string(Time) + " DOTS [" + m_GHost->m_Map->GetMapLocalPath() + "][" + MinString + "m" + SecString + "s].w3g"));
+            std::string ReplayFile = m_GHost->m_ReplayPath + std::string(Time2) + "\\" + UTIL_FileSafeName(std::string(Time) + " DOTS [" + m_GHost->m_Map->GetMapLocalPath() + "][" + MinString + "m" + SecString + "s].w3g");
+            m_GHost->m_ReplaySaves.push_back(new CReplaySave(m_Replay, ReplayFile, m_GHost->m_TFT, m_GameName, m_StatString, m_GHost->m_ReplayWar3Version, m_GHost->m_ReplayBuildNumber));
+            m_Replay = NULL;
         //}
     }
 
@@ -342,22 +312,13 @@ CBaseGame::~CBaseGame()
     }
 }
 
-uint32_t CBaseGame::GetNextTimedActionTicks()
+uint64_t CBaseGame::GetNextTimerMicroTicks()
 {
-    // return the number of ticks (ms) until the next "timed action", which for our purposes is the next game update
-    // the main GHost++ loop will make sure the next loop update happens at or before this value
-    // note: there's no reason this function couldn't take into account the game's other timers too but they're far less critical
-    // warning: this function must take into account when actions are not being sent (e.g. during loading or lagging)
-
-    if (!m_GameLoaded || m_Lagging)
-        return 50;
-
-    uint32_t TicksSinceLastUpdate = GetTicks() - m_LastActionSentTicks;
+    // return the GetMicroTicks when this game's next timer expires (UINT64_MAX if none are scheduled)
+    // the main GHost++ loop (or the game thread) will make sure the next update happens at or just after this value
+    // the action timer isn't scheduled while the game is loading or lagging so this is usually the ping or refresh timer then
 
-    if (TicksSinceLastUpdate > m_Latency - m_LastActionLateBy)
-        return 0;
-    else
-        return m_Latency - m_LastActionLateBy - TicksSinceLastUpdate;
+    return m_Timers.GetNextDeadline();
 }
 
 uint32_t CBaseGame::GetSlotsOccupied()
@@ -458,41 +419,14 @@ void CBaseGame::SetAnnounce(uint32_t interval, std::string message)
 {
     m_AnnounceInterval = interval;
     m_AnnounceMessage  = message;
-    m_LastAnnounceTime = GetTime();
-}
-
-unsigned int CBaseGame::SetFD(void *fd, void *send_fd, int *nfds)
-{
-    unsigned int NumFDs = 0;
-
-    if (m_Socket)
-    {
-        m_Socket->SetFD((fd_set *)fd, (fd_set *)send_fd, nfds);
-        NumFDs++;
-    }
-
-    for (std::vector<CPotentialPlayer *>::iterator i = m_Potentials.begin(); i != m_Potentials.end(); i++)
-    {
-        if ((*i)->GetSocket())
-        {
-            (*i)->GetSocket()->SetFD((fd_set *)fd, (fd_set *)send_fd, nfds);
-            NumFDs++;
-        }
-    }
-
-    for (std::vector<CGamePlayer *>::iterator i = m_Players.begin(); i != m_Players.end(); i++)
-    {
-        if ((*i)->GetSocket())
-        {
-            (*i)->GetSocket()->SetFD((fd_set *)fd, (fd_set *)send_fd, nfds);
-            NumFDs++;
-        }
-    }
 
-    return NumFDs;
+    if (m_AnnounceMessage.empty())
+        m_Timers.Cancel(&m_AnnounceTimer);
+    else
+        m_Timers.Schedule(&m_AnnounceTimer, GetMicroTicks() + std::max<uint32_t>(m_AnnounceInterval, 1) * 1000000);
 }
 
-bool CBaseGame::Update(void *fd, void *send_fd)
+bool CBaseGame::Update()
 {
     // update callables
 
@@ -520,7 +454,7 @@ bool CBaseGame::Update(void *fd, void *send_fd)
 
     for (std::vector<CGamePlayer *>::iterator i = m_Players.begin(); i != m_Players.end();)
     {
-        if ((*i)->Update(fd))
+        if ((*i)->Update())
         {
             EventPlayerDeleted(*i);
             delete *i;
@@ -532,12 +466,12 @@ bool CBaseGame::Update(void *fd, void *send_fd)
 
     for (std::vector<CPotentialPlayer *>::iterator i = m_Potentials.begin(); i != m_Potentials.end();)
     {
-        if ((*i)->Update(fd))
+        if ((*i)->Update())
         {
             // flush the socket (e.g. in case a rejection message is std::queued)
 
             if ((*i)->GetSocket())
-                (*i)->GetSocket()->DoSend((fd_set *)send_fd);
+                (*i)->GetSocket()->DoSend();
 
             delete *i;
             i = m_Potentials.erase(i);
@@ -559,66 +493,6 @@ bool CBaseGame::Update(void *fd, void *send_fd)
         m_Locked = false;
     }
 
-    // ping every 5 seconds
-    // changed this to ping during game loading as well to hopefully fix some problems with people disconnecting during loading
-    // changed this to ping during the game as well
-
-    if (GetTime() - m_LastPingTime >= 5)
-    {
-        // note: we must send pings to players who are downloading the map because Warcraft III disconnects from the lobby if it doesn't receive a ping every ~90 seconds
-        // so if the player takes longer than 90 seconds to download the map they would be disconnected unless we keep sending pings
-        // todotodo: ignore pings received from players who have recently finished downloading the map
-
-        SendAll(m_Protocol->SEND_W3GS_PING_FROM_HOST());
-
-        // we also broadcast the game to the local network every 5 seconds so we hijack this timer for our nefarious purposes
-        // however we only want to broadcast if the countdown hasn't started
-        // see the !sendlan code later in this file for some more information about how this works
-        // todotodo: should we send a game cancel message somewhere? we'll need to implement a host counter for it to work
-
-        if (!m_CountDownStarted)
-        {
-            // construct a fixed host counter which will be used to identify players from this "realm" (i.e. LAN)
-            // the fixed host counter's 4 most significant bits will contain a 4 bit ID (0-15)
-            // the rest of the fixed host counter will contain the 28 least significant bits of the actual host counter
-            // since we're destroying 4 bits of information here the actual host counter should not be greater than 2^28 which is a reasonable assumption
-            // when a player joins a game we can obtain the ID from the received host counter
-            // note: LAN broadcasts use an ID of 0, battle.net refreshes use an ID of 1-10, the rest are unused
-
-            uint32_t FixedHostCounter = m_HostCounter & 0x0FFFFFFF;
-            uint32_t slotstotal       = m_Slots.size();
-            uint32_t slotsopen        = GetSlotsOpen();
-            if (slotsopen < 2)
-                slotsopen = 2;
-            if (slotstotal > 12)
-                slotstotal = 12;
-
-            if (m_SaveGame)
-            {
-                // note: the PrivateGame flag is not set when broadcasting to LAN (as you might expect)
-
-                uint32_t MapGameType = MAPGAMETYPE_SAVEDGAME;
-                BYTEARRAY MapWidth;
-                MapWidth.push_back(0);
-                MapWidth.push_back(0);
-                BYTEARRAY MapHeight;
-                MapHeight.push_back(0);
-                MapHeight.push_back(0);
-                m_GHost->m_UDPSocket->Broadcast(6112, m_Protocol->SEND_W3GS_GAMEINFO(m_GHost->m_TFT, m_GHost->m_LANWar3Version, UTIL_CreateByteArray(MapGameType, false), m_Map->GetMapGameFlags(), MapWidth, MapHeight, m_GameName, "beef", GetTime() - m_CreationTime, "Save\\Multiplayer\\" + m_SaveGame->GetFileNameNoPath(), m_SaveGame->GetMagicNumber(), slotstotal, slotsopen, m_HostPort, FixedHostCounter));
-            }
-            else
-            {
-                // note: the PrivateGame flag is not set when broadcasting to LAN (as you might expect)
-                // note: we do not use m_Map->GetMapGameType because none of the filters are set when broadcasting to LAN (also as you might expect)
-
-                uint32_t MapGameType = MAPGAMETYPE_UNKNOWN0;
-                m_GHost->m_UDPSocket->Broadcast(6112, m_Protocol->SEND_W3GS_GAMEINFO(m_GHost->m_TFT, m_GHost->m_LANWar3Version, UTIL_CreateByteArray(MapGameType, false), m_Map->GetMapGameFlags(), m_Map->GetMapWidth(), m_Map->GetMapHeight(), m_GameName, "beef", GetTime() - m_CreationTime, m_Map->GetMapPath(), m_Map->GetMapCRC(), slotstotal, slotsopen, m_HostPort, FixedHostCounter));
-            }
-        }
-
-        m_LastPingTime = GetTime();
-    }
-
     // auto rehost if there was a refresh error in autohosted games
 
     if (m_RefreshError && !m_CountDownStarted && m_GameState == GAME_PUBLIC && !m_GHost->m_AutoHostGameName.empty() && m_GHost->m_AutoHostMaximumGames != 0 && m_GHost->m_AutoHostAutoStartPlayers != 0 && m_AutoStartPlayers != 0)
@@ -642,42 +516,8 @@ bool CBaseGame::Update(void *fd, void *send_fd)
             // the game creation message will be sent on the next refresh
         }
 
-        m_CreationTime    = GetTime();
-        m_LastRefreshTime = GetTime();
-    }
-
-    // refresh every 3 seconds
-
-    if (!m_RefreshError && !m_CountDownStarted && m_GameState == GAME_PUBLIC && GetSlotsOpen() > 0 && GetTime() - m_LastRefreshTime >= 3)
-    {
-        // send a game refresh packet to each battle.net connection
-
-        bool Refreshed = false;
-
-        for (std::vector<CBNET *>::iterator i = m_GHost->m_BNETs.begin(); i != m_GHost->m_BNETs.end(); i++)
-        {
-            // don't std::queue a game refresh message if the std::queue contains more than 1 packet because they're very low priority
-
-            if ((*i)->GetOutPacketsQueued() <= 1)
-            {
-                /*
-                Varlock's original refresh
-                (*i)->QueueGameRefresh( m_GameState, m_GameName, std::string( ), m_Map, m_SaveGame, GetTime( ) - m_CreationTime, m_HostCounter );
-                */
-
-                // Refresh code from Fire86 (http://codelain.com/forum/index.php?topic=11373.msg88767#msg88767)
-                (*i)->QueueGameRefresh(m_GameState, m_GameName, std::string(), m_Map, m_SaveGame, 0, m_HostCounter);
-
-                Refreshed = true;
-            }
-        }
-
-        // only print the "game refreshed" message if we actually refreshed on at least one battle.net server
-
-        if (m_RefreshMessages && Refreshed)
-            SendAllChat(m_GHost->m_Language->GameRefreshed());
-
-        m_LastRefreshTime = GetTime();
+        m_CreationTime = GetTime();
+        m_Timers.Schedule(&m_RefreshTimer, GetMicroTicks() + 3000000);
     }
 
     // send more map data
@@ -685,76 +525,25 @@ bool CBaseGame::Update(void *fd, void *send_fd)
     if (!m_GameLoading && !m_GameLoaded && GetTicks() - m_LastDownloadCounterResetTicks >= 1000)
     {
         // hackhack: another timer hijack is in progress here
-        // since the download counter is reset once per second it's a great place to update the slot info if necessary
+        // the download counter used to be reset once per second here, now it's just a convenient place to update the slot info if necessary
 
         if (m_SlotInfoChanged)
             SendAllSlotInfo();
 
-        m_DownloadCounter               = 0;
         m_LastDownloadCounterResetTicks = GetTicks();
     }
 
-    if (!m_GameLoading && !m_GameLoaded && GetTicks() - m_LastDownloadTicks >= 100)
+    if (!m_GameLoading && !m_GameLoaded)
     {
-        uint32_t Downloaders = 0;
+        // the map parts aren't sent from here anymore, the download scheduler decides who gets what across every lobby we're hosting
+        // we just tell it who's downloading from this game, it sends their parts at the start of the next update
+        // bot_maxdownloaders is enforced by the scheduler across every lobby so everyone who's downloading is registered
 
         for (std::vector<CGamePlayer *>::iterator i = m_Players.begin(); i != m_Players.end(); i++)
         {
             if ((*i)->GetDownloadStarted() && !(*i)->GetDownloadFinished())
-            {
-                Downloaders++;
-
-                if (m_GHost->m_MaxDownloaders > 0 && Downloaders > m_GHost->m_MaxDownloaders)
-                    break;
-
-                // send up to 100 pieces of the map at once so that the download goes faster
-                // if we wait for each MAPPART packet to be acknowledged by the client it'll take a long time to download
-                // this is because we would have to wait the round trip time (the ping time) between sending every 1442 bytes of map data
-                // doing it this way allows us to send at least 140 KB in each round trip interval which is much more reasonable
-                // the theoretical throughput is [140 KB * 1000 / ping] in KB/sec so someone with 100 ping (round trip ping, not LC ping) could download at 1400 KB/sec
-                // note: this creates a std::queue of map data which clogs up the connection when the client is on a slower connection (e.g. dialup)
-                // in this case any changes to the lobby are delayed by the amount of time it takes to send the std::queued data (i.e. 140 KB, which could be 30 seconds or more)
-                // for example, players joining and leaving, slot changes, chat messages would all appear to happen much later for the low bandwidth player
-                // note: the throughput is also limited by the number of times this code is executed each second
-                // e.g. if we send the maximum amount (140 KB) 10 times per second the theoretical throughput is 1400 KB/sec
-                // therefore the maximum throughput is 1400 KB/sec regardless of ping and this value slowly diminishes as the player's ping increases
-                // in addition to this, the throughput is limited by the configuration value bot_maxdownloadspeed
-                // in summary: the actual throughput is MIN( 140 * 1000 / ping, 1400, bot_maxdownloadspeed ) in KB/sec assuming only one player is downloading the map
-
-                uint32_t MapSize = UTIL_ByteArrayToUInt32(m_Map->GetMapSize(), false);
-
-                while ((*i)->GetLastMapPartSent() < (*i)->GetLastMapPartAcked() + 1442 * 100 && (*i)->GetLastMapPartSent() < MapSize)
-                {
-                    if ((*i)->GetLastMapPartSent() == 0)
-                    {
-                        // overwrite the "started download ticks" since this is the first time we've sent any map data to the player
-                        // prior to this we've only determined if the player needs to download the map but it's possible we could have delayed sending any data due to download limits
-
-                        (*i)->SetStartedDownloadingTicks(GetTicks());
-                    }
-
-                    // limit the download speed if we're sending too much data
-                    // the download counter is the # of map bytes downloaded in the last second (it's reset once per second)
-
-                    if (m_GHost->m_MaxDownloadSpeed > 0 && m_DownloadCounter > m_GHost->m_MaxDownloadSpeed * 1024)
-                        break;
-
-                    Send(*i, m_Protocol->SEND_W3GS_MAPPART(GetHostPID(), (*i)->GetPID(), (*i)->GetLastMapPartSent(), m_Map->GetMapData()));
-                    (*i)->SetLastMapPartSent((*i)->GetLastMapPartSent() + 1442);
-                    m_DownloadCounter += 1442;
-                }
-            }
+                m_GHost->m_DownloadScheduler->AddDownloader(this, *i);
         }
-
-        m_LastDownloadTicks = GetTicks();
-    }
-
-    // announce every m_AnnounceInterval seconds
-
-    if (!m_AnnounceMessage.empty() && !m_CountDownStarted && GetTime() - m_LastAnnounceTime >= m_AnnounceInterval)
-    {
-        SendAllChat(m_AnnounceMessage);
-        m_LastAnnounceTime = GetTime();
     }
 
     // kick players who don't spoof check within 20 seconds when spoof checks are required and the game is autohosted
@@ -781,7 +570,7 @@ bool CBaseGame::Update(void *fd, void *send_fd)
         {
             if (!(*i)->GetAuthenticated())
             {
-                if (m_GHost->m_DB->AuthCheck((*i)->GetName())) //проверяем есть ли игрок в ДБ и с больше чем 5 игр
+                if (m_GHost->AuthCheck((*i)->GetName())) //проверяем есть ли игрок в ДБ и с больше чем 5 игр (результат кэшируется, запрос к ДБ идёт в фоне)
                 {
                     (*i)->SetAuthenticated(true);
                     continue;
@@ -820,46 +609,6 @@ bool CBaseGame::Update(void *fd, void *send_fd)
         m_LastAutoStartTime = GetTime();
     }
 
-    // normal countdown if active every 1200 ms (because we need an extra sec for 0 )
-
-    if (m_GHost->m_UseNormalCountDown)
-    {
-        if (m_CountDownStarted && GetTicks() >= m_LastCountDownTicks + 1200)
-        {
-            if (m_CountDownCounter > 0)
-            {
-                m_CountDownCounter--;
-            }
-            else if (!m_GameLoading && !m_GameLoaded)
-            {
-                EventGameStarted();
-            }
-
-            m_LastCountDownTicks = GetTicks();
-        }
-    }
-    else
-    {
-        // countdown (ghost style) every 500 ms
-
-        if (m_CountDownStarted && GetTicks() >= m_LastCountDownTicks + 500)
-        {
-            if (m_CountDownCounter > 0)
-            {
-                // we use a countdown counter rather than a "finish countdown time" here because it might alternately round up or down the count
-                // this sometimes resulted in a countdown of e.g. "6 5 3 2 1" during my testing which looks pretty dumb
-                // doing it this way ensures it's always "5 4 3 2 1" but each interval might not be *exactly* the same length
-
-                SendAllChat(UTIL_ToString(m_CountDownCounter) + ". . .");
-                m_CountDownCounter--;
-            }
-            else if (!m_GameLoading && !m_GameLoaded)
-                EventGameStarted();
-
-            m_LastCountDownTicks = GetTicks();
-        }
-    }
-
     // check if the lobby is "abandoned" and needs to be closed since it will never start
 
     if (!m_GameLoading && !m_GameLoaded && m_AutoStartPlayers == 0 && m_GHost->m_LobbyTimeLimit > 0)
@@ -900,6 +649,7 @@ bool CBaseGame::Update(void *fd, void *send_fd)
             m_LastActionSentTicks = GetTicks();
             m_GameLoading         = false;
             m_GameLoaded          = true;
+            m_Timers.Schedule(&m_ActionTimer, GetMicroTicks() + m_Latency * 1000);
             EventGameLoaded();
         }
         else
@@ -1010,8 +760,9 @@ bool CBaseGame::Update(void *fd, void *send_fd)
                 {
                     (*i)->SetLagging(true);
                     (*i)->SetStartedLaggingTicks(GetTicks());
-                    m_Lagging            = true;
-                    m_StartedLaggingTime = GetTime();
+                    m_Lagging             = true;
+                    m_StartedLaggingTime  = GetTime();
+                    m_StartedLaggingTicks = GetTicks();
 
                     if (LaggingString.empty())
                         LaggingString = (*i)->GetName();
@@ -1124,6 +875,7 @@ bool CBaseGame::Update(void *fd, void *send_fd)
 
                     CONSOLE_Print("[GAME: " + m_GameName + "] stopped lagging on [" + (*i)->GetName() + "]");
                     SendAll(m_Protocol->SEND_W3GS_STOP_LAG(*i));
+                    (*i)->AddLaggingTicks(GetTicks() - (*i)->GetStartedLaggingTicks());
                     (*i)->SetLagging(false);
                     (*i)->SetStartedLaggingTicks(0);
                 }
@@ -1139,11 +891,15 @@ bool CBaseGame::Update(void *fd, void *send_fd)
                     Lagging = true;
             }
 
+            if (!Lagging)
+                m_LagScreenTicks += GetTicks() - m_StartedLaggingTicks;
+
             m_Lagging = Lagging;
 
-            // reset m_LastActionSentTicks because we want the game to stop running while the lag screen is up
+            // reset the action timer because we want the game to stop running while the lag screen is up
 
             m_LastActionSentTicks = GetTicks();
+            m_Timers.Schedule(&m_ActionTimer, GetMicroTicks() + m_Latency * 1000);
 
             // keep track of the last lag screen time so we can avoid timing out players
 
@@ -1151,12 +907,24 @@ bool CBaseGame::Update(void *fd, void *send_fd)
         }
     }
 
-    // send actions every m_Latency milliseconds
-    // actions are at the heart of every Warcraft 3 game but luckily we don't need to know their contents to relay them
-    // we std::queue player actions in EventPlayerAction then just resend them in batches to all players here
+    // run the timers that are due (the actions, pings, refreshes, announcements and the countdown)
+    // each one is handled once per update at most, a timer that's fallen behind reschedules itself rather than firing again right away
 
-    if (m_GameLoaded && !m_Lagging && GetTicks() - m_LastActionSentTicks >= m_Latency - m_LastActionLateBy)
-        SendAllActions();
+    uint64_t Now = GetMicroTicks();
+
+    while (CTimer *Timer = m_Timers.Expire(Now))
+    {
+        if (Timer == &m_ActionTimer)
+            EventActionTimer();
+        else if (Timer == &m_PingTimer)
+            EventPingTimer();
+        else if (Timer == &m_RefreshTimer)
+            EventRefreshTimer();
+        else if (Timer == &m_AnnounceTimer)
+            EventAnnounceTimer();
+        else if (Timer == &m_CountDownTimer)
+            EventCountDownTimer();
+    }
 
     // expire the votekick
 
@@ -1357,23 +1125,38 @@ bool CBaseGame::Update(void *fd, void *send_fd)
 
     if (m_Socket)
     {
-        CTCPSocket *NewSocket = m_Socket->Accept((fd_set *)fd);
+        // accept every waiting connection so a burst of players joining a freshly announced game is let in straight away rather than one per update
+
+        std::vector<CTCPSocket *> NewSockets = m_Socket->AcceptAll();
 
-        if (NewSocket)
+        for (std::vector<CTCPSocket *>::iterator i = NewSockets.begin(); i != NewSockets.end(); i++)
         {
+            CTCPSocket *NewSocket = *i;
+            uint32_t IP           = UTIL_ByteArrayToUInt32(NewSocket->GetIP(), true);
+            uint32_t Rejections   = 0;
+
             // check the IP blacklist
 
-            if (m_IPBlackList.find(NewSocket->GetIPString()) == m_IPBlackList.end())
+            if (m_GHost->m_IPBlackList->Contains(IP))
             {
-                if (m_GHost->m_TCPNoDelay)
-                    NewSocket->SetNoDelay(true);
+                CONSOLE_Print("[GAME: " + m_GameName + "] rejected connection from [" + NewSocket->GetIPString() + "] due to blacklist");
+                delete NewSocket;
+            }
+            else if (!m_GHost->m_ConnectionLimiter->Allow(IP, Rejections))
+            {
+                // only print the first rejection in a row so an address connecting in a loop doesn't flood the console
 
-                m_Potentials.push_back(new CPotentialPlayer(m_Protocol, this, NewSocket));
+                if (Rejections == 1)
+                    CONSOLE_Print("[GAME: " + m_GameName + "] rejected connection from [" + NewSocket->GetIPString() + "] because it's connecting too often, further connections will be rejected silently");
+
+                delete NewSocket;
             }
             else
             {
-                CONSOLE_Print("[GAME: " + m_GameName + "] rejected connection from [" + NewSocket->GetIPString() + "] due to blacklist");
-                delete NewSocket;
+                if (m_GHost->m_TCPNoDelay)
+                    NewSocket->SetNoDelay(true);
+
+                m_Potentials.push_back(new CPotentialPlayer(m_Protocol, this, NewSocket));
             }
         }
 
@@ -1384,7 +1167,7 @@ bool CBaseGame::Update(void *fd, void *send_fd)
     return m_Exiting;
 }
 
-void CBaseGame::UpdatePost(void *send_fd)
+void CBaseGame::UpdatePost()
 {
     // we need to manually call DoSend on each player now because CGamePlayer:: Update doesn't do it
     // this is in case player 2 generates a packet for player 1 during the update but it doesn't get sent because player 1 already finished updating
@@ -1393,16 +1176,268 @@ void CBaseGame::UpdatePost(void *send_fd)
     for (std::vector<CGamePlayer *>::iterator i = m_Players.begin(); i != m_Players.end(); i++)
     {
         if ((*i)->GetSocket())
-            (*i)->GetSocket()->DoSend((fd_set *)send_fd);
+            (*i)->GetSocket()->DoSend();
     }
 
     for (std::vector<CPotentialPlayer *>::iterator i = m_Potentials.begin(); i != m_Potentials.end(); i++)
     {
         if ((*i)->GetSocket())
-            (*i)->GetSocket()->DoSend((fd_set *)send_fd);
+            (*i)->GetSocket()->DoSend();
     }
 }
 
+void CBaseGame::EventActionTimer()
+{
+    // send actions every m_Latency milliseconds
+    // actions are at the heart of every Warcraft 3 game but luckily we don't need to know their contents to relay them
+    // we std::queue player actions in EventPlayerAction then just resend them in batches to all players here
+
+    uint64_t Now = GetMicroTicks();
+
+    if (!m_GameLoaded || m_Lagging)
+    {
+        m_Timers.Schedule(&m_ActionTimer, Now + m_Latency * 1000);
+        return;
+    }
+
+    uint64_t LateBy = Now - m_ActionTimer.GetDeadline();
+    m_ActionLateness.Add(LateBy);
+    SendAllActions();
+
+    // the next deadline is m_Latency after this one (not after now) so being late once doesn't delay every following action packet
+
+    if (LateBy > m_Latency * 1000)
+    {
+        // something is going terribly wrong - GHost++ is probably starved of resources
+        // print a message because even though this will take more resources it should provide some information to the administrator for future reference
+        // other solutions - dynamically modify the latency, request higher priority, terminate other games, ???
+
+        CONSOLE_Print("[GAME: " + m_GameName + "] warning - the latency is " + UTIL_ToString(m_Latency) + "ms but the last update was late by " + UTIL_ToString(LateBy / 1000) + "ms");
+    }
+
+    m_Timers.SchedulePeriodic(&m_ActionTimer, m_Latency * 1000, Now);
+}
+
+void CBaseGame::EventPingTimer()
+{
+    // ping every 5 seconds
+    // changed this to ping during game loading as well to hopefully fix some problems with people disconnecting during loading
+    // changed this to ping during the game as well
+
+    // note: we must send pings to players who are downloading the map because Warcraft III disconnects from the lobby if it doesn't receive a ping every ~90 seconds
+    // so if the player takes longer than 90 seconds to download the map they would be disconnected unless we keep sending pings
+    // todotodo: ignore pings received from players who have recently finished downloading the map
+
+    SendAll(m_Protocol->SEND_W3GS_PING_FROM_HOST());
+
+    // we also broadcast the game to the local network every 5 seconds so we hijack this timer for our nefarious purposes
+    // however we only want to broadcast if the countdown hasn't started
+    // see the !sendlan code later in this file for some more information about how this works
+    // todotodo: should we send a game cancel message somewhere? we'll need to implement a host counter for it to work
+
+    if (!m_CountDownStarted)
+    {
+        // construct a fixed host counter which will be used to identify players from this "realm" (i.e. LAN)
+        // the fixed host counter's 4 most significant bits will contain a 4 bit ID (0-15)
+        // the rest of the fixed host counter will contain the 28 least significant bits of the actual host counter
+        // since we're destroying 4 bits of information here the actual host counter should not be greater than 2^28 which is a reasonable assumption
+        // when a player joins a game we can obtain the ID from the received host counter
+        // note: LAN broadcasts use an ID of 0, battle.net refreshes use an ID of 1-10, the rest are unused
+
+        uint32_t FixedHostCounter = m_HostCounter & 0x0FFFFFFF;
+        uint32_t slotstotal       = m_Slots.size();
+        uint32_t slotsopen        = GetSlotsOpen();
+        if (slotsopen < 2)
+            slotsopen = 2;
+        if (slotstotal > 12)
+            slotstotal = 12;
+
+        if (m_SaveGame)
+        {
+            // note: the PrivateGame flag is not set when broadcasting to LAN (as you might expect)
+
+            uint32_t MapGameType = MAPGAMETYPE_SAVEDGAME;
+            BYTEARRAY MapWidth;
+            MapWidth.push_back(0);
+            MapWidth.push_back(0);
+            BYTEARRAY MapHeight;
+            MapHeight.push_back(0);
+            MapHeight.push_back(0);
+            m_GHost->m_UDPSocket->Broadcast(6112, m_Protocol->SEND_W3GS_GAMEINFO(m_GHost->m_TFT, m_GHost->m_LANWar3Version, UTIL_CreateByteArray(MapGameType, false), m_Map->GetMapGameFlags(), MapWidth, MapHeight, m_GameName, "beef", GetTime() - m_CreationTime, "Save\\Multiplayer\\" + m_SaveGame->GetFileNameNoPath(), m_SaveGame->GetMagicNumber(), slotstotal, slotsopen, m_HostPort, FixedHostCounter));
+        }
+        else
+        {
+            // note: the PrivateGame flag is not set when broadcasting to LAN (as you might expect)
+            // note: we do not use m_Map->GetMapGameType because none of the filters are set when broadcasting to LAN (also as you might expect)
+
+            uint32_t MapGameType = MAPGAMETYPE_UNKNOWN0;
+            m_GHost->m_UDPSocket->Broadcast(6112, m_Protocol->SEND_W3GS_GAMEINFO(m_GHost->m_TFT, m_GHost->m_LANWar3Version, UTIL_CreateByteArray(MapGameType, false), m_Map->GetMapGameFlags(), m_Map->GetMapWidth(), m_Map->GetMapHeight(), m_GameName, "beef", GetTime() - m_CreationTime, m_Map->GetMapPath(), m_Map->GetMapCRC(), slotstotal, slotsopen, m_HostPort, FixedHostCounter));
+        }
+    }
+
+    m_Timers.SchedulePeriodic(&m_PingTimer, 5000000, GetMicroTicks());
+}
+
+void CBaseGame::EventRefreshTimer()
+{
+    // refresh every 3 seconds
+
+    if (!m_RefreshError && !m_CountDownStarted && m_GameState == GAME_PUBLIC && GetSlotsOpen() > 0)
+    {
+        // send a game refresh packet to each battle.net connection
+
+        bool Refreshed = false;
+
+        for (std::vector<CBNET *>::iterator i = m_GHost->m_BNETs.begin(); i != m_GHost->m_BNETs.end(); i++)
+        {
+            // don't std::queue a game refresh message if the std::queue contains more than 1 packet because they're very low priority
+
+            if ((*i)->GetOutPacketsQueued() <= 1)
+            {
+                /*
+                Varlock's original refresh
+                (*i)->QueueGameRefresh( m_GameState, m_GameName, std::string( ), m_Map, m_SaveGame, GetTime( ) - m_CreationTime, m_HostCounter );
+                */
+
+                // Refresh code from Fire86 (http://codelain.com/forum/index.php?topic=11373.msg88767#msg88767)
+                (*i)->QueueGameRefresh(m_GameState, m_GameName, std::string(), m_Map, m_SaveGame, 0, m_HostCounter);
+
+                Refreshed = true;
+            }
+        }
+
+        // only print the "game refreshed" message if we actually refreshed on at least one battle.net server
+
+        if (m_RefreshMessages && Refreshed)
+            SendAllChat(m_GHost->m_Language->GameRefreshed());
+    }
+
+    m_Timers.SchedulePeriodic(&m_RefreshTimer, 3000000, GetMicroTicks());
+}
+
+void CBaseGame::EventAnnounceTimer()
+{
+    // announce every m_AnnounceInterval seconds
+    // SetAnnounce cancels the timer when the message is cleared
+
+    if (!m_CountDownStarted)
+        SendAllChat(m_AnnounceMessage);
+
+    m_Timers.SchedulePeriodic(&m_AnnounceTimer, std::max<uint32_t>(m_AnnounceInterval, 1) * 1000000, GetMicroTicks());
+}
+
+void CBaseGame::EventCountDownTimer()
+{
+    // the countdown might have been aborted since the timer was scheduled
+
+    if (!m_CountDownStarted)
+        return;
+
+    if (m_GHost->m_UseNormalCountDown)
+    {
+        // normal countdown if active every 1200 ms (because we need an extra sec for 0 )
+
+        if (m_CountDownCounter > 0)
+        {
+            m_CountDownCounter--;
+        }
+        else if (!m_GameLoading && !m_GameLoaded)
+        {
+            EventGameStarted();
+        }
+    }
+    else
+    {
+        // countdown (ghost style) every 500 ms
+
+        if (m_CountDownCounter > 0)
+        {
+            // we use a countdown counter rather than a "finish countdown time" here because it might alternately round up or down the count
+            // this sometimes resulted in a countdown of e.g. "6 5 3 2 1" during my testing which looks pretty dumb
+            // doing it this way ensures it's always "5 4 3 2 1" but each interval might not be *exactly* the same length
+
+            SendAllChat(UTIL_ToString(m_CountDownCounter) + ". . .");
+            m_CountDownCounter--;
+        }
+        else if (!m_GameLoading && !m_GameLoaded)
+            EventGameStarted();
+    }
+
+    if (m_CountDownStarted && !m_GameLoading && !m_GameLoaded)
+        m_Timers.Schedule(&m_CountDownTimer, GetMicroTicks() + (m_GHost->m_UseNormalCountDown ? 1200000 : 500000));
+}
+
+void CBaseGame::RunOnMainThread(std::function<void()> message)
+{
+    // anything owned by the main thread (the battle.net connections, the database, the game lists, etc...) has to be changed from the main thread
+    // the main thread runs the messages in order and doesn't delete the game until it's run every message the game queued so it's safe to capture this
+
+    if (m_Thread)
+        m_GHost->QueueMessage(message);
+    else
+        message();
+}
+
+void CBaseGame::RunOnGameThread(std::function<void()> message)
+{
+    // the main thread uses this to hand things back to the game (e.g. a database callable it asked for)
+
+    if (m_Thread)
+        m_Thread->QueueMessage(message);
+    else
+        message();
+}
+
+void CBaseGame::RegisterSockets()
+{
+    // the sockets are registered with the reactor of the thread calling this
+
+    if (m_Socket)
+        m_Socket->Register();
+
+    for (std::vector<CPotentialPlayer *>::iterator i = m_Potentials.begin(); i != m_Potentials.end(); i++)
+    {
+        if ((*i)->GetSocket())
+            (*i)->GetSocket()->Register();
+    }
+
+    for (std::vector<CGamePlayer *>::iterator i = m_Players.begin(); i != m_Players.end(); i++)
+    {
+        if ((*i)->GetSocket())
+            (*i)->GetSocket()->Register();
+    }
+}
+
+void CBaseGame::UnregisterSockets()
+{
+    if (m_Socket)
+        m_Socket->Unregister();
+
+    for (std::vector<CPotentialPlayer *>::iterator i = m_Potentials.begin(); i != m_Potentials.end(); i++)
+    {
+        if ((*i)->GetSocket())
+            (*i)->GetSocket()->Unregister();
+    }
+
+    for (std::vector<CGamePlayer *>::iterator i = m_Players.begin(); i != m_Players.end(); i++)
+    {
+        if ((*i)->GetSocket())
+            (*i)->GetSocket()->Unregister();
+    }
+}
+
+void CBaseGame::DeleteCallable(CBaseCallable *callable)
+{
+    // recovering a callable touches the database's connection pool so it has to happen on the main thread
+
+    CGHost *GHost = m_GHost;
+
+    RunOnMainThread([GHost, callable] {
+        GHost->m_DB->RecoverCallable(callable);
+        delete callable;
+    });
+}
+
 void CBaseGame::Send(CGamePlayer *player, BYTEARRAY data)
 {
     if (player)
@@ -1416,11 +1451,25 @@ void CBaseGame::Send(unsigned char PID, BYTEARRAY data)
 
 void CBaseGame::Send(BYTEARRAY PIDs, BYTEARRAY data)
 {
+    // build the shared buffer once and queue it to every recipient
+
+    SHAREDBYTEARRAY Data = std::make_shared<const BYTEARRAY>(std::move(data));
+
     for (unsigned int i = 0; i < PIDs.size(); i++)
-        Send(PIDs[i], data);
+    {
+        CGamePlayer *Player = GetPlayerFromPID(PIDs[i]);
+
+        if (Player)
+            Player->Send(Data);
+    }
 }
 
 void CBaseGame::SendAll(BYTEARRAY data)
+{
+    SendAll(std::make_shared<const BYTEARRAY>(std::move(data)));
+}
+
+void CBaseGame::SendAll(SHAREDBYTEARRAY data)
 {
     for (std::vector<CGamePlayer *>::iterator i = m_Players.begin(); i != m_Players.end(); i++)
         (*i)->Send(data);
@@ -1579,25 +1628,29 @@ void CBaseGame::SendAllActions()
 
     m_GameTicks += m_Latency;
 
+    // each action packet is encoded once and the same shared buffer is queued to every player, kept for GProxy++ and copied into the replay
+
     if (UsingGProxy)
     {
         // we must send empty actions to non-GProxy++ players
         // GProxy++ will insert these itself so we don't need to send them to GProxy++ players
         // empty actions are used to extend the time a player can use when reconnecting
 
+        SHAREDBYTEARRAY EmptyAction = std::make_shared<const BYTEARRAY>(m_Protocol->SEND_W3GS_INCOMING_ACTION(std::queue<CIncomingAction *>(), 0));
+
         for (std::vector<CGamePlayer *>::iterator i = m_Players.begin(); i != m_Players.end(); i++)
         {
             if (!(*i)->GetGProxy())
             {
                 for (unsigned char j = 0; j < m_GProxyEmptyActions; j++)
-                    Send(*i, m_Protocol->SEND_W3GS_INCOMING_ACTION(std::queue<CIncomingAction *>(), 0));
+                    (*i)->Send(EmptyAction);
             }
         }
 
         if (m_Replay)
         {
             for (unsigned char i = 0; i < m_GProxyEmptyActions; i++)
-                m_Replay->AddTimeSlot(0, std::queue<CIncomingAction *>());
+                m_Replay->AddTimeSlot(0, EmptyAction);
         }
     }
 
@@ -1634,14 +1687,15 @@ void CBaseGame::SendAllActions()
                 // so send everything already in the std::queue and then clear it out
                 // the W3GS_INCOMING_ACTION2 packet handles the overflow but it must be sent *before* the corresponding W3GS_INCOMING_ACTION packet
 
-                SendAll(m_Protocol->SEND_W3GS_INCOMING_ACTION2(SubActions));
+                SHAREDBYTEARRAY Packet = std::make_shared<const BYTEARRAY>(m_Protocol->SEND_W3GS_INCOMING_ACTION2(SubActions));
+                SendAll(Packet);
 
                 if (m_Replay)
-                    m_Replay->AddTimeSlot2(SubActions);
+                    m_Replay->AddTimeSlot2(Packet);
 
                 while (!SubActions.empty())
                 {
-                    delete SubActions.front();
+                    m_Protocol->m_ActionPool.Release(SubActions.front());
                     SubActions.pop();
                 }
 
@@ -1652,37 +1706,27 @@ void CBaseGame::SendAllActions()
             SubActionsLength += Action->GetLength();
         }
 
-        SendAll(m_Protocol->SEND_W3GS_INCOMING_ACTION(SubActions, m_Latency));
+        SHAREDBYTEARRAY Packet = std::make_shared<const BYTEARRAY>(m_Protocol->SEND_W3GS_INCOMING_ACTION(SubActions, m_Latency));
+        SendAll(Packet);
 
         if (m_Replay)
-            m_Replay->AddTimeSlot(m_Latency, SubActions);
+            m_Replay->AddTimeSlot(m_Latency, Packet);
+
+        // the actions go back to the pool so next tick's actions can reuse them and their buffers
 
         while (!SubActions.empty())
         {
-            delete SubActions.front();
+            m_Protocol->m_ActionPool.Release(SubActions.front());
             SubActions.pop();
         }
     }
     else
     {
-        SendAll(m_Protocol->SEND_W3GS_INCOMING_ACTION(m_Actions, m_Latency));
+        SHAREDBYTEARRAY Packet = std::make_shared<const BYTEARRAY>(m_Protocol->SEND_W3GS_INCOMING_ACTION(m_Actions, m_Latency));
+        SendAll(Packet);
 
         if (m_Replay)
-            m_Replay->AddTimeSlot(m_Latency, m_Actions);
-    }
-
-    uint32_t ActualSendInterval   = GetTicks() - m_LastActionSentTicks;
-    uint32_t ExpectedSendInterval = m_Latency - m_LastActionLateBy;
-    m_LastActionLateBy            = ActualSendInterval - ExpectedSendInterval;
-
-    if (m_LastActionLateBy > m_Latency)
-    {
-        // something is going terribly wrong - GHost++ is probably starved of resources
-        // print a message because even though this will take more resources it should provide some information to the administrator for future reference
-        // other solutions - dynamically modify the latency, request higher priority, terminate other games, ???
-
-        CONSOLE_Print("[GAME: " + m_GameName + "] warning - the latency is " + UTIL_ToString(m_Latency) + "ms but the last update was late by " + UTIL_ToString(m_LastActionLateBy) + "ms");
-        m_LastActionLateBy = m_Latency;
+            m_Replay->AddTimeSlot(m_Latency, Packet);
     }
 
     m_LastActionSentTicks = GetTicks();
@@ -1787,26 +1831,37 @@ void CBaseGame::EventPlayerDeleted(CGamePlayer *player)
 {
     m_GameNeedUpdateStatusOnline = true;
 
+    // the download scheduler forgets a game's downloaders when it starts
+
+    if (!m_GameLoading && !m_GameLoaded)
+        m_GHost->m_DownloadScheduler->RemovePlayer(player);
+
     CONSOLE_Print("[GAME: " + m_GameName + "] deleting player [" + player->GetName() + "]: " + player->GetLeftReason());
 
     // remove any std::queued spoofcheck messages for this player
 
     if (player->GetWhoisSent() && !player->GetJoinedRealm().empty() && player->GetSpoofedRealm().empty())
     {
-        for (std::vector<CBNET *>::iterator i = m_GHost->m_BNETs.begin(); i != m_GHost->m_BNETs.end(); i++)
-        {
-            if ((*i)->GetServer() == player->GetJoinedRealm())
+        CGHost *GHost     = m_GHost;
+        std::string Realm = player->GetJoinedRealm();
+        std::string Name  = player->GetName();
+
+        RunOnMainThread([GHost, Realm, Name] {
+            for (std::vector<CBNET *>::iterator i = GHost->m_BNETs.begin(); i != GHost->m_BNETs.end(); i++)
             {
-                // hackhack: there must be a better way to do this
+                if ((*i)->GetServer() == Realm)
+                {
+                    // hackhack: there must be a better way to do this
 
-                if ((*i)->GetPasswordHashType() == "pvpgn")
-                    (*i)->UnqueueChatCommand("/whereis " + player->GetName());
-                else
-                    (*i)->UnqueueChatCommand("/whois " + player->GetName());
+                    if ((*i)->GetPasswordHashType() == "pvpgn")
+                        (*i)->UnqueueChatCommand("/whereis " + Name);
+                    else
+                        (*i)->UnqueueChatCommand("/whois " + Name);
 
-                (*i)->UnqueueChatCommand("/w " + player->GetName() + " " + m_GHost->m_Language->SpoofCheckByReplying());
+                    (*i)->UnqueueChatCommand("/w " + Name + " " + GHost->m_Language->SpoofCheckByReplying());
+                }
             }
-        }
+        });
     }
 
     m_LastPlayerLeaveTicks = GetTicks();
@@ -1820,8 +1875,16 @@ void CBaseGame::EventPlayerDeleted(CGamePlayer *player)
         SendAllChat(player->GetName() + " " + player->GetLeftReason() + ".");
 
     if (player->GetLagging())
+    {
         SendAll(m_Protocol->SEND_W3GS_STOP_LAG(player));
 
+        // the player stopped lagging by leaving so count the time they lagged for the same as if they'd caught up
+
+        player->AddLaggingTicks(GetTicks() - player->GetStartedLaggingTicks());
+        player->SetLagging(false);
+        player->SetStartedLaggingTicks(0);
+    }
+
     // autosave
 
     if (m_GameLoaded && player->GetLeftCode() == PLAYERLEAVE_DISCONNECT && m_AutoSave)
@@ -1837,6 +1900,7 @@ void CBaseGame::EventPlayerDeleted(CGamePlayer *player)
         // todotodo: with the new latency system there needs to be a way to send a 0-time action
 
         SendAllActions();
+        m_Timers.Schedule(&m_ActionTimer, GetMicroTicks() + m_Latency * 1000);
     }
 
     if (m_GameLoading && m_LoadInGame)
@@ -1910,8 +1974,15 @@ void CBaseGame::EventPlayerDeleted(CGamePlayer *player)
 
     //broadcaster
     if (m_GHost->m_TCPStatus && m_GHost->m_StatusBroadcaster != NULL)
+    {
         //m_GHost->m_StatusBroadcaster->SendNump(m_GHost->GetGame()); // рассылаем количество игроков
-        m_GHost->m_StatusBroadcaster->SendGame(m_GHost->GetGame());
+        RunOnMainThread([this] {
+            // GetGame can return a game in progress so the game threads have to wait while it's read
+
+            CGameThreadLock Lock(m_GHost->m_GameThreads);
+            m_GHost->m_StatusBroadcaster->SendGame(m_GHost->GetGame());
+        });
+    }
 
     for (std::vector<CGamePlayer *>::iterator i = m_Players.begin(); i != m_Players.end(); i++)
     {
@@ -2197,7 +2268,7 @@ void CBaseGame::EventPlayerJoined(CPotentialPlayer *potential, CIncomingJoinPlay
             ApprovedLocations.push_back(m_GHost->m_ApprovedCountries.substr(i, 2));
 
         //Get their location
-        PlayerLocation = m_GHost->m_DBLocal->FromCheck(UTIL_ByteArrayToUInt32(potential->GetExternalIP(), true));
+        PlayerLocation = m_GHost->m_IPToCountry->FromCheck(UTIL_ByteArrayToUInt32(potential->GetExternalIP(), true));
 
         //Kick if not from an allowed location, ignore if their location is approved or cannot be found "??"
         playerIsApproved = false;
@@ -2407,6 +2478,7 @@ void CBaseGame::EventPlayerJoined(CPotentialPlayer *potential, CIncomingJoinPlay
 
     Player->SetWhoisShouldBeSent(m_GHost->m_SpoofChecks == 1 || (m_GHost->m_SpoofChecks == 2 && AnyAdminCheck));
     m_Players.push_back(Player);
+    CapturePlayer(Player);
     potential->SetSocket(NULL);
     potential->SetDeleteMe(true);
 
@@ -2839,6 +2911,7 @@ void CBaseGame::EventPlayerJoinedWithScore(CPotentialPlayer *potential, CIncomin
     Player->SetWhoisShouldBeSent(m_GHost->m_SpoofChecks == 1 || (m_GHost->m_SpoofChecks == 2 && AnyAdminCheck));
     Player->SetScore(score);
     m_Players.push_back(Player);
+    CapturePlayer(Player);
     potential->SetSocket(NULL);
     potential->SetDeleteMe(true);
     m_Slots[SID] = CGameSlot(Player->GetPID(), 255, SLOTSTATUS_OCCUPIED, 0, m_Slots[SID].GetTeam(), m_Slots[SID].GetColour(), m_Slots[SID].GetRace());
@@ -3607,9 +3680,7 @@ void CBaseGame::EventPlayerMapSize(CGamePlayer *player, CIncomingMapSize *mapSiz
 
         if (m_GHost->m_AllowDownloads != 0)
         {
-            std::string *MapData = m_Map->GetMapData();
-
-            if (!MapData->empty())
+            if (m_Map->GetMapDataSize() > 0)
             {
                 if (m_GHost->m_AllowDownloads == 1 || (m_GHost->m_AllowDownloads == 2 && player->GetDownloadAllowed()))
                 {
@@ -3964,6 +4035,7 @@ void CBaseGame::EventGameStarted()
 
         m_Replay->SetSlots(m_Slots);
         m_Replay->SetRandomSeed(m_RandomSeed);
+        m_Replay->SetPartFile(m_GHost->m_ReplayPath + UTIL_FileSafeName("ghost-" + m_GHost->m_RunID + "-" + UTIL_ToString(m_HostCounter) + ".w3g.part"));
         m_Replay->SetSelectMode(m_Map->GetMapLayoutStyle());
         m_Replay->SetStartSpotCount(m_Map->GetMapNumPlayers());
 
@@ -4013,7 +4085,9 @@ void CBaseGame::EventGameStarted()
     m_StatString = std::string(StatString.begin(), StatString.end());
 
     // delete the map data
+    // the download scheduler has to forget our downloaders first since it sends their parts from the map data
 
+    m_GHost->m_DownloadScheduler->RemoveGame(this);
     delete m_Map;
     m_Map = NULL;
 
@@ -4110,8 +4184,15 @@ void CBaseGame::EventGameLoaded()
 
     //broadcaster
     if (m_GHost->m_TCPStatus && m_GHost->m_StatusBroadcaster != NULL)
+    {
         //m_GHost->m_StatusBroadcaster->SendName(m_GHost->GetGame()); // рассылаем новый статус
-        m_GHost->m_StatusBroadcaster->SendGame(m_GHost->GetGame());
+        RunOnMainThread([this] {
+            // GetGame can return a game in progress so the game threads have to wait while it's read
+
+            CGameThreadLock Lock(m_GHost->m_GameThreads);
+            m_GHost->m_StatusBroadcaster->SendGame(m_GHost->GetGame());
+        });
+    }
 
     for (std::vector<CGamePlayer *>::iterator i = m_Players.begin(); i != m_Players.end(); i++)
     {
@@ -4258,6 +4339,17 @@ unsigned char CBaseGame::GetNewPID()
     return 255;
 }
 
+void CBaseGame::CapturePlayer(CGamePlayer *player)
+{
+    // see bot_capture, each game is captured to its own file with a stream for each of its players' connections
+    // this is called again with the new socket when a GProxy++ player reconnects
+
+    if (!player->GetSocket() || !m_GHost->GetCaptureGame(m_GameName) || !m_GHost->GetCapturePlayer(player->GetName()))
+        return;
+
+    player->GetSocket()->SetCapture(m_GHost->m_CapturePath + UTIL_FileSafeName("game-" + m_GHost->m_RunID + "-" + UTIL_ToString(m_HostCounter) + " " + m_GameName + ".ghc"), "W3GS " + player->GetName() + " " + player->GetExternalIPString());
+}
+
 unsigned char CBaseGame::GetNewColour()
 {
     // find an unused colour for a player to use
@@ -5106,6 +5198,34 @@ bool CBaseGame::IsDownloading()
     return false;
 }
 
+uint32_t CBaseGame::SendMapPart(CGamePlayer *player)
+{
+    // send the next map part to a downloader and return its size, or zero if there's nothing left to send
+
+    // the map data is deleted when the game starts
+
+    if (m_GameLoading || m_GameLoaded || !m_Map)
+        return 0;
+
+    CMapData *MapData = m_Map->GetMapData();
+
+    if (!MapData || player->GetLastMapPartSent() >= MapData->GetSize())
+        return 0;
+
+    if (player->GetLastMapPartSent() == 0)
+    {
+        // overwrite the "started download ticks" since this is the first time we've sent any map data to the player
+        // prior to this we've only determined if the player needs to download the map but it's possible we could have delayed sending any data due to download limits
+
+        player->SetStartedDownloadingTicks(GetTicks());
+    }
+
+    uint32_t Size = MapData->GetPartSize(player->GetLastMapPartSent() / MAPPART_SIZE);
+    Send(player, m_Protocol->SEND_W3GS_MAPPART(GetHostPID(), player->GetPID(), player->GetLastMapPartSent(), MapData));
+    player->SetLastMapPartSent(player->GetLastMapPartSent() + MAPPART_SIZE);
+    return Size;
+}
+
 bool CBaseGame::IsGameDataSaved()
 {
     return true;
@@ -5123,6 +5243,7 @@ void CBaseGame::StartCountDown(bool force)
         {
             m_CountDownStarted = true;
             m_CountDownCounter = 5;
+            m_Timers.Schedule(&m_CountDownTimer, GetMicroTicks());
             if (m_GHost->m_UseNormalCountDown)
                 SendAll(m_Protocol->SEND_W3GS_COUNTDOWN_START());
         }
@@ -5205,6 +5326,7 @@ void CBaseGame::StartCountDown(bool force)
             {
                 m_CountDownStarted = true;
                 m_CountDownCounter = 5;
+                m_Timers.Schedule(&m_CountDownTimer, GetMicroTicks());
                 if (m_GHost->m_UseNormalCountDown)
                     SendAll(m_Protocol->SEND_W3GS_COUNTDOWN_START());
             }
@@ -5300,6 +5422,7 @@ void CBaseGame::StartCountDownAuto(bool requireSpoofChecks)
         {
             m_CountDownStarted = true;
             m_CountDownCounter = 15;
+            m_Timers.Schedule(&m_CountDownTimer, GetMicroTicks());
             if (m_GHost->m_UseNormalCountDown)
                 SendAll(m_Protocol->SEND_W3GS_COUNTDOWN_START());
         }
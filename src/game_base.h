@@ -22,6 +22,9 @@
 
 #include "includes.h"
 #include "gameslot.h"
+#include "timerwheel.h"
+
+#include <functional>
 
 //
 // CBaseGame
@@ -43,6 +46,8 @@ class CIncomingMapSize;
 class CCallableScoreCheck;
 class CIncomingGarenaPlayer;
 class CCallableBanRemove;
+class CBaseCallable;
+class CGameThread;
 
 typedef std::pair<std::string, CCallableBanRemove *> PairedBanRemove;
 
@@ -70,7 +75,6 @@ protected:
     std::queue<CIncomingAction *> m_Actions; // std::queue of actions to be sent
     std::vector<std::string> m_Reserved;     // std::vector of player names with reserved slots (from the !hold command)
     std::set<std::string> m_IgnoredNames;    // set of player names to NOT print ban messages for when joining because they've already been printed
-    std::set<std::string> m_IPBlackList;     // set of IP addresses to blacklist from joining (todotodo: convert to uint32's for efficiency)
     std::vector<CGameSlot> m_EnforceSlots;   // std::vector of slots to force players to use (used with saved games)
     std::vector<PIDPlayer> m_EnforcePlayers; // std::vector of pids to force players to use (used with saved games)
     CMap *m_Map;                             // map data
@@ -100,24 +104,19 @@ protected:
     uint32_t m_SyncCounter;                   // the number of actions sent so far (for determining if anyone is lagging)
     uint32_t m_GameTicks;                     // ingame ticks
     uint32_t m_CreationTime;                  // GetTime when the game was created
-    uint32_t m_LastPingTime;                  // GetTime when the last ping was sent
-    uint32_t m_LastRefreshTime;               // GetTime when the last game refresh was sent
-    uint32_t m_LastDownloadTicks;             // GetTicks when the last map download cycle was performed
-    uint32_t m_DownloadCounter;               // # of map bytes downloaded in the last second
-    uint32_t m_LastDownloadCounterResetTicks; // GetTicks when the download counter was last reset
-    uint32_t m_LastAnnounceTime;              // GetTime when the last announce message was sent
+    uint32_t m_LastDownloadCounterResetTicks; // GetTicks when the once per second lobby timer last fired (it used to reset the download counter)
     uint32_t m_AnnounceInterval;              // how many seconds to wait between sending the m_AnnounceMessage
     uint32_t m_LastAutoStartTime;             // the last time we tried to auto start the game
     uint32_t m_LastAuthCheckTime;
     uint32_t m_AutoStartPlayers;       // auto start the game when there are this many players or more
-    uint32_t m_LastCountDownTicks;     // GetTicks when the last countdown message was sent
     uint32_t m_CountDownCounter;       // the countdown is finished when this reaches zero
     uint32_t m_StartedLoadingTicks;    // GetTicks when the game started loading
     uint32_t m_StartPlayers;           // number of players when the game started
     uint32_t m_LastLagScreenResetTime; // GetTime when the "lag" screen was last reset
     uint32_t m_LastActionSentTicks;    // GetTicks when the last action packet was sent
-    uint32_t m_LastActionLateBy;       // the number of ticks we were late sending the last action packet by
     uint32_t m_StartedLaggingTime;     // GetTime when the last lag screen started
+    uint32_t m_StartedLaggingTicks;    // GetTicks when the last lag screen started
+    uint32_t m_LagScreenTicks;         // the total number of ticks the lag screen has been up for (not counting the current lag screen)
     uint32_t m_LastLagScreenTime;      // GetTime when the last lag screen was active (continuously updated)
     uint32_t m_LastReservedSeen;       // GetTime when the last reserved player was seen in the lobby
     uint32_t m_StartedKickVoteTime;    // GetTime when the kick vote was started
@@ -150,6 +149,18 @@ protected:
     // @end
     bool m_UsingStart; // if the game start was initiated by !start or !autostart
 
+    CGameThread *m_Thread; // the game thread updating this game (NULL while it's on the main thread)
+
+    // the game's timers, each update expires the ones that are due in deadline order (see timerwheel.h)
+
+    CTimerWheel m_Timers;
+    CTimer m_ActionTimer;                // send the queued actions every m_Latency ms
+    CTimer m_PingTimer;                  // ping the players and broadcast the game on LAN every 5 seconds
+    CTimer m_RefreshTimer;               // refresh the game on battle.net every 3 seconds
+    CTimer m_AnnounceTimer;              // send the m_AnnounceMessage every m_AnnounceInterval seconds
+    CTimer m_CountDownTimer;             // the next step of the game start countdown
+    CLatenessHistogram m_ActionLateness; // how late the action timer fired, i.e. the jitter of the action packets
+
 public:
     //uint32_t m_PlayersatStart;					// how many players were at game start
 
@@ -169,6 +180,12 @@ public:
     virtual unsigned char GetGameState() { return m_GameState; }
     virtual unsigned char GetGProxyEmptyActions() { return m_GProxyEmptyActions; }
     virtual std::string GetGameName() { return m_GameName; }
+    virtual CMap *GetMap() { return m_Map; }
+    virtual CGameThread *GetThread() { return m_Thread; }
+    virtual CLatenessHistogram *GetActionLateness() { return &m_ActionLateness; }
+    virtual uint32_t GetActionQueueSize() { return m_Actions.size(); }
+    virtual uint32_t GetLatency() { return m_Latency; }
+    virtual uint32_t GetLagScreenTicks() { return m_LagScreenTicks + (m_Lagging ? GetTicks() - m_StartedLaggingTicks : 0); }
     virtual std::string GetLastGameName() { return m_LastGameName; }
     virtual void SetHCL(std::string nHCL) { m_HCLCommandString = nHCL; }
     virtual std::string GetVirtualHostName() { return m_VirtualHostName; }
@@ -203,8 +220,9 @@ public:
     virtual void SetMaximumScore(double nMaximumScore) { m_MaximumScore = nMaximumScore; }
     virtual void SetRefreshError(bool nRefreshError) { m_RefreshError = nRefreshError; }
     virtual void SetMatchMaking(bool nMatchMaking) { m_MatchMaking = nMatchMaking; }
+    virtual void SetThread(CGameThread *nThread) { m_Thread = nThread; }
 
-    virtual uint32_t GetNextTimedActionTicks();
+    virtual uint64_t GetNextTimerMicroTicks();
     virtual uint32_t GetSlotsOccupied();
     virtual uint32_t GetSlotsAllocated();
     virtual uint32_t GetSlotsOpen();
@@ -218,9 +236,36 @@ public:
 
     // processing functions
 
-    virtual unsigned int SetFD(void *fd, void *send_fd, int *nfds);
-    virtual bool Update(void *fd, void *send_fd);
-    virtual void UpdatePost(void *send_fd);
+    virtual bool Update();
+    virtual void UpdatePost();
+
+    // timer events (see m_Timers)
+
+    virtual void EventActionTimer();
+    virtual void EventPingTimer();
+    virtual void EventRefreshTimer();
+    virtual void EventAnnounceTimer();
+    virtual void EventCountDownTimer();
+
+    // game thread functions (see gamethread.h)
+
+    virtual void RunOnMainThread(std::function<void()> message);
+    virtual void RunOnGameThread(std::function<void()> message);
+    virtual void RegisterSockets();
+    virtual void UnregisterSockets();
+    virtual void DeleteCallable(CBaseCallable *callable);
+
+    // database callables have to be created on the main thread (the database's connections aren't thread safe)
+    // create is run on the main thread and the callable it returns is handed to done back on this game's thread
+
+    template <class T>
+    void CreateCallable(std::function<T *()> create, std::function<void(T *)> done)
+    {
+        RunOnMainThread([this, create, done] {
+            T *Callable = create();
+            RunOnGameThread([done, Callable] { done(Callable); });
+        });
+    }
 
     // generic functions to send packets to players
 
@@ -228,6 +273,7 @@ public:
     virtual void Send(unsigned char PID, BYTEARRAY data);
     virtual void Send(BYTEARRAY PIDs, BYTEARRAY data);
     virtual void SendAll(BYTEARRAY data);
+    virtual void SendAll(SHAREDBYTEARRAY data);
 
     // functions to send packets to players
 
@@ -285,6 +331,7 @@ public:
     virtual uint32_t GetPlayerFromNamePartial(std::string name, CGamePlayer **player);
     virtual CGamePlayer *GetPlayerFromColour(unsigned char colour);
     virtual unsigned char GetNewPID();
+    virtual void CapturePlayer(CGamePlayer *player);
     virtual unsigned char GetNewColour();
     virtual BYTEARRAY GetPIDs();
     virtual BYTEARRAY GetPIDs(unsigned char excludePID);
@@ -307,6 +354,7 @@ public:
     virtual bool IsOwner(std::string name);
     virtual bool IsReserved(std::string name);
     virtual bool IsDownloading();
+    virtual uint32_t SendMapPart(CGamePlayer *player);
     virtual bool IsGameDataSaved();
     virtual void SaveGameData();
     virtual void StartCountDown(bool force);
@@ -106,7 +106,7 @@ std::string CPotentialPlayer::GetExternalIPString()
     return std::string();
 }
 
-bool CPotentialPlayer::Update(void *fd)
+bool CPotentialPlayer::Update()
 {
     if (m_DeleteMe)
         return true;
@@ -114,7 +114,7 @@ bool CPotentialPlayer::Update(void *fd)
     if (!m_Socket)
         return false;
 
-    m_Socket->DoRecv((fd_set *)fd);
+    m_Socket->DoRecv();
     ExtractPackets();
     ProcessPackets();
 
@@ -131,43 +131,28 @@ void CPotentialPlayer::ExtractPackets()
 
     // extract as many packets as possible from the socket's receive buffer and put them in the m_Packets std::queue
 
-    std::string *RecvBuffer = m_Socket->GetBytes();
-    BYTEARRAY Bytes         = UTIL_CreateByteArray((unsigned char *)RecvBuffer->c_str(), RecvBuffer->size());
+    static const unsigned char Headers[] = {W3GS_HEADER_CONSTANT, GPS_HEADER_CONSTANT, GCBI_HEADER_CONSTANT};
+    const unsigned char *Data;
+    uint16_t Length;
+    CTCPSocket::FrameResult Result;
 
-    // a packet is at least 4 bytes so loop as long as the buffer contains 4 bytes
-
-    while (Bytes.size() >= 4)
+    while ((Result = m_Socket->FramePacket(Headers, 3, &Data, &Length)) == CTCPSocket::FRAME_COMPLETE)
     {
-        if (Bytes[0] == W3GS_HEADER_CONSTANT || Bytes[0] == GPS_HEADER_CONSTANT || Bytes[0] == GCBI_HEADER_CONSTANT)
-        {
-            // bytes 2 and 3 contain the length of the packet
-
-            uint16_t Length = UTIL_ByteArrayToUInt16(Bytes, false, 2);
+        CCommandPacket *Packet = m_Protocol->m_PacketPool.Get();
+        Packet->Set(Data[0], Data[1], Data, Length);
+        m_Packets.push(Packet);
+        m_Socket->ConsumeBytes(Length);
+    }
 
-            if (Length >= 4)
-            {
-                if (Bytes.size() >= Length)
-                {
-                    m_Packets.push(new CCommandPacket(Bytes[0], Bytes[1], BYTEARRAY(Bytes.begin(), Bytes.begin() + Length)));
-                    *RecvBuffer = RecvBuffer->substr(Length);
-                    Bytes       = BYTEARRAY(Bytes.begin() + Length, Bytes.end());
-                }
-                else
-                    return;
-            }
-            else
-            {
-                m_Error       = true;
-                m_ErrorString = "received invalid packet from player (bad length)";
-                return;
-            }
-        }
-        else
-        {
-            m_Error       = true;
-            m_ErrorString = "received invalid packet from player (bad header constant)";
-            return;
-        }
+    if (Result == CTCPSocket::FRAME_BADLENGTH)
+    {
+        m_Error       = true;
+        m_ErrorString = "received invalid packet from player (bad length)";
+    }
+    else if (Result == CTCPSocket::FRAME_BADHEADER)
+    {
+        m_Error       = true;
+        m_ErrorString = "received invalid packet from player (bad header constant)";
     }
 }
 
@@ -200,7 +185,7 @@ void CPotentialPlayer::ProcessPackets()
                 // EventPlayerJoined creates the new player, NULLs the socket, and sets the delete flag on this object so it'll be deleted shortly
                 // any unprocessed packets will be copied to the new CGamePlayer in the constructor or discarded if we get deleted because the game is full
 
-                delete Packet;
+                m_Protocol->m_PacketPool.Release(Packet);
                 return;
             }
         }
@@ -215,7 +200,7 @@ void CPotentialPlayer::ProcessPackets()
             }
         }
 
-        delete Packet;
+        m_Protocol->m_PacketPool.Release(Packet);
     }
 }
 
@@ -225,6 +210,12 @@ void CPotentialPlayer::Send(BYTEARRAY data)
         m_Socket->PutBytes(data);
 }
 
+void CPotentialPlayer::Send(SHAREDBYTEARRAY data)
+{
+    if (m_Socket)
+        m_Socket->PutBytes(data);
+}
+
 //
 // CGamePlayer
 //
@@ -248,6 +239,7 @@ CGamePlayer::CGamePlayer(CGameProtocol *nProtocol, CBaseGame *nGame, CTCPSocket
     m_FinishedDownloadingTime      = 0;
     m_FinishedLoadingTicks         = 0;
     m_StartedLaggingTicks          = 0;
+    m_LaggingTicks                 = 0;
     m_StatsSentTime                = 0;
     m_StatsDotASentTime            = 0;
     m_LastGProxyWaitNoticeSentTime = 0;
@@ -301,6 +293,7 @@ CGamePlayer::CGamePlayer(CPotentialPlayer *potential, unsigned char nPID, std::s
     m_FinishedDownloadingTime      = 0;
     m_FinishedLoadingTicks         = 0;
     m_StartedLaggingTicks          = 0;
+    m_LaggingTicks                 = 0;
     m_StatsSentTime                = 0;
     m_StatsDotASentTime            = 0;
     m_LastGProxyWaitNoticeSentTime = 0;
@@ -365,7 +358,17 @@ uint32_t CGamePlayer::GetPing(bool LCPing)
         return AvgPing;
 }
 
-bool CGamePlayer::Update(void *fd)
+uint32_t CGamePlayer::GetMinPing()
+{
+    // the lowest recent ping (not divided by two for LC style pings)
+
+    if (m_Pings.empty())
+        return 0;
+
+    return *std::min_element(m_Pings.begin(), m_Pings.end());
+}
+
+bool CGamePlayer::Update()
 {
     // wait 4 seconds after joining before sending the /whois or /w
     // if we send the /whois too early battle.net may not have caught up with where the player is and return erroneous results
@@ -374,21 +377,28 @@ bool CGamePlayer::Update(void *fd)
     {
         // todotodo: we could get kicked from battle.net for sending a command with invalid characters, do some basic checking
 
-        for (std::vector<CBNET *>::iterator i = m_Game->m_GHost->m_BNETs.begin(); i != m_Game->m_GHost->m_BNETs.end(); i++)
-        {
-            if ((*i)->GetServer() == m_JoinedRealm)
+        CGHost *GHost           = m_Game->m_GHost;
+        std::string JoinedRealm = m_JoinedRealm;
+        std::string Name        = m_Name;
+        unsigned char GameState = m_Game->GetGameState();
+
+        m_Game->RunOnMainThread([GHost, JoinedRealm, Name, GameState] {
+            for (std::vector<CBNET *>::iterator i = GHost->m_BNETs.begin(); i != GHost->m_BNETs.end(); i++)
             {
-                if (m_Game->GetGameState() == GAME_PUBLIC)
+                if ((*i)->GetServer() == JoinedRealm)
                 {
-                    if ((*i)->GetPasswordHashType() == "pvpgn")
-                        (*i)->QueueChatCommand("/whereis " + m_Name);
-                    else
-                        (*i)->QueueChatCommand("/whois " + m_Name);
+                    if (GameState == GAME_PUBLIC)
+                    {
+                        if ((*i)->GetPasswordHashType() == "pvpgn")
+                            (*i)->QueueChatCommand("/whereis " + Name);
+                        else
+                            (*i)->QueueChatCommand("/whois " + Name);
+                    }
+                    else if (GameState == GAME_PRIVATE)
+                        (*i)->QueueChatCommand(GHost->m_Language->SpoofCheckByReplying(), Name, true, false);
                 }
-                else if (m_Game->GetGameState() == GAME_PRIVATE)
-                    (*i)->QueueChatCommand(m_Game->m_GHost->m_Language->SpoofCheckByReplying(), m_Name, true, false);
             }
-        }
+        });
 
         m_WhoisSent = true;
     }
@@ -413,7 +423,7 @@ bool CGamePlayer::Update(void *fd)
 
     // base class update
 
-    CPotentialPlayer::Update(fd);
+    CPotentialPlayer::Update();
     bool Deleting;
 
     if (m_GProxy && m_Game->GetGameLoaded())
@@ -446,47 +456,32 @@ void CGamePlayer::ExtractPackets()
 
     // extract as many packets as possible from the socket's receive buffer and put them in the m_Packets std::queue
 
-    std::string *RecvBuffer = m_Socket->GetBytes();
-    BYTEARRAY Bytes         = UTIL_CreateByteArray((unsigned char *)RecvBuffer->c_str(), RecvBuffer->size());
-
-    // a packet is at least 4 bytes so loop as long as the buffer contains 4 bytes
+    static const unsigned char Headers[] = {W3GS_HEADER_CONSTANT, GPS_HEADER_CONSTANT, GCBI_HEADER_CONSTANT};
+    const unsigned char *Data;
+    uint16_t Length;
+    CTCPSocket::FrameResult Result;
 
-    while (Bytes.size() >= 4)
+    while ((Result = m_Socket->FramePacket(Headers, 3, &Data, &Length)) == CTCPSocket::FRAME_COMPLETE)
     {
-        if (Bytes[0] == W3GS_HEADER_CONSTANT || Bytes[0] == GPS_HEADER_CONSTANT || Bytes[0] == GCBI_HEADER_CONSTANT)
-        {
-            // bytes 2 and 3 contain the length of the packet
-
-            uint16_t Length = UTIL_ByteArrayToUInt16(Bytes, false, 2);
+        CCommandPacket *Packet = m_Protocol->m_PacketPool.Get();
+        Packet->Set(Data[0], Data[1], Data, Length);
+        m_Packets.push(Packet);
 
-            if (Length >= 4)
-            {
-                if (Bytes.size() >= Length)
-                {
-                    m_Packets.push(new CCommandPacket(Bytes[0], Bytes[1], BYTEARRAY(Bytes.begin(), Bytes.begin() + Length)));
+        if (Data[0] == W3GS_HEADER_CONSTANT)
+            m_TotalPacketsReceived++;
 
-                    if (Bytes[0] == W3GS_HEADER_CONSTANT)
-                        m_TotalPacketsReceived++;
+        m_Socket->ConsumeBytes(Length);
+    }
 
-                    *RecvBuffer = RecvBuffer->substr(Length);
-                    Bytes       = BYTEARRAY(Bytes.begin() + Length, Bytes.end());
-                }
-                else
-                    return;
-            }
-            else
-            {
-                m_Error       = true;
-                m_ErrorString = "received invalid packet from player (bad length)";
-                return;
-            }
-        }
-        else
-        {
-            m_Error       = true;
-            m_ErrorString = "received invalid packet from player (bad header constant)";
-            return;
-        }
+    if (Result == CTCPSocket::FRAME_BADLENGTH)
+    {
+        m_Error       = true;
+        m_ErrorString = "received invalid packet from player (bad length)";
+    }
+    else if (Result == CTCPSocket::FRAME_BADHEADER)
+    {
+        m_Error       = true;
+        m_ErrorString = "received invalid packet from player (bad header constant)";
     }
 }
 
@@ -540,7 +535,7 @@ void CGamePlayer::ProcessPackets()
                 if (Action)
                     m_Game->EventPlayerAction(this, Action);
 
-                // don't delete Action here because the game is going to store it in a std::queue and delete it later
+                // don't delete Action here because the game is going to store it in a std::queue and release it back to the pool later
 
                 break;
 
@@ -660,11 +655,16 @@ void CGamePlayer::ProcessPackets()
             }
         }
 
-        delete Packet;
+        m_Protocol->m_PacketPool.Release(Packet);
     }
 }
 
 void CGamePlayer::Send(BYTEARRAY data)
+{
+    Send(std::make_shared<const BYTEARRAY>(std::move(data)));
+}
+
+void CGamePlayer::Send(SHAREDBYTEARRAY data)
 {
     // must start counting packet total from beginning of connection
     // but we can avoid buffering packets until we know the client is using GProxy++ since that'll be determined before the game starts
@@ -682,6 +682,7 @@ void CGamePlayer::EventGProxyReconnect(CTCPSocket *NewSocket, uint32_t LastPacke
 {
     delete m_Socket;
     m_Socket = NewSocket;
+    m_Game->CapturePlayer(this);
     m_Socket->PutBytes(m_Game->m_GHost->m_GPSProtocol->SEND_GPSS_RECONNECT(m_TotalPacketsReceived));
 
     uint32_t PacketsAlreadyUnqueued = m_TotalPacketsSent - m_GProxyBuffer.size();
@@ -702,7 +703,7 @@ void CGamePlayer::EventGProxyReconnect(CTCPSocket *NewSocket, uint32_t LastPacke
 
     // send remaining packets from buffer, preserve buffer
 
-    std::queue<BYTEARRAY> TempBuffer;
+    std::queue<SHAREDBYTEARRAY> TempBuffer;
 
     while (!m_GProxyBuffer.empty())
     {
@@ -21,6 +21,7 @@
 #pragma once
 
 #include "includes.h"
+#include "downloadscheduler.h"
 
 class CTCPSocket;
 class CCommandPacket;
@@ -73,13 +74,14 @@ public:
 
     // processing functions
 
-    virtual bool Update(void *fd);
+    virtual bool Update();
     virtual void ExtractPackets();
     virtual void ProcessPackets();
 
     // other functions
 
     virtual void Send(BYTEARRAY data);
+    virtual void Send(SHAREDBYTEARRAY data);
 };
 
 //
@@ -109,6 +111,7 @@ private:
     uint32_t m_FinishedDownloadingTime; // GetTime when the player finished downloading the map
     uint32_t m_FinishedLoadingTicks;    // GetTicks when the player finished loading the game
     uint32_t m_StartedLaggingTicks;     // GetTicks when the player started lagging
+    uint32_t m_LaggingTicks;            // the total number of ticks the player has lagged for (not counting the current lag screen)
     uint32_t m_StatsSentTime;           // GetTime when we sent this player's stats to the chat (to prevent players from spamming !stats)
     uint32_t m_StatsDotASentTime;       // GetTime when we sent this player's dota stats to the chat (to prevent players from spamming !statsdota)
     uint32_t m_LastGProxyWaitNoticeSentTime;
@@ -131,9 +134,10 @@ private:
     bool m_LeftMessageSent;            // if the playerleave message has been sent or not
     bool m_GProxy;                     // if the player is using GProxy++
     bool m_GProxyDisconnectNoticeSent; // if a disconnection notice has been sent or not when using GProxy++
-    std::queue<BYTEARRAY> m_GProxyBuffer;
+    std::queue<SHAREDBYTEARRAY> m_GProxyBuffer;
     uint32_t m_GProxyReconnectKey;
     uint32_t m_LastGProxyAckTime;
+    DownloadState m_DownloadState; // the map download scheduler's state for this player
 
 public:
     CGamePlayer(CGameProtocol *nProtocol, CBaseGame *nGame, CTCPSocket *nSocket, unsigned char nPID, std::string nJoinedRealm, std::string nName, BYTEARRAY nInternalIP, bool nReserved);
@@ -146,6 +150,7 @@ public:
 
     BYTEARRAY GetInternalIP() { return m_InternalIP; }
     unsigned int GetNumPings() { return m_Pings.size(); }
+    std::vector<uint32_t> GetPings() { return m_Pings; }
     unsigned int GetNumCheckSums() { return m_CheckSums.size(); }
     std::queue<uint32_t> *GetCheckSums() { return &m_CheckSums; }
     std::string GetLeftReason() { return m_LeftReason; }
@@ -157,10 +162,12 @@ public:
     uint32_t GetJoinTime() { return m_JoinTime; }
     uint32_t GetLastMapPartSent() { return m_LastMapPartSent; }
     uint32_t GetLastMapPartAcked() { return m_LastMapPartAcked; }
+    DownloadState *GetDownloadState() { return &m_DownloadState; }
     uint32_t GetStartedDownloadingTicks() { return m_StartedDownloadingTicks; }
     uint32_t GetFinishedDownloadingTime() { return m_FinishedDownloadingTime; }
     uint32_t GetFinishedLoadingTicks() { return m_FinishedLoadingTicks; }
     uint32_t GetStartedLaggingTicks() { return m_StartedLaggingTicks; }
+    uint32_t GetLaggingTicks() { return m_LaggingTicks + (m_Lagging ? GetTicks() - m_StartedLaggingTicks : 0); }
     uint32_t GetStatsSentTime() { return m_StatsSentTime; }
     uint32_t GetStatsDotASentTime() { return m_StatsDotASentTime; }
     uint32_t GetLastGProxyWaitNoticeSentTime() { return m_LastGProxyWaitNoticeSentTime; }
@@ -195,6 +202,7 @@ public:
     void SetStartedDownloadingTicks(uint32_t nStartedDownloadingTicks) { m_StartedDownloadingTicks = nStartedDownloadingTicks; }
     void SetFinishedDownloadingTime(uint32_t nFinishedDownloadingTime) { m_FinishedDownloadingTime = nFinishedDownloadingTime; }
     void SetStartedLaggingTicks(uint32_t nStartedLaggingTicks) { m_StartedLaggingTicks = nStartedLaggingTicks; }
+    void AddLaggingTicks(uint32_t nLaggingTicks) { m_LaggingTicks += nLaggingTicks; }
     void SetStatsSentTime(uint32_t nStatsSentTime) { m_StatsSentTime = nStatsSentTime; }
     void SetStatsDotASentTime(uint32_t nStatsDotASentTime) { m_StatsDotASentTime = nStatsDotASentTime; }
     void SetLastGProxyWaitNoticeSentTime(uint32_t nLastGProxyWaitNoticeSentTime) { m_LastGProxyWaitNoticeSentTime = nLastGProxyWaitNoticeSentTime; }
@@ -216,17 +224,19 @@ public:
 
     std::string GetNameTerminated();
     uint32_t GetPing(bool LCPing);
+    uint32_t GetMinPing();
 
     void AddLoadInGameData(BYTEARRAY nLoadInGameData) { m_LoadInGameData.push(nLoadInGameData); }
 
     // processing functions
 
-    virtual bool Update(void *fd);
+    virtual bool Update();
     virtual void ExtractPackets();
     virtual void ProcessPackets();
 
     // other functions
 
     virtual void Send(BYTEARRAY data);
+    virtual void Send(SHAREDBYTEARRAY data);
     virtual void EventGProxyReconnect(CTCPSocket *NewSocket, uint32_t LastPacket);
 };
@@ -19,10 +19,12 @@
 */
 
 #include "gameprotocol.h"
+#include "commandpacket.h"
 #include "crc32.h"
 #include "game_base.h"
 #include "gameplayer.h"
 #include "ghost.h"
+#include "mapdata.h"
 #include "util.h"
 
 //
@@ -104,7 +106,7 @@ bool CGameProtocol::RECEIVE_W3GS_GAMELOADED_SELF(BYTEARRAY data)
     return false;
 }
 
-CIncomingAction *CGameProtocol::RECEIVE_W3GS_OUTGOING_ACTION(BYTEARRAY data, unsigned char PID)
+CIncomingAction *CGameProtocol::RECEIVE_W3GS_OUTGOING_ACTION(BYTEARRAY &data, unsigned char PID)
 {
     // DEBUG_Print( "RECEIVED W3GS_OUTGOING_ACTION" );
     // DEBUG_Print( data );
@@ -116,9 +118,9 @@ CIncomingAction *CGameProtocol::RECEIVE_W3GS_OUTGOING_ACTION(BYTEARRAY data, uns
 
     if (PID != 255 && ValidateLength(data) && data.size() >= 8)
     {
-        BYTEARRAY CRC    = BYTEARRAY(data.begin() + 4, data.begin() + 8);
-        BYTEARRAY Action = BYTEARRAY(data.begin() + 8, data.end());
-        return new CIncomingAction(PID, CRC, Action);
+        CIncomingAction *Action = m_ActionPool.Get();
+        Action->Set(PID, data.data() + 4, 4, data.data() + 8, data.size() - 8);
+        return Action;
     }
 
     return NULL;
@@ -507,7 +509,7 @@ BYTEARRAY CGameProtocol::SEND_W3GS_INCOMING_ACTION(std::queue<CIncomingAction *>
 
         // calculate crc (we only care about the first 2 bytes though)
 
-        BYTEARRAY crc32 = UTIL_CreateByteArray(m_GHost->m_CRC->FullCRC((unsigned char *)std::string(subpacket.begin(), subpacket.end()).c_str(), subpacket.size()), false);
+        BYTEARRAY crc32 = UTIL_CreateByteArray(m_GHost->m_CRC->FullCRC(subpacket.data(), subpacket.size()), false);
         crc32.resize(2);
 
         // finish subpacket
@@ -817,39 +819,29 @@ BYTEARRAY CGameProtocol::SEND_W3GS_STARTDOWNLOAD(unsigned char fromPID)
     return packet;
 }
 
-BYTEARRAY CGameProtocol::SEND_W3GS_MAPPART(unsigned char fromPID, unsigned char toPID, uint32_t start, std::string *mapData)
+BYTEARRAY CGameProtocol::SEND_W3GS_MAPPART(unsigned char fromPID, unsigned char toPID, uint32_t start, CMapData *mapData)
 {
-    unsigned char Unknown[] = {1, 0, 0, 0};
-
     BYTEARRAY packet;
 
-    if (start < mapData->size())
-    {
-        packet.push_back(W3GS_HEADER_CONSTANT);     // W3GS header constant
-        packet.push_back(W3GS_MAPPART);             // W3GS_MAPPART
-        packet.push_back(0);                        // packet length will be assigned later
-        packet.push_back(0);                        // packet length will be assigned later
-        packet.push_back(toPID);                    // to PID
-        packet.push_back(fromPID);                  // from PID
-        UTIL_AppendByteArray(packet, Unknown, 4);   // ???
-        UTIL_AppendByteArray(packet, start, false); // start position
-
-        // calculate end position (don't send more than 1442 map bytes in one packet)
-
-        uint32_t End = start + 1442;
-
-        if (End > mapData->size())
-            End = mapData->size();
+    // the part's crc comes from the map data's shared crc table so we only have to fill in the header and copy the part itself
 
-        // calculate crc
-
-        BYTEARRAY crc32 = UTIL_CreateByteArray(m_GHost->m_CRC->FullCRC((unsigned char *)mapData->c_str() + start, End - start), false);
-        UTIL_AppendByteArrayFast(packet, crc32);
-
-        // map data
+    if (mapData && start < mapData->GetSize() && start % MAPPART_SIZE == 0)
+    {
+        uint32_t Part           = start / MAPPART_SIZE;
+        uint32_t PartSize       = mapData->GetPartSize(Part);
+        unsigned char Unknown[] = {1, 0, 0, 0};
 
-        BYTEARRAY Data = UTIL_CreateByteArray((unsigned char *)mapData->c_str() + start, End - start);
-        UTIL_AppendByteArrayFast(packet, Data);
+        packet.reserve(18 + PartSize);
+        packet.push_back(W3GS_HEADER_CONSTANT);                         // W3GS header constant
+        packet.push_back(W3GS_MAPPART);                                 // W3GS_MAPPART
+        packet.push_back(0);                                            // packet length will be assigned later
+        packet.push_back(0);                                            // packet length will be assigned later
+        packet.push_back(toPID);                                        // to PID
+        packet.push_back(fromPID);                                      // from PID
+        UTIL_AppendByteArray(packet, Unknown, 4);                       // ???
+        UTIL_AppendByteArray(packet, start, false);                     // start position
+        UTIL_AppendByteArray(packet, mapData->GetPartCRC(Part), false); // crc
+        packet.insert(packet.end(), mapData->GetPart(Part), mapData->GetPart(Part) + PartSize);
         AssignLength(packet);
     }
     else
@@ -887,7 +879,7 @@ BYTEARRAY CGameProtocol::SEND_W3GS_INCOMING_ACTION2(std::queue<CIncomingAction *
 
         // calculate crc (we only care about the first 2 bytes though)
 
-        BYTEARRAY crc32 = UTIL_CreateByteArray(m_GHost->m_CRC->FullCRC((unsigned char *)std::string(subpacket.begin(), subpacket.end()).c_str(), subpacket.size()), false);
+        BYTEARRAY crc32 = UTIL_CreateByteArray(m_GHost->m_CRC->FullCRC(subpacket.data(), subpacket.size()), false);
         crc32.resize(2);
 
         // finish subpacket
@@ -976,6 +968,11 @@ CIncomingJoinPlayer::~CIncomingJoinPlayer()
 // CIncomingAction
 //
 
+CIncomingAction::CIncomingAction()
+{
+    m_PID = 0;
+}
+
 CIncomingAction::CIncomingAction(unsigned char nPID, BYTEARRAY &nCRC, BYTEARRAY &nAction)
 {
     m_PID    = nPID;
@@ -987,6 +984,26 @@ CIncomingAction::~CIncomingAction()
 {
 }
 
+void CIncomingAction::Set(unsigned char nPID, const unsigned char *nCRC, uint32_t nCRCLength, const unsigned char *nAction, uint32_t nActionLength)
+{
+    // assign reuses the buffers' capacity when this action came from a CPacketPool
+
+    m_PID = nPID;
+    m_CRC.assign(nCRC, nCRC + nCRCLength);
+    m_Action.assign(nAction, nAction + nActionLength);
+}
+
+void CIncomingAction::Clear()
+{
+    m_PID = 0;
+    m_CRC.clear();
+
+    if (m_Action.capacity() > PACKETPOOL_MAX_CAPACITY)
+        BYTEARRAY().swap(m_Action);
+    else
+        m_Action.clear();
+}
+
 //
 // CIncomingChatPlayer
 //
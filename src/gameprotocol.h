@@ -50,13 +50,16 @@
 #define REJECTJOIN_WRONGPASSWORD 27
 
 #include "gameslot.h"
+#include "packetpool.h"
 
 class CGHost;
+class CCommandPacket;
 class CGamePlayer;
 class CIncomingJoinPlayer;
 class CIncomingAction;
 class CIncomingChatPlayer;
 class CIncomingMapSize;
+class CMapData;
 
 class CGameProtocol
 {
@@ -104,6 +107,12 @@ public:
         W3GS_INCOMING_ACTION2   = 72  // 0x48 - received this packet when there are too many actions to fit in W3GS_INCOMING_ACTION
     };
 
+    // every game has its own protocol so the pools here are per game too
+    // received packets and actions are taken from them and released back once the game is done with them
+
+    CPacketPool<CCommandPacket> m_PacketPool;
+    CPacketPool<CIncomingAction> m_ActionPool;
+
     CGameProtocol(CGHost *nGHost);
     ~CGameProtocol();
 
@@ -112,7 +121,7 @@ public:
     CIncomingJoinPlayer *RECEIVE_W3GS_REQJOIN(BYTEARRAY data);
     uint32_t RECEIVE_W3GS_LEAVEGAME(BYTEARRAY data);
     bool RECEIVE_W3GS_GAMELOADED_SELF(BYTEARRAY data);
-    CIncomingAction *RECEIVE_W3GS_OUTGOING_ACTION(BYTEARRAY data, unsigned char PID);
+    CIncomingAction *RECEIVE_W3GS_OUTGOING_ACTION(BYTEARRAY &data, unsigned char PID);
     uint32_t RECEIVE_W3GS_OUTGOING_KEEPALIVE(BYTEARRAY data);
     CIncomingChatPlayer *RECEIVE_W3GS_CHAT_TO_HOST(BYTEARRAY data);
     bool RECEIVE_W3GS_SEARCHGAME(BYTEARRAY data, unsigned char war3Version);
@@ -142,7 +151,7 @@ public:
     BYTEARRAY SEND_W3GS_DECREATEGAME();
     BYTEARRAY SEND_W3GS_MAPCHECK(std::string mapPath, BYTEARRAY mapSize, BYTEARRAY mapInfo, BYTEARRAY mapCRC, BYTEARRAY mapSHA1);
     BYTEARRAY SEND_W3GS_STARTDOWNLOAD(unsigned char fromPID);
-    BYTEARRAY SEND_W3GS_MAPPART(unsigned char fromPID, unsigned char toPID, uint32_t start, std::string *mapData);
+    BYTEARRAY SEND_W3GS_MAPPART(unsigned char fromPID, unsigned char toPID, uint32_t start, CMapData *mapData);
     BYTEARRAY SEND_W3GS_INCOMING_ACTION2(std::queue<CIncomingAction *> actions);
 
     // other functions
@@ -185,6 +194,7 @@ private:
     BYTEARRAY m_Action;
 
 public:
+    CIncomingAction();
     CIncomingAction(unsigned char nPID, BYTEARRAY &nCRC, BYTEARRAY &nAction);
     ~CIncomingAction();
 
@@ -192,6 +202,9 @@ public:
     BYTEARRAY GetCRC() { return m_CRC; }
     BYTEARRAY *GetAction() { return &m_Action; }
     uint32_t GetLength() { return m_Action.size() + 3; }
+
+    void Set(unsigned char nPID, const unsigned char *nCRC, uint32_t nCRCLength, const unsigned char *nAction, uint32_t nActionLength);
+    void Clear();
 };
 
 //
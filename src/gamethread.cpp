@@ -0,0 +1,291 @@
+#include "gamethread.h"
+#include "game_base.h"
+#include "ghost.h"
+#include "socket.h"
+#include "util.h"
+
+//
+// CGameThread
+//
+
+CGameThread::CGameThread(CGHost *nGHost, CGameThreadPool *nPool, uint32_t nID)
+{
+    m_GHost    = nGHost;
+    m_Pool     = nPool;
+    m_ID       = nID;
+    m_NumGames = 0;
+    m_Exiting  = false;
+    m_Thread   = std::thread(&CGameThread::Run, this);
+}
+
+CGameThread::~CGameThread()
+{
+    Stop();
+}
+
+void CGameThread::QueueMessage(std::function<void()> message)
+{
+    std::lock_guard<std::mutex> Lock(m_MessagesMutex);
+    m_Messages.push_back(message);
+}
+
+void CGameThread::AddGame(CBaseGame *game)
+{
+    // main thread: the game's sockets are moved from the main thread's reactor to ours
+
+    m_NumGames++;
+    game->UnregisterSockets();
+    game->SetThread(this);
+
+    QueueMessage([this, game] {
+        game->RegisterSockets();
+        m_Games.push_back(game);
+    });
+}
+
+std::vector<CBaseGame *> CGameThread::Stop()
+{
+    // main thread: stop the thread and take back its games (their sockets have already been unregistered)
+
+    if (m_Thread.joinable())
+    {
+        m_Exiting = true;
+        m_Thread.join();
+    }
+
+    std::vector<CBaseGame *> Games = m_Games;
+    Games.insert(Games.end(), m_Finished.begin(), m_Finished.end());
+    m_Games.clear();
+    m_Finished.clear();
+    m_NumGames = 0;
+    return Games;
+}
+
+void CGameThread::Run()
+{
+    while (!m_Exiting)
+    {
+        // block until the next game needs to send its actions just like the main loop does
+
+        uint32_t usecBlock = 50000;
+        uint64_t Now       = GetMicroTicks();
+
+        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
+        {
+            uint64_t NextTimer = (*i)->GetNextTimerMicroTicks();
+
+            if (NextTimer <= Now)
+                usecBlock = 0;
+            else if (NextTimer - Now < usecBlock)
+                usecBlock = NextTimer - Now;
+        }
+
+        if (usecBlock < 100)
+            usecBlock = 100;
+
+        CSocketReactor *Reactor = CSocketReactor::Get();
+
+        if (Reactor->GetNumSockets() == 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(usecBlock));
+        else
+            Reactor->Wait(usecBlock);
+
+        m_Pool->LockShared();
+        RunMessages();
+
+        // update the games
+
+        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end();)
+        {
+            if ((*i)->Update())
+            {
+                EventGameOver(*i);
+                i = m_Games.erase(i);
+            }
+            else
+            {
+                (*i)->UpdatePost();
+                i++;
+            }
+        }
+
+        m_Pool->UnlockShared();
+    }
+
+    // the main thread might have just handed us a game or released one so run any messages that are left
+    // the reactor belongs to this thread so it's about to be destroyed, the main thread will delete the games
+
+    m_Pool->LockShared();
+    RunMessages();
+    m_Pool->UnlockShared();
+
+    for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
+        (*i)->UnregisterSockets();
+
+    for (std::vector<CBaseGame *>::iterator i = m_Finished.begin(); i != m_Finished.end(); i++)
+        (*i)->UnregisterSockets();
+}
+
+void CGameThread::RunMessages()
+{
+    // game thread: run the messages from the main thread
+
+    std::vector<std::function<void()>> Messages;
+
+    {
+        std::lock_guard<std::mutex> Lock(m_MessagesMutex);
+        Messages.swap(m_Messages);
+    }
+
+    for (std::vector<std::function<void()>>::iterator i = Messages.begin(); i != Messages.end(); i++)
+        (*i)();
+}
+
+void CGameThread::EventGameOver(CBaseGame *game)
+{
+    // game thread: the game's over but the main thread might still have messages for it in flight (e.g. a database callable it asked for)
+    // so we keep it around until the main thread has removed it from its games list (which means it won't queue anything else for it) and tells us to let it go
+
+    m_Finished.push_back(game);
+
+    m_GHost->QueueMessage([this, game] {
+        m_GHost->m_Games.erase(std::remove(m_GHost->m_Games.begin(), m_GHost->m_Games.end(), game), m_GHost->m_Games.end());
+        QueueMessage(std::bind(&CGameThread::ReleaseGame, this, game));
+    });
+}
+
+void CGameThread::ReleaseGame(CBaseGame *game)
+{
+    // game thread: any message the main thread sent the game has been run by now so it can be deleted
+
+    game->UnregisterSockets();
+    m_Finished.erase(std::remove(m_Finished.begin(), m_Finished.end(), game), m_Finished.end());
+    m_NumGames--;
+    m_GHost->QueueMessage(std::bind(&CGameThread::EventGameReleased, this, game));
+}
+
+void CGameThread::EventGameReleased(CBaseGame *game)
+{
+    // main thread
+
+    CONSOLE_Print("[GHOST] deleting game [" + game->GetGameName() + "] from game thread " + UTIL_ToString(m_ID));
+    m_GHost->EventGameDeleted(game);
+    delete game;
+}
+
+//
+// CGameThreadPool
+//
+
+CGameThreadPool::CGameThreadPool(CGHost *nGHost, uint32_t numThreads)
+{
+    m_Readers   = 0;
+    m_Writer    = false;
+    m_LockDepth = 0;
+
+    for (uint32_t i = 0; i < numThreads; i++)
+        m_Threads.push_back(new CGameThread(nGHost, this, i + 1));
+
+    CONSOLE_Print("[GHOST] running games in progress on " + UTIL_ToString(numThreads) + " game threads");
+}
+
+CGameThreadPool::~CGameThreadPool()
+{
+    Stop();
+
+    for (std::vector<CGameThread *>::iterator i = m_Threads.begin(); i != m_Threads.end(); i++)
+        delete *i;
+}
+
+void CGameThreadPool::AddGame(CBaseGame *game)
+{
+    CGameThread *Thread = NULL;
+
+    for (std::vector<CGameThread *>::iterator i = m_Threads.begin(); i != m_Threads.end(); i++)
+    {
+        if (!Thread || (*i)->GetNumGames() < Thread->GetNumGames())
+            Thread = *i;
+    }
+
+    if (Thread)
+    {
+        CONSOLE_Print("[GAME: " + game->GetGameName() + "] moving to game thread " + UTIL_ToString(Thread->GetID()));
+        Thread->AddGame(game);
+    }
+}
+
+std::vector<CBaseGame *> CGameThreadPool::Stop()
+{
+    std::vector<CBaseGame *> Games;
+
+    for (std::vector<CGameThread *>::iterator i = m_Threads.begin(); i != m_Threads.end(); i++)
+    {
+        std::vector<CBaseGame *> ThreadGames = (*i)->Stop();
+        Games.insert(Games.end(), ThreadGames.begin(), ThreadGames.end());
+    }
+
+    return Games;
+}
+
+void CGameThreadPool::Lock()
+{
+    if (m_LockDepth++ > 0)
+        return;
+
+    // stop the game threads taking the lock again and wait for the ones holding it to finish their updates
+
+    std::unique_lock<std::mutex> Lock(m_Mutex);
+    m_Writer = true;
+    m_Condition.wait(Lock, [this] { return m_Readers == 0; });
+}
+
+void CGameThreadPool::Unlock()
+{
+    if (--m_LockDepth > 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_Writer = false;
+    }
+
+    m_Condition.notify_all();
+}
+
+void CGameThreadPool::LockShared()
+{
+    std::unique_lock<std::mutex> Lock(m_Mutex);
+    m_Condition.wait(Lock, [this] { return !m_Writer; });
+    m_Readers++;
+}
+
+void CGameThreadPool::UnlockShared()
+{
+    bool Notify;
+
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        Notify = --m_Readers == 0 && m_Writer;
+    }
+
+    if (Notify)
+        m_Condition.notify_all();
+}
+
+//
+// CGameThreadLock
+//
+
+CGameThreadLock::CGameThreadLock(CGameThreadPool *nPool)
+{
+    m_Pool = nPool;
+
+    if (m_Pool)
+        m_Pool->Lock();
+}
+
+CGameThreadLock::~CGameThreadLock()
+{
+    if (m_Pool)
+        m_Pool->Unlock();
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "includes.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+//
+// CGameThread
+//
+
+// runs games in progress on a pool of worker threads so one slow game (a desync, a big burst of actions, etc...) doesn't delay every other game's action ticks
+// a game is handed to the least busy thread once it starts loading and stays there until it's over, the lobby and the admin game always run on the main thread
+// each thread has its own socket reactor and only waits on the sockets of its own games
+// the game threads never change anything owned by the main thread (battle.net connections, the database, the game lists, etc...)
+// instead a game queues a message with CBaseGame::RunOnMainThread and the main thread runs it at the start of its next update
+// the main thread sends messages back the same way with CBaseGame::RunOnGameThread (e.g. to hand over a database callable or a GProxy++ reconnect, or to chat in a game)
+// what the games read from the main thread is either fixed while they run (the battle.net connections, the root admins, the config values between reloads, etc...)
+// or a snapshot that's replaced instead of changed (the admin lists, see CBNET::IsAdmin), the ban lists are only checked when a player joins the lobby
+// the game threads hold the pool's lock (shared) while they update their games and the main thread only takes it (exclusively) for the few things that can't be done like that:
+// reading a running game's state (!getgame, !end, the status broadcaster, the metrics, etc...), reloading the config and language file and deleting the battle.net connections
+
+class CGHost;
+class CBaseGame;
+class CGameThreadPool;
+
+class CGameThread
+{
+private:
+    CGHost *m_GHost;
+    CGameThreadPool *m_Pool;
+    uint32_t m_ID;
+    std::thread m_Thread;
+    std::mutex m_MessagesMutex;                    // protects m_Messages
+    std::vector<std::function<void()>> m_Messages; // messages from the main thread waiting to be run on this thread
+    std::vector<CBaseGame *> m_Games;              // the games this thread is updating (only accessed by this thread)
+    std::vector<CBaseGame *> m_Finished;           // games that are over and waiting for the main thread to release them (only accessed by this thread)
+    std::atomic<uint32_t> m_NumGames;              // the number of games on this thread including the finished ones
+    std::atomic<bool> m_Exiting;
+
+public:
+    CGameThread(CGHost *nGHost, CGameThreadPool *nPool, uint32_t nID);
+    ~CGameThread();
+
+    uint32_t GetID() { return m_ID; }
+    uint32_t GetNumGames() { return m_NumGames; }
+
+    void QueueMessage(std::function<void()> message);
+    void AddGame(CBaseGame *game);
+    std::vector<CBaseGame *> Stop();
+
+private:
+    void Run();
+    void RunMessages();
+    void EventGameOver(CBaseGame *game);
+    void ReleaseGame(CBaseGame *game);
+    void EventGameReleased(CBaseGame *game);
+};
+
+//
+// CGameThreadPool
+//
+
+class CGameThreadPool
+{
+private:
+    std::vector<CGameThread *> m_Threads;
+    std::mutex m_Mutex;                  // protects m_Readers and m_Writer
+    std::condition_variable m_Condition; // signalled when the main thread lets go of the lock and when the last game thread does while the main thread is waiting for it
+    uint32_t m_Readers;                  // the number of game threads holding the lock (while they're updating their games)
+    bool m_Writer;                       // if the main thread holds the lock or is waiting for it, the game threads don't take it while this is set so the main thread can't be starved
+    uint32_t m_LockDepth;                // the main thread's lock can be nested, only the outermost Lock and Unlock actually lock and unlock
+
+public:
+    CGameThreadPool(CGHost *nGHost, uint32_t numThreads);
+    ~CGameThreadPool();
+
+    uint32_t GetNumThreads() { return m_Threads.size(); }
+
+    void AddGame(CBaseGame *game);
+    std::vector<CBaseGame *> Stop();
+
+    // main thread only
+
+    void Lock();
+    void Unlock();
+
+    // game threads only
+
+    void LockShared();
+    void UnlockShared();
+};
+
+//
+// CGameThreadLock
+//
+
+// takes the pool's lock for the main thread until it goes out of scope (it does nothing when there are no game threads)
+
+class CGameThreadLock
+{
+private:
+    CGameThreadPool *m_Pool;
+
+public:
+    CGameThreadLock(CGameThreadPool *nPool);
+    ~CGameThreadLock();
+};
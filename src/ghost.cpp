@@ -26,20 +26,26 @@
 #include "bnet.h"
 #include "config.h"
 #include "crc32.h"
-#include "csvparser.h"
+#include "downloadscheduler.h"
 #include "game.h"
 #include "game_admin.h"
 #include "game_base.h"
 #include "gameplayer.h"
 #include "gameprotocol.h"
+#include "gamethread.h"
 #include "gcbiprotocol.h"
 #include "ghostdb.h"
 #include "ghostdbmysql.h"
 #include "ghostdbsqlite.h"
 #include "gpsprotocol.h"
+#include "ipblacklist.h"
+#include "iptocountry.h"
 #include "language.h"
+#include "logger.h"
 #include "map.h"
+#include "metrics.h"
 #include "packed.h"
+#include "replay.h"
 #include "savegame.h"
 #include "sha1.h"
 #include "socket.h"
@@ -48,7 +54,12 @@
 #include "util.h"
 
 #include <signal.h>
+#include <atomic>
+#include <cerrno>
+#include <filesystem>
 #include <cstdlib>
+#include <cstring>
+#include <mutex>
 
 #ifdef WIN32
 #include <ws2tcpip.h> // for WSAIoctl
@@ -61,14 +72,13 @@
 
 #ifndef WIN32
 #include <sys/time.h>
+#include <unistd.h>
 #endif
 
 std::string gCFGFile;
-std::string gLogFile;
-uint32_t gLogMethod;
-std::ofstream *gLog = NULL;
-CGHost *gGHost      = NULL;
-CCurses *gCurses    = NULL;
+CLogger *gLogger = NULL;
+CGHost *gGHost   = NULL;
+CCurses *gCurses = NULL;
 
 uint32_t GetTime()
 {
@@ -93,32 +103,63 @@ uint32_t GetTicks()
 #endif
 }
 
-void SignalCatcher2(int s)
+uint64_t GetMicroTicks()
 {
-    CONSOLE_Print("[!!!] caught signal " + UTIL_ToString(s) + ", exiting NOW");
+    // used by the game timers which need better than millisecond resolution, it doesn't wrap around like GetTicks does
 
-    if (gGHost)
-    {
-        if (gGHost->m_Exiting)
-            exit(1);
-        else
-            gGHost->m_Exiting = true;
-    }
-    else
-        exit(1);
+#ifdef WIN32
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+#endif
 }
 
+// the signal handlers only count the signals, CheckSignals prints them and shuts the bot down from the main loop
+// printing isn't safe in a signal handler since it locks the console (which the interrupted thread might be holding) and allocates
+
+std::atomic<int> gSignal(0);          // the last signal caught
+std::atomic<uint32_t> gNumSignals(0); // the number of signals caught
+uint32_t gNumSignalsHandled = 0;      // the number of signals CheckSignals has acted on
+
 void SignalCatcher(int s)
 {
-    // signal( SIGABRT, SignalCatcher2 );
-    signal(SIGINT, SignalCatcher2);
+    // Windows resets the handler every time it's called
 
-    CONSOLE_Print("[!!!] caught signal " + UTIL_ToString(s) + ", exiting nicely");
+    signal(SIGINT, SignalCatcher);
 
-    if (gGHost)
-        gGHost->m_ExitingNice = true;
-    else
-        exit(1);
+    gSignal = s;
+
+    // if the main loop hasn't acted on the first two signals it's stuck so there's nothing left to do but exit straight away
+    // (the logger can't be stopped from here so whatever it still has queued is lost)
+
+    if (++gNumSignals >= 3)
+        std::_Exit(1);
+}
+
+void CheckSignals()
+{
+    uint32_t NumSignals = gNumSignals;
+
+    // the first signal lets the games in progress finish, the second shuts down at the next update
+    // either way the main loop exits normally so the logger writes everything that was queued
+
+    while (gNumSignalsHandled < NumSignals)
+    {
+        gNumSignalsHandled++;
+
+        if (gNumSignalsHandled == 1)
+        {
+            CONSOLE_Print("[!!!] caught signal " + UTIL_ToString(gSignal.load()) + ", exiting nicely");
+            gGHost->m_ExitingNice = true;
+        }
+        else
+        {
+            CONSOLE_Print("[!!!] caught signal " + UTIL_ToString(gSignal.load()) + ", exiting NOW");
+            gGHost->m_Exiting = true;
+        }
+    }
 }
 
 void CONSOLE_Print(std::string message)
@@ -133,6 +174,11 @@ void CONSOLE_Print(std::string message, bool toMainBuffer)
 
 void CONSOLE_Print(std::string message, uint32_t realmId, bool toMainBuffer)
 {
+    // database callables and replay saves print from their own threads
+
+    static std::mutex PrintMutex;
+    std::lock_guard<std::mutex> Lock(PrintMutex);
+
     if (gCurses)
         gCurses->Print(message, realmId, toMainBuffer);
     else
@@ -141,41 +187,10 @@ void CONSOLE_Print(std::string message, uint32_t realmId, bool toMainBuffer)
     }
 
     // logging
+    // the logger only queues the message, it's written to the log by the logger's own thread
 
-    if (!gLogFile.empty())
-    {
-        if (gLogMethod == 1)
-        {
-            std::ofstream Log;
-            Log.open(gLogFile.c_str(), std::ios::app);
-
-            if (!Log.fail())
-            {
-                time_t Now       = time(NULL);
-                std::string Time = asctime(localtime(&Now));
-
-                // erase the newline
-
-                Time.erase(Time.size() - 1);
-                Log << "[" << Time << "] " << message << std::endl;
-                Log.close();
-            }
-        }
-        else if (gLogMethod == 2)
-        {
-            if (gLog && !gLog->fail())
-            {
-                time_t Now       = time(NULL);
-                std::string Time = asctime(localtime(&Now));
-
-                // erase the newline
-
-                Time.erase(Time.size() - 1);
-                *gLog << "[" << Time << "] " << message << std::endl;
-                gLog->flush();
-            }
-        }
-    }
+    if (gLogger)
+        gLogger->Print(message);
 }
 
 void DEBUG_Print(std::string message)
@@ -193,6 +208,20 @@ void DEBUG_Print(BYTEARRAY b)
     std::cout << "}" << std::endl;
 }
 
+void LOG_Write(std::string file, std::string line)
+{
+    if (gLogger)
+        gLogger->Write(file, line);
+}
+
+bool LOG_WriteCapture(const std::string &file, std::string records, bool opensStream, bool closesStream)
+{
+    if (gLogger)
+        return gLogger->WriteCapture(file, std::move(records), opensStream, closesStream);
+
+    return false;
+}
+
 void CONSOLE_ChangeChannel(std::string channel, uint32_t realmId)
 {
     if (gCurses)
@@ -252,45 +281,32 @@ int main(int argc, char **argv)
     CConfig CFG;
     CFG.Read("default.cfg");
     CFG.Read(gCFGFile);
-    gLogFile   = CFG.GetString("bot_log", std::string());
-    gLogMethod = CFG.GetInt("bot_logmethod", 1);
+    std::string LogFile = CFG.GetString("bot_log", std::string());
+    uint32_t LogMethod  = CFG.GetInt("bot_logmethod", 1);
 
     if (CFG.GetInt("curses_enabled", 1) == 1)
         gCurses = new CCurses(CFG.GetInt("term_width", 0), CFG.GetInt("term_height", 0), !!CFG.GetInt("curses_splitview", 0), CFG.GetInt("curses_listtype", 0));
 
     UTIL_Construct_UTF8_Latin1_Map();
 
-    if (!gLogFile.empty())
-    {
-        if (gLogMethod == 1)
-        {
-            // log method 1: open, append, and close the log for every message
-            // this works well on Linux but poorly on Windows, particularly as the log file grows in size
-            // the log file can be edited/moved/deleted while GHost++ is running
-        }
-        else if (gLogMethod == 2)
-        {
-            // log method 2: open the log on startup, flush the log for every message, close the log on shutdown
-            // the log file CANNOT be edited/moved/deleted while GHost++ is running
+    // log method 1: open, append, and close the log for every batch of messages
+    // the log file can be edited/moved/deleted while GHost++ is running
+    // log method 2: open the log on startup, flush the log for every batch of messages, close the log on shutdown
+    // the log file CANNOT be edited/moved/deleted while GHost++ is running
+    // either way the messages are written by the logger's thread so a slow disk doesn't hold up the bot
 
-            gLog = new std::ofstream();
-            gLog->open(gLogFile.c_str(), std::ios::app);
-        }
-    }
+    gLogger = new CLogger(LogFile, LogMethod, CFG.GetInt("bot_loglevel", LOG_INFO), CFG.GetString("bot_logtags", std::string()), CFG.GetInt("bot_logmaxsize", 0), CFG.GetInt("bot_logrotations", 5));
 
     CONSOLE_Print("[GHOST] starting up");
 
-    if (!gLogFile.empty())
+    if (!LogFile.empty())
     {
-        if (gLogMethod == 1)
-            CONSOLE_Print("[GHOST] using log method 1, logging is enabled and [" + gLogFile + "] will not be locked");
-        else if (gLogMethod == 2)
-        {
-            if (gLog->fail())
-                CONSOLE_Print("[GHOST] using log method 2 but unable to open [" + gLogFile + "] for appending, logging is disabled");
-            else
-                CONSOLE_Print("[GHOST] using log method 2, logging is enabled and [" + gLogFile + "] is now locked");
-        }
+        if (!gLogger->GetLogOpen())
+            CONSOLE_Print("[GHOST] using log method " + UTIL_ToString(LogMethod) + " but unable to open [" + LogFile + "] for appending, logging will start once it can be opened");
+        else if (LogMethod == 2)
+            CONSOLE_Print("[GHOST] using log method 2, logging is enabled and [" + LogFile + "] is now locked");
+        else
+            CONSOLE_Print("[GHOST] using log method " + UTIL_ToString(LogMethod) + ", logging is enabled and [" + LogFile + "] will not be locked");
     }
     else
         CONSOLE_Print("[GHOST] no log file specified, logging is disabled");
@@ -324,6 +340,7 @@ int main(int argc, char **argv)
         else
         {
             CONSOLE_Print("[GHOST] error setting Windows timer resolution");
+            delete gLogger;
             return 1;
         }
     }
@@ -349,6 +366,7 @@ int main(int argc, char **argv)
     if (WSAStartup(MAKEWORD(2, 2), &wsadata) != 0)
     {
         CONSOLE_Print("[GHOST] error starting winsock");
+        delete gLogger;
         return 1;
     }
 
@@ -367,6 +385,8 @@ int main(int argc, char **argv)
 
     while (1)
     {
+        CheckSignals();
+
         // block for 50ms on all sockets - if you intend to perform any timed actions more frequently you should change this
         // that said it's likely we'll loop more often than this due to there being data waiting on one of the sockets but there aren't any guarantees
 
@@ -391,14 +411,6 @@ int main(int argc, char **argv)
     timeEndPeriod(TimerResolution);
 #endif
 
-    if (gLog)
-    {
-        if (!gLog->fail())
-            gLog->close();
-
-        delete gLog;
-    }
-
     // shutdown curses
 
     if (gCurses)
@@ -408,6 +420,11 @@ int main(int argc, char **argv)
         gCurses = NULL;
     }
 
+    // shutdown the logger, it writes whatever is still queued before it exits
+
+    delete gLogger;
+    gLogger = NULL;
+
     return 0;
 }
 
@@ -415,6 +432,35 @@ int main(int argc, char **argv)
 // CGHost
 //
 
+static std::string GetHostName()
+{
+    // anything but letters, digits and dots is replaced so the name can be used as part of a file name and doesn't contain the '-' separating m_RunID's parts
+
+    char Buffer[256];
+
+#ifdef WIN32
+    DWORD Size = sizeof(Buffer);
+
+    if (!GetComputerNameA(Buffer, &Size))
+        return "unknown";
+#else
+    if (gethostname(Buffer, sizeof(Buffer)) != 0)
+        return "unknown";
+
+    Buffer[sizeof(Buffer) - 1] = 0;
+#endif
+
+    std::string HostName = Buffer;
+
+    for (std::string::iterator i = HostName.begin(); i != HostName.end(); i++)
+    {
+        if (!isalnum((unsigned char)*i) && *i != '.')
+            *i = '_';
+    }
+
+    return HostName.empty() ? "unknown" : HostName;
+}
+
 CGHost::CGHost(CConfig *CFG)
 {
     m_UDPSocket = new CUDPSocket();
@@ -443,7 +489,22 @@ CGHost::CGHost(CConfig *CFG)
         m_DB = new CGHostDBSQLite(CFG);
 
     CONSOLE_Print("[GHOST] opening secondary (local) database");
-    m_DBLocal = new CGHostDBSQLite(CFG);
+    m_DBLocal     = new CGHostDBSQLite(CFG);
+    m_IPToCountry = new CIPToCountry();
+
+    m_DownloadScheduler = new CDownloadScheduler(this);
+    m_ConnectionLimiter = new CConnectionLimiter();
+    m_IPBlackList       = new CIPBlackList();
+
+    // the number of game threads can't be changed with !reload since a game stays on the same thread until it's over
+
+    m_NumGameThreads = CFG->GetInt("bot_gamethreads", 0);
+    m_GameThreads    = m_NumGameThreads > 0 ? new CGameThreadPool(this, m_NumGameThreads) : NULL;
+
+    // the metrics server only runs if it's given a port, it can't be changed with !reload either
+
+    uint16_t MetricsPort = CFG->GetInt("bot_metricsport", 0);
+    m_MetricsServer      = MetricsPort > 0 ? new CMetricsServer(this, CFG->GetString("bot_metricsaddress", "127.0.0.1"), MetricsPort) : NULL;
 
     // get a list of local IP addresses
     // this list is used elsewhere to determine if a player connecting to the bot is local or not
@@ -518,6 +579,7 @@ CGHost::CGHost(CConfig *CFG)
     m_AutoHostGameName         = CFG->GetString("autohost_gamename", std::string());
     m_AutoHostOwner            = CFG->GetString("autohost_owner", std::string());
     m_LastAutoHostTime         = GetTime() - m_RehostDelay + 15;
+    m_LastAuthCachePruneTime   = GetTime();
     m_AutoHostMatchMaking      = false;
     m_AutoHostMinimumScore     = 0.0;
     m_AutoHostMaximumScore     = 0.0;
@@ -525,6 +587,17 @@ CGHost::CGHost(CConfig *CFG)
     m_AllGamesFinishedTime     = 0;
     m_TFT                      = CFG->GetInt("bot_tft", 1) == 0 ? false : true;
 
+    // the host name and process ID tell RemoveStaleReplayParts whether a file's bot is still running and the start time keeps the names unique across runs
+    // the host name is needed as well as the process ID because bots in separate containers can share bot_replaypath (and process IDs)
+
+    m_HostName = GetHostName();
+
+#ifdef WIN32
+    m_RunID = m_HostName + "-" + UTIL_ToString((uint32_t)GetCurrentProcessId()) + "-" + UTIL_ToString((uint32_t)time(NULL));
+#else
+    m_RunID = m_HostName + "-" + UTIL_ToString((uint32_t)getpid()) + "-" + UTIL_ToString((uint32_t)time(NULL));
+#endif
+
     if (m_TFT)
         CONSOLE_Print("[GHOST] acting as Warcraft III: The Frozen Throne");
     else
@@ -706,6 +779,10 @@ CGHost::CGHost(CConfig *CFG)
 
     LoadIPToCountryData();
 
+    // remove the replay part files left behind by bots that didn't shut down properly
+
+    RemoveStaleReplayParts();
+
     // create the admin game
 
     if (m_AdminGameCreate)
@@ -731,6 +808,28 @@ CGHost::CGHost(CConfig *CFG)
 
 CGHost::~CGHost()
 {
+    // stop the game threads before deleting anything their games use, their games are deleted below along with the rest (back on the main thread)
+    // the messages they queued are run first so games they had already released get deleted too
+
+    if (m_GameThreads)
+    {
+        std::vector<CBaseGame *> Games = m_GameThreads->Stop();
+
+        for (std::vector<CBaseGame *>::iterator i = Games.begin(); i != Games.end(); i++)
+            (*i)->SetThread(NULL);
+
+        RunMessages();
+
+        for (std::vector<CBaseGame *>::iterator i = Games.begin(); i != Games.end(); i++)
+        {
+            if (std::find(m_Games.begin(), m_Games.end(), *i) == m_Games.end())
+                m_Games.push_back(*i);
+        }
+
+        delete m_GameThreads;
+        m_GameThreads = NULL;
+    }
+
     delete m_UDPSocket;
     delete m_ReconnectSocket;
     delete m_StatusBroadcaster;
@@ -752,8 +851,27 @@ CGHost::~CGHost()
     for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
         delete *i;
 
+    // deleting a replay save waits for it to finish so we don't lose any replays on shutdown
+
+    if (!m_ReplaySaves.empty())
+        CONSOLE_Print("[GHOST] waiting for " + UTIL_ToString(m_ReplaySaves.size()) + " replays to finish saving");
+
+    for (std::vector<CReplaySave *>::iterator i = m_ReplaySaves.begin(); i != m_ReplaySaves.end(); i++)
+        delete *i;
+
+    delete m_DownloadScheduler;
+    delete m_MetricsServer;
+    delete m_ConnectionLimiter;
+    delete m_IPBlackList;
+
+    // auth checks still in progress are orphaned like any other callable
+
+    for (std::vector<CCallableAuthCheck *>::iterator i = m_AuthChecks.begin(); i != m_AuthChecks.end(); i++)
+        m_Callables.push_back(*i);
+
     delete m_DB;
     delete m_DBLocal;
+    delete m_IPToCountry;
 
     // warning: we don't delete any entries of m_Callables here because we can't be guaranteed that the associated threads have terminated
     // this is fine if the program is currently exiting because the OS will clean up after us
@@ -792,6 +910,7 @@ bool CGHost::Update(uint32_t usecBlock)
         if (!m_BNETs.empty())
         {
             CONSOLE_Print("[GHOST] deleting all battle.net connections in preparation for exiting nicely");
+            CGameThreadLock Lock(m_GameThreads);
 
             for (std::vector<CBNET *>::iterator i = m_BNETs.begin(); i != m_BNETs.end(); i++)
                 delete *i;
@@ -853,6 +972,56 @@ bool CGHost::Update(uint32_t usecBlock)
             i++;
     }
 
+    // update auth checks
+
+    for (std::vector<CCallableAuthCheck *>::iterator i = m_AuthChecks.begin(); i != m_AuthChecks.end();)
+    {
+        if ((*i)->GetReady())
+        {
+            // don't cache a failed check if the query itself failed, we'll just try again next time
+
+            if ((*i)->GetError().empty())
+                m_AuthCache[(*i)->GetUser()] = std::make_pair((*i)->GetResult(), GetTime());
+
+            m_DB->RecoverCallable(*i);
+            delete *i;
+            i = m_AuthChecks.erase(i);
+        }
+        else
+            i++;
+    }
+
+    if (GetTime() - m_LastAuthCachePruneTime >= 60)
+    {
+        for (std::map<std::string, std::pair<bool, uint32_t>>::iterator i = m_AuthCache.begin(); i != m_AuthCache.end();)
+        {
+            if (GetTime() - i->second.second >= m_AuthCacheTime)
+                m_AuthCache.erase(i++);
+            else
+                i++;
+        }
+
+        m_LastAuthCachePruneTime = GetTime();
+    }
+
+    // update replay saves
+
+    for (std::vector<CReplaySave *>::iterator i = m_ReplaySaves.begin(); i != m_ReplaySaves.end();)
+    {
+        if ((*i)->GetReady())
+        {
+            if ((*i)->GetResult())
+                CONSOLE_Print("[GHOST] saved replay [" + (*i)->GetFileName() + "] in " + UTIL_ToString(GetTicks() - (*i)->GetStartTicks()) + " ms");
+            else
+                CONSOLE_Print("[GHOST] warning - failed to save replay [" + (*i)->GetFileName() + "]");
+
+            delete *i;
+            i = m_ReplaySaves.erase(i);
+        }
+        else
+            i++;
+    }
+
     // создание сокета для обновления статуса
     if (m_TCPStatus)
     {
@@ -902,117 +1071,72 @@ bool CGHost::Update(uint32_t usecBlock)
         }
     }
 
-    unsigned int NumFDs = 0;
-
-    // take every socket we own and throw it in one giant select statement so we can block on all sockets
-
-    int nfds = 0;
-    fd_set fd;
-    fd_set send_fd;
-    FD_ZERO(&fd);
-    FD_ZERO(&send_fd);
-
-    // 1. all battle.net sockets
-
-    for (std::vector<CBNET *>::iterator i = m_BNETs.begin(); i != m_BNETs.end(); i++)
-        NumFDs += (*i)->SetFD(&fd, &send_fd, &nfds);
-
-    // 2. the current game's server and player sockets
-
-    if (m_CurrentGame)
-        NumFDs += m_CurrentGame->SetFD(&fd, &send_fd, &nfds);
-
-    // 3. the admin game's server and player sockets
+    // before we wait on the sockets we need to determine how long to block for
+    // previously we just blocked for a maximum of the passed usecBlock microseconds
+    // however, in an effort to make game updates happen closer to the desired latency setting we now use a dynamic block interval
+    // note: we still use the passed usecBlock as a hard maximum
 
-    if (m_AdminGame)
-        NumFDs += m_AdminGame->SetFD(&fd, &send_fd, &nfds);
+    // the games' timers have microsecond deadlines and the reactor wakes up within microseconds of the timeout (see socket.h) so the actions go out on time
 
-    // 4. all running games' player sockets
+    uint64_t Now = GetMicroTicks();
 
     for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-        NumFDs += (*i)->SetFD(&fd, &send_fd, &nfds);
-
-    // 5. the GProxy++ reconnect socket(s)
-
-    if (m_Reconnect && m_ReconnectSocket)
-    {
-        m_ReconnectSocket->SetFD(&fd, &send_fd, &nfds);
-        NumFDs++;
-    }
-
-    for (std::vector<CTCPSocket *>::iterator i = m_ReconnectSockets.begin(); i != m_ReconnectSockets.end(); i++)
-    {
-        (*i)->SetFD(&fd, &send_fd, &nfds);
-        NumFDs++;
-    }
-
-    // 6. Status sockets
-
-    if (m_TCPStatus && m_StatusBroadcaster->connectSocket)
-    {
-        m_StatusBroadcaster->connectSocket->SetFD(&fd, &send_fd, &nfds);
-        NumFDs++;
-    }
-
-    for (std::vector<CTCPStatusBroadcasterSocket *>::iterator i = m_StatusBroadcaster->sockets.begin(); i != m_StatusBroadcaster->sockets.end(); i++)
     {
-        (*i)->socket->SetFD(&fd, &send_fd, &nfds);
-        NumFDs++;
-    }
-
-    m_StatusBroadcaster->set_fd(&fd, &send_fd, &nfds);
+        if ((*i)->GetThread())
+            continue;
 
-    // before we call select we need to determine how long to block for
-    // previously we just blocked for a maximum of the passed usecBlock microseconds
-    // however, in an effort to make game updates happen closer to the desired latency setting we now use a dynamic block interval
-    // note: we still use the passed usecBlock as a hard maximum
+        uint64_t NextTimer = (*i)->GetNextTimerMicroTicks();
 
-    for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-    {
-        if ((*i)->GetNextTimedActionTicks() * 1000 < usecBlock)
-            usecBlock = (*i)->GetNextTimedActionTicks() * 1000;
+        if (NextTimer <= Now)
+            usecBlock = 0;
+        else if (NextTimer - Now < usecBlock)
+            usecBlock = NextTimer - Now;
     }
 
-    // always block for at least 1ms just in case something goes wrong
+    // always block for at least 100us just in case something goes wrong
     // this prevents the bot from sucking up all the available CPU if a game keeps asking for immediate updates
     // it's a bit ridiculous to include this check since, in theory, the bot is programmed well enough to never make this mistake
     // however, considering who programmed it, it's worthwhile to do it anyway
 
-    if (usecBlock < 1000)
-        usecBlock = 1000;
+    if (usecBlock < 100)
+        usecBlock = 100;
 
-    struct timeval tv;
-    tv.tv_sec  = 0;
-    tv.tv_usec = usecBlock;
+    // every socket we own is registered with the reactor when it starts listening, connecting or is accepted
+    // so rather than throwing them all in one giant select statement on every update we just wait for the ones that are ready
 
-    struct timeval send_tv;
-    send_tv.tv_sec  = 0;
-    send_tv.tv_usec = 0;
-
-#ifdef WIN32
-    select(1, &fd, NULL, NULL, &tv);
-    select(1, NULL, &send_fd, NULL, &send_tv);
-#else
-    select(nfds + 1, &fd, NULL, NULL, &tv);
-    select(nfds + 1, NULL, &send_fd, NULL, &send_tv);
-#endif
+    CSocketReactor *Reactor = CSocketReactor::Get();
 
-    if (NumFDs == 0)
+    if (Reactor->GetNumSockets() == 0)
     {
         // we don't have any sockets (i.e. we aren't connected to battle.net maybe due to a lost connection and there aren't any games running)
-        // select will return immediately and we'll chew up the CPU if we let it loop so just sleep for 50ms to kill some time
+        // there's nothing to wait on so just sleep for 50ms to kill some time
 
         MILLISLEEP(50);
     }
+    else
+        Reactor->Wait(usecBlock);
 
     bool AdminExit = false;
     bool BNETExit  = false;
 
+    // run the messages from the game threads
+
+    RunMessages();
+
+    // send map parts to the downloaders the lobbies registered during the last update
+    // this happens before the games update so the parts are sent along with everything else in UpdatePost
+
+    m_DownloadScheduler->Update();
+
+    // load the IP blacklist again if it was changed since the last update
+
+    m_IPBlackList->Update();
+
     // update current game
 
     if (m_CurrentGame)
     {
-        if (m_CurrentGame->Update(&fd, &send_fd))
+        if (m_CurrentGame->Update())
         {
             CONSOLE_Print("[GHOST] deleting current game [" + m_CurrentGame->GetGameName() + "]");
             delete m_CurrentGame;
@@ -1025,14 +1149,15 @@ bool CGHost::Update(uint32_t usecBlock)
             }
         }
         else if (m_CurrentGame)
-            m_CurrentGame->UpdatePost(&send_fd);
+            m_CurrentGame->UpdatePost();
     }
 
     // update admin game
+    // the admin commands that read the games in progress lock the game threads out themselves (see gamethread.h)
 
     if (m_AdminGame)
     {
-        if (m_AdminGame->Update(&fd, &send_fd))
+        if (m_AdminGame->Update())
         {
             CONSOLE_Print("[GHOST] deleting admin game");
             delete m_AdminGame;
@@ -1040,14 +1165,30 @@ bool CGHost::Update(uint32_t usecBlock)
             AdminExit   = true;
         }
         else if (m_AdminGame)
-            m_AdminGame->UpdatePost(&send_fd);
+            m_AdminGame->UpdatePost();
     }
 
     // update running games
 
     for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end();)
     {
-        if ((*i)->Update(&fd, &send_fd))
+        // games on a game thread are updated (and deleted) by that thread
+        // the rest are handed to a game thread as soon as they start loading
+
+        if ((*i)->GetThread())
+        {
+            i++;
+            continue;
+        }
+
+        if (m_GameThreads)
+        {
+            m_GameThreads->AddGame(*i);
+            i++;
+            continue;
+        }
+
+        if ((*i)->Update())
         {
             CONSOLE_Print("[GHOST] deleting game [" + (*i)->GetGameName() + "]");
             EventGameDeleted(*i);
@@ -1056,16 +1197,17 @@ bool CGHost::Update(uint32_t usecBlock)
         }
         else
         {
-            (*i)->UpdatePost(&send_fd);
+            (*i)->UpdatePost();
             i++;
         }
     }
 
     // update battle.net connections
+    // the battle.net commands that read the games in progress lock the game threads out themselves (see gamethread.h)
 
     for (std::vector<CBNET *>::iterator i = m_BNETs.begin(); i != m_BNETs.end(); i++)
     {
-        if ((*i)->Update(&fd, &send_fd))
+        if ((*i)->Update())
             BNETExit = true;
     }
 
@@ -1073,10 +1215,10 @@ bool CGHost::Update(uint32_t usecBlock)
 
     if (m_Reconnect && m_ReconnectSocket)
     {
-        CTCPSocket *NewSocket = m_ReconnectSocket->Accept(&fd);
+        // everyone in a game reconnects at once if the bot's connection drops for a moment so accept every waiting connection
 
-        if (NewSocket)
-            m_ReconnectSockets.push_back(NewSocket);
+        std::vector<CTCPSocket *> NewSockets = m_ReconnectSocket->AcceptAll();
+        m_ReconnectSockets.insert(m_ReconnectSockets.end(), NewSockets.begin(), NewSockets.end());
     }
 
     for (std::vector<CTCPSocket *>::iterator i = m_ReconnectSockets.begin(); i != m_ReconnectSockets.end();)
@@ -1088,53 +1230,90 @@ bool CGHost::Update(uint32_t usecBlock)
             continue;
         }
 
-        (*i)->DoRecv(&fd);
-        std::string *RecvBuffer = (*i)->GetBytes();
-        BYTEARRAY Bytes         = UTIL_CreateByteArray((unsigned char *)RecvBuffer->c_str(), RecvBuffer->size());
+        (*i)->DoRecv();
+        const unsigned char *Data = (*i)->GetRecvData();
+        uint32_t Size             = (*i)->GetRecvSize();
 
         // a packet is at least 4 bytes
 
-        if (Bytes.size() >= 4)
+        if (Size >= 4)
         {
-            if (Bytes[0] == GPS_HEADER_CONSTANT)
+            if (Data[0] == GPS_HEADER_CONSTANT)
             {
                 // bytes 2 and 3 contain the length of the packet
 
-                uint16_t Length = UTIL_ByteArrayToUInt16(Bytes, false, 2);
+                uint16_t Length = (uint16_t)(Data[2] | (Data[3] << 8));
 
                 if (Length >= 4)
                 {
-                    if (Bytes.size() >= Length)
+                    if (Size >= Length)
                     {
-                        if (Bytes[1] == CGPSProtocol::GPS_RECONNECT && Length == 13)
+                        if (Data[1] == CGPSProtocol::GPS_RECONNECT && Length == 13)
                         {
+                            BYTEARRAY Bytes       = BYTEARRAY(Data, Data + Length);
                             unsigned char PID     = Bytes[4];
                             uint32_t ReconnectKey = UTIL_ByteArrayToUInt32(Bytes, false, 5);
                             uint32_t LastPacket   = UTIL_ByteArrayToUInt32(Bytes, false, 9);
 
                             // look for a matching player in a running game
 
-                            CGamePlayer *Match = NULL;
+                            CBaseGame *MatchGame = NULL;
+                            CGamePlayer *Match   = NULL;
 
-                            for (std::vector<CBaseGame *>::iterator j = m_Games.begin(); j != m_Games.end(); j++)
                             {
-                                if ((*j)->GetGameLoaded())
-                                {
-                                    CGamePlayer *Player = (*j)->GetPlayerFromPID(PID);
+                                CGameThreadLock Lock(m_GameThreads);
 
-                                    if (Player && Player->GetGProxy() && Player->GetGProxyReconnectKey() == ReconnectKey)
+                                for (std::vector<CBaseGame *>::iterator j = m_Games.begin(); j != m_Games.end(); j++)
+                                {
+                                    if ((*j)->GetGameLoaded())
                                     {
-                                        Match = Player;
-                                        break;
+                                        CGamePlayer *Player = (*j)->GetPlayerFromPID(PID);
+
+                                        if (Player && Player->GetGProxy() && Player->GetGProxyReconnectKey() == ReconnectKey)
+                                        {
+                                            MatchGame = *j;
+                                            Match     = Player;
+                                            break;
+                                        }
                                     }
                                 }
                             }
 
-                            if (Match)
+                            if (Match && MatchGame->GetThread())
+                            {
+                                // the game's on a game thread so the socket has to be handed over to it
+                                // the player might have left by the time the game thread gets the message so it has to look for them again
+
+                                CTCPSocket *Socket = *i;
+                                Socket->ConsumeBytes(Length);
+                                Socket->Unregister();
+                                i = m_ReconnectSockets.erase(i);
+
+                                MatchGame->RunOnGameThread([this, MatchGame, Socket, PID, ReconnectKey, LastPacket] {
+                                    CGamePlayer *Player = MatchGame->GetPlayerFromPID(PID);
+
+                                    if (Player && Player->GetGProxy() && Player->GetGProxyReconnectKey() == ReconnectKey)
+                                    {
+                                        // reconnect successful!
+
+                                        Socket->Register();
+                                        Player->EventGProxyReconnect(Socket, LastPacket);
+                                    }
+                                    else
+                                    {
+                                        Socket->PutBytes(m_GPSProtocol->SEND_GPSS_REJECT(REJECTGPS_NOTFOUND));
+                                        Socket->DoSend();
+                                        delete Socket;
+                                    }
+                                });
+
+                                continue;
+                            }
+                            else if (Match)
                             {
                                 // reconnect successful!
 
-                                *RecvBuffer = RecvBuffer->substr(Length);
+                                (*i)->ConsumeBytes(Length);
                                 Match->EventGProxyReconnect(*i, LastPacket);
                                 i = m_ReconnectSockets.erase(i);
                                 continue;
@@ -1142,7 +1321,7 @@ bool CGHost::Update(uint32_t usecBlock)
                             else
                             {
                                 (*i)->PutBytes(m_GPSProtocol->SEND_GPSS_REJECT(REJECTGPS_NOTFOUND));
-                                (*i)->DoSend(&send_fd);
+                                (*i)->DoSend();
                                 delete *i;
                                 i = m_ReconnectSockets.erase(i);
                                 continue;
@@ -1151,7 +1330,7 @@ bool CGHost::Update(uint32_t usecBlock)
                         else
                         {
                             (*i)->PutBytes(m_GPSProtocol->SEND_GPSS_REJECT(REJECTGPS_INVALID));
-                            (*i)->DoSend(&send_fd);
+                            (*i)->DoSend();
                             delete *i;
                             i = m_ReconnectSockets.erase(i);
                             continue;
@@ -1161,7 +1340,7 @@ bool CGHost::Update(uint32_t usecBlock)
                 else
                 {
                     (*i)->PutBytes(m_GPSProtocol->SEND_GPSS_REJECT(REJECTGPS_INVALID));
-                    (*i)->DoSend(&send_fd);
+                    (*i)->DoSend();
                     delete *i;
                     i = m_ReconnectSockets.erase(i);
                     continue;
@@ -1170,14 +1349,14 @@ bool CGHost::Update(uint32_t usecBlock)
             else
             {
                 (*i)->PutBytes(m_GPSProtocol->SEND_GPSS_REJECT(REJECTGPS_INVALID));
-                (*i)->DoSend(&send_fd);
+                (*i)->DoSend();
                 delete *i;
                 i = m_ReconnectSockets.erase(i);
                 continue;
             }
         }
 
-        (*i)->DoSend(&send_fd);
+        (*i)->DoSend();
         i++;
     }
 
@@ -1185,13 +1364,16 @@ bool CGHost::Update(uint32_t usecBlock)
     if (m_TCPStatus && m_StatusBroadcaster->connectSocket)
     {
         //новое подключение
-        CTCPStatusBroadcasterSocket *NewSocketStatus = new CTCPStatusBroadcasterSocket(m_StatusBroadcaster->connectSocket->Accept(&fd));
+        CTCPStatusBroadcasterSocket *NewSocketStatus = new CTCPStatusBroadcasterSocket(m_StatusBroadcaster->connectSocket->Accept());
 
         if (NewSocketStatus->socket)
         {
+            // GetGame can return a game in progress so the game threads have to wait while it's read
+
+            CGameThreadLock Lock(m_GameThreads);
+
             //NewSocketStatus->socket->SetLogFile("statuslog.txt");
             m_StatusBroadcaster->sockets.push_back(NewSocketStatus);
-            NewSocketStatus->socket->SetFD(&fd, &send_fd, &nfds);
             m_StatusBroadcaster->SendGame(GetGame(), NewSocketStatus); // отправялем "GAME" всем новым подключениям
         }
 
@@ -1208,17 +1390,17 @@ bool CGHost::Update(uint32_t usecBlock)
                     continue;
                 }
 
-                (*i)->socket->DoRecv(&fd);
-                std::string *RecvBuffer = (*i)->socket->GetBytes();
-
-                BYTEARRAY Bytes = UTIL_CreateByteArray((unsigned char *)RecvBuffer->c_str(), RecvBuffer->size());
+                (*i)->socket->DoRecv();
+                const unsigned char *Data = (*i)->socket->GetRecvData();
 
                 //отправка "GAME" и "SLOT" по запросу на конкретный сокет
-                if (Bytes.size() >= 4)
+                if ((*i)->socket->GetRecvSize() >= 4)
                 {
-                    if (Bytes[0] == 'G' && Bytes[1] == 'A' && Bytes[2] == 'M' && Bytes[3] == 'E')
+                    CGameThreadLock Lock(m_GameThreads);
+
+                    if (memcmp(Data, "GAME", 4) == 0)
                         m_StatusBroadcaster->SendGame(GetGame(), (*i));
-                    if (Bytes[0] == 'S' && Bytes[1] == 'L' && Bytes[2] == 'O' && Bytes[3] == 'T')
+                    if (memcmp(Data, "SLOT", 4) == 0)
                         m_StatusBroadcaster->SendSlot(GetGame(), (*i));
                 }
 
@@ -1228,6 +1410,11 @@ bool CGHost::Update(uint32_t usecBlock)
         }
     }
 
+    // answer metrics requests
+
+    if (m_MetricsServer)
+        m_MetricsServer->Update();
+
     // autohost
 
     /* debug info
@@ -1418,8 +1605,7 @@ void CGHost::EventBNETWhisper(CBNET *bnet, std::string user, std::string message
         if (m_CurrentGame)
             m_CurrentGame->SendLocalAdminChat("[WHISPER: " + bnet->GetServerAlias() + "] [" + user + "] " + message);
 
-        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-            (*i)->SendLocalAdminChat("[WHISPER: " + bnet->GetServerAlias() + "] [" + user + "] " + message);
+        SendLocalAdminChatToGames("[WHISPER: " + bnet->GetServerAlias() + "] [" + user + "] " + message);
     }
 }
 
@@ -1432,8 +1618,7 @@ void CGHost::EventBNETChat(CBNET *bnet, std::string user, std::string message)
         if (m_CurrentGame)
             m_CurrentGame->SendLocalAdminChat("[LOCAL: " + bnet->GetServerAlias() + "] [" + user + "] " + message);
 
-        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-            (*i)->SendLocalAdminChat("[LOCAL: " + bnet->GetServerAlias() + "] [" + user + "] " + message);
+        SendLocalAdminChatToGames("[LOCAL: " + bnet->GetServerAlias() + "] [" + user + "] " + message);
     }
 }
 
@@ -1446,8 +1631,7 @@ void CGHost::EventBNETBROADCAST(CBNET *bnet, std::string user, std::string messa
         if (m_CurrentGame)
             m_CurrentGame->SendLocalAdminChat("[BROADCAST: " + bnet->GetServerAlias() + "] " + message);
 
-        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-            (*i)->SendLocalAdminChat("[BROADCAST: " + bnet->GetServerAlias() + "] " + message);
+        SendLocalAdminChatToGames("[BROADCAST: " + bnet->GetServerAlias() + "] " + message);
     }
 }
 
@@ -1460,8 +1644,7 @@ void CGHost::EventBNETCHANNEL(CBNET *bnet, std::string user, std::string message
         if (m_CurrentGame)
             m_CurrentGame->SendLocalAdminChat("[BNET: " + bnet->GetServerAlias() + "] joined channel [" + message + "]");
 
-        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-            (*i)->SendLocalAdminChat("[BNET: " + bnet->GetServerAlias() + "] joined channel [" + message + "]");
+        SendLocalAdminChatToGames("[BNET: " + bnet->GetServerAlias() + "] joined channel [" + message + "]");
     }
 }
 
@@ -1474,8 +1657,7 @@ void CGHost::EventBNETWHISPERSENT(CBNET *bnet, std::string user, std::string mes
         if (m_CurrentGame)
             m_CurrentGame->SendLocalAdminChat("[WHISPERED: " + bnet->GetServerAlias() + "] [" + user + "] " + message);
 
-        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-            (*i)->SendLocalAdminChat("[WHISPERED: " + bnet->GetServerAlias() + "] [" + user + "] " + message);
+        SendLocalAdminChatToGames("[WHISPERED: " + bnet->GetServerAlias() + "] [" + user + "] " + message);
     }
 }
 
@@ -1488,8 +1670,7 @@ void CGHost::EventBNETCHANNELFULL(CBNET *bnet, std::string user, std::string mes
         if (m_CurrentGame)
             m_CurrentGame->SendLocalAdminChat("[BNET: " + bnet->GetServerAlias() + "] channel is full");
 
-        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-            (*i)->SendLocalAdminChat("[BNET: " + bnet->GetServerAlias() + "] channel is full");
+        SendLocalAdminChatToGames("[BNET: " + bnet->GetServerAlias() + "] channel is full");
     }
 }
 
@@ -1502,8 +1683,7 @@ void CGHost::EventBNETCHANNELDOESNOTEXIST(CBNET *bnet, std::string user, std::st
         if (m_CurrentGame)
             m_CurrentGame->SendLocalAdminChat("[BNET: " + bnet->GetServerAlias() + "] channel does not exist");
 
-        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-            (*i)->SendLocalAdminChat("[BNET: " + bnet->GetServerAlias() + "] channel does not exist");
+        SendLocalAdminChatToGames("[BNET: " + bnet->GetServerAlias() + "] channel does not exist");
     }
 }
 
@@ -1516,8 +1696,7 @@ void CGHost::EventBNETCHANNELRESTRICTED(CBNET *bnet, std::string user, std::stri
         if (m_CurrentGame)
             m_CurrentGame->SendLocalAdminChat("[BNET: " + bnet->GetServerAlias() + "] channel restricted");
 
-        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-            (*i)->SendLocalAdminChat("[BNET: " + bnet->GetServerAlias() + "] channel restricted");
+        SendLocalAdminChatToGames("[BNET: " + bnet->GetServerAlias() + "] channel restricted");
     }
 }
 
@@ -1530,8 +1709,7 @@ void CGHost::EventBNETError(CBNET *bnet, std::string user, std::string message)
         if (m_CurrentGame)
             m_CurrentGame->SendLocalAdminChat("[ERROR: " + bnet->GetServerAlias() + "] " + message);
 
-        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-            (*i)->SendLocalAdminChat("[ERROR: " + bnet->GetServerAlias() + "] " + message);
+        SendLocalAdminChatToGames("[ERROR: " + bnet->GetServerAlias() + "] " + message);
     }
 }
 
@@ -1544,8 +1722,7 @@ void CGHost::EventBNETEmote(CBNET *bnet, std::string user, std::string message)
         if (m_CurrentGame)
             m_CurrentGame->SendLocalAdminChat("[E: " + bnet->GetServerAlias() + "] [" + user + "] " + message);
 
-        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-            (*i)->SendLocalAdminChat("[E: " + bnet->GetServerAlias() + "] [" + user + "] " + message);
+        SendLocalAdminChatToGames("[E: " + bnet->GetServerAlias() + "] [" + user + "] " + message);
     }
 }
 
@@ -1569,13 +1746,48 @@ void CGHost::EventBNETInfo(CBNET *bnet, std::string user, std::string message)
         if (m_CurrentGame)
             m_CurrentGame->SendLocalAdminChat("[INFO: " + bnet->GetServerAlias() + "] " + message);
 
-        for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
-            (*i)->SendLocalAdminChat("[INFO: " + bnet->GetServerAlias() + "] " + message);
+        SendLocalAdminChatToGames("[INFO: " + bnet->GetServerAlias() + "] " + message);
     }
 }
 
+void CGHost::SendLocalAdminChatToGames(std::string message)
+{
+    // the games in progress might be on game threads so the message is handed to each game's thread
+
+    for (std::vector<CBaseGame *>::iterator i = m_Games.begin(); i != m_Games.end(); i++)
+    {
+        CBaseGame *Game = *i;
+        Game->RunOnGameThread([Game, message] { Game->SendLocalAdminChat(message); });
+    }
+}
+
+void CGHost::QueueMessage(std::function<void()> message)
+{
+    std::lock_guard<std::mutex> Lock(m_MessagesMutex);
+    m_Messages.push_back(message);
+}
+
+void CGHost::RunMessages()
+{
+    // run the messages the game threads queued for us (see CBaseGame::RunOnMainThread)
+    // they only touch what the main thread owns so the game threads carry on while they're running
+
+    std::vector<std::function<void()>> Messages;
+
+    {
+        std::lock_guard<std::mutex> Lock(m_MessagesMutex);
+        Messages.swap(m_Messages);
+    }
+
+    for (std::vector<std::function<void()>>::iterator i = Messages.begin(); i != Messages.end(); i++)
+        (*i)();
+}
+
 void CGHost::ReloadConfigs()
 {
+    // the game threads read the config values (and the language file) while they're updating their games
+
+    CGameThreadLock Lock(m_GameThreads);
     CConfig CFG;
     CFG.Read("default.cfg");
     CFG.Read(gCFGFile);
@@ -1660,6 +1872,26 @@ void CGHost::SetConfigs(CConfig *CFG)
     m_WhisperResponses       = CFG->GetInt("bot_whisperresponses", 0) == 0 ? false : true;
     m_ForceLoadInGame        = CFG->GetInt("bot_forceloadingame", 0) == 0 ? false : true;
     m_HCLCommandFromGameName = CFG->GetInt("bot_hclfromgamename", 0) == 0 ? false : true;
+    m_AuthCacheTime          = CFG->GetInt("bot_authcachetime", 300);
+    m_MaxPlayerDownloadSpeed = CFG->GetInt("bot_maxplayerdownloadspeed", 0);
+    m_ListenBacklog          = CFG->GetInt("bot_listenbacklog", 128);
+    m_ConnectionLimiter->SetLimits(CFG->GetInt("bot_connectburst", 10), CFG->GetInt("bot_connectrate", 60));
+
+    // the IP blacklist is loaded once for every lobby (and again on !reload or whenever the file changes)
+
+    m_IPBlackList->Load(m_IPBlackListFile);
+
+    // packet capture (see capture.h), the game and player filters are compared without case
+
+    std::string CaptureGames   = CFG->GetString("bot_capturegames", std::string());
+    std::string CapturePlayers = CFG->GetString("bot_captureplayers", std::string());
+    transform(CaptureGames.begin(), CaptureGames.end(), CaptureGames.begin(), (int (*)(int))tolower);
+    transform(CapturePlayers.begin(), CapturePlayers.end(), CapturePlayers.begin(), (int (*)(int))tolower);
+    m_Capture        = CFG->GetInt("bot_capture", 0) == 0 ? false : true;
+    m_CapturePath    = UTIL_AddPathSeperator(CFG->GetString("bot_capturepath", std::string()));
+    m_CaptureGames   = UTIL_Tokenize(CaptureGames, ' ');
+    m_CapturePlayers = UTIL_Tokenize(CapturePlayers, ' ');
+    m_CaptureBNET    = CFG->GetInt("bot_capturebnet", 0) == 0 ? false : true;
 
     //
 
@@ -1673,6 +1905,36 @@ void CGHost::SetConfigs(CConfig *CFG)
     //
 }
 
+bool CGHost::GetCaptureGame(std::string gameName)
+{
+    // a game is captured if its name contains any of the words in bot_capturegames
+
+    if (!m_Capture)
+        return false;
+
+    if (m_CaptureGames.empty())
+        return true;
+
+    transform(gameName.begin(), gameName.end(), gameName.begin(), (int (*)(int))tolower);
+
+    for (std::vector<std::string>::iterator i = m_CaptureGames.begin(); i != m_CaptureGames.end(); i++)
+    {
+        if (gameName.find(*i) != std::string::npos)
+            return true;
+    }
+
+    return false;
+}
+
+bool CGHost::GetCapturePlayer(std::string name)
+{
+    if (m_CapturePlayers.empty())
+        return true;
+
+    transform(name.begin(), name.end(), name.begin(), (int (*)(int))tolower);
+    return std::find(m_CapturePlayers.begin(), m_CapturePlayers.end(), name) != m_CapturePlayers.end();
+}
+
 void CGHost::ExtractScripts()
 {
     std::string PatchMPQFileName = m_Warcraft3Path + "War3Patch.mpq";
@@ -1745,68 +2007,70 @@ void CGHost::ExtractScripts()
 
 void CGHost::LoadIPToCountryData()
 {
-    std::ifstream in;
-    in.open("ip-to-country.csv");
+    // the parsed ranges are cached in a binary file next to the csv file so we only have to parse it once (or whenever it changes)
 
-    if (in.fail())
-        CONSOLE_Print("[GHOST] warning - unable to read file [ip-to-country.csv], iptocountry data not loaded");
-    else
-    {
-        CONSOLE_Print("[GHOST] started loading [ip-to-country.csv]");
+    m_IPToCountry->Load("ip-to-country.csv", "ip-to-country.bin");
+}
 
-        // the begin and commit statements are optimizations
-        // we're about to insert ~4 MB of data into the database so if we allow the database to treat each insert as a transaction it will take a LONG time
-        // todotodo: handle begin/commit failures a bit more gracefully
+static bool ProcessRunning(uint32_t pid)
+{
+#ifdef WIN32
+    HANDLE Process = OpenProcess(SYNCHRONIZE, FALSE, pid);
 
-        if (!m_DBLocal->Begin())
-            CONSOLE_Print("[GHOST] warning - failed to begin local database transaction, iptocountry data not loaded");
-        else
-        {
-            unsigned char Percent = 0;
-            std::string Line;
-            std::string IP1;
-            std::string IP2;
-            std::string Country;
-            CSVParser parser;
+    if (!Process)
+        return GetLastError() == ERROR_ACCESS_DENIED;
 
-            // get length of file for the progress meter
+    bool Running = WaitForSingleObject(Process, 0) == WAIT_TIMEOUT;
+    CloseHandle(Process);
+    return Running;
+#else
+    return kill(pid, 0) == 0 || errno == EPERM;
+#endif
+}
 
-            in.seekg(0, std::ios::end);
-            uint32_t FileLength = in.tellg();
-            in.seekg(0, std::ios::beg);
+void CGHost::RemoveStaleReplayParts()
+{
+    // the part files are named ghost-<host name>-<process ID>-<start time>-<host counter>.w3g.part (see m_RunID)
+    // a part file is only deleted once the process that wrote it has exited since other bots might be sharing bot_replaypath
+    // we can't check a process on another host (or in another container) so those are only deleted once they haven't been written to for a day
 
-            while (!in.eof())
-            {
-                getline(in, Line);
+    std::error_code Error;
+    std::filesystem::directory_iterator i(m_ReplayPath.empty() ? std::filesystem::path(".") : std::filesystem::path(m_ReplayPath), Error);
 
-                if (Line.empty())
-                    continue;
+    for (; !Error && i != std::filesystem::directory_iterator(); i.increment(Error))
+    {
+        std::string Name = i->path().filename().string();
 
-                parser << Line;
-                parser >> IP1;
-                parser >> IP2;
-                parser >> Country;
-                m_DBLocal->FromAdd(UTIL_ToUInt32(IP1), UTIL_ToUInt32(IP2), Country);
+        if (Name.size() <= 9 || Name.substr(Name.size() - 9) != ".w3g.part")
+            continue;
 
-                // it's probably going to take awhile to load the iptocountry data (~10 seconds on my 3.2 GHz P4 when using SQLite3)
-                // so let's print a progress meter just to keep the user from getting worried
+        std::vector<std::string> Parts = UTIL_Tokenize(Name.substr(0, Name.size() - 9), '-');
 
-                unsigned char NewPercent = (unsigned char)((float)in.tellg() / FileLength * 100);
+        if (Parts.size() != 5 || Parts[0] != "ghost" || Parts[2].empty() || Parts[2].find_first_not_of("1234567890") != std::string::npos)
+        {
+            CONSOLE_Print("[GHOST] warning - found replay part file [" + i->path().string() + "] written by an older version, delete it if no other bot is using it");
+            continue;
+        }
 
-                if (NewPercent != Percent && NewPercent % 10 == 0)
-                {
-                    Percent = NewPercent;
-                    CONSOLE_Print("[GHOST] iptocountry data: " + UTIL_ToString(Percent) + "% loaded");
-                }
-            }
+        if (Parts[1] == m_HostName)
+        {
+            if (ProcessRunning(UTIL_ToUInt32(Parts[2])))
+                continue;
+        }
+        else
+        {
+            std::filesystem::file_time_type WriteTime = std::filesystem::last_write_time(i->path(), Error);
 
-            if (!m_DBLocal->Commit())
-                CONSOLE_Print("[GHOST] warning - failed to commit local database transaction, iptocountry data not loaded");
-            else
-                CONSOLE_Print("[GHOST] finished loading [ip-to-country.csv]");
+            if (Error || std::filesystem::file_time_type::clock::now() - WriteTime < std::chrono::hours(24))
+            {
+                Error.clear();
+                continue;
+            }
         }
 
-        in.close();
+        CONSOLE_Print("[GHOST] deleting stale replay part file [" + i->path().string() + "], the game it was recorded in didn't finish");
+        std::filesystem::remove(i->path(), Error);
+        Error.clear();
     }
 }
 
@@ -2049,3 +2313,36 @@ std::string CGHost::CalcStatString(CMap *map)
     std::string s_StatString = std::string(StatString.begin(), StatString.end());
     return s_StatString;
 }
+
+bool CGHost::AuthCheck(std::string name)
+{
+    // this never blocks, it answers from the cache and queues a threaded auth check if the cached answer is missing or stale
+    // players that passed are remembered for m_AuthCacheTime seconds, players that failed are checked again after a few seconds since they might just not be in the database yet
+
+    transform(name.begin(), name.end(), name.begin(), (int (*)(int))tolower);
+    bool Result = false;
+    std::map<std::string, std::pair<bool, uint32_t>>::iterator Cached = m_AuthCache.find(name);
+
+    if (Cached != m_AuthCache.end())
+    {
+        Result = Cached->second.first;
+
+        if (GetTime() - Cached->second.second < (Result ? m_AuthCacheTime : 5))
+            return Result;
+    }
+
+    // a stale pass is still used while we check again in the background
+
+    for (std::vector<CCallableAuthCheck *>::iterator i = m_AuthChecks.begin(); i != m_AuthChecks.end(); i++)
+    {
+        if ((*i)->GetUser() == name)
+            return Result;
+    }
+
+    CCallableAuthCheck *Callable = m_DB->ThreadedAuthCheck(name);
+
+    if (Callable)
+        m_AuthChecks.push_back(Callable);
+
+    return Result;
+}
@@ -22,6 +22,10 @@
 
 #include "includes.h"
 
+#include <atomic>
+#include <functional>
+#include <mutex>
+
 //
 // CGHost
 //
@@ -29,6 +33,7 @@
 class CUDPSocket;
 class CTCPServer;
 class CTCPSocket;
+class CConnectionLimiter;
 class CStatusBroadcaster;
 class CGPSProtocol;
 class CGCBIProtocol;
@@ -39,6 +44,13 @@ class CBaseGame;
 class CAdminGame;
 class CGHostDB;
 class CBaseCallable;
+class CCallableAuthCheck;
+class CIPToCountry;
+class CIPBlackList;
+class CReplaySave;
+class CDownloadScheduler;
+class CGameThreadPool;
+class CMetricsServer;
 class CLanguage;
 class CMap;
 class CSaveGame;
@@ -48,11 +60,11 @@ class CGHost
 {
 public:
     uint32_t m_gameoverminpercent;
-    bool m_AddCompsAllowed;        // config value: разрешить ли добавлять компы для админского слота
-    bool m_DesyncKick;             // config value: кикать ли при десинках
-    uint32_t m_RehostDelay;        // config value: задержка между рехостами
-    std::string m_ObserverSlots;   // config value: слоты в которые нельзя свапать
-    std::string m_TMProotPassword; // config value: пароль от временной админки
+    bool m_AddCompsAllowed;         // config value: разрешить ли добавлять компы для админского слота
+    std::atomic<bool> m_DesyncKick; // config value: кикать ли при десинках (changed by !desync on the game threads)
+    uint32_t m_RehostDelay;         // config value: задержка между рехостами
+    std::string m_ObserverSlots;    // config value: слоты в которые нельзя свапать
+    std::string m_TMProotPassword;  // config value: пароль от временной админки
 
     bool m_TCPStatus;                        // config value: рассылать ли статусы
     CStatusBroadcaster *m_StatusBroadcaster; // рассыльщик статусов
@@ -72,6 +84,22 @@ public:
     CGHostDB *m_DB;                           // database
     CGHostDB *m_DBLocal;                      // local database (for temporary data)
     std::vector<CBaseCallable *> m_Callables; // std::vector of orphaned callables waiting to die
+
+    std::vector<CCallableAuthCheck *> m_AuthChecks;               // threaded auth checks in progress (at most one per player name)
+    std::map<std::string, std::pair<bool, uint32_t>> m_AuthCache; // lowercase player name -> auth check result and the GetTime when we got it
+    uint32_t m_LastAuthCachePruneTime;                            // GetTime when the auth cache was last pruned
+
+    CIPToCountry *m_IPToCountry;              // sorted iptocountry ranges (replaces the old temporary iptocountry table in the local database)
+    std::vector<CReplaySave *> m_ReplaySaves; // replays being saved in the background
+    CDownloadScheduler *m_DownloadScheduler;  // sends map parts to the downloaders in every lobby
+    CMetricsServer *m_MetricsServer;          // serves the per game metrics over HTTP (NULL if bot_metricsport is 0)
+    CConnectionLimiter *m_ConnectionLimiter;  // limits how often each IP address can connect to the lobbies (main thread only, the lobbies are always on the main thread)
+    CIPBlackList *m_IPBlackList;              // the IP blacklist shared by every lobby, loaded from m_IPBlackListFile and loaded again when it changes (main thread only)
+
+    CGameThreadPool *m_GameThreads;                // runs the games in progress on worker threads (NULL if bot_gamethreads is 0)
+    std::mutex m_MessagesMutex;                    // protects m_Messages
+    std::vector<std::function<void()>> m_Messages; // messages from the game threads waiting to be run on the main thread
+
     std::vector<BYTEARRAY> m_LocalAddresses;  // std::vector of local IP addresses
     CLanguage *m_Language;                    // language
     CMap *m_Map;                              // the currently loaded map
@@ -79,11 +107,13 @@ public:
     CMap *m_AutoHostMap;                      // the map to use when autohosting
     CSaveGame *m_SaveGame;                    // the save game to use
     std::vector<PIDPlayer> m_EnforcePlayers;  // std::vector of pids to force players to use in the next game (used with saved games)
-    bool m_Exiting;                           // set to true to force ghost to shutdown next update (used by SignalCatcher)
+    bool m_Exiting;                           // set to true to force ghost to shutdown next update (used by CheckSignals)
     bool m_ExitingNice;                       // set to true to force ghost to disconnect from all battle.net connections and wait for all games to finish before shutting down
     bool m_Enabled;                           // set to false to prevent new games from being created
     std::string m_Version;                    // GHost++ version string
     uint32_t m_HostCounter;                   // the current host counter (a unique number to identify a game, incremented each time a game is created)
+    std::string m_HostName;                   // the host name (with anything that can't be part of m_RunID replaced)
+    std::string m_RunID;                      // the host name, process ID and start time, added to the names of the replay part files and captures so they don't collide with other bots or earlier runs
     std::string m_AutoHostGameName;           // the base game name to auto host with
     std::string m_AutoHostOwner;
     std::string m_AutoHostServer;
@@ -93,60 +123,60 @@ public:
     bool m_AutoHostMatchMaking;
     double m_AutoHostMinimumScore;
     double m_AutoHostMaximumScore;
-    bool m_AllGamesFinished;         // if all games finished (used when exiting nicely)
-    uint32_t m_AllGamesFinishedTime; // GetTime when all games finished (used when exiting nicely)
-    std::string m_LanguageFile;      // config value: language file
-    std::string m_Warcraft3Path;     // config value: Warcraft 3 path
-    bool m_TFT;                      // config value: TFT enabled or not
-    std::string m_BindAddress;       // config value: the address to host games on
-    uint16_t m_HostPort;             // config value: the port to host games on
-    bool m_Reconnect;                // config value: GProxy++ reliable reconnects enabled or not
-    uint16_t m_ReconnectPort;        // config value: the port to listen for GProxy++ reliable reconnects on
-    uint32_t m_ReconnectWaitTime;    // config value: the maximum number of minutes to wait for a GProxy++ reliable reconnect
-    uint32_t m_MaxGames;             // config value: maximum number of games in progress
-    char m_CommandTrigger;           // config value: the command trigger inside games
-    std::string m_MapCFGPath;        // config value: map cfg path
-    std::string m_SaveGamePath;      // config value: savegame path
-    std::string m_MapPath;           // config value: map path
-    bool m_SaveReplays;              // config value: save replays
-    std::string m_ReplayPath;        // config value: replay path
-    std::string m_VirtualHostName;   // config value: virtual host name
-    bool m_HideIPAddresses;          // config value: hide IP addresses from players
-    bool m_CheckMultipleIPUsage;     // config value: check for multiple IP address usage
-    uint32_t m_SpoofChecks;          // config value: do automatic spoof checks or not
-    bool m_RequireSpoofChecks;       // config value: require spoof checks or not
-    bool m_ReserveAdmins;            // config value: consider admins to be reserved players or not
-    bool m_RefreshMessages;          // config value: display refresh messages or not (by default)
-    bool m_AutoLock;                 // config value: auto lock games when the owner is present
-    bool m_AutoSave;                 // config value: auto save before someone disconnects
-    uint32_t m_AllowDownloads;       // config value: allow map downloads or not
-    bool m_PingDuringDownloads;      // config value: ping during map downloads or not
-    uint32_t m_MaxDownloaders;       // config value: maximum number of map downloaders at the same time
-    uint32_t m_MaxDownloadSpeed;     // config value: maximum total map download speed in KB/sec
-    bool m_LCPings;                  // config value: use LC style pings (divide actual pings by two)
-    uint32_t m_AutoKickPing;         // config value: auto kick players with ping higher than this
-    uint32_t m_BanMethod;            // config value: ban method (ban by name/ip/both)
-    std::string m_IPBlackListFile;   // config value: IP blacklist file (ipblacklist.txt)
-    uint32_t m_LobbyTimeLimit;       // config value: auto close the game lobby after this many minutes without any reserved players
-    uint32_t m_Latency;              // config value: the latency (by default)
-    uint32_t m_SyncLimit;            // config value: the maximum number of packets a player can fall out of sync before starting the lag screen (by default)
-    bool m_VoteKickAllowed;          // config value: if votekicks are allowed or not
-    uint32_t m_VoteKickPercentage;   // config value: percentage of players required to vote yes for a votekick to pass
-    std::string m_DefaultMap;        // config value: default map (map.cfg)
-    std::string m_MOTDFile;          // config value: motd.txt
-    std::string m_GameLoadedFile;    // config value: gameloaded.txt
-    std::string m_GameOverFile;      // config value: gameover.txt
-    bool m_LocalAdminMessages;       // config value: send local admin messages or not
-    bool m_AdminGameCreate;          // config value: create the admin game or not
-    uint16_t m_AdminGamePort;        // config value: the port to host the admin game on
-    std::string m_AdminGamePassword; // config value: the admin game password
-    std::string m_AdminGameMap;      // config value: the admin game map config to use
-    unsigned char m_LANWar3Version;  // config value: LAN warcraft 3 version
-    uint32_t m_ReplayWar3Version;    // config value: replay warcraft 3 version (for saving replays)
-    uint32_t m_ReplayBuildNumber;    // config value: replay build number (for saving replays)
-    bool m_TCPNoDelay;               // config value: use Nagle's algorithm or not
-    uint32_t m_MatchMakingMethod;    // config value: the matchmaking method
-    bool m_UseNormalCountDown;       // config value: use normal wc3 countdown
+    bool m_AllGamesFinished;                // if all games finished (used when exiting nicely)
+    uint32_t m_AllGamesFinishedTime;        // GetTime when all games finished (used when exiting nicely)
+    std::string m_LanguageFile;             // config value: language file
+    std::string m_Warcraft3Path;            // config value: Warcraft 3 path
+    bool m_TFT;                             // config value: TFT enabled or not
+    std::string m_BindAddress;              // config value: the address to host games on
+    uint16_t m_HostPort;                    // config value: the port to host games on
+    bool m_Reconnect;                       // config value: GProxy++ reliable reconnects enabled or not
+    uint16_t m_ReconnectPort;               // config value: the port to listen for GProxy++ reliable reconnects on
+    uint32_t m_ReconnectWaitTime;           // config value: the maximum number of minutes to wait for a GProxy++ reliable reconnect
+    uint32_t m_MaxGames;                    // config value: maximum number of games in progress
+    char m_CommandTrigger;                  // config value: the command trigger inside games
+    std::string m_MapCFGPath;               // config value: map cfg path
+    std::string m_SaveGamePath;             // config value: savegame path
+    std::string m_MapPath;                  // config value: map path
+    bool m_SaveReplays;                     // config value: save replays
+    std::string m_ReplayPath;               // config value: replay path
+    std::string m_VirtualHostName;          // config value: virtual host name
+    bool m_HideIPAddresses;                 // config value: hide IP addresses from players
+    bool m_CheckMultipleIPUsage;            // config value: check for multiple IP address usage
+    uint32_t m_SpoofChecks;                 // config value: do automatic spoof checks or not
+    bool m_RequireSpoofChecks;              // config value: require spoof checks or not
+    bool m_ReserveAdmins;                   // config value: consider admins to be reserved players or not
+    bool m_RefreshMessages;                 // config value: display refresh messages or not (by default)
+    bool m_AutoLock;                        // config value: auto lock games when the owner is present
+    bool m_AutoSave;                        // config value: auto save before someone disconnects
+    uint32_t m_AllowDownloads;              // config value: allow map downloads or not
+    bool m_PingDuringDownloads;             // config value: ping during map downloads or not
+    uint32_t m_MaxDownloaders;              // config value: maximum number of map downloaders at the same time
+    uint32_t m_MaxDownloadSpeed;            // config value: maximum total map download speed in KB/sec
+    bool m_LCPings;                         // config value: use LC style pings (divide actual pings by two)
+    uint32_t m_AutoKickPing;                // config value: auto kick players with ping higher than this
+    uint32_t m_BanMethod;                   // config value: ban method (ban by name/ip/both)
+    std::string m_IPBlackListFile;          // config value: IP blacklist file (ipblacklist.txt)
+    uint32_t m_LobbyTimeLimit;              // config value: auto close the game lobby after this many minutes without any reserved players
+    uint32_t m_Latency;                     // config value: the latency (by default)
+    uint32_t m_SyncLimit;                   // config value: the maximum number of packets a player can fall out of sync before starting the lag screen (by default)
+    bool m_VoteKickAllowed;                 // config value: if votekicks are allowed or not
+    uint32_t m_VoteKickPercentage;          // config value: percentage of players required to vote yes for a votekick to pass
+    std::string m_DefaultMap;               // config value: default map (map.cfg)
+    std::string m_MOTDFile;                 // config value: motd.txt
+    std::string m_GameLoadedFile;           // config value: gameloaded.txt
+    std::string m_GameOverFile;             // config value: gameover.txt
+    bool m_LocalAdminMessages;              // config value: send local admin messages or not
+    bool m_AdminGameCreate;                 // config value: create the admin game or not
+    uint16_t m_AdminGamePort;               // config value: the port to host the admin game on
+    std::string m_AdminGamePassword;        // config value: the admin game password
+    std::string m_AdminGameMap;             // config value: the admin game map config to use
+    unsigned char m_LANWar3Version;         // config value: LAN warcraft 3 version
+    uint32_t m_ReplayWar3Version;           // config value: replay warcraft 3 version (for saving replays)
+    uint32_t m_ReplayBuildNumber;           // config value: replay build number (for saving replays)
+    bool m_TCPNoDelay;                      // config value: use Nagle's algorithm or not
+    uint32_t m_MatchMakingMethod;           // config value: the matchmaking method
+    std::atomic<bool> m_UseNormalCountDown; // config value: use normal wc3 countdown (changed by !normalcountdown on the game threads)
 
     std::string m_ApprovedCountries; // custom value: approved countries
     // @disturbed_oc
@@ -161,6 +191,17 @@ public:
     uint32_t m_AllowDownloads2;  // config value: allow map downloads or not
     bool m_HideCommands;         // custom value: hide or show commands
     bool m_WhisperResponses;     // config value: have ghost whisper responses to most commands regardless of how you communicated
+    uint32_t m_AuthCacheTime;    // config value: how many seconds to remember that a player passed the auth check
+
+    uint32_t m_MaxPlayerDownloadSpeed; // config value: maximum map download speed of each downloader in KB/sec
+    uint32_t m_NumGameThreads;         // config value: number of threads to run the games in progress on (0 to run them on the main thread)
+    uint32_t m_ListenBacklog;          // config value: the lobby listeners' backlog (connections the kernel holds until we accept them)
+
+    bool m_Capture;                            // config value: capture the connections of the players matching the filters (see capture.h)
+    std::string m_CapturePath;                 // config value: the directory to write the capture files to
+    std::vector<std::string> m_CaptureGames;   // config value: only capture games whose names contain one of these words (lowercase, empty to capture every game)
+    std::vector<std::string> m_CapturePlayers; // config value: only capture these players (lowercase, empty to capture every player)
+    bool m_CaptureBNET;                        // config value: capture the battle.net connections too
 
     CGHost(CConfig *CFG);
     ~CGHost();
@@ -193,11 +234,18 @@ public:
 
     // other functions
 
+    void QueueMessage(std::function<void()> message);
+    void RunMessages();
+    void SendLocalAdminChatToGames(std::string message);
     void ReloadConfigs();
     void SetConfigs(CConfig *CFG);
+    bool GetCaptureGame(std::string gameName);
+    bool GetCapturePlayer(std::string name);
     void ExtractScripts();
     void LoadIPToCountryData();
+    void RemoveStaleReplayParts();
     void CreateGame(CMap *map, unsigned char gameState, bool saveGame, std::string gameName, std::string ownerName, std::string creatorName, std::string creatorServer, bool whisper);
     CBaseGame *GetGame(); //текущая игра, лобби или стартанутая
+    bool AuthCheck(std::string name);
     std::string CalcStatString(CMap *map);
 };
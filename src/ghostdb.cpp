@@ -150,16 +150,6 @@ CDBDotAPlayerSummary *CGHostDB::DotAPlayerSummaryCheck(std::string name)
     return NULL;
 }
 
-std::string CGHostDB::FromCheck(uint32_t ip)
-{
-    return "??";
-}
-
-bool CGHostDB::FromAdd(uint32_t ip1, uint32_t ip2, std::string country)
-{
-    return false;
-}
-
 bool CGHostDB::DownloadAdd(std::string map, uint32_t mapsize, std::string name, std::string ip, uint32_t spoofed, std::string spoofedrealm, uint32_t downloadtime)
 {
     return false;
@@ -200,6 +190,11 @@ CCallableAdminCheck *CGHostDB::ThreadedAdminCheck(std::string server, std::strin
     return NULL;
 }
 
+CCallableAuthCheck *CGHostDB::ThreadedAuthCheck(std::string user)
+{
+    return NULL;
+}
+
 CCallableAdminAdd *CGHostDB::ThreadedAdminAdd(std::string server, std::string user)
 {
     return NULL;
@@ -328,6 +323,10 @@ CCallableAdminCheck::~CCallableAdminCheck()
 {
 }
 
+CCallableAuthCheck::~CCallableAuthCheck()
+{
+}
+
 CCallableAdminAdd::~CCallableAdminAdd()
 {
 }
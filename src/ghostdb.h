@@ -30,6 +30,7 @@ class CConfig;
 class CBaseCallable;
 class CCallableAdminCount;
 class CCallableAdminCheck;
+class CCallableAuthCheck;
 class CCallableAdminAdd;
 class CCallableAdminRemove;
 class CCallableAdminList;
@@ -96,8 +97,6 @@ public:
     virtual uint32_t DotAPlayerAdd(uint32_t gameid, uint32_t colour, uint32_t kills, uint32_t deaths, uint32_t creepkills, uint32_t creepdenies, uint32_t assists, uint32_t gold, uint32_t neutralkills, std::string item1, std::string item2, std::string item3, std::string item4, std::string item5, std::string item6, std::string hero, uint32_t newcolour, uint32_t towerkills, uint32_t raxkills, uint32_t courierkills);
     virtual uint32_t DotAPlayerCount(std::string name);
     virtual CDBDotAPlayerSummary *DotAPlayerSummaryCheck(std::string name);
-    virtual std::string FromCheck(uint32_t ip);
-    virtual bool FromAdd(uint32_t ip1, uint32_t ip2, std::string country);
     virtual bool DownloadAdd(std::string map, uint32_t mapsize, std::string name, std::string ip, uint32_t spoofed, std::string spoofedrealm, uint32_t downloadtime);
     virtual uint32_t W3MMDPlayerAdd(std::string category, uint32_t gameid, uint32_t pid, std::string name, std::string flag, uint32_t leaver, uint32_t practicing);
     virtual bool W3MMDVarAdd(uint32_t gameid, std::map<VarP, int32_t> var_ints);
@@ -109,6 +108,7 @@ public:
     virtual void CreateThread(CBaseCallable *callable);
     virtual CCallableAdminCount *ThreadedAdminCount(std::string server);
     virtual CCallableAdminCheck *ThreadedAdminCheck(std::string server, std::string user);
+    virtual CCallableAuthCheck *ThreadedAuthCheck(std::string user);
     virtual CCallableAdminAdd *ThreadedAdminAdd(std::string server, std::string user);
     virtual CCallableAdminRemove *ThreadedAdminRemove(std::string server, std::string user);
     virtual CCallableAdminList *ThreadedAdminList(std::string server);
@@ -210,6 +210,21 @@ public:
     virtual void SetResult(bool nResult) { m_Result = nResult; }
 };
 
+class CCallableAuthCheck : virtual public CBaseCallable
+{
+protected:
+    std::string m_User;
+    bool m_Result;
+
+public:
+    CCallableAuthCheck(std::string nUser) : CBaseCallable(), m_User(nUser), m_Result(false) {}
+    virtual ~CCallableAuthCheck();
+
+    virtual std::string GetUser() { return m_User; }
+    virtual bool GetResult() { return m_Result; }
+    virtual void SetResult(bool nResult) { m_Result = nResult; }
+};
+
 class CCallableAdminAdd : virtual public CBaseCallable
 {
 protected:
@@ -34,6 +34,181 @@
 #include <mysql/mysql.h>
 #include <thread>
 
+//
+// CMySQLWorkerPool
+//
+
+CMySQLWorkerPool::CMySQLWorkerPool(uint32_t numWorkers, void *firstConnection, std::string nServer, std::string nDatabase, std::string nUser, std::string nPassword, uint16_t nPort)
+{
+    m_Server         = nServer;
+    m_Database       = nDatabase;
+    m_User           = nUser;
+    m_Password       = nPassword;
+    m_Port           = nPort;
+    m_Exiting        = false;
+    m_NumBusy        = 0;
+    m_NumConnected   = firstConnection ? 1 : 0;
+    m_NumRun         = 0;
+    m_PeakQueued     = 0;
+    m_TotalWaitTicks = 0;
+    m_MaxWaitTicks   = 0;
+    m_TotalRunTicks  = 0;
+    m_MaxRunTicks    = 0;
+
+    if (numWorkers == 0)
+        numWorkers = 1;
+
+    // the first worker takes over the connection we opened on startup, the rest connect when they run their first callable
+
+    for (uint32_t i = 0; i < numWorkers; i++)
+        m_Workers.push_back(std::thread(&CMySQLWorkerPool::Run, this, i == 0 ? firstConnection : NULL));
+}
+
+CMySQLWorkerPool::~CMySQLWorkerPool()
+{
+    // let the workers finish whatever is still queued (e.g. the stats of a game that just ended) before they close their connections
+
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_Exiting = true;
+    }
+
+    m_JobQueued.notify_all();
+
+    for (std::vector<std::thread>::iterator i = m_Workers.begin(); i != m_Workers.end(); i++)
+        i->join();
+}
+
+uint32_t CMySQLWorkerPool::GetQueueDepth()
+{
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+    return m_Jobs.size();
+}
+
+std::string CMySQLWorkerPool::GetStatus()
+{
+    std::lock_guard<std::mutex> Lock(m_Mutex);
+
+    std::string Status = "Workers: " + UTIL_ToString(m_NumBusy) + "/" + UTIL_ToString(m_Workers.size()) + " busy, " + UTIL_ToString(m_NumConnected) + " connected. Queued: " + UTIL_ToString(m_Jobs.size()) + " (peak " + UTIL_ToString(m_PeakQueued) + ").";
+
+    if (m_NumRun > 0)
+        Status += " Last " + UTIL_ToString(m_NumRun) + " queries waited " + UTIL_ToString((uint32_t)(m_TotalWaitTicks / m_NumRun)) + "ms avg/" + UTIL_ToString(m_MaxWaitTicks) + "ms max and ran " + UTIL_ToString((uint32_t)(m_TotalRunTicks / m_NumRun)) + "ms avg/" + UTIL_ToString(m_MaxRunTicks) + "ms max.";
+
+    m_NumRun         = 0;
+    m_PeakQueued     = m_Jobs.size();
+    m_TotalWaitTicks = 0;
+    m_MaxWaitTicks   = 0;
+    m_TotalRunTicks  = 0;
+    m_MaxRunTicks    = 0;
+    return Status;
+}
+
+void CMySQLWorkerPool::Queue(CBaseCallable *callable)
+{
+    {
+        std::lock_guard<std::mutex> Lock(m_Mutex);
+        m_Jobs.push(std::make_pair(callable, GetTicks()));
+
+        if (m_Jobs.size() > m_PeakQueued)
+            m_PeakQueued = m_Jobs.size();
+    }
+
+    m_JobQueued.notify_one();
+}
+
+void *CMySQLWorkerPool::Connect()
+{
+    MYSQL *Connection = mysql_init(NULL);
+
+    if (!Connection)
+        return NULL;
+
+    my_bool Reconnect = true;
+    mysql_options(Connection, MYSQL_OPT_RECONNECT, &Reconnect);
+
+    if (!mysql_real_connect(Connection, m_Server.c_str(), m_User.c_str(), m_Password.c_str(), m_Database.c_str(), m_Port, NULL, 0))
+    {
+        mysql_close(Connection);
+        return NULL;
+    }
+
+    return Connection;
+}
+
+void CMySQLWorkerPool::Run(void *connection)
+{
+#ifndef WIN32
+    // disable SIGPIPE since this is a new thread and it doesn't inherit the spawning thread's signal handlers
+    // MySQL should automatically disable SIGPIPE when we initialize it but we do so anyway here
+
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    mysql_thread_init();
+
+    while (true)
+    {
+        std::unique_lock<std::mutex> Lock(m_Mutex);
+
+        while (m_Jobs.empty() && !m_Exiting)
+            m_JobQueued.wait(Lock);
+
+        if (m_Jobs.empty())
+            break;
+
+        CBaseCallable *Callable = m_Jobs.front().first;
+        uint32_t QueuedTicks    = m_Jobs.front().second;
+        m_Jobs.pop();
+        m_NumBusy++;
+        Lock.unlock();
+
+        // (re)connect if we don't have a connection yet or the last attempt failed
+        // if it fails again the callable reports the error when it's recovered
+
+        if (!connection)
+        {
+            connection = Connect();
+
+            if (connection)
+            {
+                Lock.lock();
+                m_NumConnected++;
+                Lock.unlock();
+            }
+        }
+
+        uint32_t StartTicks = GetTicks();
+
+        // the callable may be deleted by the main thread as soon as it's marked as ready so don't touch it after running it
+
+        CMySQLCallable *MySQLCallable = dynamic_cast<CMySQLCallable *>(Callable);
+
+        if (MySQLCallable)
+            MySQLCallable->SetConnection(connection);
+
+        (*Callable)();
+
+        uint32_t EndTicks = GetTicks();
+
+        Lock.lock();
+        m_NumBusy--;
+        m_NumRun++;
+        m_TotalWaitTicks += StartTicks - QueuedTicks;
+        m_TotalRunTicks += EndTicks - StartTicks;
+
+        if (StartTicks - QueuedTicks > m_MaxWaitTicks)
+            m_MaxWaitTicks = StartTicks - QueuedTicks;
+
+        if (EndTicks - StartTicks > m_MaxRunTicks)
+            m_MaxRunTicks = EndTicks - StartTicks;
+    }
+
+    if (connection)
+        mysql_close((MYSQL *)connection);
+
+    mysql_thread_end();
+}
+
 //
 // CGHostDBMySQL
 //
@@ -46,7 +221,7 @@ CGHostDBMySQL::CGHostDBMySQL(CConfig *CFG) : CGHostDB(CFG)
     m_Password             = CFG->GetString("db_mysql_password", std::string());
     m_Port                 = CFG->GetInt("db_mysql_port", 0);
     m_BotID                = CFG->GetInt("db_mysql_botid", 0);
-    m_NumConnections       = 1;
+    m_WorkerPool           = NULL;
     m_OutstandingCallables = 0;
 
     mysql_library_init(0, NULL, NULL);
@@ -75,17 +250,18 @@ CGHostDBMySQL::CGHostDBMySQL(CConfig *CFG) : CGHostDB(CFG)
         return;
     }
 
-    m_IdleConnections.push(Connection);
+    // the connection is handed over to the worker pool which runs all the threaded database functions
+
+    m_WorkerPool = new CMySQLWorkerPool(CFG->GetInt("db_mysql_workers", 4), Connection, m_Server, m_Database, m_User, m_Password, m_Port);
+    CONSOLE_Print("[MYSQL] started " + UTIL_ToString(m_WorkerPool->GetNumWorkers()) + " database worker threads");
 }
 
 CGHostDBMySQL::~CGHostDBMySQL()
 {
-    CONSOLE_Print("[MYSQL] closing " + UTIL_ToString(m_IdleConnections.size()) + "/" + UTIL_ToString(m_NumConnections) + " idle MySQL connections");
-
-    while (!m_IdleConnections.empty())
+    if (m_WorkerPool)
     {
-        mysql_close((MYSQL *)m_IdleConnections.front());
-        m_IdleConnections.pop();
+        CONSOLE_Print("[MYSQL] waiting for " + UTIL_ToString(m_WorkerPool->GetQueueDepth()) + " queued queries and closing the database worker threads");
+        delete m_WorkerPool;
     }
 
     if (m_OutstandingCallables > 0)
@@ -96,7 +272,10 @@ CGHostDBMySQL::~CGHostDBMySQL()
 
 std::string CGHostDBMySQL::GetStatus()
 {
-    return "DB STATUS --- Connections: " + UTIL_ToString(m_IdleConnections.size()) + "/" + UTIL_ToString(m_NumConnections) + " idle. Outstanding callables: " + UTIL_ToString(m_OutstandingCallables) + ".";
+    if (!m_WorkerPool)
+        return "DB STATUS --- Not connected.";
+
+    return "DB STATUS --- " + m_WorkerPool->GetStatus() + " Outstanding callables: " + UTIL_ToString(m_OutstandingCallables) + ".";
 }
 
 void CGHostDBMySQL::RecoverCallable(CBaseCallable *callable)
@@ -105,13 +284,7 @@ void CGHostDBMySQL::RecoverCallable(CBaseCallable *callable)
 
     if (MySQLCallable)
     {
-        if (m_IdleConnections.size() > 30)
-        {
-            mysql_close((MYSQL *)MySQLCallable->GetConnection());
-            m_NumConnections--;
-        }
-        else
-            m_IdleConnections.push(MySQLCallable->GetConnection());
+        // the connection belongs to the worker that ran the callable so there's nothing to give back here
 
         if (m_OutstandingCallables == 0)
             CONSOLE_Print("[MYSQL] recovered a mysql callable with zero outstanding");
@@ -127,37 +300,17 @@ void CGHostDBMySQL::RecoverCallable(CBaseCallable *callable)
 
 void CGHostDBMySQL::CreateThread(CBaseCallable *callable)
 {
-    try
-    {
-        std::thread t = std::thread(std::ref(*callable));
-        t.detach();
-    }
-    catch (const std::exception &ex)
-    {
-        CONSOLE_Print("[MYSQL] error spawning thread on attempt #1 [" + std::string(ex.what()) + "], pausing execution and trying again in 50ms");
-        MILLISLEEP(50);
+    // we don't actually create a thread anymore, the callable waits in the worker pool's queue until a worker is free
 
-        try
-        {
-            std::thread t = std::thread(std::ref(*callable));
-            t.detach();
-        }
-        catch (const std::exception &ex)
-        {
-            CONSOLE_Print("[MYSQL] error spawning thread on attempt #2 [" + std::string(ex.what()) + "], giving up");
-            callable->SetReady(true);
-        }
-    }
+    if (m_WorkerPool)
+        m_WorkerPool->Queue(callable);
+    else
+        callable->SetReady(true);
 }
 
 CCallableAdminCount *CGHostDBMySQL::ThreadedAdminCount(std::string server)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableAdminCount *Callable = new CMySQLCallableAdminCount(server, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableAdminCount *Callable = new CMySQLCallableAdminCount(server, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -165,12 +318,15 @@ CCallableAdminCount *CGHostDBMySQL::ThreadedAdminCount(std::string server)
 
 CCallableAdminCheck *CGHostDBMySQL::ThreadedAdminCheck(std::string server, std::string user)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
+    CCallableAdminCheck *Callable = new CMySQLCallableAdminCheck(server, user, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CreateThread(Callable);
+    m_OutstandingCallables++;
+    return Callable;
+}
 
-    CCallableAdminCheck *Callable = new CMySQLCallableAdminCheck(server, user, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+CCallableAuthCheck *CGHostDBMySQL::ThreadedAuthCheck(std::string user)
+{
+    CCallableAuthCheck *Callable = new CMySQLCallableAuthCheck(user, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -178,12 +334,7 @@ CCallableAdminCheck *CGHostDBMySQL::ThreadedAdminCheck(std::string server, std::
 
 CCallableAdminAdd *CGHostDBMySQL::ThreadedAdminAdd(std::string server, std::string user)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableAdminAdd *Callable = new CMySQLCallableAdminAdd(server, user, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableAdminAdd *Callable = new CMySQLCallableAdminAdd(server, user, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -191,12 +342,7 @@ CCallableAdminAdd *CGHostDBMySQL::ThreadedAdminAdd(std::string server, std::stri
 
 CCallableAdminRemove *CGHostDBMySQL::ThreadedAdminRemove(std::string server, std::string user)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableAdminRemove *Callable = new CMySQLCallableAdminRemove(server, user, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableAdminRemove *Callable = new CMySQLCallableAdminRemove(server, user, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -204,12 +350,7 @@ CCallableAdminRemove *CGHostDBMySQL::ThreadedAdminRemove(std::string server, std
 
 CCallableAdminList *CGHostDBMySQL::ThreadedAdminList(std::string server)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableAdminList *Callable = new CMySQLCallableAdminList(server, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableAdminList *Callable = new CMySQLCallableAdminList(server, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -217,12 +358,7 @@ CCallableAdminList *CGHostDBMySQL::ThreadedAdminList(std::string server)
 
 CCallableBanCount *CGHostDBMySQL::ThreadedBanCount(std::string server)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableBanCount *Callable = new CMySQLCallableBanCount(server, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableBanCount *Callable = new CMySQLCallableBanCount(server, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -230,12 +366,7 @@ CCallableBanCount *CGHostDBMySQL::ThreadedBanCount(std::string server)
 
 CCallableBanCheck *CGHostDBMySQL::ThreadedBanCheck(std::string server, std::string user, std::string ip)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableBanCheck *Callable = new CMySQLCallableBanCheck(server, user, ip, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableBanCheck *Callable = new CMySQLCallableBanCheck(server, user, ip, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -243,12 +374,7 @@ CCallableBanCheck *CGHostDBMySQL::ThreadedBanCheck(std::string server, std::stri
 
 CCallableBanAdd *CGHostDBMySQL::ThreadedBanAdd(std::string server, std::string user, std::string ip, std::string gamename, std::string admin, std::string reason)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableBanAdd *Callable = new CMySQLCallableBanAdd(server, user, ip, gamename, admin, reason, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableBanAdd *Callable = new CMySQLCallableBanAdd(server, user, ip, gamename, admin, reason, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -256,12 +382,7 @@ CCallableBanAdd *CGHostDBMySQL::ThreadedBanAdd(std::string server, std::string u
 
 CCallableBanRemove *CGHostDBMySQL::ThreadedBanRemove(std::string server, std::string user)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableBanRemove *Callable = new CMySQLCallableBanRemove(server, user, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableBanRemove *Callable = new CMySQLCallableBanRemove(server, user, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -269,12 +390,7 @@ CCallableBanRemove *CGHostDBMySQL::ThreadedBanRemove(std::string server, std::st
 
 CCallableBanRemove *CGHostDBMySQL::ThreadedBanRemove(std::string user)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableBanRemove *Callable = new CMySQLCallableBanRemove(std::string(), user, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableBanRemove *Callable = new CMySQLCallableBanRemove(std::string(), user, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -282,12 +398,7 @@ CCallableBanRemove *CGHostDBMySQL::ThreadedBanRemove(std::string user)
 
 CCallableBanList *CGHostDBMySQL::ThreadedBanList(std::string server)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableBanList *Callable = new CMySQLCallableBanList(server, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableBanList *Callable = new CMySQLCallableBanList(server, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -295,12 +406,7 @@ CCallableBanList *CGHostDBMySQL::ThreadedBanList(std::string server)
 
 CCallableGameAdd *CGHostDBMySQL::ThreadedGameAdd(std::string server, std::string map, std::string gamename, std::string ownername, uint32_t duration, uint32_t gamestate, std::string creatorname, std::string creatorserver)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableGameAdd *Callable = new CMySQLCallableGameAdd(server, map, gamename, ownername, duration, gamestate, creatorname, creatorserver, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableGameAdd *Callable = new CMySQLCallableGameAdd(server, map, gamename, ownername, duration, gamestate, creatorname, creatorserver, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -308,12 +414,7 @@ CCallableGameAdd *CGHostDBMySQL::ThreadedGameAdd(std::string server, std::string
 
 CCallableGamePlayerAdd *CGHostDBMySQL::ThreadedGamePlayerAdd(uint32_t gameid, std::string name, std::string ip, uint32_t spoofed, std::string spoofedrealm, uint32_t reserved, uint32_t loadingtime, uint32_t left, std::string leftreason, uint32_t team, uint32_t colour)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableGamePlayerAdd *Callable = new CMySQLCallableGamePlayerAdd(gameid, name, ip, spoofed, spoofedrealm, reserved, loadingtime, left, leftreason, team, colour, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableGamePlayerAdd *Callable = new CMySQLCallableGamePlayerAdd(gameid, name, ip, spoofed, spoofedrealm, reserved, loadingtime, left, leftreason, team, colour, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -321,12 +422,7 @@ CCallableGamePlayerAdd *CGHostDBMySQL::ThreadedGamePlayerAdd(uint32_t gameid, st
 
 CCallableGamePlayerSummaryCheck *CGHostDBMySQL::ThreadedGamePlayerSummaryCheck(std::string name)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableGamePlayerSummaryCheck *Callable = new CMySQLCallableGamePlayerSummaryCheck(name, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableGamePlayerSummaryCheck *Callable = new CMySQLCallableGamePlayerSummaryCheck(name, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -334,12 +430,7 @@ CCallableGamePlayerSummaryCheck *CGHostDBMySQL::ThreadedGamePlayerSummaryCheck(s
 
 CCallableDotAGameAdd *CGHostDBMySQL::ThreadedDotAGameAdd(uint32_t gameid, uint32_t winner, uint32_t min, uint32_t sec)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableDotAGameAdd *Callable = new CMySQLCallableDotAGameAdd(gameid, winner, min, sec, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableDotAGameAdd *Callable = new CMySQLCallableDotAGameAdd(gameid, winner, min, sec, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -347,12 +438,7 @@ CCallableDotAGameAdd *CGHostDBMySQL::ThreadedDotAGameAdd(uint32_t gameid, uint32
 
 CCallableDotAPlayerAdd *CGHostDBMySQL::ThreadedDotAPlayerAdd(uint32_t gameid, uint32_t colour, uint32_t kills, uint32_t deaths, uint32_t creepkills, uint32_t creepdenies, uint32_t assists, uint32_t gold, uint32_t neutralkills, std::string item1, std::string item2, std::string item3, std::string item4, std::string item5, std::string item6, std::string hero, uint32_t newcolour, uint32_t towerkills, uint32_t raxkills, uint32_t courierkills)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableDotAPlayerAdd *Callable = new CMySQLCallableDotAPlayerAdd(gameid, colour, kills, deaths, creepkills, creepdenies, assists, gold, neutralkills, item1, item2, item3, item4, item5, item6, hero, newcolour, towerkills, raxkills, courierkills, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableDotAPlayerAdd *Callable = new CMySQLCallableDotAPlayerAdd(gameid, colour, kills, deaths, creepkills, creepdenies, assists, gold, neutralkills, item1, item2, item3, item4, item5, item6, hero, newcolour, towerkills, raxkills, courierkills, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -360,12 +446,7 @@ CCallableDotAPlayerAdd *CGHostDBMySQL::ThreadedDotAPlayerAdd(uint32_t gameid, ui
 
 CCallableDotAPlayerSummaryCheck *CGHostDBMySQL::ThreadedDotAPlayerSummaryCheck(std::string name)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableDotAPlayerSummaryCheck *Callable = new CMySQLCallableDotAPlayerSummaryCheck(name, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableDotAPlayerSummaryCheck *Callable = new CMySQLCallableDotAPlayerSummaryCheck(name, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -373,12 +454,7 @@ CCallableDotAPlayerSummaryCheck *CGHostDBMySQL::ThreadedDotAPlayerSummaryCheck(s
 
 CCallableDownloadAdd *CGHostDBMySQL::ThreadedDownloadAdd(std::string map, uint32_t mapsize, std::string name, std::string ip, uint32_t spoofed, std::string spoofedrealm, uint32_t downloadtime)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableDownloadAdd *Callable = new CMySQLCallableDownloadAdd(map, mapsize, name, ip, spoofed, spoofedrealm, downloadtime, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableDownloadAdd *Callable = new CMySQLCallableDownloadAdd(map, mapsize, name, ip, spoofed, spoofedrealm, downloadtime, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -386,12 +462,7 @@ CCallableDownloadAdd *CGHostDBMySQL::ThreadedDownloadAdd(std::string map, uint32
 
 CCallableScoreCheck *CGHostDBMySQL::ThreadedScoreCheck(std::string category, std::string name, std::string server)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableScoreCheck *Callable = new CMySQLCallableScoreCheck(category, name, server, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableScoreCheck *Callable = new CMySQLCallableScoreCheck(category, name, server, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -399,12 +470,7 @@ CCallableScoreCheck *CGHostDBMySQL::ThreadedScoreCheck(std::string category, std
 
 CCallableW3MMDPlayerAdd *CGHostDBMySQL::ThreadedW3MMDPlayerAdd(std::string category, uint32_t gameid, uint32_t pid, std::string name, std::string flag, uint32_t leaver, uint32_t practicing)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableW3MMDPlayerAdd *Callable = new CMySQLCallableW3MMDPlayerAdd(category, gameid, pid, name, flag, leaver, practicing, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableW3MMDPlayerAdd *Callable = new CMySQLCallableW3MMDPlayerAdd(category, gameid, pid, name, flag, leaver, practicing, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -412,12 +478,7 @@ CCallableW3MMDPlayerAdd *CGHostDBMySQL::ThreadedW3MMDPlayerAdd(std::string categ
 
 CCallableW3MMDVarAdd *CGHostDBMySQL::ThreadedW3MMDVarAdd(uint32_t gameid, std::map<VarP, int32_t> var_ints)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableW3MMDVarAdd *Callable = new CMySQLCallableW3MMDVarAdd(gameid, var_ints, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableW3MMDVarAdd *Callable = new CMySQLCallableW3MMDVarAdd(gameid, var_ints, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -425,12 +486,7 @@ CCallableW3MMDVarAdd *CGHostDBMySQL::ThreadedW3MMDVarAdd(uint32_t gameid, std::m
 
 CCallableW3MMDVarAdd *CGHostDBMySQL::ThreadedW3MMDVarAdd(uint32_t gameid, std::map<VarP, double> var_reals)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableW3MMDVarAdd *Callable = new CMySQLCallableW3MMDVarAdd(gameid, var_reals, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableW3MMDVarAdd *Callable = new CMySQLCallableW3MMDVarAdd(gameid, var_reals, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
@@ -438,31 +494,12 @@ CCallableW3MMDVarAdd *CGHostDBMySQL::ThreadedW3MMDVarAdd(uint32_t gameid, std::m
 
 CCallableW3MMDVarAdd *CGHostDBMySQL::ThreadedW3MMDVarAdd(uint32_t gameid, std::map<VarP, std::string> var_strings)
 {
-    void *Connection = GetIdleConnection();
-
-    if (!Connection)
-        m_NumConnections++;
-
-    CCallableW3MMDVarAdd *Callable = new CMySQLCallableW3MMDVarAdd(gameid, var_strings, Connection, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
+    CCallableW3MMDVarAdd *Callable = new CMySQLCallableW3MMDVarAdd(gameid, var_strings, NULL, m_BotID, m_Server, m_Database, m_User, m_Password, m_Port);
     CreateThread(Callable);
     m_OutstandingCallables++;
     return Callable;
 }
 
-void *CGHostDBMySQL::GetIdleConnection()
-{
-    //CONSOLE_Print("GetIdleConnectionStart");
-    void *Connection = NULL;
-
-    if (!m_IdleConnections.empty())
-    {
-        Connection = m_IdleConnections.front();
-        m_IdleConnections.pop();
-    }
-
-    return Connection;
-}
-
 //
 // unprototyped global helper functions
 //
@@ -533,91 +570,67 @@ uint32_t MySQLAdminCount(void *conn, std::string *error, uint32_t botid, std::st
     return Count;
 }
 
-//check if player have over 1 games and auth him automaticaly
-bool CGHostDBMySQL::AuthCheck(std::string user)
+bool MySQLAdminCheck(void *conn, std::string *error, uint32_t botid, std::string server, std::string user)
 {
-    //CONSOLE_Print("authSQLstart");
-
-    MYSQL *Connection = NULL;
-    if (!(Connection = mysql_init(NULL)))
-    {
-        m_Error = mysql_error((MYSQL *)Connection);
-        CONSOLE_Print(std::string("error: ") + mysql_error(Connection));
-        return 0;
-    }
-
-    my_bool Reconnect = true;
-    mysql_options(Connection, MYSQL_OPT_RECONNECT, &Reconnect);
-
-    if (!(mysql_real_connect(Connection, m_Server.c_str(), m_User.c_str(), m_Password.c_str(), m_Database.c_str(), m_Port, NULL, 0)))
-    {
-        m_Error = mysql_error((MYSQL *)Connection);
-        CONSOLE_Print(std::string("error: ") + mysql_error(Connection));
-        return 0;
-    }
-
     transform(user.begin(), user.end(), user.begin(), (int (*)(int))tolower);
-    std::string EscUser = MySQLEscapeString(Connection, user);
-
-    //get name from alias if any
-    std::string Query = "SELECT * FROM players_aliases WHERE alias1 = \"" + EscUser + "\" OR alias2 = \"" + EscUser + "\" OR alias3 = \"" + EscUser + "\" OR alias4 = \"" + EscUser + "\"";
+    std::string EscServer = MySQLEscapeString(conn, server);
+    std::string EscUser   = MySQLEscapeString(conn, user);
+    bool IsAdmin          = false;
+    std::string Query     = "SELECT * FROM admins WHERE server='" + EscServer + "' AND name='" + EscUser + "'";
 
-    if (mysql_real_query((MYSQL *)Connection, Query.c_str(), Query.size()) != 0)
-        CONSOLE_Print("mysql_real_query error");
+    if (mysql_real_query((MYSQL *)conn, Query.c_str(), Query.size()) != 0)
+        *error = mysql_error((MYSQL *)conn);
     else
     {
-        MYSQL_RES *Result = mysql_store_result((MYSQL *)Connection);
+        MYSQL_RES *Result = mysql_store_result((MYSQL *)conn);
+
         if (Result)
         {
             std::vector<std::string> Row = MySQLFetchRow(Result);
 
             if (!Row.empty())
-                EscUser = Row[0];
+                IsAdmin = true;
 
             mysql_free_result(Result);
         }
+        else
+            *error = mysql_error((MYSQL *)conn);
     }
 
-    bool IsAuthenticated = false;
-    Query                = "SELECT * FROM players WHERE name='" + EscUser + "' AND total_games > 1";
+    return IsAdmin;
+}
 
-    if (mysql_real_query((MYSQL *)Connection, Query.c_str(), Query.size()) != 0)
-        CONSOLE_Print("mysql_real_query error");
+//check if player have over 1 games and auth him automaticaly
+bool MySQLAuthCheck(void *conn, std::string *error, uint32_t botid, std::string user)
+{
+    transform(user.begin(), user.end(), user.begin(), (int (*)(int))tolower);
+    std::string EscUser = MySQLEscapeString(conn, user);
+
+    //get name from alias if any
+    std::string Query = "SELECT * FROM players_aliases WHERE alias1 = '" + EscUser + "' OR alias2 = '" + EscUser + "' OR alias3 = '" + EscUser + "' OR alias4 = '" + EscUser + "'";
+
+    if (mysql_real_query((MYSQL *)conn, Query.c_str(), Query.size()) != 0)
+    {
+        *error = mysql_error((MYSQL *)conn);
+        return false;
+    }
     else
     {
-        MYSQL_RES *Result = mysql_store_result((MYSQL *)Connection);
+        MYSQL_RES *Result = mysql_store_result((MYSQL *)conn);
 
         if (Result)
         {
             std::vector<std::string> Row = MySQLFetchRow(Result);
 
             if (!Row.empty())
-            {
-                //CONSOLE_Print("IsAuthenticated = true");
-                IsAuthenticated = true;
-            }
+                EscUser = MySQLEscapeString(conn, Row[0]);
 
             mysql_free_result(Result);
         }
-        else
-        {
-            m_Error = mysql_error((MYSQL *)Connection);
-            CONSOLE_Print(std::string("error: ") + mysql_error(Connection));
-        }
     }
 
-    mysql_close(Connection);
-
-    return IsAuthenticated;
-}
-
-bool MySQLAdminCheck(void *conn, std::string *error, uint32_t botid, std::string server, std::string user)
-{
-    transform(user.begin(), user.end(), user.begin(), (int (*)(int))tolower);
-    std::string EscServer = MySQLEscapeString(conn, server);
-    std::string EscUser   = MySQLEscapeString(conn, user);
-    bool IsAdmin          = false;
-    std::string Query     = "SELECT * FROM admins WHERE server='" + EscServer + "' AND name='" + EscUser + "'";
+    bool IsAuthenticated = false;
+    Query                = "SELECT * FROM players WHERE name='" + EscUser + "' AND total_games > 1";
 
     if (mysql_real_query((MYSQL *)conn, Query.c_str(), Query.size()) != 0)
         *error = mysql_error((MYSQL *)conn);
@@ -630,7 +643,7 @@ bool MySQLAdminCheck(void *conn, std::string *error, uint32_t botid, std::string
             std::vector<std::string> Row = MySQLFetchRow(Result);
 
             if (!Row.empty())
-                IsAdmin = true;
+                IsAuthenticated = true;
 
             mysql_free_result(Result);
         }
@@ -638,7 +651,7 @@ bool MySQLAdminCheck(void *conn, std::string *error, uint32_t botid, std::string
             *error = mysql_error((MYSQL *)conn);
     }
 
-    return IsAdmin;
+    return IsAuthenticated;
 }
 
 bool MySQLAdminAdd(void *conn, std::string *error, uint32_t botid, std::string server, std::string user)
@@ -1225,34 +1238,16 @@ void CMySQLCallable::Init()
 {
     CBaseCallable::Init();
 
-#ifndef WIN32
-    // disable SIGPIPE since this is (or should be) a new thread and it doesn't inherit the spawning thread's signal handlers
-    // MySQL should automatically disable SIGPIPE when we initialize it but we do so anyway here
-
-    signal(SIGPIPE, SIG_IGN);
-#endif
-
-    mysql_thread_init();
+    // the worker running us owns the connection and has already initialized MySQL for its thread
 
     if (!m_Connection)
-    {
-        if (!(m_Connection = mysql_init(NULL)))
-            m_Error = mysql_error((MYSQL *)m_Connection);
-
-        my_bool Reconnect = true;
-        mysql_options((MYSQL *)m_Connection, MYSQL_OPT_RECONNECT, &Reconnect);
-
-        if (!(mysql_real_connect((MYSQL *)m_Connection, m_SQLServer.c_str(), m_SQLUser.c_str(), m_SQLPassword.c_str(), m_SQLDatabase.c_str(), m_SQLPort, NULL, 0)))
-            m_Error = mysql_error((MYSQL *)m_Connection);
-    }
+        m_Error = "unable to connect to MySQL server";
     else if (mysql_ping((MYSQL *)m_Connection) != 0)
         m_Error = mysql_error((MYSQL *)m_Connection);
 }
 
 void CMySQLCallable::Close()
 {
-    mysql_thread_end();
-
     CBaseCallable::Close();
 }
 
@@ -1276,6 +1271,16 @@ void CMySQLCallableAdminCheck::operator()()
     Close();
 }
 
+void CMySQLCallableAuthCheck::operator()()
+{
+    Init();
+
+    if (m_Error.empty())
+        m_Result = MySQLAuthCheck(m_Connection, &m_Error, m_SQLBotID, m_User);
+
+    Close();
+}
+
 void CMySQLCallableAdminAdd::operator()()
 {
     Init();
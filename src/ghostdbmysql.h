@@ -25,6 +25,9 @@
 #include "includes.h"
 #include "ghostdb.h"
 
+#include <condition_variable>
+#include <mutex>
+
 /**************
  *** SCHEMA ***
  **************
@@ -162,6 +165,50 @@ CREATE TABLE w3mmdvars (
  *** SCHEMA ***
  **************/
 
+//
+// CMySQLWorkerPool
+//
+
+// a fixed number of worker threads which run the queued MySQL callables in order
+// each worker keeps its own connection open for as long as it lives so a burst of queries (e.g. saving the stats after a game) doesn't spawn a thread and a connection per query
+// jobs are only ever queued from the main thread and the queue is short lived so a plain mutex is all the synchronization we need
+
+class CMySQLWorkerPool
+{
+private:
+    std::string m_Server;
+    std::string m_Database;
+    std::string m_User;
+    std::string m_Password;
+    uint16_t m_Port;
+    std::vector<std::thread> m_Workers;
+    std::queue<std::pair<CBaseCallable *, uint32_t>> m_Jobs; // the callable and the ticks when it was queued
+    std::mutex m_Mutex;
+    std::condition_variable m_JobQueued;
+    bool m_Exiting;
+    uint32_t m_NumBusy;      // number of workers currently running a callable
+    uint32_t m_NumConnected; // number of workers with an open connection
+    uint32_t m_NumRun;       // the following stats are reset every time GetStatus is called
+    uint32_t m_PeakQueued;
+    uint64_t m_TotalWaitTicks;
+    uint32_t m_MaxWaitTicks;
+    uint64_t m_TotalRunTicks;
+    uint32_t m_MaxRunTicks;
+
+    void *Connect();
+    void Run(void *connection);
+
+public:
+    CMySQLWorkerPool(uint32_t numWorkers, void *firstConnection, std::string nServer, std::string nDatabase, std::string nUser, std::string nPassword, uint16_t nPort);
+    ~CMySQLWorkerPool();
+
+    uint32_t GetNumWorkers() { return m_Workers.size(); }
+    uint32_t GetQueueDepth();
+    std::string GetStatus();
+
+    void Queue(CBaseCallable *callable);
+};
+
 //
 // CGHostDBMySQL
 //
@@ -175,8 +222,7 @@ private:
     std::string m_Password;
     uint16_t m_Port;
     uint32_t m_BotID;
-    std::queue<void *> m_IdleConnections;
-    uint32_t m_NumConnections;
+    CMySQLWorkerPool *m_WorkerPool;
     uint32_t m_OutstandingCallables;
 
 public:
@@ -190,7 +236,7 @@ public:
     // threaded database functions
 
     virtual void CreateThread(CBaseCallable *callable);
-    //virtual CCallableAuthCheck *MySQLAuthCheck(std::string user);
+    virtual CCallableAuthCheck *ThreadedAuthCheck(std::string user);
     virtual CCallableAdminCount *ThreadedAdminCount(std::string server);
     virtual CCallableAdminCheck *ThreadedAdminCheck(std::string server, std::string user);
     virtual CCallableAdminAdd *ThreadedAdminAdd(std::string server, std::string user);
@@ -214,14 +260,6 @@ public:
     virtual CCallableW3MMDVarAdd *ThreadedW3MMDVarAdd(uint32_t gameid, std::map<VarP, int32_t> var_ints);
     virtual CCallableW3MMDVarAdd *ThreadedW3MMDVarAdd(uint32_t gameid, std::map<VarP, double> var_reals);
     virtual CCallableW3MMDVarAdd *ThreadedW3MMDVarAdd(uint32_t gameid, std::map<VarP, std::string> var_strings);
-
-    // other database functions
-
-    virtual void *GetIdleConnection();
-
-    //
-
-    bool AuthCheck(std::string user);
 };
 
 //
@@ -230,6 +268,7 @@ public:
 
 uint32_t MySQLAdminCount(void *conn, std::string *error, uint32_t botid, std::string server);
 bool MySQLAdminCheck(void *conn, std::string *error, uint32_t botid, std::string server, std::string user);
+bool MySQLAuthCheck(void *conn, std::string *error, uint32_t botid, std::string user);
 bool MySQLAdminAdd(void *conn, std::string *error, uint32_t botid, std::string server, std::string user);
 bool MySQLAdminRemove(void *conn, std::string *error, uint32_t botid, std::string server, std::string user);
 std::vector<std::string> MySQLAdminList(void *conn, std::string *error, uint32_t botid, std::string server);
@@ -272,6 +311,7 @@ public:
     virtual ~CMySQLCallable() {}
 
     virtual void *GetConnection() { return m_Connection; }
+    virtual void SetConnection(void *nConnection) { m_Connection = nConnection; }
 
     virtual void Init();
     virtual void Close();
@@ -299,6 +339,17 @@ public:
     virtual void Close() { CMySQLCallable::Close(); }
 };
 
+class CMySQLCallableAuthCheck : public CCallableAuthCheck, public CMySQLCallable
+{
+public:
+    CMySQLCallableAuthCheck(std::string nUser, void *nConnection, uint32_t nSQLBotID, std::string nSQLServer, std::string nSQLDatabase, std::string nSQLUser, std::string nSQLPassword, uint16_t nSQLPort) : CBaseCallable(), CCallableAuthCheck(nUser), CMySQLCallable(nConnection, nSQLBotID, nSQLServer, nSQLDatabase, nSQLUser, nSQLPassword, nSQLPort) {}
+    virtual ~CMySQLCallableAuthCheck() {}
+
+    virtual void operator()();
+    virtual void Init() { CMySQLCallable::Init(); }
+    virtual void Close() { CMySQLCallable::Close(); }
+};
+
 class CMySQLCallableAdminAdd : public CCallableAdminAdd, public CMySQLCallable
 {
 public:
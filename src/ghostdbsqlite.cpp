@@ -285,18 +285,10 @@ CGHostDBSQLite ::CGHostDBSQLite(CConfig *CFG) : CGHostDB(CFG)
         Upgrade7_8();
         SchemaNumber = "8";
     }
-
-    if (m_DB->Exec("CREATE TEMPORARY TABLE iptocountry ( ip1 INTEGER NOT NULL, ip2 INTEGER NOT NULL, country TEXT NOT NULL, PRIMARY KEY ( ip1, ip2 ) )") != SQLITE_OK)
-        CONSOLE_Print("[SQLITE3] error creating temporary iptocountry table - " + m_DB->GetError());
-
-    FromAddStmt = NULL;
 }
 
 CGHostDBSQLite ::~CGHostDBSQLite()
 {
-    if (FromAddStmt)
-        m_DB->Finalize(FromAddStmt);
-
     CONSOLE_Print("[SQLITE3] closing database [" + m_File + "]");
     delete m_DB;
 }
@@ -1210,74 +1202,6 @@ CDBDotAPlayerSummary *CGHostDBSQLite ::DotAPlayerSummaryCheck(std::string name)
     return DotAPlayerSummary;
 }
 
-std::string CGHostDBSQLite ::FromCheck(uint32_t ip)
-{
-    // a big thank you to tjado for help with the iptocountry feature
-
-    std::string From = "??";
-    sqlite3_stmt *Statement;
-    m_DB->Prepare("SELECT country FROM iptocountry WHERE ip1<=? AND ip2>=?", (void **)&Statement);
-
-    if (Statement)
-    {
-        // we bind the ip as an int64 because SQLite treats it as signed
-
-        sqlite3_bind_int64(Statement, 1, ip);
-        sqlite3_bind_int64(Statement, 2, ip);
-        int RC = m_DB->Step(Statement);
-
-        if (RC == SQLITE_ROW)
-        {
-            std::vector<std::string> *Row = m_DB->GetRow();
-
-            if (Row->size() == 1)
-                From = (*Row)[0];
-            else
-                CONSOLE_Print("[SQLITE3] error checking iptocountry [" + UTIL_ToString(ip) + "] - row doesn't have 1 column");
-        }
-        else if (RC == SQLITE_ERROR)
-            CONSOLE_Print("[SQLITE3] error checking iptocountry [" + UTIL_ToString(ip) + "] - " + m_DB->GetError());
-
-        m_DB->Finalize(Statement);
-    }
-    else
-        CONSOLE_Print("[SQLITE3] prepare error checking iptocountry [" + UTIL_ToString(ip) + "] - " + m_DB->GetError());
-
-    return From;
-}
-
-bool CGHostDBSQLite ::FromAdd(uint32_t ip1, uint32_t ip2, std::string country)
-{
-    // a big thank you to tjado for help with the iptocountry feature
-
-    bool Success = false;
-
-    if (!FromAddStmt)
-        m_DB->Prepare("INSERT INTO iptocountry VALUES ( ?, ?, ? )", (void **)&FromAddStmt);
-
-    if (FromAddStmt)
-    {
-        // we bind the ip as an int64 because SQLite treats it as signed
-
-        sqlite3_bind_int64((sqlite3_stmt *)FromAddStmt, 1, ip1);
-        sqlite3_bind_int64((sqlite3_stmt *)FromAddStmt, 2, ip2);
-        sqlite3_bind_text((sqlite3_stmt *)FromAddStmt, 3, country.c_str(), -1, SQLITE_TRANSIENT);
-
-        int RC = m_DB->Step(FromAddStmt);
-
-        if (RC == SQLITE_DONE)
-            Success = true;
-        else if (RC == SQLITE_ERROR)
-            CONSOLE_Print("[SQLITE3] error adding iptocountry [" + UTIL_ToString(ip1) + " : " + UTIL_ToString(ip2) + " : " + country + "] - " + m_DB->GetError());
-
-        m_DB->Reset(FromAddStmt);
-    }
-    else
-        CONSOLE_Print("[SQLITE3] prepare error adding iptocountry [" + UTIL_ToString(ip1) + " : " + UTIL_ToString(ip2) + " : " + country + "] - " + m_DB->GetError());
-
-    return Success;
-}
-
 bool CGHostDBSQLite ::DownloadAdd(std::string map, uint32_t mapsize, std::string name, std::string ip, uint32_t spoofed, std::string spoofedrealm, uint32_t downloadtime)
 {
     bool Success = false;
@@ -1491,6 +1415,14 @@ CCallableAdminCheck *CGHostDBSQLite ::ThreadedAdminCheck(std::string server, std
     return Callable;
 }
 
+CCallableAuthCheck *CGHostDBSQLite ::ThreadedAuthCheck(std::string user)
+{
+    CCallableAuthCheck *Callable = new CCallableAuthCheck(user);
+    Callable->SetResult(AuthCheck(user));
+    Callable->SetReady(true);
+    return Callable;
+}
+
 CCallableAdminAdd *CGHostDBSQLite ::ThreadedAdminAdd(std::string server, std::string user)
 {
     CCallableAdminAdd *Callable = new CCallableAdminAdd(server, user);
@@ -143,13 +143,6 @@ CREATE TABLE w3mmdvars (
 	value_string TEXT DEFAULT NULL
 )
 
-CREATE TEMPORARY TABLE iptocountry (
-	ip1 INTEGER NOT NULL,
-	ip2 INTEGER NOT NULL,
-	country TEXT NOT NULL,
-	PRIMARY KEY ( ip1, ip2 )
-)
-
 CREATE INDEX idx_gameid ON gameplayers ( gameid )
 CREATE INDEX idx_gameid_colour ON dotaplayers ( gameid, colour )
 
@@ -195,12 +188,6 @@ private:
     std::string m_File;
     CSQLITE3 *m_DB;
 
-    // we keep some prepared statements in memory rather than recreating them each function call
-    // this is an optimization because preparing statements takes time
-    // however it only pays off if you're going to be using the statement extremely often
-
-    void *FromAddStmt;
-
 public:
     CGHostDBSQLite(CConfig *CFG);
     virtual ~CGHostDBSQLite();
@@ -235,8 +222,6 @@ public:
     virtual uint32_t DotAPlayerAdd(uint32_t gameid, uint32_t colour, uint32_t kills, uint32_t deaths, uint32_t creepkills, uint32_t creepdenies, uint32_t assists, uint32_t gold, uint32_t neutralkills, std::string item1, std::string item2, std::string item3, std::string item4, std::string item5, std::string item6, std::string hero, uint32_t newcolour, uint32_t towerkills, uint32_t raxkills, uint32_t courierkills);
     virtual uint32_t DotAPlayerCount(std::string name);
     virtual CDBDotAPlayerSummary *DotAPlayerSummaryCheck(std::string name);
-    virtual std::string FromCheck(uint32_t ip);
-    virtual bool FromAdd(uint32_t ip1, uint32_t ip2, std::string country);
     virtual bool DownloadAdd(std::string map, uint32_t mapsize, std::string name, std::string ip, uint32_t spoofed, std::string spoofedrealm, uint32_t downloadtime);
     virtual uint32_t W3MMDPlayerAdd(std::string category, uint32_t gameid, uint32_t pid, std::string name, std::string flag, uint32_t leaver, uint32_t practicing);
     virtual bool W3MMDVarAdd(uint32_t gameid, std::map<VarP, int32_t> var_ints);
@@ -249,6 +234,7 @@ public:
 
     virtual CCallableAdminCount *ThreadedAdminCount(std::string server);
     virtual CCallableAdminCheck *ThreadedAdminCheck(std::string server, std::string user);
+    virtual CCallableAuthCheck *ThreadedAuthCheck(std::string user);
     virtual CCallableAdminAdd *ThreadedAdminAdd(std::string server, std::string user);
     virtual CCallableAdminRemove *ThreadedAdminRemove(std::string server, std::string user);
     virtual CCallableAdminList *ThreadedAdminList(std::string server);
@@ -36,25 +36,31 @@
 // STL
 
 #include <algorithm>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <queue>
 #include <set>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <chrono>
 #include <thread>
 
 typedef std::vector<unsigned char> BYTEARRAY;
+typedef std::shared_ptr<const BYTEARRAY> SHAREDBYTEARRAY; // immutable once built so it can be queued to many sockets at once
 typedef std::pair<unsigned char, std::string> PIDPlayer;
 
 // time
 
-uint32_t GetTime();  // seconds
-uint32_t GetTicks(); // milliseconds
+uint32_t GetTime();       // seconds
+uint32_t GetTicks();      // milliseconds
+uint64_t GetMicroTicks(); // microseconds
 
 #define MILLISLEEP(x) std::this_thread::sleep_for(std::chrono::milliseconds(x));
 
@@ -70,6 +76,8 @@ void CONSOLE_Print(std::string message, bool toMainBuffer);
 void CONSOLE_Print(std::string message, uint32_t realmId, bool toMainBuffer = true);
 void DEBUG_Print(std::string message);
 void DEBUG_Print(BYTEARRAY b);
+void LOG_Write(std::string file, std::string line);                                                         // write a line to any file from the logger's thread (e.g. packet traces)
+bool LOG_WriteCapture(const std::string &file, std::string records, bool opensStream, bool closesStream); // write packet capture records to a capture file from the logger's thread, returns false if they were dropped
 
 void CONSOLE_ChangeChannel(std::string channel, uint32_t realmId);
 void CONSOLE_AddChannelUser(std::string name, uint32_t realmId, int flag);
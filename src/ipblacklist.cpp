@@ -0,0 +1,258 @@
+#include "ipblacklist.h"
+#include "util.h"
+
+#include <algorithm>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <cstring>
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+//
+// CIPBlackList
+//
+
+CIPBlackList::CIPBlackList()
+{
+    m_NumLines      = 0;
+    m_Notify        = -1;
+    m_FileTime      = 0;
+    m_LastCheckTime = GetTime();
+}
+
+CIPBlackList::~CIPBlackList()
+{
+    StopWatching();
+}
+
+void CIPBlackList::Load(std::string file)
+{
+    StopWatching();
+    m_File = file;
+
+    if (m_File.empty())
+    {
+        m_Ranges.clear();
+        m_NumLines = 0;
+        return;
+    }
+
+    // start watching before reading so a change made while we're reading isn't missed
+
+    Watch();
+    Read();
+}
+
+void CIPBlackList::Update()
+{
+    if (m_File.empty())
+        return;
+
+#ifdef __linux__
+    if (m_Notify != -1)
+    {
+        // we watch the whole directory because most editors save a file by writing a new one and renaming it over the old one
+        // so only the events for our file (or an overflowed queue) mean it has to be loaded again
+
+        std::string::size_type Slash = m_File.rfind('/');
+        std::string Name             = Slash == std::string::npos ? m_File : m_File.substr(Slash + 1);
+        bool Changed                 = false;
+        char Buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+        while (true)
+        {
+            ssize_t Length = read(m_Notify, Buffer, sizeof(Buffer));
+
+            if (Length <= 0)
+            {
+                if (Length < 0 && errno != EAGAIN && errno != EINTR)
+                {
+                    CONSOLE_Print("[IPBLACKLIST] error reading file notifications (" + std::string(strerror(errno)) + "), checking [" + m_File + "] every " + UTIL_ToString(IPBLACKLIST_CHECK_INTERVAL) + " seconds instead");
+                    StopWatching();
+                }
+
+                break;
+            }
+
+            for (char *i = Buffer; i < Buffer + Length;)
+            {
+                struct inotify_event *Event = (struct inotify_event *)i;
+
+                if ((Event->mask & IN_Q_OVERFLOW) || (Event->len > 0 && Name == Event->name))
+                    Changed = true;
+
+                i += sizeof(struct inotify_event) + Event->len;
+            }
+        }
+
+        if (Changed)
+        {
+            CONSOLE_Print("[IPBLACKLIST] IP blacklist file [" + m_File + "] changed");
+            Read();
+        }
+
+        if (m_Notify != -1)
+            return;
+    }
+#endif
+
+    if (GetTime() - m_LastCheckTime >= IPBLACKLIST_CHECK_INTERVAL)
+    {
+        m_LastCheckTime = GetTime();
+
+        if (GetFileTime() != m_FileTime)
+        {
+            CONSOLE_Print("[IPBLACKLIST] IP blacklist file [" + m_File + "] changed");
+            Read();
+        }
+    }
+}
+
+bool CIPBlackList::Contains(uint32_t ip)
+{
+    // find the last range starting at or before this ip, it's the only one that can contain it
+
+    std::vector<IPBlackListRange>::iterator Range = std::upper_bound(m_Ranges.begin(), m_Ranges.end(), ip, [](uint32_t value, const IPBlackListRange &range) { return value < range.m_IP1; });
+
+    if (Range == m_Ranges.begin())
+        return false;
+
+    Range--;
+    return ip <= Range->m_IP2;
+}
+
+bool CIPBlackList::ParseLine(std::string line, IPBlackListRange &range)
+{
+    // remove spaces and newlines and partial newlines to help fix issues with Windows formatted files on Linux systems
+
+    line.erase(remove(line.begin(), line.end(), ' '), line.end());
+    line.erase(remove(line.begin(), line.end(), '\t'), line.end());
+    line.erase(remove(line.begin(), line.end(), '\r'), line.end());
+    line.erase(remove(line.begin(), line.end(), '\n'), line.end());
+
+    if (line.empty() || line[0] == '#')
+        return false;
+
+    std::string::size_type Slash = line.find('/');
+    std::string Address          = line.substr(0, Slash);
+    uint32_t PrefixLength        = 32;
+    uint32_t IP;
+
+    if (!UTIL_ParseIP(Address, IP))
+        return false;
+
+    if (Slash != std::string::npos)
+    {
+        std::string Prefix = line.substr(Slash + 1);
+
+        if (Prefix.empty() || Prefix.size() > 2 || Prefix.find_first_not_of("1234567890") != std::string::npos)
+            return false;
+
+        PrefixLength = UTIL_ToUInt32(Prefix);
+
+        if (PrefixLength > 32)
+            return false;
+    }
+
+    // the host bits of a block like 1.2.3.4/24 are ignored so it's the same as 1.2.3.0/24
+
+    uint32_t Mask = PrefixLength == 0 ? 0 : 0xFFFFFFFF << (32 - PrefixLength);
+    range.m_IP1   = IP & Mask;
+    range.m_IP2   = IP | ~Mask;
+    return true;
+}
+
+void CIPBlackList::Read()
+{
+    m_FileTime      = GetFileTime();
+    m_LastCheckTime = GetTime();
+
+    std::ifstream in;
+    in.open(m_File.c_str());
+
+    if (in.fail())
+    {
+        CONSOLE_Print("[IPBLACKLIST] error loading IP blacklist file [" + m_File + "]");
+        m_Ranges.clear();
+        m_NumLines = 0;
+        return;
+    }
+
+    std::vector<IPBlackListRange> Ranges;
+    std::string Line;
+    uint32_t NumLines = 0;
+
+    while (!in.eof())
+    {
+        getline(in, Line);
+
+        // ignore blank lines, comments and lines that don't look like IP addresses or CIDR blocks
+
+        IPBlackListRange Range;
+
+        if (!ParseLine(Line, Range))
+            continue;
+
+        Ranges.push_back(Range);
+        NumLines++;
+    }
+
+    in.close();
+
+    // merge the overlapping and adjacent ranges so that every ip is in at most one range and a lookup only has to check one
+
+    std::sort(Ranges.begin(), Ranges.end(), [](const IPBlackListRange &a, const IPBlackListRange &b) { return a.m_IP1 < b.m_IP1; });
+    std::vector<IPBlackListRange> Merged;
+
+    for (std::vector<IPBlackListRange>::iterator i = Ranges.begin(); i != Ranges.end(); i++)
+    {
+        if (!Merged.empty() && (Merged.back().m_IP2 == 0xFFFFFFFF || (*i).m_IP1 <= Merged.back().m_IP2 + 1))
+            Merged.back().m_IP2 = std::max(Merged.back().m_IP2, (*i).m_IP2);
+        else
+            Merged.push_back(*i);
+    }
+
+    m_Ranges.swap(Merged);
+    m_NumLines = NumLines;
+    CONSOLE_Print("[IPBLACKLIST] loaded " + UTIL_ToString(m_NumLines) + " lines (" + UTIL_ToString(m_Ranges.size()) + " ranges) from IP blacklist file [" + m_File + "]");
+}
+
+void CIPBlackList::Watch()
+{
+#ifdef __linux__
+    std::string::size_type Slash = m_File.rfind('/');
+    std::string Directory        = Slash == std::string::npos ? "." : (Slash == 0 ? "/" : m_File.substr(0, Slash));
+    m_Notify                     = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (m_Notify == -1)
+        CONSOLE_Print("[IPBLACKLIST] warning - unable to watch [" + m_File + "] (" + std::string(strerror(errno)) + "), checking it every " + UTIL_ToString(IPBLACKLIST_CHECK_INTERVAL) + " seconds instead");
+    else if (inotify_add_watch(m_Notify, Directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) == -1)
+    {
+        CONSOLE_Print("[IPBLACKLIST] warning - unable to watch [" + Directory + "] (" + std::string(strerror(errno)) + "), checking [" + m_File + "] every " + UTIL_ToString(IPBLACKLIST_CHECK_INTERVAL) + " seconds instead");
+        StopWatching();
+    }
+#endif
+}
+
+void CIPBlackList::StopWatching()
+{
+#ifdef __linux__
+    if (m_Notify != -1)
+        close(m_Notify);
+#endif
+
+    m_Notify = -1;
+}
+
+time_t CIPBlackList::GetFileTime()
+{
+    struct stat Info;
+
+    if (stat(m_File.c_str(), &Info) != 0)
+        return 0;
+
+    return Info.st_mtime;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "includes.h"
+
+//
+// CIPBlackList
+//
+
+// the IP blacklist (bot_ipblacklistfile) is shared by every lobby and checked as soon as a connection is accepted
+// each line of the file is either a single address (1.2.3.4) or a CIDR block (1.2.3.0/24), blank lines and lines starting with # are ignored
+// the addresses are kept as a flat array of non overlapping ranges sorted by ip1 and binary searched just like the iptocountry data
+// the file is loaded once and loaded again whenever it changes, on Linux inotify tells us when it's written and elsewhere we check its modification time
+
+#define IPBLACKLIST_CHECK_INTERVAL 5 // seconds between checking the file's modification time (when inotify isn't available)
+
+struct IPBlackListRange
+{
+    uint32_t m_IP1; // first ip in the range (host byte order)
+    uint32_t m_IP2; // last ip in the range (host byte order)
+};
+
+class CIPBlackList
+{
+private:
+    std::string m_File;                     // the file the blacklist was loaded from (empty if there's no blacklist)
+    std::vector<IPBlackListRange> m_Ranges; // the sorted and merged ranges
+    uint32_t m_NumLines;                    // the number of addresses and blocks in the file
+    int m_Notify;                           // the inotify descriptor watching the file's directory (-1 if we're not using inotify)
+    time_t m_FileTime;                      // the file's modification time when it was loaded
+    uint32_t m_LastCheckTime;               // GetTime when the file's modification time was last checked
+
+public:
+    CIPBlackList();
+    ~CIPBlackList();
+
+    std::string GetFile() { return m_File; }
+    uint32_t GetNumLines() { return m_NumLines; }
+    uint32_t GetNumRanges() { return m_Ranges.size(); }
+
+    void Load(std::string file); // load the file and start watching it for changes (or clear the blacklist if file is empty)
+    void Update();               // load the file again if it has changed
+    bool Contains(uint32_t ip);
+
+    static bool ParseLine(std::string line, IPBlackListRange &range);
+
+private:
+    void Read();
+    void Watch();
+    void StopWatching();
+    time_t GetFileTime();
+};
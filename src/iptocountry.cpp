@@ -0,0 +1,278 @@
+#include "iptocountry.h"
+#include "csvparser.h"
+#include "ghost.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// the cache file is a header followed by m_NumRanges IPToCountryRange structs
+// the csv file's size and modification time are stored in the header so we know when the cache is stale
+
+#define IPTOCOUNTRY_CACHE_MAGIC 0x43545049 // "IPTC"
+#define IPTOCOUNTRY_CACHE_VERSION 1
+
+struct IPToCountryCacheHeader
+{
+    uint32_t m_Magic;
+    uint32_t m_Version;
+    uint32_t m_CSVSize;
+    uint32_t m_CSVTime;
+    uint32_t m_NumRanges;
+    uint32_t m_Reserved;
+};
+
+//
+// CIPToCountry
+//
+
+CIPToCountry::CIPToCountry()
+{
+    m_Data       = NULL;
+    m_NumRanges  = 0;
+    m_Mapped     = NULL;
+    m_MappedSize = 0;
+}
+
+CIPToCountry::~CIPToCountry()
+{
+    Clear();
+}
+
+void CIPToCountry::Clear()
+{
+#ifndef WIN32
+    if (m_Mapped)
+        munmap(m_Mapped, m_MappedSize);
+#endif
+
+    m_Ranges.clear();
+    m_Data       = NULL;
+    m_NumRanges  = 0;
+    m_Mapped     = NULL;
+    m_MappedSize = 0;
+}
+
+bool CIPToCountry::Load(std::string csvFile, std::string cacheFile)
+{
+    Clear();
+
+    if (LoadCache(csvFile, cacheFile))
+    {
+        CONSOLE_Print("[IPTOCOUNTRY] loaded " + UTIL_ToString(m_NumRanges) + " ranges from [" + cacheFile + "]");
+        return true;
+    }
+
+    if (!LoadCSV(csvFile))
+        return false;
+
+    SaveCache(csvFile, cacheFile);
+    return true;
+}
+
+std::string CIPToCountry::FromCheck(uint32_t ip)
+{
+    // find the last range starting at or before this ip, it's the only one that can contain it
+
+    const IPToCountryRange *End   = m_Data + m_NumRanges;
+    const IPToCountryRange *Range = std::upper_bound(m_Data, End, ip, [](uint32_t value, const IPToCountryRange &range) { return value < range.m_IP1; });
+
+    if (Range == m_Data)
+        return "??";
+
+    Range--;
+
+    if (ip > Range->m_IP2)
+        return "??";
+
+    return std::string(Range->m_Country);
+}
+
+bool CIPToCountry::LoadCache(std::string csvFile, std::string cacheFile)
+{
+    struct stat CSVInfo;
+    struct stat CacheInfo;
+
+    if (stat(cacheFile.c_str(), &CacheInfo) != 0)
+        return false;
+
+    // if the csv file is missing we use whatever cache we have
+
+    bool HaveCSV = stat(csvFile.c_str(), &CSVInfo) == 0;
+    IPToCountryCacheHeader Header;
+
+    if ((size_t)CacheInfo.st_size < sizeof(Header))
+        return false;
+
+#ifdef WIN32
+    std::ifstream in;
+    in.open(cacheFile.c_str(), std::ios::binary);
+
+    if (in.fail())
+        return false;
+
+    in.read((char *)&Header, sizeof(Header));
+#else
+    int fd = open(cacheFile.c_str(), O_RDONLY);
+
+    if (fd == -1)
+        return false;
+
+    m_MappedSize = CacheInfo.st_size;
+    m_Mapped     = mmap(NULL, m_MappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (m_Mapped == MAP_FAILED)
+    {
+        m_Mapped     = NULL;
+        m_MappedSize = 0;
+        return false;
+    }
+
+    memcpy(&Header, m_Mapped, sizeof(Header));
+#endif
+
+    bool Valid = Header.m_Magic == IPTOCOUNTRY_CACHE_MAGIC && Header.m_Version == IPTOCOUNTRY_CACHE_VERSION && (size_t)CacheInfo.st_size == sizeof(Header) + (size_t)Header.m_NumRanges * sizeof(IPToCountryRange);
+
+    if (Valid && HaveCSV && (Header.m_CSVSize != (uint32_t)CSVInfo.st_size || Header.m_CSVTime != (uint32_t)CSVInfo.st_mtime))
+    {
+        CONSOLE_Print("[IPTOCOUNTRY] cache file [" + cacheFile + "] is out of date, rebuilding");
+        Valid = false;
+    }
+
+    if (!Valid)
+    {
+        Clear();
+        return false;
+    }
+
+#ifdef WIN32
+    m_Ranges.resize(Header.m_NumRanges);
+    in.read((char *)m_Ranges.data(), (std::streamsize)m_Ranges.size() * sizeof(IPToCountryRange));
+
+    if (in.fail())
+    {
+        Clear();
+        return false;
+    }
+
+    m_Data = m_Ranges.data();
+#else
+    m_Data = (const IPToCountryRange *)((const char *)m_Mapped + sizeof(Header));
+#endif
+
+    m_NumRanges = Header.m_NumRanges;
+    return true;
+}
+
+bool CIPToCountry::LoadCSV(std::string csvFile)
+{
+    std::ifstream in;
+    in.open(csvFile.c_str());
+
+    if (in.fail())
+    {
+        CONSOLE_Print("[IPTOCOUNTRY] warning - unable to read file [" + csvFile + "], iptocountry data not loaded");
+        return false;
+    }
+
+    CONSOLE_Print("[IPTOCOUNTRY] started loading [" + csvFile + "]");
+
+    std::string Line;
+    std::string IP1;
+    std::string IP2;
+    std::string Country;
+    CSVParser parser;
+
+    while (!in.eof())
+    {
+        getline(in, Line);
+
+        if (Line.empty())
+            continue;
+
+        parser << Line;
+        parser >> IP1;
+        parser >> IP2;
+        parser >> Country;
+
+        IPToCountryRange Range;
+        memset(&Range, 0, sizeof(Range));
+        Range.m_IP1 = UTIL_ToUInt32(IP1);
+        Range.m_IP2 = UTIL_ToUInt32(IP2);
+        strncpy(Range.m_Country, Country.c_str(), sizeof(Range.m_Country) - 1);
+
+        if (Range.m_IP2 >= Range.m_IP1)
+            m_Ranges.push_back(Range);
+    }
+
+    in.close();
+
+    // the csv file is normally sorted already but we can't binary search it unless we're sure
+
+    std::sort(m_Ranges.begin(), m_Ranges.end(), [](const IPToCountryRange &a, const IPToCountryRange &b) { return a.m_IP1 < b.m_IP1; });
+
+    m_Data      = m_Ranges.data();
+    m_NumRanges = m_Ranges.size();
+    CONSOLE_Print("[IPTOCOUNTRY] finished loading " + UTIL_ToString(m_NumRanges) + " ranges from [" + csvFile + "]");
+    return true;
+}
+
+void CIPToCountry::SaveCache(std::string csvFile, std::string cacheFile)
+{
+    struct stat CSVInfo;
+
+    if (stat(csvFile.c_str(), &CSVInfo) != 0)
+        return;
+
+    IPToCountryCacheHeader Header;
+    Header.m_Magic     = IPTOCOUNTRY_CACHE_MAGIC;
+    Header.m_Version   = IPTOCOUNTRY_CACHE_VERSION;
+    Header.m_CSVSize   = CSVInfo.st_size;
+    Header.m_CSVTime   = CSVInfo.st_mtime;
+    Header.m_NumRanges = m_NumRanges;
+    Header.m_Reserved  = 0;
+
+    // the cache is written to a temporary file which is then renamed over the old cache
+    // so another bot that has the old cache mapped keeps its copy and a crash while writing never leaves a half written cache behind
+
+    std::string TempFile = cacheFile + ".tmp";
+    std::ofstream out;
+    out.open(TempFile.c_str(), std::ios::binary | std::ios::trunc);
+
+    if (out.fail())
+    {
+        CONSOLE_Print("[IPTOCOUNTRY] warning - unable to write cache file [" + TempFile + "]");
+        return;
+    }
+
+    out.write((const char *)&Header, sizeof(Header));
+    out.write((const char *)m_Data, (std::streamsize)m_NumRanges * sizeof(IPToCountryRange));
+    out.close();
+
+    if (out.fail())
+    {
+        CONSOLE_Print("[IPTOCOUNTRY] warning - failed writing cache file [" + TempFile + "]");
+        remove(TempFile.c_str());
+        return;
+    }
+
+#ifdef WIN32
+    // rename doesn't replace an existing file on Windows (the cache isn't mapped there so nobody has it open)
+
+    remove(cacheFile.c_str());
+#endif
+
+    if (rename(TempFile.c_str(), cacheFile.c_str()) != 0)
+    {
+        CONSOLE_Print("[IPTOCOUNTRY] warning - unable to replace cache file [" + cacheFile + "]");
+        remove(TempFile.c_str());
+    }
+}
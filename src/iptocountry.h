@@ -0,0 +1,42 @@
+#pragma once
+
+#include "includes.h"
+
+//
+// CIPToCountry
+//
+
+// the iptocountry data is a list of non overlapping ip ranges so we keep it as a flat array sorted by ip1 and binary search it
+// the array is written to a binary cache file the first time the csv file is parsed and later runs map the cache file directly into memory
+
+struct IPToCountryRange
+{
+    uint32_t m_IP1;    // first ip in the range (host byte order)
+    uint32_t m_IP2;    // last ip in the range (host byte order)
+    char m_Country[4]; // two letter country code, zero padded
+};
+
+class CIPToCountry
+{
+private:
+    std::vector<IPToCountryRange> m_Ranges; // the ranges when they were parsed from the csv file (or read from the cache file on Windows)
+    const IPToCountryRange *m_Data;         // the sorted ranges, either m_Ranges.data() or a pointer into the mapped cache file
+    uint32_t m_NumRanges;                   // number of ranges pointed to by m_Data
+    void *m_Mapped;                         // the mapped cache file
+    size_t m_MappedSize;                    // size of the mapped cache file
+
+public:
+    CIPToCountry();
+    ~CIPToCountry();
+
+    uint32_t GetNumRanges() { return m_NumRanges; }
+
+    bool Load(std::string csvFile, std::string cacheFile);
+    std::string FromCheck(uint32_t ip);
+
+private:
+    void Clear();
+    bool LoadCache(std::string csvFile, std::string cacheFile);
+    bool LoadCSV(std::string csvFile);
+    void SaveCache(std::string csvFile, std::string cacheFile);
+};
@@ -0,0 +1,399 @@
+#include "logger.h"
+#include "capture.h"
+#include "util.h"
+
+#include <cstdio>
+#include <ctime>
+
+//
+// CLogger
+//
+
+CLogger::CLogger(std::string nLogFile, uint32_t nLogMethod, uint32_t nMinLevel, std::string tags, uint32_t maxSizeMB, uint32_t nNumRotations)
+{
+    m_LogFile       = nLogFile;
+    m_LogMethod     = nLogMethod;
+    m_MinLevel      = nMinLevel;
+    m_MaxSize       = (uint64_t)maxSizeMB * 1024 * 1024;
+    m_NumRotations  = nNumRotations;
+    m_LogOpen       = false;
+    m_Queue         = NULL;
+    m_NumQueued     = 0;
+    m_NumDropped    = 0;
+    m_LastTime      = 0;
+    m_Exiting       = false;
+    m_CaptureHeader = CAPTURE_FileHeader();
+
+    // the tags are separated by spaces and compared without case
+
+    std::transform(tags.begin(), tags.end(), tags.begin(), (int (*)(int))toupper);
+    std::stringstream SS;
+    SS << tags;
+
+    while (!SS.eof())
+    {
+        std::string Tag;
+        SS >> Tag;
+
+        if (!Tag.empty())
+            m_Tags.push_back(Tag);
+    }
+
+    // open the log now so we can tell the user if it can't be written to, with log method 2 it stays open (and locked on Windows) until we shut down
+
+    if (!m_LogFile.empty())
+    {
+        File *LogFile = Open(m_LogFile, false);
+
+        if (LogFile)
+        {
+            m_LogOpen = true;
+
+            if (m_LogMethod != 2)
+                Close(LogFile);
+        }
+    }
+
+    m_Thread = std::thread(&CLogger::Run, this);
+}
+
+CLogger::~CLogger()
+{
+    // the flusher writes whatever is still queued before it exits
+
+    m_Exiting = true;
+    m_Thread.join();
+
+    for (std::map<std::string, File>::iterator i = m_Files.begin(); i != m_Files.end(); i++)
+        delete (*i).second.m_Stream;
+}
+
+void CLogger::Print(std::string message)
+{
+    if (m_LogFile.empty())
+        return;
+
+    uint32_t Level = GetLevel(message);
+
+    if (Level < m_MinLevel)
+        return;
+
+    if (!m_Tags.empty() && std::find(m_Tags.begin(), m_Tags.end(), GetTag(message)) == m_Tags.end())
+        return;
+
+    Record *NewRecord   = new Record;
+    NewRecord->m_File   = m_LogFile;
+    NewRecord->m_Line   = message;
+    NewRecord->m_Level  = Level;
+    NewRecord->m_Time   = time(NULL);
+    NewRecord->m_Binary = false;
+    Queue(NewRecord);
+}
+
+void CLogger::Write(std::string file, std::string line)
+{
+    Record *NewRecord   = new Record;
+    NewRecord->m_File   = file;
+    NewRecord->m_Line   = line;
+    NewRecord->m_Level  = LOG_DEBUG;
+    NewRecord->m_Time   = 0;
+    NewRecord->m_Binary = false;
+    Queue(NewRecord);
+}
+
+bool CLogger::WriteCapture(const std::string &file, std::string records, bool opensStream, bool closesStream)
+{
+    Record *NewRecord         = new Record;
+    NewRecord->m_File         = file;
+    NewRecord->m_Line         = std::move(records);
+    NewRecord->m_Level        = LOG_DEBUG;
+    NewRecord->m_Time         = 0;
+    NewRecord->m_Binary       = true;
+    NewRecord->m_OpensStream  = opensStream;
+    NewRecord->m_ClosesStream = closesStream;
+    return Queue(NewRecord);
+}
+
+uint32_t CLogger::GetLevel(std::string message)
+{
+    // the console messages don't have a severity of their own but every error and warning says so
+
+    std::transform(message.begin(), message.end(), message.begin(), (int (*)(int))tolower);
+
+    if (message.find("error") != std::string::npos)
+        return LOG_ERROR;
+    else if (message.find("warning") != std::string::npos)
+        return LOG_WARNING;
+
+    return LOG_INFO;
+}
+
+std::string CLogger::GetLevelName(uint32_t level)
+{
+    if (level == LOG_DEBUG)
+        return "DEBUG";
+    else if (level == LOG_INFO)
+        return "INFO";
+    else if (level == LOG_WARNING)
+        return "WARNING";
+
+    return "ERROR";
+}
+
+std::string CLogger::GetTag(std::string message)
+{
+    // the tag is the start of the message's prefix, e.g. "[GAME: name] ..." is tagged GAME and "[MYSQL] ..." is tagged MYSQL
+
+    if (message.empty() || message[0] != '[')
+        return std::string();
+
+    std::string::size_type End = message.find_first_of(":] ", 1);
+
+    if (End == std::string::npos)
+        return std::string();
+
+    return message.substr(1, End - 1);
+}
+
+bool CLogger::Queue(Record *record)
+{
+    // if the flusher can't keep up (e.g. the disk is full or stalled) drop the record instead of using more and more memory
+
+    if (m_NumQueued >= LOG_MAX_QUEUED)
+    {
+        m_NumDropped++;
+        delete record;
+        return false;
+    }
+
+    m_NumQueued++;
+    record->m_Next = m_Queue.load(std::memory_order_relaxed);
+
+    // the flusher only ever takes the whole list so pushing onto it can't suffer from ABA
+
+    while (!m_Queue.compare_exchange_weak(record->m_Next, record, std::memory_order_release, std::memory_order_relaxed))
+        ;
+
+    return true;
+}
+
+void CLogger::Run()
+{
+    while (!m_Exiting)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(LOG_FLUSH_INTERVAL));
+        Flush();
+    }
+
+    Flush();
+}
+
+void CLogger::Flush()
+{
+    Record *Newest = m_Queue.exchange(NULL, std::memory_order_acquire);
+    Record *Oldest = NULL;
+    uint32_t Count = 0;
+
+    // the list is newest first so reverse it to write the lines in order
+
+    while (Newest)
+    {
+        Record *Next   = Newest->m_Next;
+        Newest->m_Next = Oldest;
+        Oldest         = Newest;
+        Newest         = Next;
+        Count++;
+    }
+
+    m_NumQueued -= Count;
+    uint32_t Dropped = m_NumDropped.exchange(0);
+
+    if (Dropped > 0 && !m_LogFile.empty())
+    {
+        Record *DroppedRecord   = new Record;
+        DroppedRecord->m_File   = m_LogFile;
+        DroppedRecord->m_Line   = "[LOGGER] warning - dropped " + UTIL_ToString(Dropped) + " lines because the log couldn't keep up";
+        DroppedRecord->m_Level  = LOG_WARNING;
+        DroppedRecord->m_Time   = time(NULL);
+        DroppedRecord->m_Binary = false;
+        DroppedRecord->m_Next   = Oldest;
+        Oldest                  = DroppedRecord;
+    }
+
+    while (Oldest)
+    {
+        Record *Current = Oldest;
+        Oldest          = Oldest->m_Next;
+        File *Target    = Open(Current->m_File, Current->m_Binary);
+
+        if (Target && Current->m_Binary)
+        {
+            // a new capture file starts with the header and a file we don't have any open streams in is marked where our data starts
+            // e.g. another run left it behind with streams that never ended (the header is only ever at the start)
+
+            std::map<std::string, uint32_t>::iterator Streams = m_CaptureStreams.find(Current->m_File);
+
+            if (Target->m_Size == 0)
+            {
+                Target->m_Stream->write(m_CaptureHeader.data(), m_CaptureHeader.size());
+                Target->m_Size += m_CaptureHeader.size();
+            }
+            else if (Streams == m_CaptureStreams.end())
+            {
+                std::string Restart = CAPTURE_Restart();
+                Target->m_Stream->write(Restart.data(), Restart.size());
+                Target->m_Size += Restart.size();
+            }
+
+            Target->m_Stream->write(Current->m_Line.data(), Current->m_Line.size());
+            Target->m_Size += Current->m_Line.size();
+            Target->m_Used = true;
+
+            // forget the file once its last stream has ended so capturing game after game doesn't keep every file name forever
+
+            if (Current->m_OpensStream)
+                m_CaptureStreams[Current->m_File]++;
+
+            if (Current->m_ClosesStream)
+            {
+                Streams = m_CaptureStreams.find(Current->m_File);
+
+                if (Streams != m_CaptureStreams.end() && --(*Streams).second == 0)
+                    m_CaptureStreams.erase(Streams);
+            }
+
+            if (m_MaxSize > 0 && Target->m_Size >= m_MaxSize)
+                Rotate(Current->m_File, Target);
+        }
+        else if (Target)
+        {
+            std::string Line;
+
+            if (Current->m_Time != 0)
+                Line = "[" + GetTimeString(Current->m_Time) + "] [" + GetLevelName(Current->m_Level) + "] " + Current->m_Line + "\n";
+            else
+                Line = Current->m_Line + "\n";
+
+            Target->m_Stream->write(Line.data(), Line.size());
+            Target->m_Size += Line.size();
+            Target->m_Used = true;
+
+            if (m_MaxSize > 0 && Target->m_Size >= m_MaxSize)
+                Rotate(Current->m_File, Target);
+        }
+
+        delete Current;
+    }
+
+    // one flush per file per batch, with log method 1 the files are closed again so they can be edited/moved/deleted while we're running
+    // with log method 2 only bot_log stays open for good, the packet traces and captures are closed after a batch that didn't write to them
+    // otherwise every game that was ever traced or captured would keep its files open until we run out of descriptors
+
+    for (std::map<std::string, File>::iterator i = m_Files.begin(); i != m_Files.end();)
+    {
+        if (m_LogMethod == 2 && ((*i).second.m_Used || (*i).first == m_LogFile))
+        {
+            (*i).second.m_Stream->flush();
+            (*i).second.m_Used = false;
+            i++;
+        }
+        else
+        {
+            delete (*i).second.m_Stream;
+            i = m_Files.erase(i);
+        }
+    }
+}
+
+CLogger::File *CLogger::Open(std::string name, bool binary)
+{
+    std::map<std::string, File>::iterator i = m_Files.find(name);
+
+    if (i != m_Files.end())
+        return &(*i).second;
+
+    std::ofstream *Stream = new std::ofstream();
+    Stream->open(name.c_str(), binary ? std::ios::app | std::ios::binary : std::ios::app);
+
+    if (Stream->fail())
+    {
+        delete Stream;
+        return NULL;
+    }
+
+    File NewFile;
+    NewFile.m_Stream = Stream;
+    NewFile.m_Binary = binary;
+    NewFile.m_Used   = false;
+    Stream->seekp(0, std::ios::end);
+    NewFile.m_Size = std::max((std::streamoff)Stream->tellp(), (std::streamoff)0);
+    m_Files[name]  = NewFile;
+    return &m_Files[name];
+}
+
+void CLogger::Close(File *file)
+{
+    for (std::map<std::string, File>::iterator i = m_Files.begin(); i != m_Files.end(); i++)
+    {
+        if (&(*i).second == file)
+        {
+            delete (*i).second.m_Stream;
+            m_Files.erase(i);
+            return;
+        }
+    }
+}
+
+void CLogger::Rotate(std::string name, File *file)
+{
+    // <file> becomes <file>.1, <file>.1 becomes <file>.2 and so on, the oldest is deleted
+    // without any rotations the file is just started again
+
+    delete file->m_Stream;
+
+    if (m_NumRotations == 0)
+        std::remove(name.c_str());
+    else
+    {
+        std::remove((name + "." + UTIL_ToString(m_NumRotations)).c_str());
+
+        for (uint32_t i = m_NumRotations - 1; i >= 1; i--)
+            std::rename((name + "." + UTIL_ToString(i)).c_str(), (name + "." + UTIL_ToString(i + 1)).c_str());
+
+        std::rename(name.c_str(), (name + ".1").c_str());
+    }
+
+    file->m_Stream = new std::ofstream();
+    file->m_Stream->open(name.c_str(), file->m_Binary ? std::ios::app | std::ios::binary : std::ios::app);
+    file->m_Size = 0;
+
+    // if the new file can't be opened it's opened again for the next line
+
+    if (file->m_Stream->fail())
+        Close(file);
+}
+
+std::string CLogger::GetTimeString(time_t time)
+{
+    // consecutive lines are usually logged in the same second so only format the time once per second
+
+    if (time != m_LastTime)
+    {
+        struct tm Local;
+        char Buffer[64];
+
+#ifdef WIN32
+        localtime_s(&Local, &time);
+#else
+        localtime_r(&time, &Local);
+#endif
+
+        // the same format as asctime without the newline
+
+        strftime(Buffer, sizeof(Buffer), "%a %b %e %H:%M:%S %Y", &Local);
+        m_LastTime       = time;
+        m_LastTimeString = Buffer;
+    }
+
+    return m_LastTimeString;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "includes.h"
+
+#include <atomic>
+
+//
+// CLogger
+//
+
+// writes the log (bot_log), the packet traces (CTCPSocket::SetLogFile) and the packet captures (CTCPSocket::SetCapture) from a background thread so printing never waits on the disk
+// any thread can queue a line without taking a lock, the lines are pushed onto a lock free list which the flusher thread takes in one go every LOG_FLUSH_INTERVAL
+// each batch is written with one open (log method 1) or one flush (log method 2) per file instead of one per line
+// every console message is given a severity (from the message itself, "error" or "warning") and a tag (the subsystem in its prefix, e.g. GAME, BNET, MYSQL, MAP)
+// so bot_loglevel and bot_logtags can keep the log down to what's interesting
+// when a file grows past bot_logmaxsize it's rotated to <file>.1, <file>.2, etc... keeping bot_logrotations old files
+
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARNING 2
+#define LOG_ERROR 3
+
+#define LOG_FLUSH_INTERVAL 100 // milliseconds between batches
+#define LOG_MAX_QUEUED 100000  // lines waiting to be written before new lines are dropped (e.g. the disk is full or stalled)
+
+class CLogger
+{
+private:
+    // a queued line, the list is built newest first and reversed by the flusher
+
+    struct Record
+    {
+        Record *m_Next;
+        std::string m_File;
+        std::string m_Line; // the line (or the records of a capture)
+        uint32_t m_Level;
+        time_t m_Time;       // 0 for lines written without a timestamp (the packet traces)
+        bool m_Binary;       // if the data is capture records written as is instead of a line
+        bool m_OpensStream;  // if the capture records are the first of a stream to be queued
+        bool m_ClosesStream; // if the capture records end a stream
+    };
+
+    // an open file (only accessed by the flusher thread)
+
+    struct File
+    {
+        std::ofstream *m_Stream;
+        uint64_t m_Size;
+        bool m_Binary;
+        bool m_Used; // if anything was written to the file in this batch
+    };
+
+    std::string m_LogFile;                            // bot_log (empty if only packet traces are logged)
+    uint32_t m_LogMethod;                             // 1 to reopen the files for every batch, 2 to keep them open (and locked on Windows)
+    uint32_t m_MinLevel;                              // console messages below this level aren't logged
+    std::vector<std::string> m_Tags;                  // only log console messages with these tags (empty to log every tag)
+    uint64_t m_MaxSize;                               // rotate a file when it grows past this many bytes (0 to never rotate)
+    uint32_t m_NumRotations;                          // the number of rotated files to keep
+    bool m_LogOpen;                                   // if bot_log could be opened for appending when the logger started
+    std::atomic<Record *> m_Queue;                    // the newest queued line
+    std::atomic<uint32_t> m_NumQueued;                // the number of queued lines
+    std::atomic<uint32_t> m_NumDropped;               // the number of lines dropped since the last batch because too many were queued
+    std::map<std::string, File> m_Files;              // the open files (only accessed by the flusher thread once it's started)
+    std::string m_CaptureHeader;                      // the header every capture file starts with (see capture.h)
+    std::map<std::string, uint32_t> m_CaptureStreams; // capture file -> the number of our streams in it that haven't ended (only accessed by the flusher thread)
+    std::string m_LastTimeString;                     // the last timestamp formatted (only accessed by the flusher thread)
+    time_t m_LastTime;                                // the time m_LastTimeString was formatted for
+    std::thread m_Thread;
+    std::atomic<bool> m_Exiting;
+
+public:
+    CLogger(std::string nLogFile, uint32_t nLogMethod, uint32_t nMinLevel, std::string tags, uint32_t maxSizeMB, uint32_t nNumRotations);
+    ~CLogger();
+
+    std::string GetLogFile() { return m_LogFile; }
+    uint32_t GetLogMethod() { return m_LogMethod; }
+    bool GetLogOpen() { return m_LogOpen; }
+
+    void Print(std::string message);                // log a console message to bot_log (if it passes bot_loglevel and bot_logtags)
+    void Write(std::string file, std::string line); // log a line without a timestamp to any file (used for the packet traces)
+    bool WriteCapture(const std::string &file, std::string records, bool opensStream, bool closesStream); // write packet capture records as is to a capture file (see capture.h), returns false if they were dropped
+
+    static uint32_t GetLevel(std::string message);
+    static std::string GetLevelName(uint32_t level);
+    static std::string GetTag(std::string message);
+
+private:
+    bool Queue(Record *record);
+    void Run();
+    void Flush();
+    File *Open(std::string name, bool binary);
+    void Close(File *file);
+    void Rotate(std::string name, File *file);
+    std::string GetTimeString(time_t time);
+};
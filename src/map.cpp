@@ -22,9 +22,12 @@
 #include "config.h"
 #include "crc32.h"
 #include "ghost.h"
+#include "mapdata.h"
 #include "sha1.h"
 #include "util.h"
 
+#include <sys/stat.h>
+
 #define __STORMLIB_SELF__
 #include <StormLib.h>
 
@@ -256,10 +259,34 @@ void CMap::Load(CConfig *CFG, std::string nCFGFile)
     // load the map data
 
     m_MapLocalPath = CFG->GetString("map_localpath", std::string());
-    m_MapData.clear();
+    m_MapData.reset();
 
     if (!m_MapLocalPath.empty())
-        m_MapData = UTIL_FileRead(m_GHost->m_MapPath + m_MapLocalPath);
+        m_MapData = CMapData::Get(m_GHost->m_MapPath + m_MapLocalPath);
+
+    BYTEARRAY MapSize;
+    BYTEARRAY MapInfo;
+    BYTEARRAY MapCRC;
+    BYTEARRAY MapSHA1;
+    uint32_t MapOptions = 0;
+    BYTEARRAY MapWidth;
+    BYTEARRAY MapHeight;
+    uint32_t MapNumPlayers = 0;
+    uint32_t MapNumTeams   = 0;
+    std::vector<CGameSlot> Slots;
+
+    // check the map cache before doing any MPQ work
+    // everything we calculate below only depends on the map file and the default common.j and blizzard.j so rehosting the same map can skip it entirely
+
+    std::string CacheFile = GetCacheFile();
+    std::string CacheKey;
+    bool CacheHit = false;
+
+    if (m_MapData)
+    {
+        CacheKey = GetCacheKey();
+        CacheHit = LoadCache(CacheFile, CacheKey, MapSize, MapInfo, MapCRC, MapSHA1, MapOptions, MapWidth, MapHeight, MapNumPlayers, MapNumTeams, Slots);
+    }
 
     // load the map MPQ
 
@@ -267,7 +294,9 @@ void CMap::Load(CConfig *CFG, std::string nCFGFile)
     HANDLE MapMPQ;
     bool MapMPQReady = false;
 
-    if (SFileOpenArchive(MapMPQFileName.c_str(), 0, MPQ_OPEN_FORCE_MPQ_V1, &MapMPQ))
+    if (CacheHit)
+        CONSOLE_Print("[MAP] using cached map_size, map_info, map_crc, map_sha1, map_options, map_width, map_height, map_slot<x>, map_numplayers, map_numteams from [" + CacheFile + "]");
+    else if (SFileOpenArchive(MapMPQFileName.c_str(), 0, MPQ_OPEN_FORCE_MPQ_V1, &MapMPQ))
     {
         CONSOLE_Print("[MAP] loading MPQ file [" + MapMPQFileName + "]");
         MapMPQReady = true;
@@ -277,23 +306,18 @@ void CMap::Load(CConfig *CFG, std::string nCFGFile)
 
     // try to calculate map_size, map_info, map_crc, map_sha1
 
-    BYTEARRAY MapSize;
-    BYTEARRAY MapInfo;
-    BYTEARRAY MapCRC;
-    BYTEARRAY MapSHA1;
-
-    if (!m_MapData.empty())
+    if (!CacheHit && m_MapData)
     {
         m_GHost->m_SHA->Reset();
 
         // calculate map_size
 
-        MapSize = UTIL_CreateByteArray((uint32_t)m_MapData.size(), false);
+        MapSize = UTIL_CreateByteArray(m_MapData->GetSize(), false);
         CONSOLE_Print("[MAP] calculated map_size = " + UTIL_ByteArrayToDecString(MapSize));
 
         // calculate map_info (this is actually the CRC)
 
-        MapInfo = UTIL_CreateByteArray((uint32_t)m_GHost->m_CRC->FullCRC((unsigned char *)m_MapData.c_str(), m_MapData.size()), false);
+        MapInfo = UTIL_CreateByteArray((uint32_t)m_GHost->m_CRC->FullCRC((unsigned char *)m_MapData->GetData(), m_MapData->GetSize()), false);
         CONSOLE_Print("[MAP] calculated map_info = " + UTIL_ByteArrayToDecString(MapInfo));
 
         // calculate map_crc (this is not the CRC) and map_sha1
@@ -467,19 +491,12 @@ void CMap::Load(CConfig *CFG, std::string nCFGFile)
             }
         }
     }
-    else
+    else if (!m_MapData)
         CONSOLE_Print("[MAP] no map data available, using config file for map_size, map_info, map_crc, map_sha1");
 
     // try to calculate map_width, map_height, map_slot<x>, map_numplayers, map_numteams
 
-    uint32_t MapOptions = 0;
-    BYTEARRAY MapWidth;
-    BYTEARRAY MapHeight;
-    uint32_t MapNumPlayers = 0;
-    uint32_t MapNumTeams   = 0;
-    std::vector<CGameSlot> Slots;
-
-    if (!m_MapData.empty())
+    if (!CacheHit && m_MapData)
     {
         if (MapMPQReady)
         {
@@ -707,13 +724,16 @@ void CMap::Load(CConfig *CFG, std::string nCFGFile)
         else
             CONSOLE_Print("[MAP] unable to calculate map_options, map_width, map_height, map_slot<x>, map_numplayers, map_numteams - map MPQ file not loaded");
     }
-    else
+    else if (!m_MapData)
         CONSOLE_Print("[MAP] no map data available, using config file for map_options, map_width, map_height, map_slot<x>, map_numplayers, map_numteams");
 
     // close the map MPQ
 
     if (MapMPQReady)
+    {
         SFileCloseArchive(MapMPQ);
+        SaveCache(CacheFile, CacheKey, MapSize, MapInfo, MapCRC, MapSHA1, MapOptions, MapWidth, MapHeight, MapNumPlayers, MapNumTeams, Slots);
+    }
 
     m_MapPath = CFG->GetString("map_path", std::string());
 
@@ -964,7 +984,7 @@ void CMap::CheckValid()
         m_Valid = false;
         CONSOLE_Print("[MAP] invalid map_size detected");
     }
-    else if (!m_MapData.empty() && m_MapData.size() != UTIL_ByteArrayToUInt32(m_MapSize, false))
+    else if (m_MapData && m_MapData->GetSize() != UTIL_ByteArrayToUInt32(m_MapSize, false))
     {
         m_Valid = false;
         CONSOLE_Print("[MAP] invalid map_size detected - size mismatch with actual map data");
@@ -1064,3 +1084,117 @@ uint32_t CMap::XORRotateLeft(unsigned char *data, uint32_t length)
 
     return Val;
 }
+
+std::string CMap::GetCacheFile()
+{
+    return m_GHost->m_MapCFGPath + UTIL_FileSafeName(m_MapLocalPath) + ".mapcache";
+}
+
+std::string CMap::GetCacheKey()
+{
+    // the key is the map file's size and modification time plus the size and crc of the default common.j and blizzard.j
+    // we use the crc of the scripts instead of their modification times because ExtractScripts rewrites them on every startup
+
+    std::string Key = UTIL_ToString(m_MapData->GetSize());
+    struct stat MapInfo;
+
+    if (stat((m_GHost->m_MapPath + m_MapLocalPath).c_str(), &MapInfo) == 0)
+        Key += " " + UTIL_ToString((uint32_t)MapInfo.st_mtime);
+
+    std::string CommonJ;
+    std::string BlizzardJ;
+
+    if (UTIL_FileExists(m_GHost->m_MapCFGPath + "common.j"))
+        CommonJ = UTIL_FileRead(m_GHost->m_MapCFGPath + "common.j");
+
+    if (UTIL_FileExists(m_GHost->m_MapCFGPath + "blizzard.j"))
+        BlizzardJ = UTIL_FileRead(m_GHost->m_MapCFGPath + "blizzard.j");
+
+    Key += " " + UTIL_ToString((uint32_t)CommonJ.size()) + " " + UTIL_ToString(m_GHost->m_CRC->FullCRC((unsigned char *)CommonJ.c_str(), CommonJ.size()));
+    Key += " " + UTIL_ToString((uint32_t)BlizzardJ.size()) + " " + UTIL_ToString(m_GHost->m_CRC->FullCRC((unsigned char *)BlizzardJ.c_str(), BlizzardJ.size()));
+    return Key;
+}
+
+bool CMap::LoadCache(std::string cacheFile, std::string cacheKey, BYTEARRAY &mapSize, BYTEARRAY &mapInfo, BYTEARRAY &mapCRC, BYTEARRAY &mapSHA1, uint32_t &mapOptions, BYTEARRAY &mapWidth, BYTEARRAY &mapHeight, uint32_t &mapNumPlayers, uint32_t &mapNumTeams, std::vector<CGameSlot> &slots)
+{
+    if (!UTIL_FileExists(cacheFile))
+        return false;
+
+    CConfig Cache;
+    Cache.Read(cacheFile);
+
+    if (Cache.GetInt("cache_version", 0) != MAPCACHE_VERSION || Cache.GetString("cache_key", std::string()) != cacheKey || Cache.GetString("cache_mappath", std::string()) != m_MapLocalPath)
+    {
+        CONSOLE_Print("[MAP] map cache [" + cacheFile + "] is out of date, recalculating");
+        return false;
+    }
+
+    // values we failed to calculate last time were saved as empty strings so they're still empty now and fall back to the config file like before
+
+    mapSize       = UTIL_ExtractNumbers(Cache.GetString("map_size", std::string()), 4);
+    mapInfo       = UTIL_ExtractNumbers(Cache.GetString("map_info", std::string()), 4);
+    mapCRC        = UTIL_ExtractNumbers(Cache.GetString("map_crc", std::string()), 4);
+    mapSHA1       = UTIL_ExtractNumbers(Cache.GetString("map_sha1", std::string()), 20);
+    mapOptions    = Cache.GetInt("map_options", 0);
+    mapWidth      = UTIL_ExtractNumbers(Cache.GetString("map_width", std::string()), 2);
+    mapHeight     = UTIL_ExtractNumbers(Cache.GetString("map_height", std::string()), 2);
+    mapNumPlayers = Cache.GetInt("map_numplayers", 0);
+    mapNumTeams   = Cache.GetInt("map_numteams", 0);
+    slots.clear();
+
+    for (uint32_t Slot = 1; Slot <= 12; Slot++)
+    {
+        std::string SlotString = Cache.GetString("map_slot" + UTIL_ToString(Slot), std::string());
+
+        if (SlotString.empty())
+            break;
+
+        BYTEARRAY SlotData = UTIL_ExtractNumbers(SlotString, 9);
+        slots.push_back(CGameSlot(SlotData));
+    }
+
+    return true;
+}
+
+void CMap::SaveCache(std::string cacheFile, std::string cacheKey, BYTEARRAY &mapSize, BYTEARRAY &mapInfo, BYTEARRAY &mapCRC, BYTEARRAY &mapSHA1, uint32_t mapOptions, BYTEARRAY &mapWidth, BYTEARRAY &mapHeight, uint32_t mapNumPlayers, uint32_t mapNumTeams, std::vector<CGameSlot> &slots)
+{
+    if (cacheKey.empty())
+        return;
+
+    // the cache is written in the same format as a map config file so it can be inspected (or deleted) by hand
+
+    std::ofstream out;
+    out.open(cacheFile.c_str(), std::ios::trunc);
+
+    if (out.fail())
+    {
+        CONSOLE_Print("[MAP] warning - unable to write map cache [" + cacheFile + "]");
+        return;
+    }
+
+    out << "# map cache generated by GHost++, delete this file to force the map to be recalculated" << std::endl;
+    out << "cache_version = " << MAPCACHE_VERSION << std::endl;
+    out << "cache_key = " << cacheKey << std::endl;
+    out << "cache_mappath = " << m_MapLocalPath << std::endl;
+    out << "map_size = " << UTIL_ByteArrayToDecString(mapSize) << std::endl;
+    out << "map_info = " << UTIL_ByteArrayToDecString(mapInfo) << std::endl;
+    out << "map_crc = " << UTIL_ByteArrayToDecString(mapCRC) << std::endl;
+    out << "map_sha1 = " << UTIL_ByteArrayToDecString(mapSHA1) << std::endl;
+    out << "map_options = " << mapOptions << std::endl;
+    out << "map_width = " << UTIL_ByteArrayToDecString(mapWidth) << std::endl;
+    out << "map_height = " << UTIL_ByteArrayToDecString(mapHeight) << std::endl;
+    out << "map_numplayers = " << mapNumPlayers << std::endl;
+    out << "map_numteams = " << mapNumTeams << std::endl;
+
+    uint32_t SlotNum = 1;
+
+    for (std::vector<CGameSlot>::iterator i = slots.begin(); i != slots.end(); i++)
+    {
+        BYTEARRAY SlotData = (*i).GetByteArray();
+        out << "map_slot" << SlotNum << " = " << UTIL_ByteArrayToDecString(SlotData) << std::endl;
+        SlotNum++;
+    }
+
+    out.close();
+    CONSOLE_Print("[MAP] saved map cache [" + cacheFile + "]");
+}
@@ -23,6 +23,7 @@
 #include "config.h"
 #include "ghost.h"
 #include "includes.h"
+#include "mapdata.h"
 
 #define MAPSPEED_SLOW 1
 #define MAPSPEED_NORMAL 2
@@ -86,6 +87,8 @@
 #define MAPGAMETYPE_OBSONDEATH 1 << 21
 #define MAPGAMETYPE_OBSNONE 1 << 22
 
+#define MAPCACHE_VERSION 1
+
 #include "gameslot.h"
 
 //
@@ -123,7 +126,7 @@ private:
     uint32_t m_MapDefaultPlayerScore;     // config value: map default player score (for matchmaking)
     std::string m_MapLocalPath;           // config value: map local path
     bool m_MapLoadInGame;
-    std::string m_MapData; // the map data itself, for sending the map to players
+    std::shared_ptr<CMapData> m_MapData; // the map data itself, for sending the map to players (shared with every other map loaded from the same file)
     uint32_t m_MapNumPlayers;
     uint32_t m_MapNumTeams;
     std::vector<CGameSlot> m_Slots;
@@ -165,7 +168,8 @@ public:
     uint32_t GetMapDefaultPlayerScore() { return m_MapDefaultPlayerScore; }
     std::string GetMapLocalPath() { return m_MapLocalPath; }
     bool GetMapLoadInGame() { return m_MapLoadInGame; }
-    std::string *GetMapData() { return &m_MapData; }
+    CMapData *GetMapData() { return m_MapData.get(); }
+    uint32_t GetMapDataSize() { return m_MapData ? m_MapData->GetSize() : 0; }
     uint32_t GetMapNumPlayers() { return m_MapNumPlayers; }
     uint32_t GetMapNumTeams() { return m_MapNumTeams; }
     std::vector<CGameSlot> GetSlots() { return m_Slots; }
@@ -181,4 +185,10 @@ public:
     void Load(CConfig *CFG, std::string nCFGFile);
     void CheckValid();
     uint32_t XORRotateLeft(unsigned char *data, uint32_t length);
+
+private:
+    std::string GetCacheFile();
+    std::string GetCacheKey();
+    bool LoadCache(std::string cacheFile, std::string cacheKey, BYTEARRAY &mapSize, BYTEARRAY &mapInfo, BYTEARRAY &mapCRC, BYTEARRAY &mapSHA1, uint32_t &mapOptions, BYTEARRAY &mapWidth, BYTEARRAY &mapHeight, uint32_t &mapNumPlayers, uint32_t &mapNumTeams, std::vector<CGameSlot> &slots);
+    void SaveCache(std::string cacheFile, std::string cacheKey, BYTEARRAY &mapSize, BYTEARRAY &mapInfo, BYTEARRAY &mapCRC, BYTEARRAY &mapSHA1, uint32_t mapOptions, BYTEARRAY &mapWidth, BYTEARRAY &mapHeight, uint32_t mapNumPlayers, uint32_t mapNumTeams, std::vector<CGameSlot> &slots);
 };
@@ -0,0 +1,160 @@
+#include "mapdata.h"
+#include "crc32.h"
+#include "ghost.h"
+#include "util.h"
+
+#include <sys/stat.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+std::mutex CMapData::m_RegistryMutex;
+std::map<std::string, std::weak_ptr<CMapData>> CMapData::m_Registry;
+
+//
+// CMapData
+//
+
+CMapData::CMapData(std::string nFile)
+{
+    m_File     = nFile;
+    m_FileTime  = 0;
+    m_FileInode = 0;
+    m_Data      = NULL;
+    m_Size      = 0;
+    m_Mapped    = NULL;
+
+    struct stat FileInfo;
+
+#ifndef WIN32
+    int fd = open(m_File.c_str(), O_RDONLY);
+
+    if (fd == -1 || fstat(fd, &FileInfo) != 0 || FileInfo.st_size == 0)
+    {
+        if (fd != -1)
+            close(fd);
+
+        return;
+    }
+
+    m_FileTime  = FileInfo.st_mtime;
+    m_FileInode = FileInfo.st_ino;
+
+    // the mapping is private so nothing we do can write back to the file
+    // the file is checked again once it's mapped, if it was being written to while we loaded it we take a copy instead
+
+    void *Mapped = mmap(NULL, FileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    struct stat MappedInfo;
+
+    if (Mapped != MAP_FAILED && fstat(fd, &MappedInfo) == 0 && MappedInfo.st_size == FileInfo.st_size && MappedInfo.st_mtime == FileInfo.st_mtime)
+    {
+        close(fd);
+        m_Mapped = Mapped;
+        m_Data   = (const unsigned char *)m_Mapped;
+        m_Size   = FileInfo.st_size;
+        return;
+    }
+
+    close(fd);
+
+    if (Mapped != MAP_FAILED)
+    {
+        munmap(Mapped, FileInfo.st_size);
+        CONSOLE_Print("[MAPDATA] warning - file [" + m_File + "] changed while it was being mapped, reading it instead");
+    }
+    else
+        CONSOLE_Print("[MAPDATA] warning - unable to map file [" + m_File + "], reading it instead");
+#else
+    if (stat(m_File.c_str(), &FileInfo) != 0 || FileInfo.st_size == 0)
+        return;
+
+    m_FileTime  = FileInfo.st_mtime;
+    m_FileInode = FileInfo.st_ino;
+#endif
+
+    m_Buffer = UTIL_FileRead(m_File);
+
+    if (!m_Buffer.empty())
+    {
+        m_Data = (const unsigned char *)m_Buffer.data();
+        m_Size = m_Buffer.size();
+    }
+}
+
+CMapData::~CMapData()
+{
+#ifndef WIN32
+    if (m_Mapped)
+        munmap(m_Mapped, m_Size);
+#endif
+}
+
+uint32_t CMapData::GetPartCRC(uint32_t part)
+{
+    // every game downloading this map shares the same table so each part's crc is only ever calculated once
+    // the table is filled on first use rather than on load so maps that are never downloaded don't pay for it
+
+    std::call_once(m_PartCRCsFlag, [this]() {
+        CCRC32 CRC;
+        CRC.Initialize();
+        uint32_t NumParts = GetNumParts();
+        m_PartCRCs.reserve(NumParts);
+
+        for (uint32_t i = 0; i < NumParts; i++)
+            m_PartCRCs.push_back(CRC.FullCRC((unsigned char *)GetPart(i), GetPartSize(i)));
+    });
+
+    return m_PartCRCs[part];
+}
+
+std::shared_ptr<CMapData> CMapData::Get(std::string file)
+{
+    struct stat FileInfo;
+
+    if (stat(file.c_str(), &FileInfo) != 0)
+    {
+        CONSOLE_Print("[MAPDATA] warning - unable to read file [" + file + "]");
+        return std::shared_ptr<CMapData>();
+    }
+
+    std::lock_guard<std::mutex> Lock(m_RegistryMutex);
+
+    // reuse the data if another map already loaded this file and the file hasn't changed since
+    // if it has changed the games using the old version keep it until they finish
+    // a map file replaced by renaming a new one over it is a different inode so it's always loaded again
+
+    std::map<std::string, std::weak_ptr<CMapData>>::iterator i = m_Registry.find(file);
+
+    if (i != m_Registry.end())
+    {
+        std::shared_ptr<CMapData> Data = i->second.lock();
+
+        if (Data && Data->m_Size == (uint32_t)FileInfo.st_size && Data->m_FileTime == (uint32_t)FileInfo.st_mtime && Data->m_FileInode == (uint64_t)FileInfo.st_ino)
+            return Data;
+    }
+
+    std::shared_ptr<CMapData> Data(new CMapData(file));
+
+    if (!Data->m_Data)
+    {
+        CONSOLE_Print("[MAPDATA] warning - unable to read file [" + file + "]");
+        return std::shared_ptr<CMapData>();
+    }
+
+    m_Registry[file] = Data;
+
+    // forget about any files no map is using anymore
+
+    for (i = m_Registry.begin(); i != m_Registry.end();)
+    {
+        if (i->second.expired())
+            i = m_Registry.erase(i);
+        else
+            i++;
+    }
+
+    return Data;
+}
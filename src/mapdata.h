@@ -0,0 +1,52 @@
+#pragma once
+
+#include "includes.h"
+
+#include <mutex>
+
+#define MAPPART_SIZE 1442 // the number of map bytes in each W3GS_MAPPART packet
+
+//
+// CMapData
+//
+
+// the raw contents of a map file, shared by every CMap (and therefore every game) using the same file
+// on Linux the file is mapped read only so all the games send their map parts straight out of the page cache
+// note: map files must be replaced by writing the new file elsewhere and renaming it over the old one, never overwritten in place
+// note: the games using the old file keep the old inode mapped, whereas a file truncated or rewritten in place can crash the bot (SIGBUS) or send new bytes under the old crc
+
+class CMapData
+{
+private:
+    std::string m_File;          // the file this data was loaded from
+    uint32_t m_FileTime;         // modification time of the file when it was loaded
+    uint64_t m_FileInode;        // inode of the file when it was loaded
+    const unsigned char *m_Data; // the map data itself
+    uint32_t m_Size;             // size of the map data
+    void *m_Mapped;              // the mapping (NULL if the data was read into m_Buffer instead)
+    std::string m_Buffer;        // the map data when it couldn't be mapped (or changed while it was being mapped)
+
+    std::once_flag m_PartCRCsFlag;
+    std::vector<uint32_t> m_PartCRCs; // crc of each MAPPART_SIZE byte part of the map, calculated the first time anyone downloads the map
+
+    static std::mutex m_RegistryMutex;
+    static std::map<std::string, std::weak_ptr<CMapData>> m_Registry; // file -> data of every map file currently in use
+
+    CMapData(std::string nFile);
+
+public:
+    ~CMapData();
+
+    std::string GetFile() { return m_File; }
+    const unsigned char *GetData() { return m_Data; }
+    uint32_t GetSize() { return m_Size; }
+    uint32_t GetNumParts() { return (m_Size + MAPPART_SIZE - 1) / MAPPART_SIZE; }
+    const unsigned char *GetPart(uint32_t part) { return m_Data + part * MAPPART_SIZE; }
+    uint32_t GetPartSize(uint32_t part) { return part + 1 < GetNumParts() ? MAPPART_SIZE : m_Size - part * MAPPART_SIZE; }
+    uint32_t GetPartCRC(uint32_t part);
+
+    // returns the shared data for this file, loading it only if no other map is using the current version of the file
+    // returns NULL if the file couldn't be read
+
+    static std::shared_ptr<CMapData> Get(std::string file);
+};
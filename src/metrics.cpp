@@ -0,0 +1,289 @@
+#include "metrics.h"
+#include "game_base.h"
+#include "gameplayer.h"
+#include "gamethread.h"
+#include "ghost.h"
+#include "socket.h"
+#include "timerwheel.h"
+#include "util.h"
+
+#include <cmath>
+#include <cstring>
+
+//
+// CMetricsServer
+//
+
+CMetricsServer::CMetricsServer(CGHost *nGHost, std::string address, uint16_t port)
+{
+    m_GHost      = nGHost;
+    m_Socket     = new CTCPServer();
+    m_NumScrapes = 0;
+
+    if (m_Socket->Listen(address, port))
+        CONSOLE_Print("[METRICS] listening for metrics requests on " + (address.empty() ? std::string("all addresses") : address) + " port " + UTIL_ToString(port));
+    else
+    {
+        CONSOLE_Print("[METRICS] error listening for metrics requests on port " + UTIL_ToString(port));
+        delete m_Socket;
+        m_Socket = NULL;
+    }
+}
+
+CMetricsServer::~CMetricsServer()
+{
+    for (std::vector<Request>::iterator i = m_Requests.begin(); i != m_Requests.end(); i++)
+        delete (*i).m_Socket;
+
+    delete m_Socket;
+}
+
+void CMetricsServer::Update()
+{
+    if (!m_Socket)
+        return;
+
+    if (m_Socket->HasError())
+    {
+        CONSOLE_Print("[METRICS] metrics listener error (" + m_Socket->GetErrorString() + ")");
+        delete m_Socket;
+        m_Socket = NULL;
+        return;
+    }
+
+    CTCPSocket *NewSocket = m_Socket->Accept();
+
+    if (NewSocket)
+    {
+        Request NewRequest;
+        NewRequest.m_Socket    = NewSocket;
+        NewRequest.m_Responded = false;
+        m_Requests.push_back(NewRequest);
+    }
+
+    for (std::vector<Request>::iterator i = m_Requests.begin(); i != m_Requests.end();)
+    {
+        CTCPSocket *Socket = (*i).m_Socket;
+
+        if (Socket->HasError() || !Socket->GetConnected() || GetTime() - Socket->GetLastRecv() >= METRICS_TIMEOUT)
+        {
+            delete Socket;
+            i = m_Requests.erase(i);
+            continue;
+        }
+
+        if (!(*i).m_Responded)
+        {
+            Socket->DoRecv();
+
+            // we only need the request line, the headers are read (and ignored) so we know the request is complete
+
+            std::string Received((const char *)Socket->GetRecvData(), Socket->GetRecvSize());
+
+            if (Received.find("\r\n\r\n") != std::string::npos || Received.find("\n\n") != std::string::npos)
+            {
+                std::string Status = "200 OK";
+                std::string Body;
+
+                if (Received.compare(0, 4, "GET ") != 0)
+                {
+                    Status = "405 Method Not Allowed";
+                    Body   = "only GET is supported\n";
+                }
+                else if (Received.compare(4, 9, "/metrics ") == 0 || Received.compare(4, 2, "/ ") == 0)
+                {
+                    Body = GetMetrics();
+                    m_NumScrapes++;
+                }
+                else
+                {
+                    Status = "404 Not Found";
+                    Body   = "the metrics are at /metrics\n";
+                }
+
+                Socket->PutBytes("HTTP/1.0 " + Status + "\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: " + UTIL_ToString(Body.size()) + "\r\nConnection: close\r\n\r\n" + Body);
+                Socket->ClearRecvBuffer();
+                (*i).m_Responded = true;
+            }
+            else if (Received.size() > METRICS_MAX_REQUEST)
+            {
+                delete Socket;
+                i = m_Requests.erase(i);
+                continue;
+            }
+        }
+
+        Socket->DoSend();
+
+        // close the connection once the whole response has been sent (the client knows it's complete when we close it)
+
+        if ((*i).m_Responded && Socket->GetSendQueued() == 0)
+        {
+            delete Socket;
+            i = m_Requests.erase(i);
+            continue;
+        }
+
+        i++;
+    }
+}
+
+std::string CMetricsServer::GetMetrics()
+{
+    // the games in progress might be running on the game threads so they have to wait while we read them
+
+    CGameThreadLock Lock(m_GHost->m_GameThreads);
+
+    m_Families.clear();
+
+    Add("ghost_games", "gauge", "Number of games in progress.", std::string(), m_GHost->m_Games.size());
+    Add("ghost_lobbies", "gauge", "Number of games in the lobby.", std::string(), m_GHost->m_CurrentGame ? 1 : 0);
+    Add("ghost_metrics_scrapes_total", "counter", "Number of metrics requests answered.", std::string(), m_NumScrapes);
+
+    if (m_GHost->m_CurrentGame)
+        AddGame(m_GHost->m_CurrentGame);
+
+    for (std::vector<CBaseGame *>::iterator i = m_GHost->m_Games.begin(); i != m_GHost->m_Games.end(); i++)
+        AddGame(*i);
+
+    std::string Metrics;
+
+    for (std::vector<Family>::iterator i = m_Families.begin(); i != m_Families.end(); i++)
+        Metrics += "# HELP " + (*i).m_Name + " " + (*i).m_Help + "\n# TYPE " + (*i).m_Name + " " + (*i).m_Type + "\n" + (*i).m_Samples;
+
+    m_Families.clear();
+    return Metrics;
+}
+
+void CMetricsServer::AddGame(CBaseGame *game)
+{
+    std::string Game  = "game=\"" + EscapeLabel(game->GetGameName()) + "\",host_counter=\"" + UTIL_ToString(game->GetHostCounter()) + "\"";
+    std::string State = game->GetGameLoaded() ? "playing" : (game->GetGameLoading() ? "loading" : "lobby");
+
+    Add("ghost_game_info", "gauge", "Always 1, labelled with the game's state (lobby, loading or playing).", Game + ",state=\"" + State + "\"", 1);
+    Add("ghost_game_players", "gauge", "Number of human players in the game.", Game, game->GetNumHumanPlayers());
+    Add("ghost_game_latency_seconds", "gauge", "Interval between action packets.", Game, game->GetLatency() / 1000.0);
+    Add("ghost_game_action_queue_depth", "gauge", "Number of actions waiting for the next action packet.", Game, game->GetActionQueueSize());
+    Add("ghost_game_lagging", "gauge", "1 while the lag screen is up.", Game, game->GetLagging() ? 1 : 0);
+    Add("ghost_game_lag_screen_seconds_total", "counter", "Total time the lag screen has been up.", Game, game->GetLagScreenTicks() / 1000.0);
+
+    // the histogram's buckets are cumulative in the exposition format
+
+    CLatenessHistogram *Lateness = game->GetActionLateness();
+    uint64_t Cumulative          = 0;
+
+    for (uint32_t i = 0; i < LATENESS_BUCKETS; i++)
+    {
+        Cumulative += Lateness->GetBucket(i);
+        std::string Bound = i < LATENESS_BUCKETS - 1 ? FormatValue(CLatenessHistogram::GetBucketBound(i) / 1000000.0) : "+Inf";
+        Add("ghost_game_action_lateness_seconds", "histogram", "How late each action packet was sent compared to its deadline.", Game + ",le=\"" + Bound + "\"", Cumulative, "_bucket");
+    }
+
+    Add("ghost_game_action_lateness_seconds", "histogram", std::string(), Game, Lateness->GetTotal() / 1000000.0, "_sum");
+    Add("ghost_game_action_lateness_seconds", "histogram", std::string(), Game, Lateness->GetCount(), "_count");
+    Add("ghost_game_action_lateness_max_seconds", "gauge", "The latest an action packet has been sent.", Game, Lateness->GetMax() / 1000000.0);
+
+    std::vector<CGamePlayer *> Players = game->GetPlayers();
+
+    for (std::vector<CGamePlayer *>::iterator i = Players.begin(); i != Players.end(); i++)
+    {
+        std::string Player = Game + ",player=\"" + EscapeLabel((*i)->GetName()) + "\"";
+        CTCPSocket *Socket = (*i)->GetSocket();
+
+        // the socket is replaced when a GProxy++ player reconnects so the byte counters start again from zero
+
+        if (Socket)
+        {
+            Add("ghost_player_received_bytes_total", "counter", "Bytes received from the player.", Player, Socket->GetBytesReceived());
+            Add("ghost_player_sent_bytes_total", "counter", "Bytes sent to the player.", Player, Socket->GetBytesSent());
+            Add("ghost_player_send_queue_bytes", "gauge", "Bytes waiting to be sent to the player.", Player, Socket->GetSendQueued());
+        }
+
+        // the ping quantiles are taken from the last 20 pings
+
+        std::vector<uint32_t> Pings = (*i)->GetPings();
+
+        if (!Pings.empty())
+        {
+            std::sort(Pings.begin(), Pings.end());
+            const double Quantiles[] = {0, 0.5, 0.9, 1};
+            uint64_t Total           = 0;
+
+            for (uint32_t j = 0; j < sizeof(Quantiles) / sizeof(Quantiles[0]); j++)
+            {
+                uint32_t Ping = Pings[(uint32_t)std::lround(Quantiles[j] * (Pings.size() - 1))];
+                Add("ghost_player_ping_seconds", "summary", "Round trip time of the player's recent pings.", Player + ",quantile=\"" + FormatValue(Quantiles[j]) + "\"", Ping / 1000.0);
+            }
+
+            for (std::vector<uint32_t>::iterator j = Pings.begin(); j != Pings.end(); j++)
+                Total += *j;
+
+            Add("ghost_player_ping_seconds", "summary", std::string(), Player, Total / 1000.0, "_sum");
+            Add("ghost_player_ping_seconds", "summary", std::string(), Player, Pings.size(), "_count");
+        }
+
+        Add("ghost_player_lagging", "gauge", "1 while the player is lagging.", Player, (*i)->GetLagging() ? 1 : 0);
+        Add("ghost_player_lag_seconds_total", "counter", "Total time the player has been lagging.", Player, (*i)->GetLaggingTicks() / 1000.0);
+    }
+}
+
+void CMetricsServer::Add(std::string name, std::string type, std::string help, std::string labels, double value, std::string suffix)
+{
+    Family *Target = NULL;
+
+    for (std::vector<Family>::iterator i = m_Families.begin(); i != m_Families.end(); i++)
+    {
+        if ((*i).m_Name == name)
+        {
+            Target = &(*i);
+            break;
+        }
+    }
+
+    if (!Target)
+    {
+        Family NewFamily;
+        NewFamily.m_Name = name;
+        NewFamily.m_Type = type;
+        NewFamily.m_Help = help;
+        m_Families.push_back(NewFamily);
+        Target = &m_Families.back();
+    }
+
+    Target->m_Samples += name + suffix + (labels.empty() ? std::string() : "{" + labels + "}") + " " + FormatValue(value) + "\n";
+}
+
+std::string CMetricsServer::EscapeLabel(std::string value)
+{
+    // label values escape backslashes, double quotes and newlines
+
+    std::string Escaped;
+
+    for (std::string::iterator i = value.begin(); i != value.end(); i++)
+    {
+        if (*i == '\\')
+            Escaped += "\\\\";
+        else if (*i == '"')
+            Escaped += "\\\"";
+        else if (*i == '\n')
+            Escaped += "\\n";
+        else
+            Escaped += *i;
+    }
+
+    return Escaped;
+}
+
+std::string CMetricsServer::FormatValue(double value)
+{
+    // whole numbers (counts and bytes) are written out in full, everything else with enough precision for microseconds
+
+    char Buffer[32];
+
+    if (value == std::floor(value) && std::fabs(value) < 1e15)
+        snprintf(Buffer, sizeof(Buffer), "%.0f", value);
+    else
+        snprintf(Buffer, sizeof(Buffer), "%.9g", value);
+
+    return Buffer;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "includes.h"
+
+//
+// CMetricsServer
+//
+
+// serves per game and per player metrics over HTTP in the Prometheus text exposition format so the bot can be monitored (and alerted on) before players notice any lag
+// it listens on bot_metricsaddress (localhost by default) and bot_metricsport, any GET request for / or /metrics is answered with the current metrics and the connection is closed
+// the metrics are collected on the main thread while it holds the game thread lock so the games in progress can be read safely (see gamethread.h)
+// exported per game: the action timer lateness histogram, the latency, the action queue depth, the number of players and the total lag screen time
+// exported per player: the bytes received and sent, the send queue depth, the recent ping distribution and the total time spent lagging
+
+#define METRICS_MAX_REQUEST 4096 // the largest request header we accept in bytes
+#define METRICS_TIMEOUT 10       // close connections that haven't sent a complete request after this many seconds
+
+class CGHost;
+class CBaseGame;
+class CTCPServer;
+class CTCPSocket;
+
+class CMetricsServer
+{
+private:
+    // a connection waiting for its request to arrive or its response to be sent
+
+    struct Request
+    {
+        CTCPSocket *m_Socket;
+        bool m_Responded;
+    };
+
+    // the samples of one metric family, the families are written in the order they were first added
+
+    struct Family
+    {
+        std::string m_Name;
+        std::string m_Type;
+        std::string m_Help;
+        std::string m_Samples;
+    };
+
+    CGHost *m_GHost;
+    CTCPServer *m_Socket;            // listening socket (NULL if it couldn't listen)
+    std::vector<Request> m_Requests; // connections that haven't been closed yet
+    std::vector<Family> m_Families;  // only used while building the metrics
+    uint32_t m_NumScrapes;           // the number of requests answered so far
+
+public:
+    CMetricsServer(CGHost *nGHost, std::string address, uint16_t port);
+    ~CMetricsServer();
+
+    bool GetListening() { return m_Socket != NULL; }
+
+    void Update();
+    std::string GetMetrics();
+
+private:
+    void AddGame(CBaseGame *game);
+    void Add(std::string name, std::string type, std::string help, std::string labels, double value, std::string suffix = std::string());
+    static std::string EscapeLabel(std::string value);
+    static std::string FormatValue(double value);
+};
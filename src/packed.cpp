@@ -23,6 +23,8 @@
 #include "ghost.h"
 #include "util.h"
 
+#include <atomic>
+#include <cstring>
 #include <zlib.h>
 
 // we can't use zlib's uncompress function because it expects a complete compressed buffer
@@ -293,48 +295,109 @@ void CPacked::Compress(bool TFT)
 
     m_Compressed.clear();
 
-    // compress data into blocks of size 8192 bytes
-    // use a buffer of size 8213 bytes because in the worst case zlib will grow the data 0.1% plus 12 bytes
+    std::vector<std::string> CompressedBlocks;
+
+    if (!CompressBlocks(m_Decompressed.data(), m_Decompressed.size(), true, CompressedBlocks))
+    {
+        m_Valid = false;
+        return;
+    }
 
     uint32_t CompressedSize = 0;
-    std::string Padded      = m_Decompressed;
-    Padded.append(8192 - (Padded.size() % 8192), 0);
-    std::vector<std::string> CompressedBlocks;
-    std::string::size_type Position = 0;
-    unsigned char *CompressedData   = new unsigned char[8213];
 
-    while (Position < Padded.size())
+    for (std::vector<std::string>::iterator i = CompressedBlocks.begin(); i != CompressedBlocks.end(); i++)
+        CompressedSize += (*i).size();
+
+    // append header
+
+    m_Compressed += BuildHeader(TFT, m_Decompressed.size(), CompressedBlocks.size(), CompressedSize);
+
+    // append blocks
+
+    for (std::vector<std::string>::iterator i = CompressedBlocks.begin(); i != CompressedBlocks.end(); i++)
     {
-        uLongf BlockCompressedLong = 8213;
-        int Result                 = compress(CompressedData, &BlockCompressedLong, (const Bytef *)Padded.c_str() + Position, 8192);
+        m_Compressed += BuildBlockHeader(*i);
+        m_Compressed += *i;
+    }
+}
 
-        if (Result != Z_OK)
+bool CPacked::CompressBlocks(const char *data, uint32_t length, bool last, std::vector<std::string> &blocks)
+{
+    // compress data into blocks of size 8192 bytes
+    // use a buffer of size 8213 bytes because in the worst case zlib will grow the data 0.1% plus 12 bytes
+    // the last block is padded with zeros (a whole block of zeros if the data is an exact multiple of 8192 bytes)
+    // if this isn't the last of the data the length must be a multiple of 8192 bytes and no padding block is added
+    // the blocks are independent so they're compressed in parallel, each worker takes the next block until there are none left
+
+    uint32_t NumBlocks = last ? length / 8192 + 1 : length / 8192;
+    blocks.clear();
+    blocks.resize(NumBlocks);
+    std::atomic<uint32_t> NextBlock(0);
+    std::atomic<int> Error(Z_OK);
+
+    auto CompressBlock = [&]() {
+        unsigned char CompressedData[8213];
+        unsigned char LastBlock[8192];
+
+        for (uint32_t Block = NextBlock++; Block < NumBlocks && Error == Z_OK; Block = NextBlock++)
         {
-            CONSOLE_Print("[PACKED] compress error " + UTIL_ToString(Result));
-            delete[] CompressedData;
-            m_Valid = false;
-            return;
+            uint32_t Position   = Block * 8192;
+            const Bytef *Source = (const Bytef *)data + Position;
+
+            if (last && Block == NumBlocks - 1)
+            {
+                memset(LastBlock, 0, sizeof(LastBlock));
+                memcpy(LastBlock, Source, length - Position);
+                Source = LastBlock;
+            }
+
+            uLongf BlockCompressedLong = sizeof(CompressedData);
+            int Result                 = compress(CompressedData, &BlockCompressedLong, Source, 8192);
+
+            if (Result != Z_OK)
+                Error = Result;
+            else
+                blocks[Block].assign((char *)CompressedData, BlockCompressedLong);
         }
+    };
+
+    // small replays aren't worth starting threads for
+
+    uint32_t NumThreads = std::min<uint32_t>(std::max<uint32_t>(std::thread::hardware_concurrency(), 1), 4);
+    NumThreads          = std::max<uint32_t>(std::min<uint32_t>(NumThreads, NumBlocks / 32), 1);
+    std::vector<std::thread> Threads;
+
+    for (uint32_t i = 1; i < NumThreads; i++)
+        Threads.push_back(std::thread(CompressBlock));
 
-        CompressedBlocks.push_back(std::string((char *)CompressedData, BlockCompressedLong));
-        CompressedSize += BlockCompressedLong;
-        Position += 8192;
+    CompressBlock();
+
+    for (std::vector<std::thread>::iterator i = Threads.begin(); i != Threads.end(); i++)
+        (*i).join();
+
+    if (Error != Z_OK)
+    {
+        CONSOLE_Print("[PACKED] compress error " + UTIL_ToString(Error.load()));
+        return false;
     }
 
-    delete[] CompressedData;
+    return true;
+}
 
-    // build header
+std::string CPacked::BuildHeader(bool TFT, uint32_t decompressedSize, uint32_t numBlocks, uint32_t compressedSize)
+{
+    // compressedSize is the total size of the compressed blocks not including their headers
 
     uint32_t HeaderSize           = 68;
-    uint32_t HeaderCompressedSize = HeaderSize + CompressedSize + CompressedBlocks.size() * 8;
+    uint32_t HeaderCompressedSize = HeaderSize + compressedSize + numBlocks * 8;
     uint32_t HeaderVersion        = 1;
     BYTEARRAY Header;
     UTIL_AppendByteArray(Header, "Warcraft III recorded game\x01A");
     UTIL_AppendByteArray(Header, HeaderSize, false);
     UTIL_AppendByteArray(Header, HeaderCompressedSize, false);
     UTIL_AppendByteArray(Header, HeaderVersion, false);
-    UTIL_AppendByteArray(Header, (uint32_t)m_Decompressed.size(), false);
-    UTIL_AppendByteArray(Header, (uint32_t)CompressedBlocks.size(), false);
+    UTIL_AppendByteArray(Header, decompressedSize, false);
+    UTIL_AppendByteArray(Header, numBlocks, false);
 
     if (TFT)
     {
@@ -371,40 +434,31 @@ void CPacked::Compress(bool TFT)
 
     Header.erase(Header.end() - 4, Header.end());
     UTIL_AppendByteArray(Header, CRC, false);
+    return std::string(Header.begin(), Header.end());
+}
 
-    // append header
-
-    m_Compressed += std::string(Header.begin(), Header.end());
-
-    // append blocks
-
-    for (std::vector<std::string>::iterator i = CompressedBlocks.begin(); i != CompressedBlocks.end(); i++)
-    {
-        BYTEARRAY BlockHeader;
-        UTIL_AppendByteArray(BlockHeader, (uint16_t)(*i).size(), false);
-        UTIL_AppendByteArray(BlockHeader, (uint16_t)8192, false);
-
-        // append zero block header CRC
-
-        UTIL_AppendByteArray(BlockHeader, (uint32_t)0, false);
+std::string CPacked::BuildBlockHeader(const std::string &block)
+{
+    BYTEARRAY BlockHeader;
+    UTIL_AppendByteArray(BlockHeader, (uint16_t)block.size(), false);
+    UTIL_AppendByteArray(BlockHeader, (uint16_t)8192, false);
 
-        // calculate block header CRC
+    // append zero block header CRC
 
-        std::string BlockHeaderString = std::string(BlockHeader.begin(), BlockHeader.end());
-        uint32_t CRC1                 = m_CRC->FullCRC((unsigned char *)BlockHeaderString.c_str(), BlockHeaderString.size());
-        CRC1                          = CRC1 ^ (CRC1 >> 16);
-        uint32_t CRC2                 = m_CRC->FullCRC((unsigned char *)(*i).c_str(), (*i).size());
-        CRC2                          = CRC2 ^ (CRC2 >> 16);
-        uint32_t BlockCRC             = (CRC1 & 0xFFFF) | (CRC2 << 16);
+    UTIL_AppendByteArray(BlockHeader, (uint32_t)0, false);
 
-        // overwrite the block header CRC with the calculated CRC
+    // calculate block header CRC
 
-        BlockHeader.erase(BlockHeader.end() - 4, BlockHeader.end());
-        UTIL_AppendByteArray(BlockHeader, BlockCRC, false);
+    std::string BlockHeaderString = std::string(BlockHeader.begin(), BlockHeader.end());
+    uint32_t CRC1                 = m_CRC->FullCRC((unsigned char *)BlockHeaderString.c_str(), BlockHeaderString.size());
+    CRC1                          = CRC1 ^ (CRC1 >> 16);
+    uint32_t CRC2                 = m_CRC->FullCRC((unsigned char *)block.c_str(), block.size());
+    CRC2                          = CRC2 ^ (CRC2 >> 16);
+    uint32_t BlockCRC             = (CRC1 & 0xFFFF) | (CRC2 << 16);
 
-        // append block header and data
+    // overwrite the block header CRC with the calculated CRC
 
-        m_Compressed += std::string(BlockHeader.begin(), BlockHeader.end());
-        m_Compressed += *i;
-    }
+    BlockHeader.erase(BlockHeader.end() - 4, BlockHeader.end());
+    UTIL_AppendByteArray(BlockHeader, BlockCRC, false);
+    return std::string(BlockHeader.begin(), BlockHeader.end());
 }
@@ -75,4 +75,9 @@ public:
     virtual bool Pack(bool TFT, std::string inFileName, std::string outFileName);
     virtual void Decompress(bool allBlocks);
     virtual void Compress(bool TFT);
+
+protected:
+    bool CompressBlocks(const char *data, uint32_t length, bool last, std::vector<std::string> &blocks);
+    std::string BuildHeader(bool TFT, uint32_t decompressedSize, uint32_t numBlocks, uint32_t compressedSize);
+    std::string BuildBlockHeader(const std::string &block);
 };
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "includes.h"
+
+//
+// CPacketPool
+//
+
+// a free list of packet objects so the ones a game receives and throws away every tick are reused instead of reallocated
+// T needs a default constructor and a Clear function which empties it but keeps its buffers' capacity (up to PACKETPOOL_MAX_CAPACITY bytes)
+// so once a game's been running for a few ticks receiving packets and actions doesn't touch the allocator at all
+// pools aren't thread safe, each game has its own and only uses it from the thread updating the game
+// objects from Get are allocated with new so it's always safe to delete them directly instead of releasing them (e.g. if the pool is already gone)
+
+#define PACKETPOOL_MAX_FREE 512      // objects beyond this many are deleted when released
+#define PACKETPOOL_MAX_CAPACITY 2048 // buffers bigger than this are freed when an object is released rather than kept around
+
+template <class T>
+class CPacketPool
+{
+private:
+    std::vector<T *> m_Free; // released objects waiting to be reused
+    uint32_t m_Allocated;    // number of times Get had to allocate a new object
+    uint32_t m_Reused;       // number of times Get reused a released object
+
+public:
+    CPacketPool()
+    {
+        m_Allocated = 0;
+        m_Reused    = 0;
+    }
+
+    ~CPacketPool()
+    {
+        for (typename std::vector<T *>::iterator i = m_Free.begin(); i != m_Free.end(); i++)
+            delete *i;
+    }
+
+    uint32_t GetFree() { return m_Free.size(); }
+    uint32_t GetAllocated() { return m_Allocated; }
+    uint32_t GetReused() { return m_Reused; }
+
+    T *Get()
+    {
+        if (m_Free.empty())
+        {
+            m_Allocated++;
+            return new T();
+        }
+
+        T *Object = m_Free.back();
+        m_Free.pop_back();
+        m_Reused++;
+        return Object;
+    }
+
+    void Release(T *object)
+    {
+        if (!object)
+            return;
+
+        if (m_Free.size() >= PACKETPOOL_MAX_FREE)
+        {
+            delete object;
+            return;
+        }
+
+        object->Clear();
+        m_Free.push_back(object);
+    }
+};
@@ -36,11 +36,17 @@ CReplay::CReplay() : CPacked()
     m_RandomSeed     = 0;
     m_SelectMode     = 0;
     m_StartSpotCount = 0;
-    m_CompiledBlocks.reserve(262144);
+    m_PartSize       = 0;
+    m_CompiledBlocks.reserve(REPLAY_SPILL_SIZE * 2);
 }
 
 CReplay::~CReplay()
 {
+    if (m_Part.is_open())
+        m_Part.close();
+
+    if (m_PartSize > 0)
+        remove(m_PartFile.c_str());
 }
 
 void CReplay::AddLeaveGame(uint32_t reason, unsigned char PID, uint32_t result)
@@ -52,6 +58,7 @@ void CReplay::AddLeaveGame(uint32_t reason, unsigned char PID, uint32_t result)
     UTIL_AppendByteArray(Block, result, false);
     UTIL_AppendByteArray(Block, (uint32_t)1, false);
     m_CompiledBlocks += std::string(Block.begin(), Block.end());
+    SpillBlocks(false);
 }
 
 void CReplay::AddLeaveGameDuringLoading(uint32_t reason, unsigned char PID, uint32_t result)
@@ -87,6 +94,7 @@ void CReplay::AddTimeSlot2(std::queue<CIncomingAction *> actions)
     Block[1]              = LengthBytes[0];
     Block[2]              = LengthBytes[1];
     m_CompiledBlocks += std::string(Block.begin(), Block.end());
+    SpillBlocks(false);
 }
 
 void CReplay::AddTimeSlot(uint16_t timeIncrement, std::queue<CIncomingAction *> actions)
@@ -112,6 +120,38 @@ void CReplay::AddTimeSlot(uint16_t timeIncrement, std::queue<CIncomingAction *>
     Block[2]              = LengthBytes[1];
     m_CompiledBlocks += std::string(Block.begin(), Block.end());
     m_ReplayLength += timeIncrement;
+    SpillBlocks(false);
+}
+
+void CReplay::AddActionBlock(unsigned char blockID, uint16_t timeIncrement, const BYTEARRAY &actionPacket)
+{
+    // a W3GS_INCOMING_ACTION(2) packet is the 4 byte header, 2 bytes of send interval, 2 bytes of crc (only if there are actions) and then the actions
+    // the actions are laid out exactly as they are in a replay time slot so copy them straight out of the packet we already sent to the players
+
+    uint32_t ActionsLength = actionPacket.size() > 8 ? actionPacket.size() - 8 : 0;
+    uint16_t BlockLength   = (uint16_t)(ActionsLength + 2);
+
+    m_CompiledBlocks.push_back(blockID);
+    m_CompiledBlocks.push_back((char)(BlockLength & 0xFF));
+    m_CompiledBlocks.push_back((char)(BlockLength >> 8));
+    m_CompiledBlocks.push_back((char)(timeIncrement & 0xFF));
+    m_CompiledBlocks.push_back((char)(timeIncrement >> 8));
+
+    if (ActionsLength > 0)
+        m_CompiledBlocks.append((const char *)actionPacket.data() + 8, ActionsLength);
+
+    SpillBlocks(false);
+}
+
+void CReplay::AddTimeSlot2(SHAREDBYTEARRAY actionPacket)
+{
+    AddActionBlock(REPLAY_TIMESLOT2, 0, *actionPacket);
+}
+
+void CReplay::AddTimeSlot(uint16_t timeIncrement, SHAREDBYTEARRAY actionPacket)
+{
+    AddActionBlock(REPLAY_TIMESLOT, timeIncrement, *actionPacket);
+    m_ReplayLength += timeIncrement;
 }
 
 void CReplay::AddChatMessage(unsigned char PID, unsigned char flags, uint32_t chatMode, std::string message)
@@ -130,6 +170,7 @@ void CReplay::AddChatMessage(unsigned char PID, unsigned char flags, uint32_t ch
     Block[2]              = LengthBytes[0];
     Block[3]              = LengthBytes[1];
     m_CompiledBlocks += std::string(Block.begin(), Block.end());
+    SpillBlocks(false);
 }
 
 void CReplay::AddLoadingBlock(BYTEARRAY &loadingBlock)
@@ -137,6 +178,38 @@ void CReplay::AddLoadingBlock(BYTEARRAY &loadingBlock)
     m_LoadingBlocks.push(loadingBlock);
 }
 
+void CReplay::SpillBlocks(bool force)
+{
+    // the data is spilled uncompressed because the replay header in front of it isn't final until the game ends
+    // the host PID and name are overwritten every time a player leaves so we don't know where the 8192 byte compressed block boundaries will fall until then
+
+    if (m_PartFile.empty() || m_CompiledBlocks.empty() || (!force && m_CompiledBlocks.size() < REPLAY_SPILL_SIZE))
+        return;
+
+    if (!m_Part.is_open())
+    {
+        m_Part.open(m_PartFile.c_str(), std::ios::binary | std::ios::trunc);
+
+        if (m_Part.fail())
+        {
+            CONSOLE_Print("[REPLAY] warning - unable to open part file [" + m_PartFile + "], keeping replay data in memory");
+            m_PartFile.clear();
+            return;
+        }
+    }
+
+    m_Part.write(m_CompiledBlocks.data(), m_CompiledBlocks.size());
+
+    if (m_Part.fail() && m_Valid)
+    {
+        CONSOLE_Print("[REPLAY] warning - failed writing part file [" + m_PartFile + "], the replay will not be saved");
+        m_Valid = false;
+    }
+
+    m_PartSize += m_CompiledBlocks.size();
+    m_CompiledBlocks.clear();
+}
+
 void CReplay::BuildReplay(std::string gameName, std::string statString, uint32_t war3Version, uint16_t buildNumber)
 {
     m_War3Version = war3Version;
@@ -211,9 +284,123 @@ void CReplay::BuildReplay(std::string gameName, std::string statString, uint32_t
     UTIL_AppendByteArray(Replay, (uint32_t)1, false);
 
     // done
+    // if any replay data was spilled the rest of it goes to the part file too and Save reads it back from there
 
     m_Decompressed = std::string(Replay.begin(), Replay.end());
-    m_Decompressed += m_CompiledBlocks;
+
+    if (m_PartSize > 0)
+    {
+        SpillBlocks(true);
+        m_Part.close();
+
+        if (m_Part.fail() && m_Valid)
+        {
+            CONSOLE_Print("[REPLAY] warning - failed writing part file [" + m_PartFile + "], the replay will not be saved");
+            m_Valid = false;
+        }
+    }
+    else
+        m_Decompressed += m_CompiledBlocks;
+}
+
+bool CReplay::Save(bool TFT, std::string fileName)
+{
+    if (m_PartSize == 0)
+        return CPacked::Save(TFT, fileName);
+
+    if (!m_Valid)
+        return false;
+
+    CONSOLE_Print("[REPLAY] saving data from part file [" + m_PartFile + "] to file [" + fileName + "]");
+
+    std::ifstream in;
+    in.open(m_PartFile.c_str(), std::ios::binary);
+
+    if (in.fail())
+    {
+        CONSOLE_Print("[REPLAY] warning - unable to read part file [" + m_PartFile + "]");
+        return false;
+    }
+
+    std::ofstream out;
+    out.open(fileName.c_str(), std::ios::binary | std::ios::trunc);
+
+    if (out.fail())
+    {
+        CONSOLE_Print("[REPLAY] warning - unable to write file [" + fileName + "]");
+        return false;
+    }
+
+    // the header needs the total compressed size so write a placeholder and come back to it once all the blocks are written
+    // the replay header built by BuildReplay is followed by the part file, they're compressed a batch of blocks at a time
+
+    uint32_t DecompressedSize = m_Decompressed.size() + m_PartSize;
+    uint32_t Position         = 0;
+    uint32_t NumBlocks        = 0;
+    uint32_t CompressedSize   = 0;
+    std::string Batch         = m_Decompressed;
+    std::vector<std::string> Blocks;
+    out.write(std::string(68, 0).data(), 68);
+
+    while (1)
+    {
+        std::string::size_type Old = Batch.size();
+
+        if (Old < REPLAY_SAVE_BATCH_SIZE)
+        {
+            Batch.resize(REPLAY_SAVE_BATCH_SIZE);
+            in.read(&Batch[Old], REPLAY_SAVE_BATCH_SIZE - Old);
+            Batch.resize(Old + in.gcount());
+        }
+
+        bool Last = Position + Batch.size() >= DecompressedSize;
+
+        if (!Last && Batch.size() < 8192)
+        {
+            CONSOLE_Print("[REPLAY] warning - part file [" + m_PartFile + "] is truncated");
+            out.close();
+            remove(fileName.c_str());
+            return false;
+        }
+
+        uint32_t Length = Last ? DecompressedSize - Position : Batch.size() / 8192 * 8192;
+
+        if (!CompressBlocks(Batch.data(), Length, Last, Blocks))
+        {
+            out.close();
+            remove(fileName.c_str());
+            return false;
+        }
+
+        for (std::vector<std::string>::iterator i = Blocks.begin(); i != Blocks.end(); i++)
+        {
+            std::string BlockHeader = BuildBlockHeader(*i);
+            out.write(BlockHeader.data(), BlockHeader.size());
+            out.write((*i).data(), (*i).size());
+            CompressedSize += (*i).size();
+        }
+
+        NumBlocks += Blocks.size();
+        Position += Length;
+        Batch.erase(0, Length);
+
+        if (Last)
+            break;
+    }
+
+    std::string Header = BuildHeader(TFT, DecompressedSize, NumBlocks, CompressedSize);
+    out.seekp(0);
+    out.write(Header.data(), Header.size());
+    out.close();
+
+    if (out.fail())
+    {
+        CONSOLE_Print("[REPLAY] warning - failed writing file [" + fileName + "]");
+        remove(fileName.c_str());
+        return false;
+    }
+
+    return true;
 }
 
 #define READB(x, y, z) (x).read((char *)(y), (z))
@@ -579,3 +766,31 @@ void CReplay::ParseReplay(bool parseBlocks)
 
     m_Valid = true;
 }
+
+//
+// CReplaySave
+//
+
+CReplaySave::CReplaySave(CReplay *nReplay, std::string nFileName, bool TFT, std::string gameName, std::string statString, uint32_t war3Version, uint16_t buildNumber)
+{
+    m_Replay     = nReplay;
+    m_FileName   = nFileName;
+    m_StartTicks = GetTicks();
+    m_Ready      = false;
+    m_Result     = false;
+    m_Thread     = std::thread([this, TFT, gameName, statString, war3Version, buildNumber]() {
+        m_Replay->BuildReplay(gameName, statString, war3Version, buildNumber);
+        m_Result = m_Replay->Save(TFT, m_FileName);
+        m_Ready  = true;
+    });
+}
+
+CReplaySave::~CReplaySave()
+{
+    // if we're being deleted before the save finished (i.e. the bot is shutting down) wait for it rather than losing the replay
+
+    if (m_Thread.joinable())
+        m_Thread.join();
+
+    delete m_Replay;
+}
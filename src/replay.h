@@ -23,10 +23,20 @@
 #include "includes.h"
 #include "packed.h"
 
+#include <atomic>
+
 //
 // CReplay
 //
 
+// replay data is spilled to a part file whenever this much of it has built up so long games don't keep it all in memory
+
+#define REPLAY_SPILL_SIZE 8192
+
+// when saving a spilled replay the part file is compressed this much at a time
+
+#define REPLAY_SAVE_BATCH_SIZE (8192 * 256)
+
 class CIncomingAction;
 class CGameSlot;
 
@@ -61,7 +71,14 @@ private:
     std::queue<BYTEARRAY> m_LoadingBlocks;
     std::queue<BYTEARRAY> m_Blocks;
     std::queue<uint32_t> m_CheckSums;
-    std::string m_CompiledBlocks;
+    std::string m_CompiledBlocks; // replay data which hasn't been spilled to the part file yet
+
+    std::string m_PartFile; // the file replay data is spilled to during the game, empty to keep it all in memory
+    std::ofstream m_Part;
+    uint32_t m_PartSize; // bytes spilled to the part file so far
+
+    void AddActionBlock(unsigned char blockID, uint16_t timeIncrement, const BYTEARRAY &actionPacket);
+    void SpillBlocks(bool force);
 
 public:
     CReplay();
@@ -81,6 +98,8 @@ public:
     std::queue<BYTEARRAY> *GetLoadingBlocks() { return &m_LoadingBlocks; }
     std::queue<BYTEARRAY> *GetBlocks() { return &m_Blocks; }
     std::queue<uint32_t> *GetCheckSums() { return &m_CheckSums; }
+    std::string GetPartFile() { return m_PartFile; }
+    uint32_t GetPartSize() { return m_PartSize; }
 
     void AddPlayer(unsigned char nPID, std::string nName) { m_Players.push_back(PIDPlayer(nPID, nName)); }
     void SetSlots(std::vector<CGameSlot> nSlots) { m_Slots = nSlots; }
@@ -90,14 +109,45 @@ public:
     void SetMapGameType(uint32_t nMapGameType) { m_MapGameType = nMapGameType; }
     void SetHostPID(unsigned char nHostPID) { m_HostPID = nHostPID; }
     void SetHostName(std::string nHostName) { m_HostName = nHostName; }
+    void SetPartFile(std::string nPartFile) { m_PartFile = nPartFile; }
 
     void AddLeaveGame(uint32_t reason, unsigned char PID, uint32_t result);
     void AddLeaveGameDuringLoading(uint32_t reason, unsigned char PID, uint32_t result);
     void AddTimeSlot2(std::queue<CIncomingAction *> actions);
     void AddTimeSlot(uint16_t timeIncrement, std::queue<CIncomingAction *> actions);
+    void AddTimeSlot2(SHAREDBYTEARRAY actionPacket);
+    void AddTimeSlot(uint16_t timeIncrement, SHAREDBYTEARRAY actionPacket);
     void AddChatMessage(unsigned char PID, unsigned char flags, uint32_t chatMode, std::string message);
     void AddLoadingBlock(BYTEARRAY &loadingBlock);
     void BuildReplay(std::string gameName, std::string statString, uint32_t war3Version, uint16_t buildNumber);
+    virtual bool Save(bool TFT, std::string fileName);
 
     void ParseReplay(bool parseBlocks);
 };
+
+//
+// CReplaySave
+//
+
+// builds, compresses and writes a finished game's replay on its own thread so the main loop isn't stalled
+// the save takes ownership of the replay, CGHost polls GetReady and deletes the save once it's done
+
+class CReplaySave
+{
+private:
+    CReplay *m_Replay;
+    std::string m_FileName;
+    uint32_t m_StartTicks;
+    std::atomic<bool> m_Ready;
+    bool m_Result;
+    std::thread m_Thread;
+
+public:
+    CReplaySave(CReplay *nReplay, std::string nFileName, bool TFT, std::string gameName, std::string statString, uint32_t war3Version, uint16_t buildNumber);
+    ~CReplaySave();
+
+    std::string GetFileName() { return m_FileName; }
+    uint32_t GetStartTicks() { return m_StartTicks; }
+    bool GetReady() { return m_Ready; }
+    bool GetResult() { return m_Result; }
+};
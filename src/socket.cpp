@@ -19,12 +19,16 @@
 */
 
 #include "socket.h"
+#include "capture.h"
 #include "ghost.h"
 #include "util.h"
 
+#include <atomic>
 #include <cstring>
 
 #ifndef WIN32
+#include <poll.h>
+
 int GetLastError() { return errno; }
 #endif
 
@@ -36,22 +40,30 @@ CSocket::CSocket(std::string nName)
 {
     m_Socket = INVALID_SOCKET;
     memset(&m_SIN, 0, sizeof(m_SIN));
-    m_HasError = false;
-    m_Error    = 0;
-    m_Name     = nName;
+    m_HasError   = false;
+    m_Error      = 0;
+    m_Name       = nName;
+    m_Registered = false;
+    m_ReadReady  = false;
+    m_Reactor    = NULL;
 }
 
 CSocket::CSocket(SOCKET nSocket, struct sockaddr_in nSIN, std::string nName)
 {
-    m_Socket   = nSocket;
-    m_SIN      = nSIN;
-    m_Name     = nName;
-    m_HasError = false;
-    m_Error    = 0;
+    m_Socket     = nSocket;
+    m_SIN        = nSIN;
+    m_Name       = nName;
+    m_HasError   = false;
+    m_Error      = 0;
+    m_Registered = false;
+    m_ReadReady  = false;
+    m_Reactor    = NULL;
 }
 
 CSocket::~CSocket()
 {
+    Unregister();
+
     if (m_Socket != INVALID_SOCKET)
         closesocket(m_Socket);
 }
@@ -160,18 +172,20 @@ std::string CSocket::GetName()
     return m_Name;
 }
 
-void CSocket::SetFD(fd_set *fd, fd_set *send_fd, int *nfds)
+void CSocket::Register()
 {
-    if (m_Socket == INVALID_SOCKET)
+    if (m_Socket == INVALID_SOCKET || m_Registered)
         return;
 
-    FD_SET(m_Socket, fd);
-    FD_SET(m_Socket, send_fd);
+    CSocketReactor::Get()->Add(this);
+}
 
-#ifndef WIN32
-    if (m_Socket > *nfds)
-        *nfds = m_Socket;
-#endif
+void CSocket::Unregister()
+{
+    if (!m_Registered)
+        return;
+
+    m_Reactor->Remove(this);
 }
 
 void CSocket::Allocate(int type)
@@ -189,6 +203,8 @@ void CSocket::Allocate(int type)
 
 void CSocket::Reset()
 {
+    Unregister();
+
     if (m_Socket != INVALID_SOCKET)
         closesocket(m_Socket);
 
@@ -198,6 +214,228 @@ void CSocket::Reset()
     m_Error    = 0;
 }
 
+//
+// CSocketReactor
+//
+
+CSocketReactor::CSocketReactor()
+{
+    m_NumSockets = 0;
+
+#ifdef __linux__
+    m_EpollFD = epoll_create1(EPOLL_CLOEXEC);
+
+    if (m_EpollFD == -1)
+        CONSOLE_Print("[REACTOR] error (epoll_create1) - " + UTIL_ToString(GetLastError()));
+
+    // the timer's event is told apart from the sockets' by its data pointer
+    // if it can't be created we fall back to epoll's timeout which is rounded down to whole milliseconds
+
+    m_TimerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (m_TimerFD == -1)
+        CONSOLE_Print("[REACTOR] error (timerfd_create) - " + UTIL_ToString(GetLastError()));
+    else
+    {
+        struct epoll_event Event;
+        memset(&Event, 0, sizeof(Event));
+        Event.events   = EPOLLIN;
+        Event.data.ptr = &m_TimerFD;
+
+        if (epoll_ctl(m_EpollFD, EPOLL_CTL_ADD, m_TimerFD, &Event) == -1)
+        {
+            CONSOLE_Print("[REACTOR] error (epoll_ctl add timer) - " + UTIL_ToString(GetLastError()));
+            close(m_TimerFD);
+            m_TimerFD = -1;
+        }
+    }
+#endif
+}
+
+CSocketReactor::~CSocketReactor()
+{
+#ifdef __linux__
+    if (m_TimerFD != -1)
+        close(m_TimerFD);
+
+    if (m_EpollFD != -1)
+        close(m_EpollFD);
+#endif
+}
+
+CSocketReactor *CSocketReactor::Get()
+{
+    thread_local CSocketReactor Reactor;
+    return &Reactor;
+}
+
+void CSocketReactor::Add(CSocket *socket)
+{
+#ifdef __linux__
+    // level triggered, we'll be told again next wait if a socket still has data after we've read from it
+
+    struct epoll_event Event;
+    memset(&Event, 0, sizeof(Event));
+    Event.events   = EPOLLIN;
+    Event.data.ptr = socket;
+
+    if (epoll_ctl(m_EpollFD, EPOLL_CTL_ADD, socket->m_Socket, &Event) == -1)
+    {
+        CONSOLE_Print("[REACTOR] error (epoll_ctl add) - " + UTIL_ToString(GetLastError()));
+        return;
+    }
+#else
+    m_Sockets.push_back(socket);
+#endif
+
+    socket->m_Registered = true;
+    socket->m_ReadReady  = false;
+    socket->m_Reactor    = this;
+    m_NumSockets++;
+}
+
+void CSocketReactor::Remove(CSocket *socket)
+{
+#ifdef __linux__
+    struct epoll_event Event;
+    memset(&Event, 0, sizeof(Event));
+    epoll_ctl(m_EpollFD, EPOLL_CTL_DEL, socket->m_Socket, &Event);
+#else
+    m_Sockets.erase(std::remove(m_Sockets.begin(), m_Sockets.end(), socket), m_Sockets.end());
+#endif
+
+    // the socket might be destroyed before the next wait so make sure we don't hold on to it
+
+    if (socket->m_ReadReady)
+        m_Ready.erase(std::remove(m_Ready.begin(), m_Ready.end(), socket), m_Ready.end());
+
+    socket->m_Registered = false;
+    socket->m_ReadReady  = false;
+    socket->m_Reactor    = NULL;
+    m_NumSockets--;
+}
+
+uint32_t CSocketReactor::Wait(uint32_t usecBlock)
+{
+    // clear the previous wait's readiness flags
+
+    for (std::vector<CSocket *>::iterator i = m_Ready.begin(); i != m_Ready.end(); i++)
+        (*i)->m_ReadReady = false;
+
+    m_Ready.clear();
+
+#ifdef __linux__
+    if (m_Events.size() < m_NumSockets + 1)
+        m_Events.resize(m_NumSockets + 1);
+
+    int Timeout = usecBlock / 1000;
+
+    if (m_TimerFD != -1)
+    {
+        // arming the timer resets it so an expiration left over from an earlier wait doesn't end this one early
+        // a zero timeout disarms it, otherwise epoll's own timeout is rounded up and only there as a backstop
+
+        struct itimerspec Spec;
+        memset(&Spec, 0, sizeof(Spec));
+        Spec.it_value.tv_sec  = usecBlock / 1000000;
+        Spec.it_value.tv_nsec = (usecBlock % 1000000) * 1000;
+
+        if (timerfd_settime(m_TimerFD, 0, &Spec, NULL) == 0 && usecBlock > 0)
+            Timeout++;
+    }
+
+    int NumEvents = epoll_wait(m_EpollFD, &m_Events[0], (int)m_Events.size(), Timeout);
+
+    for (int i = 0; i < NumEvents; i++)
+    {
+        if (m_Events[i].data.ptr == &m_TimerFD)
+            continue;
+
+        // errors and hangups are reported as readable so the owner finds out about them in recv
+
+        CSocket *Socket     = (CSocket *)m_Events[i].data.ptr;
+        Socket->m_ReadReady = true;
+        m_Ready.push_back(Socket);
+    }
+#else
+    fd_set fd;
+    FD_ZERO(&fd);
+    int nfds = 0;
+
+    for (std::vector<CSocket *>::iterator i = m_Sockets.begin(); i != m_Sockets.end(); i++)
+    {
+        FD_SET((*i)->m_Socket, &fd);
+
+        if ((int)(*i)->m_Socket > nfds)
+            nfds = (int)(*i)->m_Socket;
+    }
+
+    struct timeval tv;
+    tv.tv_sec  = usecBlock / 1000000;
+    tv.tv_usec = usecBlock % 1000000;
+
+#ifdef WIN32
+    select(1, &fd, NULL, NULL, &tv);
+#else
+    select(nfds + 1, &fd, NULL, NULL, &tv);
+#endif
+
+    for (std::vector<CSocket *>::iterator i = m_Sockets.begin(); i != m_Sockets.end(); i++)
+    {
+        if (FD_ISSET((*i)->m_Socket, &fd))
+        {
+            (*i)->m_ReadReady = true;
+            m_Ready.push_back(*i);
+        }
+    }
+#endif
+
+    return m_Ready.size();
+}
+
+//
+// CRecvBuffer
+//
+
+CRecvBuffer::CRecvBuffer()
+{
+    m_ReadPos  = 0;
+    m_WritePos = 0;
+}
+
+CRecvBuffer::~CRecvBuffer()
+{
+}
+
+unsigned char *CRecvBuffer::Reserve(uint32_t length)
+{
+    if (m_Data.size() - m_WritePos < length)
+    {
+        // not enough room at the end, move the unread data back to the front first
+        // this invalidates any outstanding views into the buffer
+
+        if (m_ReadPos > 0)
+        {
+            memmove(m_Data.data(), m_Data.data() + m_ReadPos, m_WritePos - m_ReadPos);
+            m_WritePos -= m_ReadPos;
+            m_ReadPos = 0;
+        }
+
+        if (m_Data.size() - m_WritePos < length)
+            m_Data.resize(m_WritePos + length);
+    }
+
+    return m_Data.data() + m_WritePos;
+}
+
+void CRecvBuffer::Consume(uint32_t length)
+{
+    if (length >= GetSize())
+        Clear();
+    else
+        m_ReadPos += length;
+}
+
 //
 // CTCPSocket
 //
@@ -205,9 +443,17 @@ void CSocket::Reset()
 CTCPSocket::CTCPSocket(std::string nName) : CSocket(nName)
 {
     Allocate(SOCK_STREAM);
-    m_Connected = false;
-    m_LastRecv  = GetTime();
-    m_LastSend  = GetTime();
+    m_Connected        = false;
+    m_SendOffset       = 0;
+    m_SendQueued       = 0;
+    m_LastRecv         = GetTime();
+    m_LastSend         = GetTime();
+    m_BytesReceived    = 0;
+    m_BytesSent        = 0;
+    m_CaptureStream    = 0;
+    m_CaptureLost      = 0;
+    m_CaptureLostBytes = 0;
+    m_CaptureQueued    = false;
 
     // make socket non blocking
 
@@ -221,22 +467,34 @@ CTCPSocket::CTCPSocket(std::string nName) : CSocket(nName)
 
 CTCPSocket::CTCPSocket(SOCKET nSocket, struct sockaddr_in nSIN, std::string nName) : CSocket(nSocket, nSIN, nName)
 {
-    m_Connected = true;
-    m_LastRecv  = GetTime();
-    m_LastSend  = GetTime();
-
-    // make socket non blocking
+    m_Connected        = true;
+    m_SendOffset       = 0;
+    m_SendQueued       = 0;
+    m_LastRecv         = GetTime();
+    m_LastSend         = GetTime();
+    m_BytesReceived    = 0;
+    m_BytesSent        = 0;
+    m_CaptureStream    = 0;
+    m_CaptureLost      = 0;
+    m_CaptureLostBytes = 0;
+    m_CaptureQueued    = false;
+
+    // make socket non blocking (on Linux it was accepted non blocking, see CTCPServer::AcceptSocket)
 
 #ifdef WIN32
     int iMode = 1;
     ioctlsocket(m_Socket, FIONBIO, (u_long FAR *)&iMode);
-#else
+#elif !defined(__linux__)
     fcntl(m_Socket, F_SETFL, fcntl(m_Socket, F_GETFL) | O_NONBLOCK);
 #endif
+
+    Register();
 }
 
 CTCPSocket::~CTCPSocket()
 {
+    if (!m_CaptureFile.empty())
+        Capture(CAPTURE_CLOSED, NULL, 0);
 }
 
 void CTCPSocket::Reset()
@@ -245,8 +503,8 @@ void CTCPSocket::Reset()
 
     Allocate(SOCK_STREAM);
     m_Connected = false;
-    m_RecvBuffer.clear();
-    m_SendBuffer.clear();
+    m_RecvBuffer.Clear();
+    ClearSendBuffer();
     m_LastRecv = GetTime();
     m_LastSend = GetTime();
 
@@ -260,46 +518,103 @@ void CTCPSocket::Reset()
 #endif
 
     if (!m_LogFile.empty())
-    {
-        std::ofstream Log;
-        Log.open(m_LogFile.c_str(), std::ios::app);
+        LOG_Write(m_LogFile, "----------RESET----------");
 
-        if (!Log.fail())
-        {
-            Log << "----------RESET----------" << std::endl;
-            Log.close();
-        }
-    }
+    if (!m_CaptureFile.empty())
+        Capture(CAPTURE_RESET, NULL, 0);
+}
+
+CTCPSocket::FrameResult CTCPSocket::FramePacket(const unsigned char *headers, uint32_t numHeaders, const unsigned char **data, uint16_t *length)
+{
+    // frame the next packet in the receive buffer using the common 4 byte header (header constant, packet id, uint16 length)
+    // on success data and length describe the packet inside the receive buffer, call ConsumeBytes( length ) once done with it
+    // the view is only valid until the next call to DoRecv
+
+    uint32_t Size = m_RecvBuffer.GetSize();
+
+    if (Size < 4)
+        return FRAME_INCOMPLETE;
+
+    const unsigned char *Data = m_RecvBuffer.GetData();
+
+    if (std::find(headers, headers + numHeaders, Data[0]) == headers + numHeaders)
+        return FRAME_BADHEADER;
+
+    // bytes 2 and 3 contain the length of the packet
+
+    uint16_t Length = (uint16_t)(Data[2] | (Data[3] << 8));
+
+    if (Length < 4)
+        return FRAME_BADLENGTH;
+
+    if (Size < Length)
+        return FRAME_INCOMPLETE;
+
+    *data   = Data;
+    *length = Length;
+    return FRAME_COMPLETE;
 }
 
 void CTCPSocket::PutBytes(std::string bytes)
 {
-    m_SendBuffer += bytes;
+    if (!bytes.empty())
+    {
+        m_SendQueued += bytes.size();
+        m_SendQueue.push_back(std::make_shared<const BYTEARRAY>(bytes.begin(), bytes.end()));
+    }
 }
 
 void CTCPSocket::PutBytes(BYTEARRAY bytes)
 {
-    m_SendBuffer += std::string(bytes.begin(), bytes.end());
+    if (!bytes.empty())
+    {
+        m_SendQueued += bytes.size();
+        m_SendQueue.push_back(std::make_shared<const BYTEARRAY>(std::move(bytes)));
+    }
 }
 
-void CTCPSocket::DoRecv(fd_set *fd)
+void CTCPSocket::PutBytes(SHAREDBYTEARRAY bytes)
+{
+    // the buffer is only referenced, not copied, so the same data can be queued to any number of sockets
+
+    if (bytes && !bytes->empty())
+    {
+        m_SendQueued += bytes->size();
+        m_SendQueue.push_back(bytes);
+    }
+}
+
+void CTCPSocket::ClearSendBuffer()
+{
+    m_SendQueue.clear();
+    m_SendOffset = 0;
+    m_SendQueued = 0;
+}
+
+void CTCPSocket::DoRecv()
 {
     if (m_Socket == INVALID_SOCKET || m_HasError || !m_Connected)
         return;
 
-    if (FD_ISSET(m_Socket, fd))
+    if (m_ReadReady)
     {
         // data is waiting, receive it
 
-        char buffer[1024];
-        int c = recv(m_Socket, buffer, 1024, 0);
+        m_ReadReady = false;
+
+        // receive straight into the free space at the end of the buffer
+
+        unsigned char *Buffer = m_RecvBuffer.Reserve(16384);
+        int c                 = recv(m_Socket, (char *)Buffer, 16384, 0);
 
         if (c == SOCKET_ERROR && GetLastError() != EWOULDBLOCK)
         {
             // receive Error
+            // stop waiting on the socket since it'll keep reporting the error until the owner deletes it
 
             m_HasError = true;
             m_Error    = GetLastError();
+            Unregister();
             if (GetName() != "status")
                 CONSOLE_Print("[TCPSOCKET] error (recv) - " + GetErrorString());
             return;
@@ -310,73 +625,181 @@ void CTCPSocket::DoRecv(fd_set *fd)
 
             //CONSOLE_Print( "[TCPSOCKET] closed by remote host" );
             m_Connected = false;
+            Unregister();
         }
         else if (c > 0)
         {
             // success! add the received data to the buffer
 
             if (!m_LogFile.empty())
-            {
-                std::ofstream Log;
-                Log.open(m_LogFile.c_str(), std::ios::app);
-
-                if (!Log.fail())
-                {
-                    Log << "					RECEIVE <<< " << UTIL_ByteArrayToHexString(UTIL_CreateByteArray((unsigned char *)buffer, c)) << std::endl;
-                    Log.close();
-                }
-            }
+                LOG_Write(m_LogFile, "					RECEIVE <<< " + UTIL_ByteArrayToHexString(UTIL_CreateByteArray(Buffer, c)));
+
+            if (!m_CaptureFile.empty())
+                Capture(CAPTURE_RECEIVED, (unsigned char *)Buffer, c);
 
-            m_RecvBuffer += std::string(buffer, c);
+            m_RecvBuffer.Commit(c);
             m_LastRecv = GetTime();
+            m_BytesReceived += c;
         }
     }
 }
 
-void CTCPSocket::DoSend(fd_set *send_fd)
+void CTCPSocket::DoSend()
 {
-    if (m_Socket == INVALID_SOCKET || m_HasError || !m_Connected || m_SendBuffer.empty())
+    if (m_Socket == INVALID_SOCKET || m_HasError || !m_Connected || m_SendQueue.empty())
         return;
 
-    if (FD_ISSET(m_Socket, send_fd))
+    // we don't wait for write readiness, just try to send and let the kernel tell us if the socket buffer is full
+    // hand the kernel as many queued buffers as we can in one call, starting part way through the first one if we only sent some of it last time
+
+    const uint32_t MaxBuffers = 64;
+    uint32_t NumBuffers       = 0;
+
+#ifdef WIN32
+    WSABUF Buffers[MaxBuffers];
+
+    for (std::deque<SHAREDBYTEARRAY>::iterator i = m_SendQueue.begin(); i != m_SendQueue.end() && NumBuffers < MaxBuffers; i++)
     {
-        // socket is ready, send it
+        uint32_t Offset         = NumBuffers == 0 ? m_SendOffset : 0;
+        Buffers[NumBuffers].buf = (char *)(*i)->data() + Offset;
+        Buffers[NumBuffers].len = (ULONG)((*i)->size() - Offset);
+        NumBuffers++;
+    }
 
-        int s = send(m_Socket, m_SendBuffer.c_str(), (int)m_SendBuffer.size(), MSG_NOSIGNAL);
+    DWORD Sent = 0;
+    int s      = WSASend(m_Socket, Buffers, NumBuffers, &Sent, 0, NULL, NULL) == SOCKET_ERROR ? SOCKET_ERROR : (int)Sent;
+#else
+    struct iovec Buffers[MaxBuffers];
 
-        if (s == SOCKET_ERROR && GetLastError() != EWOULDBLOCK)
+    for (std::deque<SHAREDBYTEARRAY>::iterator i = m_SendQueue.begin(); i != m_SendQueue.end() && NumBuffers < MaxBuffers; i++)
+    {
+        uint32_t Offset              = NumBuffers == 0 ? m_SendOffset : 0;
+        Buffers[NumBuffers].iov_base = (void *)((*i)->data() + Offset);
+        Buffers[NumBuffers].iov_len  = (*i)->size() - Offset;
+        NumBuffers++;
+    }
+
+    struct msghdr Message;
+    memset(&Message, 0, sizeof(Message));
+    Message.msg_iov    = Buffers;
+    Message.msg_iovlen = NumBuffers;
+
+    int s = sendmsg(m_Socket, &Message, MSG_NOSIGNAL);
+#endif
+
+    if (s == SOCKET_ERROR && GetLastError() != EWOULDBLOCK)
+    {
+        // send error
+
+        m_HasError = true;
+        m_Error    = GetLastError();
+        Unregister();
+        CONSOLE_Print("[TCPSOCKET] error (send) - " + GetErrorString());
+        return;
+    }
+    else if (s > 0)
+    {
+        // success! only some of the data may have been sent, drop the buffers that went out completely and remember how far we got into the next one
+
+        if (!m_LogFile.empty() || !m_CaptureFile.empty())
         {
-            // send error
+            BYTEARRAY SentBytes;
 
-            m_HasError = true;
-            m_Error    = GetLastError();
-            CONSOLE_Print("[TCPSOCKET] error (send) - " + GetErrorString());
-            return;
+            for (uint32_t i = 0; i < NumBuffers && SentBytes.size() < (uint32_t)s; i++)
+            {
+#ifdef WIN32
+                unsigned char *Data = (unsigned char *)Buffers[i].buf;
+                uint32_t Length     = std::min((uint32_t)Buffers[i].len, (uint32_t)s - (uint32_t)SentBytes.size());
+#else
+                unsigned char *Data = (unsigned char *)Buffers[i].iov_base;
+                uint32_t Length     = std::min((uint32_t)Buffers[i].iov_len, (uint32_t)s - (uint32_t)SentBytes.size());
+#endif
+                SentBytes.insert(SentBytes.end(), Data, Data + Length);
+            }
+
+            if (!m_LogFile.empty())
+                LOG_Write(m_LogFile, "SEND >>> " + UTIL_ByteArrayToHexString(SentBytes));
+
+            if (!m_CaptureFile.empty())
+                Capture(CAPTURE_SENT, SentBytes.data(), SentBytes.size());
         }
-        else if (s > 0)
+
+        uint32_t Remaining = s;
+        m_SendQueued -= s;
+        m_BytesSent += s;
+
+        while (Remaining > 0)
         {
-            // success! only some of the data may have been sent, remove it from the buffer
+            uint32_t Left = m_SendQueue.front()->size() - m_SendOffset;
 
-            if (!m_LogFile.empty())
+            if (Remaining >= Left)
             {
-                std::ofstream Log;
-                Log.open(m_LogFile.c_str(), std::ios::app);
-
-                if (!Log.fail())
-                {
-                    Log << "SEND >>> " << UTIL_ByteArrayToHexString(BYTEARRAY(m_SendBuffer.begin(), m_SendBuffer.begin() + s)) << std::endl;
-                    Log.close();
-                }
+                Remaining -= Left;
+                m_SendQueue.pop_front();
+                m_SendOffset = 0;
+            }
+            else
+            {
+                m_SendOffset += Remaining;
+                Remaining = 0;
             }
-
-            m_SendBuffer = m_SendBuffer.substr(s);
-            m_LastSend   = GetTime();
         }
+
+        m_LastSend = GetTime();
+    }
+}
+
+void CTCPSocket::SetCapture(std::string file, std::string label)
+{
+    // each call starts a new stream so the decoder can tell apart the connections captured to the same file (e.g. every player in a game)
+
+    static std::atomic<uint32_t> NextStream(1);
+
+    if (!m_CaptureFile.empty())
+        Capture(CAPTURE_CLOSED, NULL, 0);
+
+    m_CaptureFile = file;
+
+    if (!m_CaptureFile.empty())
+    {
+        m_CaptureStream    = NextStream++;
+        m_CaptureLost      = 0;
+        m_CaptureLostBytes = 0;
+        m_CaptureQueued    = false;
+        Capture(CAPTURE_OPENED, (const unsigned char *)label.data(), label.size());
+    }
+}
+
+void CTCPSocket::Capture(unsigned char type, const unsigned char *data, uint32_t length)
+{
+    // a dropped record leaves a hole in the stream the decoder can't reassemble packets across
+    // so the next record that's queued is preceded by a gap record (in the same write so it can't be dropped on its own)
+    // the logger counts the streams in each file so it's told when the first of ours is queued and when the stream ends
+
+    std::string Data;
+
+    if (m_CaptureLost > 0)
+        Data = CAPTURE_Gap(m_CaptureStream, m_CaptureLost, m_CaptureLostBytes);
+
+    Data += CAPTURE_Record(m_CaptureStream, type, data, length);
+
+    if (LOG_WriteCapture(m_CaptureFile, std::move(Data), !m_CaptureQueued, type == CAPTURE_CLOSED))
+    {
+        m_CaptureLost      = 0;
+        m_CaptureLostBytes = 0;
+        m_CaptureQueued    = true;
+    }
+    else
+    {
+        m_CaptureLost++;
+        m_CaptureLostBytes += length;
     }
 }
 
 void CTCPSocket::Disconnect()
 {
+    Unregister();
+
     if (m_Socket != INVALID_SOCKET)
         shutdown(m_Socket, SHUT_RDWR);
 
@@ -492,6 +915,7 @@ void CTCPClient::Connect(std::string localaddress, std::string address, uint16_t
     }
 
     m_Connecting = true;
+    Register();
 }
 
 bool CTCPClient::CheckConnect()
@@ -499,6 +923,10 @@ bool CTCPClient::CheckConnect()
     if (m_Socket == INVALID_SOCKET || m_HasError || !m_Connecting)
         return false;
 
+    // check if the socket is connected
+    // note: we use poll rather than select where we can because select can't handle descriptors above FD_SETSIZE
+
+#ifdef WIN32
     fd_set fd;
     FD_ZERO(&fd);
     FD_SET(m_Socket, &fd);
@@ -507,13 +935,7 @@ bool CTCPClient::CheckConnect()
     tv.tv_sec  = 0;
     tv.tv_usec = 0;
 
-    // check if the socket is connected
-
-#ifdef WIN32
     if (select(1, NULL, &fd, NULL, &tv) == SOCKET_ERROR)
-#else
-    if (select(m_Socket + 1, NULL, &fd, NULL, &tv) == SOCKET_ERROR)
-#endif
     {
         m_HasError = true;
         m_Error    = GetLastError();
@@ -521,6 +943,21 @@ bool CTCPClient::CheckConnect()
     }
 
     if (FD_ISSET(m_Socket, &fd))
+#else
+    struct pollfd PollFD;
+    PollFD.fd      = m_Socket;
+    PollFD.events  = POLLOUT;
+    PollFD.revents = 0;
+
+    if (poll(&PollFD, 1, 0) == SOCKET_ERROR)
+    {
+        m_HasError = true;
+        m_Error    = GetLastError();
+        return false;
+    }
+
+    if (PollFD.revents != 0)
+#endif
     {
         m_Connecting = false;
         m_Connected  = true;
@@ -551,7 +988,7 @@ CTCPServer::~CTCPServer()
 {
 }
 
-bool CTCPServer::Listen(std::string address, uint16_t port)
+bool CTCPServer::Listen(std::string address, uint16_t port, int backlog)
 {
     if (m_Socket == INVALID_SOCKET || m_HasError)
         return false;
@@ -576,9 +1013,9 @@ bool CTCPServer::Listen(std::string address, uint16_t port)
         return false;
     }
 
-    // listen, std::queue length 8
+    // the backlog holds the connections the kernel has completed but we haven't accepted yet, if it's full new connections are dropped until it isn't
 
-    if (listen(m_Socket, 8) == SOCKET_ERROR)
+    if (listen(m_Socket, backlog) == SOCKET_ERROR)
     {
         m_HasError = true;
         m_Error    = GetLastError();
@@ -586,39 +1023,144 @@ bool CTCPServer::Listen(std::string address, uint16_t port)
         return false;
     }
 
+    // only register once we're listening, an unconnected socket is always reported as hung up
+
+    Register();
     return true;
 }
 
-CTCPSocket *CTCPServer::Accept(fd_set *fd)
+CTCPSocket *CTCPServer::Accept()
 {
-    if (m_Socket == INVALID_SOCKET || m_HasError)
+    if (m_Socket == INVALID_SOCKET || m_HasError || !m_ReadReady)
         return NULL;
 
-    if (FD_ISSET(m_Socket, fd))
+    // a connection is waiting, accept it
+
+    m_ReadReady = false;
+    return AcceptSocket();
+}
+
+std::vector<CTCPSocket *> CTCPServer::AcceptAll(uint32_t maxSockets)
+{
+    // the reactor only tells us the listener is readable, not how many connections are waiting
+    // so keep accepting until the backlog is empty (the listener is non blocking so accept fails with EWOULDBLOCK) instead of taking one per update
+
+    std::vector<CTCPSocket *> Sockets;
+
+    if (m_Socket == INVALID_SOCKET || m_HasError || !m_ReadReady)
+        return Sockets;
+
+    m_ReadReady = false;
+
+    while (Sockets.size() < maxSockets)
     {
-        // a connection is waiting, accept it
+        CTCPSocket *NewSocket = AcceptSocket();
+
+        if (!NewSocket)
+            break;
 
-        struct sockaddr_in Addr;
-        int AddrLen = sizeof(Addr);
-        SOCKET NewSocket;
+        Sockets.push_back(NewSocket);
+    }
+
+    return Sockets;
+}
+
+CTCPSocket *CTCPServer::AcceptSocket()
+{
+    struct sockaddr_in Addr;
+    int AddrLen = sizeof(Addr);
+    SOCKET NewSocket;
 
 #ifdef WIN32
-        if ((NewSocket = accept(m_Socket, (struct sockaddr *)&Addr, &AddrLen)) == INVALID_SOCKET)
+    NewSocket = accept(m_Socket, (struct sockaddr *)&Addr, &AddrLen);
+#elif defined(__linux__)
+    // accept the socket non blocking so the new CTCPSocket doesn't need another two system calls to make it so
+
+    NewSocket = accept4(m_Socket, (struct sockaddr *)&Addr, (socklen_t *)&AddrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
 #else
-        if ((NewSocket = accept(m_Socket, (struct sockaddr *)&Addr, (socklen_t *)&AddrLen)) == INVALID_SOCKET)
+    NewSocket = accept(m_Socket, (struct sockaddr *)&Addr, (socklen_t *)&AddrLen);
 #endif
+
+    // accept errors (including there not being any connections waiting) are ignored
+
+    if (NewSocket == INVALID_SOCKET)
+        return NULL;
+
+    return new CTCPSocket(NewSocket, Addr);
+}
+
+//
+// CConnectionLimiter
+//
+
+CConnectionLimiter::CConnectionLimiter()
+{
+    m_Burst          = 0;
+    m_PerMinute      = 0;
+    m_LastPruneTicks = GetTicks();
+}
+
+CConnectionLimiter::~CConnectionLimiter()
+{
+}
+
+void CConnectionLimiter::SetLimits(uint32_t nBurst, uint32_t nPerMinute)
+{
+    m_Burst     = nBurst;
+    m_PerMinute = nPerMinute;
+
+    if (m_Burst == 0)
+        m_Buckets.clear();
+}
+
+bool CConnectionLimiter::Allow(uint32_t ip, uint32_t &rejections)
+{
+    rejections = 0;
+
+    if (m_Burst == 0)
+        return true;
+
+    uint32_t Ticks = GetTicks();
+
+    // forget the addresses whose buckets have refilled every minute so the map only holds addresses that connected recently
+
+    if (Ticks - m_LastPruneTicks >= 60000)
+    {
+        for (std::unordered_map<uint32_t, Bucket>::iterator i = m_Buckets.begin(); i != m_Buckets.end();)
         {
-            // accept error, ignore it
+            if ((*i).second.m_Tokens + (Ticks - (*i).second.m_LastTicks) * m_PerMinute / 60000.0 >= m_Burst)
+                i = m_Buckets.erase(i);
+            else
+                i++;
         }
-        else
-        {
-            // success! return the new socket
 
-            return new CTCPSocket(NewSocket, Addr);
-        }
+        m_LastPruneTicks = Ticks;
+    }
+
+    std::unordered_map<uint32_t, Bucket>::iterator i = m_Buckets.find(ip);
+
+    if (i == m_Buckets.end())
+    {
+        Bucket NewBucket;
+        NewBucket.m_Tokens     = m_Burst;
+        NewBucket.m_LastTicks  = Ticks;
+        NewBucket.m_Rejections = 0;
+        i                      = m_Buckets.insert(std::make_pair(ip, NewBucket)).first;
     }
 
-    return NULL;
+    Bucket &Target     = (*i).second;
+    Target.m_Tokens    = std::min((double)m_Burst, Target.m_Tokens + (Ticks - Target.m_LastTicks) * m_PerMinute / 60000.0);
+    Target.m_LastTicks = Ticks;
+
+    if (Target.m_Tokens < 1)
+    {
+        rejections = ++Target.m_Rejections;
+        return false;
+    }
+
+    Target.m_Tokens -= 1;
+    Target.m_Rejections = 0;
+    return true;
 }
 
 //
@@ -788,6 +1330,7 @@ bool CUDPServer::Bind(struct sockaddr_in sin)
         return false;
     }
 
+    Register();
     return true;
 }
 
@@ -812,17 +1355,19 @@ bool CUDPServer::Bind(std::string address, uint16_t port)
     return Bind(sin);
 }
 
-void CUDPServer::RecvFrom(fd_set *fd, struct sockaddr_in *sin, std::string *message)
+void CUDPServer::RecvFrom(struct sockaddr_in *sin, std::string *message)
 {
     if (m_Socket == INVALID_SOCKET || m_HasError || !sin || !message)
         return;
 
     int AddrLen = sizeof(*sin);
 
-    if (FD_ISSET(m_Socket, fd))
+    if (m_ReadReady)
     {
         // data is waiting, receive it
 
+        m_ReadReady = false;
+
         char buffer[1024];
 
 #ifdef WIN32
@@ -108,8 +108,14 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
 typedef int SOCKET;
 
 #define INVALID_SOCKET -1
@@ -130,18 +136,26 @@ typedef int SOCKET;
 #define SHUT_RDWR 2
 #endif
 
+class CSocketReactor;
+
 //
 // CSocket
 //
 
 class CSocket
 {
+    friend class CSocketReactor;
+
 protected:
     SOCKET m_Socket;
     struct sockaddr_in m_SIN;
     bool m_HasError;
     int m_Error;
     std::string m_Name = "";
+    bool m_Registered; // if the socket is registered with the reactor
+    bool m_ReadReady;  // if the reactor reported the socket as readable during the last wait
+
+    CSocketReactor *m_Reactor; // the reactor the socket is registered with
 
     ~CSocket();
 
@@ -156,26 +170,111 @@ public:
     virtual int GetError() { return m_Error; }
     virtual std::string GetErrorString();
     virtual std::string GetName();
-    virtual void SetFD(fd_set *fd, fd_set *send_fd, int *nfds);
+    virtual bool GetReadReady() { return m_ReadReady; }
+    virtual void Register();
+    virtual void Unregister();
     virtual void Allocate(int type);
     virtual void Reset();
 };
 
+//
+// CSocketReactor
+//
+
+// a persistent readiness notifier shared by every socket owned by a thread (each game thread has its own, see gamethread.h)
+// sockets register themselves once when they start listening, connecting or are accepted and unregister when they're closed so the main loop doesn't have to rebuild a descriptor set on every update
+// a socket must be unregistered by the thread it was registered by, to move it to another thread unregister it and register it again from the new thread
+// on Linux this is backed by epoll (no descriptor limit, cost proportional to the number of ready sockets), elsewhere it falls back to select over the registered sockets
+// note: we only wait for read readiness, sends are attempted optimistically whenever a socket has data queued (EWOULDBLOCK is handled by DoSend)
+// on Linux the wait is ended by a timerfd rather than epoll's millisecond timeout so the game timers (see timerwheel.h) wake us up within microseconds of their deadlines
+
+class CSocketReactor
+{
+private:
+#ifdef __linux__
+    int m_EpollFD;
+    int m_TimerFD; // ends the wait at the exact timeout, registered with the epoll instance next to the sockets
+    std::vector<struct epoll_event> m_Events;
+#else
+    std::vector<CSocket *> m_Sockets;
+#endif
+    std::vector<CSocket *> m_Ready; // sockets flagged as readable during the last wait
+    uint32_t m_NumSockets;
+
+    CSocketReactor();
+
+public:
+    ~CSocketReactor();
+
+    static CSocketReactor *Get();
+
+    uint32_t GetNumSockets() { return m_NumSockets; }
+
+    void Add(CSocket *socket);
+    void Remove(CSocket *socket);
+    uint32_t Wait(uint32_t usecBlock);
+};
+
+//
+// CRecvBuffer
+//
+
+// a contiguous receive buffer with separate read and write positions
+// consuming data only advances the read position so complete packets can be handed out as views into the buffer without copying
+// the unread data is moved back to the front only when we run out of room at the end which is rare since the buffer usually drains completely
+
+class CRecvBuffer
+{
+private:
+    BYTEARRAY m_Data;
+    uint32_t m_ReadPos;
+    uint32_t m_WritePos;
+
+public:
+    CRecvBuffer();
+    ~CRecvBuffer();
+
+    const unsigned char *GetData() { return m_Data.data() + m_ReadPos; }
+    uint32_t GetSize() { return m_WritePos - m_ReadPos; }
+    unsigned char *Reserve(uint32_t length);
+    void Commit(uint32_t length) { m_WritePos += length; }
+    void Consume(uint32_t length);
+    void Clear() { m_ReadPos = m_WritePos = 0; }
+};
+
 //
 // CTCPSocket
 //
 
 class CTCPSocket : public CSocket
 {
+public:
+    enum FrameResult
+    {
+        FRAME_INCOMPLETE = 0,
+        FRAME_COMPLETE   = 1,
+        FRAME_BADHEADER  = 2,
+        FRAME_BADLENGTH  = 3
+    };
+
 protected:
     bool m_Connected;
     std::string m_LogFile;
 
 private:
-    std::string m_RecvBuffer;
-    std::string m_SendBuffer;
+    CRecvBuffer m_RecvBuffer;
+    std::deque<SHAREDBYTEARRAY> m_SendQueue; // buffers waiting to be sent, they're shared with any other socket sending the same data
+    uint32_t m_SendOffset;                   // how much of the first buffer in the queue has already been sent
+    uint32_t m_SendQueued;                   // the number of bytes in the send queue that haven't been sent yet
     uint32_t m_LastRecv;
     uint32_t m_LastSend;
+    uint64_t m_BytesReceived;    // the total number of bytes received (for the metrics, see metrics.h)
+    uint64_t m_BytesSent;        // the total number of bytes sent
+    std::string m_CaptureFile;   // the file everything sent and received is captured to (see capture.h, empty if it isn't captured)
+    uint32_t m_CaptureStream;    // the capture's stream ID
+    uint32_t m_CaptureLost;      // the number of capture records the logger dropped since the last one it queued
+    uint32_t m_CaptureLostBytes; // the number of bytes of data in those records
+    bool m_CaptureQueued;        // if any of the stream's records have been queued
 
 public:
     CTCPSocket(std::string nName = "");
@@ -184,18 +283,30 @@ public:
 
     virtual void Reset();
     virtual bool GetConnected() { return m_Connected; }
-    virtual std::string *GetBytes() { return &m_RecvBuffer; }
+    virtual const unsigned char *GetRecvData() { return m_RecvBuffer.GetData(); }
+    virtual uint32_t GetRecvSize() { return m_RecvBuffer.GetSize(); }
+    virtual void ConsumeBytes(uint32_t length) { m_RecvBuffer.Consume(length); }
+    virtual FrameResult FramePacket(const unsigned char *headers, uint32_t numHeaders, const unsigned char **data, uint16_t *length);
     virtual void PutBytes(std::string bytes);
     virtual void PutBytes(BYTEARRAY bytes);
-    virtual void ClearRecvBuffer() { m_RecvBuffer.clear(); }
-    virtual void ClearSendBuffer() { m_SendBuffer.clear(); }
+    virtual void PutBytes(SHAREDBYTEARRAY bytes);
+    virtual void ClearRecvBuffer() { m_RecvBuffer.Clear(); }
+    virtual void ClearSendBuffer();
     virtual uint32_t GetLastRecv() { return m_LastRecv; }
     virtual uint32_t GetLastSend() { return m_LastSend; }
-    virtual void DoRecv(fd_set *fd);
-    virtual void DoSend(fd_set *send_fd);
+    virtual uint32_t GetSendQueued() { return m_SendQueued; }
+    virtual uint64_t GetBytesReceived() { return m_BytesReceived; }
+    virtual uint64_t GetBytesSent() { return m_BytesSent; }
+    virtual void DoRecv();
+    virtual void DoSend();
     virtual void Disconnect();
     virtual void SetNoDelay(bool noDelay);
     virtual void SetLogFile(std::string nLogFile) { m_LogFile = nLogFile; }
+    virtual void SetCapture(std::string file, std::string label); // start capturing to the file as a new stream described by the label, or stop capturing if the file is empty
+    virtual bool GetCapturing() { return !m_CaptureFile.empty(); }
+
+private:
+    void Capture(unsigned char type, const unsigned char *data, uint32_t length);
 };
 
 //
@@ -222,14 +333,51 @@ public:
 // CTCPServer
 //
 
+#define TCPSERVER_MAX_ACCEPT 64 // the most connections AcceptAll accepts at once so a flood can't stall the loop (the rest are accepted on the next update)
+
 class CTCPServer : public CTCPSocket
 {
 public:
     CTCPServer(std::string nName = "");
     virtual ~CTCPServer();
 
-    virtual bool Listen(std::string address, uint16_t port);
-    virtual CTCPSocket *Accept(fd_set *fd);
+    virtual bool Listen(std::string address, uint16_t port, int backlog = 8);
+    virtual CTCPSocket *Accept();                                                        // accepts one waiting connection
+    virtual std::vector<CTCPSocket *> AcceptAll(uint32_t maxSockets = TCPSERVER_MAX_ACCEPT); // accepts every waiting connection
+
+private:
+    CTCPSocket *AcceptSocket();
+};
+
+//
+// CConnectionLimiter
+//
+
+// limits how often each IP address can connect to a listener with a token bucket per address
+// an address can connect m_Burst times in a row and then gets one more connection every 60 / m_PerMinute seconds
+// so a burst of players joining a freshly announced game from different addresses isn't slowed down at all but a single address reconnecting in a loop is
+
+class CConnectionLimiter
+{
+private:
+    struct Bucket
+    {
+        double m_Tokens;       // the connections the address can make right now
+        uint32_t m_LastTicks;  // GetTicks when m_Tokens was last refilled
+        uint32_t m_Rejections; // the number of connections rejected since the address was last allowed to connect
+    };
+
+    std::unordered_map<uint32_t, Bucket> m_Buckets; // IP address (host byte order) -> bucket
+    uint32_t m_Burst;                               // the size of each bucket (0 to disable the limit)
+    uint32_t m_PerMinute;                           // how fast the buckets refill
+    uint32_t m_LastPruneTicks;                      // GetTicks when the full buckets were last removed
+
+public:
+    CConnectionLimiter();
+    ~CConnectionLimiter();
+
+    void SetLimits(uint32_t nBurst, uint32_t nPerMinute);
+    bool Allow(uint32_t ip, uint32_t &rejections); // takes a token from the address' bucket, rejections is the number of connections rejected in a row including this one (0 if it's allowed)
 };
 
 //
@@ -264,7 +412,7 @@ public:
 
     virtual bool Bind(struct sockaddr_in sin);
     virtual bool Bind(std::string address, uint16_t port);
-    virtual void RecvFrom(fd_set *fd, struct sockaddr_in *sin, std::string *message);
+    virtual void RecvFrom(struct sockaddr_in *sin, std::string *message);
 };
 
 //обертка для TCP сокета
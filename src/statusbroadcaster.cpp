@@ -8,9 +8,6 @@ CStatusBroadcaster::CStatusBroadcaster(std::string gameName)
 {
     autoHostGameName = gameName;
     connectSocket    = NULL;
-    nfds             = 0;
-    fd               = NULL;
-    send_fd          = NULL;
 }
 
 CStatusBroadcaster::~CStatusBroadcaster()
@@ -26,12 +23,6 @@ CStatusBroadcaster::~CStatusBroadcaster()
     }
 }
 
-void CStatusBroadcaster::set_fd(fd_set *n_fd, fd_set *n_send_fd, int *n_nfds)
-{
-    fd      = n_fd;
-    send_fd = n_send_fd;
-    nfds    = n_nfds;
-}
 bool CStatusBroadcaster::StartListen(std::string m_BindAddress)
 {
     connectSocket = new CTCPServer("status");
@@ -64,11 +55,13 @@ std::string CStatusBroadcaster::MakeGameNameString(CBaseGame *game)
 
 void CStatusBroadcaster::SendAll(BYTEARRAY *packet)
 {
+    SHAREDBYTEARRAY Packet = std::make_shared<const BYTEARRAY>(*packet);
+
     //отправка дл¤ каждого сокета
     for (std::vector<CTCPStatusBroadcasterSocket *>::iterator i = sockets.begin(); i != sockets.end(); i++)
     {
-        (*i)->socket->PutBytes(*packet);
-        (*i)->socket->DoSend(send_fd);
+        (*i)->socket->PutBytes(Packet);
+        (*i)->socket->DoSend();
         (*i)->socket->ClearSendBuffer();
     }
 }
@@ -76,7 +69,7 @@ void CStatusBroadcaster::SendAll(BYTEARRAY *packet)
 void CStatusBroadcaster::Send(BYTEARRAY *packet, CTCPStatusBroadcasterSocket *bs)
 {
     bs->socket->PutBytes(*packet);
-    bs->socket->DoSend(send_fd);
+    bs->socket->DoSend();
     bs->socket->ClearSendBuffer();
 }
 
@@ -8,11 +8,6 @@ class CBaseGame;
 
 class CStatusBroadcaster
 {
-private:
-    int *nfds = 0;
-    fd_set *fd;
-    fd_set *send_fd;
-
 public:
     CTCPServer *connectSocket; // сокет для подключения
     uint16_t hostPort;
@@ -29,8 +24,6 @@ public:
     CStatusBroadcaster(std::string gameName);
     ~CStatusBroadcaster();
 
-    void set_fd(fd_set *n_fd, fd_set *n_send_fd, int *n_ndfs);
-
     bool StartListen(std::string m_BindAddress);
     std::string MakeGameNameString(CBaseGame *game);
     void SendAll(BYTEARRAY *packet);
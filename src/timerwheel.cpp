@@ -0,0 +1,298 @@
+#include "timerwheel.h"
+#include "util.h"
+
+//
+// CTimer
+//
+
+CTimer::CTimer()
+{
+    m_Wheel    = NULL;
+    m_Prev     = NULL;
+    m_Next     = NULL;
+    m_Deadline = 0;
+    m_Level    = 0;
+    m_Slot     = 0;
+}
+
+CTimer::~CTimer()
+{
+    if (m_Wheel)
+        m_Wheel->Cancel(this);
+}
+
+//
+// CTimerWheel
+//
+
+CTimerWheel::CTimerWheel()
+{
+    for (uint32_t i = 0; i < TIMERWHEEL_LEVELS; i++)
+    {
+        for (uint32_t j = 0; j < TIMERWHEEL_SLOTS; j++)
+            m_Slots[i][j] = NULL;
+    }
+
+    m_Tick      = GetMicroTicks() / TIMERWHEEL_RESOLUTION;
+    m_NumTimers = 0;
+}
+
+CTimerWheel::~CTimerWheel()
+{
+    // the timers belong to their owners so just unlink them
+
+    for (uint32_t i = 0; i < TIMERWHEEL_LEVELS; i++)
+    {
+        for (uint32_t j = 0; j < TIMERWHEEL_SLOTS; j++)
+        {
+            while (m_Slots[i][j])
+                Unlink(m_Slots[i][j]);
+        }
+    }
+}
+
+void CTimerWheel::Schedule(CTimer *timer, uint64_t deadline)
+{
+    if (timer->m_Wheel)
+        timer->m_Wheel->Unlink(timer);
+
+    timer->m_Deadline = deadline;
+    Link(timer);
+}
+
+void CTimerWheel::SchedulePeriodic(CTimer *timer, uint64_t period, uint64_t now)
+{
+    // keep the period relative to the last deadline so the timer doesn't drift by however late it was handled
+    // but if we've fallen more than a whole period behind (e.g. the bot was blocked for a while) skip the missed periods instead of firing them all at once
+
+    uint64_t Deadline = timer->m_Deadline + period;
+
+    if (Deadline <= now)
+        Deadline = now + period;
+
+    Schedule(timer, Deadline);
+}
+
+void CTimerWheel::Cancel(CTimer *timer)
+{
+    if (timer->m_Wheel == this)
+        Unlink(timer);
+}
+
+CTimer *CTimerWheel::Expire(uint64_t now)
+{
+    uint64_t NowTick = now / TIMERWHEEL_RESOLUTION;
+
+    if (m_NumTimers == 0)
+    {
+        // nothing to cascade so we can jump straight to the current tick
+
+        if (NowTick > m_Tick)
+            m_Tick = NowTick;
+
+        return NULL;
+    }
+
+    while (true)
+    {
+        // the current level 0 slot holds every timer due in the current tick (timers scheduled in the past are put in the current tick too)
+        // they're returned in deadline order and only once their exact deadline has passed
+
+        CTimer *Next = NULL;
+
+        for (CTimer *Timer = m_Slots[0][m_Tick & (TIMERWHEEL_SLOTS - 1)]; Timer; Timer = Timer->m_Next)
+        {
+            if (Timer->m_Deadline <= now && (!Next || Timer->m_Deadline < Next->m_Deadline))
+                Next = Timer;
+        }
+
+        if (Next)
+        {
+            Unlink(Next);
+            return Next;
+        }
+
+        // the timers left in the current slot (if any) are due later in this tick
+
+        if (m_Tick >= NowTick)
+            return NULL;
+
+        m_Tick++;
+
+        // cascade each level whose slot the tick just moved into, starting with the highest so timers cascaded into the current slot of a lower level are cascaded again
+
+        uint32_t Level = 0;
+
+        while (Level < TIMERWHEEL_LEVELS - 1 && (m_Tick & ((1ULL << ((Level + 1) * TIMERWHEEL_SLOT_BITS)) - 1)) == 0)
+            Level++;
+
+        for (; Level > 0; Level--)
+            Cascade(Level);
+    }
+}
+
+uint64_t CTimerWheel::GetNextDeadline()
+{
+    // the slots of each level are in deadline order starting from the current one so the first non empty slot of each level holds that level's earliest timers
+    // except for the last level where the next slot can also hold deadlines past the end of the wheel, it's scanned completely
+
+    uint64_t Deadline = UINT64_MAX;
+
+    if (m_NumTimers == 0)
+        return Deadline;
+
+    for (uint32_t i = 0; i < TIMERWHEEL_LEVELS; i++)
+    {
+        uint32_t Start = (m_Tick >> (i * TIMERWHEEL_SLOT_BITS)) & (TIMERWHEEL_SLOTS - 1);
+
+        for (uint32_t j = 0; j < TIMERWHEEL_SLOTS; j++)
+        {
+            CTimer *Timer = m_Slots[i][(Start + j) & (TIMERWHEEL_SLOTS - 1)];
+
+            if (!Timer)
+                continue;
+
+            for (; Timer; Timer = Timer->m_Next)
+                Deadline = std::min(Deadline, Timer->m_Deadline);
+
+            if (i < TIMERWHEEL_LEVELS - 1)
+                break;
+        }
+    }
+
+    return Deadline;
+}
+
+void CTimerWheel::Link(CTimer *timer)
+{
+    // a timer goes in the lowest level whose current turn includes its tick, i.e. the tick and the current tick are in the same slot of the level above
+    // so its slot in that level is always ahead of the current one and it's cascaded down exactly when the wheel reaches that slot
+    // a deadline in the past goes in the current tick's slot
+
+    uint64_t Tick  = std::max(timer->m_Deadline / TIMERWHEEL_RESOLUTION, m_Tick);
+    uint32_t Level = 0;
+    uint32_t Slot  = 0;
+
+    while (Level < TIMERWHEEL_LEVELS && (Tick >> ((Level + 1) * TIMERWHEEL_SLOT_BITS)) != (m_Tick >> ((Level + 1) * TIMERWHEEL_SLOT_BITS)))
+        Level++;
+
+    if (Level < TIMERWHEEL_LEVELS)
+        Slot = (Tick >> (Level * TIMERWHEEL_SLOT_BITS)) & (TIMERWHEEL_SLOTS - 1);
+    else
+    {
+        // deadlines past the end of the wheel wait in the last level's next slot and are linked again each time it cascades
+
+        Level = TIMERWHEEL_LEVELS - 1;
+        Slot  = ((m_Tick >> (Level * TIMERWHEEL_SLOT_BITS)) + 1) & (TIMERWHEEL_SLOTS - 1);
+    }
+
+    timer->m_Wheel = this;
+    timer->m_Level = Level;
+    timer->m_Slot  = Slot;
+    timer->m_Prev  = NULL;
+    timer->m_Next  = m_Slots[Level][Slot];
+
+    if (timer->m_Next)
+        timer->m_Next->m_Prev = timer;
+
+    m_Slots[Level][Slot] = timer;
+    m_NumTimers++;
+}
+
+void CTimerWheel::Unlink(CTimer *timer)
+{
+    if (timer->m_Prev)
+        timer->m_Prev->m_Next = timer->m_Next;
+    else
+        m_Slots[timer->m_Level][timer->m_Slot] = timer->m_Next;
+
+    if (timer->m_Next)
+        timer->m_Next->m_Prev = timer->m_Prev;
+
+    timer->m_Wheel = NULL;
+    timer->m_Prev  = NULL;
+    timer->m_Next  = NULL;
+    m_NumTimers--;
+}
+
+void CTimerWheel::Cascade(uint32_t level)
+{
+    // move the timers in the level's current slot down to the levels below
+
+    uint32_t Slot = (m_Tick >> (level * TIMERWHEEL_SLOT_BITS)) & (TIMERWHEEL_SLOTS - 1);
+    CTimer *Timer = m_Slots[level][Slot];
+    m_Slots[level][Slot] = NULL;
+
+    while (Timer)
+    {
+        CTimer *Following = Timer->m_Next;
+        m_NumTimers--;
+        Link(Timer);
+        Timer = Following;
+    }
+}
+
+//
+// CLatenessHistogram
+//
+
+CLatenessHistogram::CLatenessHistogram()
+{
+    for (uint32_t i = 0; i < LATENESS_BUCKETS; i++)
+        m_Buckets[i] = 0;
+
+    m_Count = 0;
+    m_Total = 0;
+    m_Max   = 0;
+}
+
+CLatenessHistogram::~CLatenessHistogram()
+{
+}
+
+uint64_t CLatenessHistogram::GetBucketBound(uint32_t bucket)
+{
+    static const uint64_t Bounds[LATENESS_BUCKETS - 1] = {100, 250, 500, 1000, 2000, 5000, 10000, 25000, 50000};
+
+    if (bucket < LATENESS_BUCKETS - 1)
+        return Bounds[bucket];
+
+    return UINT64_MAX;
+}
+
+void CLatenessHistogram::Add(uint64_t lateness)
+{
+    uint32_t Bucket = 0;
+
+    while (lateness > GetBucketBound(Bucket))
+        Bucket++;
+
+    m_Buckets[Bucket]++;
+    m_Count++;
+    m_Total += lateness;
+    m_Max = std::max(m_Max, lateness);
+}
+
+uint64_t CLatenessHistogram::GetPercentile(double percent)
+{
+    uint64_t Target = (uint64_t)(m_Count * percent / 100);
+    uint64_t Seen   = 0;
+
+    for (uint32_t i = 0; i < LATENESS_BUCKETS - 1; i++)
+    {
+        Seen += m_Buckets[i];
+
+        if (Seen >= Target && Seen > 0)
+            return std::min(GetBucketBound(i), m_Max);
+    }
+
+    return m_Max;
+}
+
+std::string CLatenessHistogram::GetSummary()
+{
+    if (m_Count == 0)
+        return "no ticks yet";
+
+    return UTIL_ToString((uint32_t)m_Count) + " ticks, average " + UTIL_ToString(m_Total / m_Count / 1000.0, 2) + "ms late, 50% within " + UTIL_ToString(GetPercentile(50) / 1000.0, 2) + "ms, 99% within " + UTIL_ToString(GetPercentile(99) / 1000.0, 2) + "ms, max " + UTIL_ToString(m_Max / 1000.0, 2) + "ms";
+}
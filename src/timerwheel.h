@@ -0,0 +1,103 @@
+#pragma once
+
+#include "includes.h"
+
+//
+// CTimerWheel
+//
+
+// a hierarchical timing wheel for the timers each game runs (action broadcasts, pings, refreshes, the countdown, announcements)
+// the wheel has TIMERWHEEL_LEVELS levels of TIMERWHEEL_SLOTS slots, a slot in level 0 covers one TIMERWHEEL_RESOLUTION tick and each level's slots cover a whole turn of the level below
+// a timer goes in the lowest level that reaches its deadline and moves down a level (cascades) whenever the level below it completes a turn
+// so scheduling and cancelling are O(1) and expiring only looks at the slots the time has passed through
+// deadlines are kept in microseconds (GetMicroTicks) and a timer is only expired once its exact deadline has passed, the ticks just decide which slot it's in
+
+#define TIMERWHEEL_LEVELS 4        // with 64 slots per level and 1ms ticks the wheel reaches about 4.6 hours ahead, later deadlines wait in the last slot
+#define TIMERWHEEL_SLOTS 64        // slots per level (a power of two)
+#define TIMERWHEEL_SLOT_BITS 6     // log2 of TIMERWHEEL_SLOTS
+#define TIMERWHEEL_RESOLUTION 1000 // microseconds per tick
+
+class CTimerWheel;
+
+//
+// CTimer
+//
+
+// a timer is owned by whoever scheduled it (usually a game member) and just links itself into the wheel while it's scheduled
+
+class CTimer
+{
+    friend class CTimerWheel;
+
+private:
+    CTimerWheel *m_Wheel; // the wheel the timer is scheduled on (NULL if it isn't scheduled)
+    CTimer *m_Prev;       // the previous timer in the same slot
+    CTimer *m_Next;       // the next timer in the same slot
+    uint64_t m_Deadline;  // GetMicroTicks when the timer expires (kept after it expires so the owner can tell how late it was)
+    uint32_t m_Level;
+    uint32_t m_Slot;
+
+public:
+    CTimer();
+    ~CTimer();
+
+    bool GetScheduled() { return m_Wheel != NULL; }
+    uint64_t GetDeadline() { return m_Deadline; }
+};
+
+class CTimerWheel
+{
+private:
+    CTimer *m_Slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS]; // the first timer in each slot
+    uint64_t m_Tick;                                       // the tick the wheel has expired timers up to
+    uint32_t m_NumTimers;
+
+public:
+    CTimerWheel();
+    ~CTimerWheel();
+
+    uint32_t GetNumTimers() { return m_NumTimers; }
+
+    void Schedule(CTimer *timer, uint64_t deadline);                     // (re)schedules the timer, a deadline in the past expires it on the next call to Expire
+    void SchedulePeriodic(CTimer *timer, uint64_t period, uint64_t now); // schedules the timer one period after its last deadline, or after now if it's fallen more than a period behind
+    void Cancel(CTimer *timer);
+    CTimer *Expire(uint64_t now);                                        // removes and returns the timer with the earliest deadline at or before now (NULL if there isn't one)
+    uint64_t GetNextDeadline();                                          // the earliest deadline of any scheduled timer (UINT64_MAX if there aren't any)
+
+private:
+    void Link(CTimer *timer);
+    void Unlink(CTimer *timer);
+    void Cascade(uint32_t level);
+};
+
+//
+// CLatenessHistogram
+//
+
+// counts how late a timer fired in buckets from 0.1ms to 50ms so the jitter of a game's action broadcasts can be reported
+
+#define LATENESS_BUCKETS 10
+
+class CLatenessHistogram
+{
+private:
+    uint64_t m_Buckets[LATENESS_BUCKETS]; // the number of samples up to each bucket's bound (the last bucket has no bound)
+    uint64_t m_Count;
+    uint64_t m_Total; // in microseconds
+    uint64_t m_Max;   // in microseconds
+
+public:
+    CLatenessHistogram();
+    ~CLatenessHistogram();
+
+    static uint64_t GetBucketBound(uint32_t bucket); // the inclusive upper bound of a bucket in microseconds (UINT64_MAX for the last bucket)
+
+    uint64_t GetBucket(uint32_t bucket) { return m_Buckets[bucket]; }
+    uint64_t GetCount() { return m_Count; }
+    uint64_t GetTotal() { return m_Total; }
+    uint64_t GetMax() { return m_Max; }
+
+    void Add(uint64_t lateness);
+    uint64_t GetPercentile(double percent); // the bound of the bucket holding the given percentile (the max for the last bucket)
+    std::string GetSummary();
+};
@@ -2,6 +2,7 @@
 #include "userinterface.h"
 #include "bnet.h"
 #include "game_base.h"
+#include "gamethread.h"
 #include "ghost.h"
 #include "util.h"
 
@@ -12,6 +13,40 @@ int ceili(float f)
     return int(ceilf(f));
 }
 
+//
+// CScrollback
+//
+
+CScrollback::CScrollback()
+{
+    m_First = 0;
+    m_Total = 0;
+}
+
+CScrollback::~CScrollback()
+{
+}
+
+void CScrollback::Add(const std::string &message, int flag)
+{
+    if (m_Lines.size() < MAX_BUFFER_SIZE)
+        m_Lines.push_back(std::pair<std::string, int>(message, flag));
+    else
+    {
+        // overwrite the oldest message, assigning to the string reuses its memory when the new message fits
+
+        m_Lines[m_First].first  = message;
+        m_Lines[m_First].second = flag;
+        m_First                 = (m_First + 1) % MAX_BUFFER_SIZE;
+    }
+
+    m_Total++;
+}
+
+//
+// CCurses
+//
+
 CCurses::CCurses(int nTermWidth, int nTermHeight, bool nSplitView, int nListType)
 {
     // Initialize vectors
@@ -20,7 +55,9 @@ CCurses::CCurses(int nTermWidth, int nTermHeight, bool nSplitView, int nListType
         m_RealmData.push_back(temp1);
 
     SWindowData temp2;
-    temp2.Scroll = 0;
+    temp2.Scroll     = 0;
+    temp2.Drawn      = NULL;
+    temp2.DrawnTotal = 0;
     for (uint32_t i = 0; i < 10; ++i)
         m_WindowData.push_back(temp2);
 
@@ -33,6 +70,7 @@ CCurses::CCurses(int nTermWidth, int nTermHeight, bool nSplitView, int nListType
     }
 
     // Initialize variables
+    m_MainThread      = std::this_thread::get_id();
     m_RealmId         = 0;
     m_RealmId2        = 0;
     m_ListUpdateTimer = 0;
@@ -160,7 +198,6 @@ void CCurses::SelectTab(uint32_t n)
 
         m_RealmId = m_TabData[m_SelectedTab].id;
 
-        m_Buffers[B_REALM]   = &m_RealmData[m_RealmId].Messages;
         m_Buffers[B_CHANNEL] = &m_RealmData[m_RealmId].ChannelUsers;
 
         UpdateCustomLists(m_TabData[m_SelectedTab].bufferType);
@@ -287,7 +324,7 @@ void CCurses::UpdateWindow(WindowType type)
     mvwin(m_WindowData[type].Window, y1, x1);
     m_WindowData[type].IsWindowChanged = true;
 
-    if (!m_TabData.empty() && m_Buffers[m_TabData[m_SelectedTab].bufferType]->size() > (std::size_t)LINES / 2)
+    if (!m_TabData.empty() && GetBufferSize(m_TabData[m_SelectedTab].bufferType) > (uint32_t)LINES / 2)
     {
         if ((m_WindowData[type].Scroll < LINES) && (type == W_FULL || type == W_FULL2))
             m_WindowData[type].Scroll = LINES;
@@ -426,6 +463,9 @@ void CCurses::CompileAdmins()
 
 void CCurses::CompileGames()
 {
+    // the games in progress might be running on game threads
+    CGameThreadLock Lock(m_GHost->m_GameThreads);
+
     m_Buffers[B_GAMES]->clear();
 
     if (m_GHost->m_Games.empty() && m_GHost->m_CurrentGame)
@@ -601,7 +641,7 @@ void CCurses::Draw()
         switch (m_TabData[m_SelectedTab].type)
         {
         case T_MAIN:
-            DrawWindow(W_FULL2, m_TabData[m_SelectedTab].bufferType);
+            DrawScrollback(W_FULL2, m_TabData[m_SelectedTab].bufferType);
             DrawWindow(W_INPUT, B_INPUT);
             break;
         case T_LIST:
@@ -620,19 +660,19 @@ void CCurses::Draw()
             if (m_SplitView)
             {
                 DrawHorizontalLine(W_HLINE);
-                DrawWindow(W_UPPER, B_MAIN);
-                DrawWindow(W_LOWER, m_TabData[m_SelectedTab].bufferType);
+                DrawScrollback(W_UPPER, B_MAIN);
+                DrawScrollback(W_LOWER, m_TabData[m_SelectedTab].bufferType);
             }
             else
             {
-                DrawWindow(W_FULL, m_TabData[m_SelectedTab].bufferType);
+                DrawScrollback(W_FULL, m_TabData[m_SelectedTab].bufferType);
             }
             //DrawVerticalLine( W_VLINE );
             DrawWindow(W_CHANNEL, B_CHANNEL);
             DrawWindow(W_INPUT, B_INPUT);
             break;
         case T_GAME:
-            DrawWindow(W_FULL, m_TabData[m_SelectedTab].bufferType);
+            DrawScrollback(W_FULL, m_TabData[m_SelectedTab].bufferType);
             DrawWindow(W_INPUT, B_INPUT);
             break;
         }
@@ -692,17 +732,11 @@ void CCurses::DrawWindow(WindowType wType, BufferType bType)
         int k = 0;
         for (Buffer::iterator i = onlyLast ? m_Buffers[bType]->end() - 1 : m_Buffers[bType]->begin(); i != m_Buffers[bType]->end(); i++)
         {
-            std::string message = (*i).first;
-            int &flag           = (*i).second;
+            std::pair<std::string, int> line((*i).first, (*i).second);
 
-            message = UTIL_UTF8ToLatin1(message);
+            line.first = UTIL_UTF8ToLatin1(line.first);
 
-            SetAttribute(data, message, flag, bType, true);
-
-            for (std::string::iterator j = message.begin(); j != message.end(); j++)
-                waddch(data.Window, UTIL_ToULong(*j));
-
-            SetAttribute(data, message, flag, bType, false);
+            DrawLine(data, line, bType);
 
             if (k++ >= data.Scroll)
                 break;
@@ -716,6 +750,64 @@ void CCurses::DrawWindow(WindowType wType, BufferType bType)
     }
 }
 
+void CCurses::DrawScrollback(WindowType wType, BufferType bType)
+{
+    SWindowData &data       = m_WindowData[wType];
+    CScrollback *Scrollback = GetScrollback(bType);
+    uint32_t Size           = Scrollback->GetSize();
+    uint32_t New            = Scrollback->GetTotal() - data.DrawnTotal;
+
+    if (!data.IsWindowChanged && data.Drawn == Scrollback)
+    {
+        if (New == 0)
+            return;
+
+        // when the window is showing the end of the scrollback the new messages are just added at the bottom and the window scrolls the rest up
+        // which looks exactly like clearing it and drawing every message again (that's done when the window is scrolled back)
+
+        if (New < Size && data.Scroll + 1 >= (int)Size)
+        {
+            for (uint32_t n = Size - New; n < Size; n++)
+            {
+                waddch(data.Window, '\n');
+                DrawLine(data, Scrollback->GetLine(n), bType);
+            }
+
+            wrefresh(data.Window);
+            data.DrawnTotal = Scrollback->GetTotal();
+            return;
+        }
+    }
+
+    wclear(data.Window);
+
+    for (uint32_t n = 0; n < Size; n++)
+    {
+        if (n > 0)
+            waddch(data.Window, '\n');
+
+        DrawLine(data, Scrollback->GetLine(n), bType);
+
+        if ((int)n >= data.Scroll)
+            break;
+    }
+
+    wrefresh(data.Window);
+    data.IsWindowChanged = false;
+    data.Drawn           = Scrollback;
+    data.DrawnTotal      = Scrollback->GetTotal();
+}
+
+void CCurses::DrawLine(SWindowData &data, std::pair<std::string, int> &line, BufferType type)
+{
+    SetAttribute(data, line.first, line.second, type, true);
+
+    for (std::string::iterator i = line.first.begin(); i != line.first.end(); i++)
+        waddch(data.Window, UTIL_ToULong(*i));
+
+    SetAttribute(data, line.first, line.second, type, false);
+}
+
 void CCurses::DrawListWindow(WindowType wType, BufferType bType)
 {
     SWindowData &data = m_WindowData[wType];
@@ -838,45 +930,40 @@ void CCurses::Resize()
 
 void CCurses::Print(std::string message, uint32_t realmId, bool toMainBuffer)
 {
-    message                          = UTIL_UTF8ToLatin1(message);
-    std::pair<std::string, int> temp = std::pair<std::string, int>(message, 0);
-    if (toMainBuffer)
+    // curses isn't thread safe so messages from other threads are drawn by the main thread in Update
+
+    if (std::this_thread::get_id() != m_MainThread)
     {
-        m_Buffers[B_MAIN]->push_back(temp);
+        std::lock_guard<std::mutex> Lock(m_QueuedPrintsMutex);
+        m_QueuedPrints.push_back(SQueuedPrint{message, realmId, toMainBuffer});
+        return;
+    }
 
-        if (m_Buffers[B_MAIN]->size() > MAX_BUFFER_SIZE)
-            m_Buffers[B_MAIN]->erase(m_Buffers[B_MAIN]->begin());
+    // the message is converted once here, the windows only redraw the messages they haven't drawn yet (see DrawScrollback)
 
-        m_WindowData[W_UPPER].IsWindowChanged = true;
+    message = UTIL_UTF8ToLatin1(message);
 
-        if (m_WindowData[W_UPPER].Scroll < 512)
+    if (toMainBuffer)
+    {
+        m_Main.Add(message, 0);
+
+        if (m_WindowData[W_UPPER].Scroll < MAX_BUFFER_SIZE)
             m_WindowData[W_UPPER].Scroll++;
     }
     else
     {
-        m_RealmData[realmId].Messages.push_back(temp);
-
-        if (m_RealmData[realmId].Messages.size() > MAX_BUFFER_SIZE)
-            m_RealmData[realmId].Messages.erase(m_RealmData[realmId].Messages.begin());
+        m_RealmData[realmId].Messages.Add(message, 0);
 
-        m_WindowData[W_LOWER].IsWindowChanged = true;
-
-        if (m_WindowData[W_LOWER].Scroll < 512)
+        if (m_WindowData[W_LOWER].Scroll < MAX_BUFFER_SIZE)
             m_WindowData[W_LOWER].Scroll++;
     }
 
-    m_Buffers[B_ALL]->push_back(temp);
-
-    if (m_Buffers[B_ALL]->size() > MAX_BUFFER_SIZE)
-        m_Buffers[B_ALL]->erase(m_Buffers[B_ALL]->begin());
+    m_All.Add(message, 0);
 
-    m_WindowData[W_FULL].IsWindowChanged  = true;
-    m_WindowData[W_FULL2].IsWindowChanged = true;
-
-    if (m_WindowData[W_FULL].Scroll < 512)
+    if (m_WindowData[W_FULL].Scroll < MAX_BUFFER_SIZE)
         m_WindowData[W_FULL].Scroll++;
 
-    if (m_WindowData[W_FULL2].Scroll < 512)
+    if (m_WindowData[W_FULL2].Scroll < MAX_BUFFER_SIZE)
         m_WindowData[W_FULL2].Scroll++;
 
     Draw();
@@ -957,7 +1044,7 @@ void CCurses::ScrollDown()
         switch (m_TabData[m_SelectedTab].type)
         {
         case T_MAIN:
-            m_WindowData[W_FULL2].Scroll          = (uint32_t)m_WindowData[W_FULL2].Scroll < m_Buffers[m_TabData[m_SelectedTab].bufferType]->size() ? m_WindowData[W_FULL2].Scroll + SCROLL_VALUE : m_WindowData[W_FULL2].Scroll;
+            m_WindowData[W_FULL2].Scroll          = (uint32_t)m_WindowData[W_FULL2].Scroll < GetBufferSize(m_TabData[m_SelectedTab].bufferType) ? m_WindowData[W_FULL2].Scroll + SCROLL_VALUE : m_WindowData[W_FULL2].Scroll;
             m_WindowData[W_FULL2].IsWindowChanged = true;
             break;
         case T_REALM:
@@ -965,18 +1052,18 @@ void CCurses::ScrollDown()
             {
                 if (exY < LINES / 2)
                 {
-                    m_WindowData[W_UPPER].Scroll          = (uint32_t)m_WindowData[W_UPPER].Scroll < m_Buffers[B_MAIN]->size() ? m_WindowData[W_UPPER].Scroll + SCROLL_VALUE : m_WindowData[W_UPPER].Scroll;
+                    m_WindowData[W_UPPER].Scroll          = (uint32_t)m_WindowData[W_UPPER].Scroll < m_Main.GetSize() ? m_WindowData[W_UPPER].Scroll + SCROLL_VALUE : m_WindowData[W_UPPER].Scroll;
                     m_WindowData[W_UPPER].IsWindowChanged = true;
                 }
                 else
                 {
-                    m_WindowData[W_LOWER].Scroll          = (uint32_t)m_WindowData[W_LOWER].Scroll < m_Buffers[m_TabData[m_SelectedTab].bufferType]->size() ? m_WindowData[W_LOWER].Scroll + SCROLL_VALUE : m_WindowData[W_LOWER].Scroll;
+                    m_WindowData[W_LOWER].Scroll          = (uint32_t)m_WindowData[W_LOWER].Scroll < GetBufferSize(m_TabData[m_SelectedTab].bufferType) ? m_WindowData[W_LOWER].Scroll + SCROLL_VALUE : m_WindowData[W_LOWER].Scroll;
                     m_WindowData[W_LOWER].IsWindowChanged = true;
                 }
             }
             else
             {
-                m_WindowData[W_FULL].Scroll          = (uint32_t)m_WindowData[W_FULL].Scroll < m_Buffers[m_TabData[m_SelectedTab].bufferType]->size() ? m_WindowData[W_FULL].Scroll + SCROLL_VALUE : m_WindowData[W_FULL].Scroll;
+                m_WindowData[W_FULL].Scroll          = (uint32_t)m_WindowData[W_FULL].Scroll < GetBufferSize(m_TabData[m_SelectedTab].bufferType) ? m_WindowData[W_FULL].Scroll + SCROLL_VALUE : m_WindowData[W_FULL].Scroll;
                 m_WindowData[W_FULL].IsWindowChanged = true;
             }
             break;
@@ -1031,6 +1118,17 @@ bool CCurses::Update()
 {
     bool Quit = false;
 
+    // Draw the messages printed from other threads
+    std::vector<SQueuedPrint> QueuedPrints;
+
+    {
+        std::lock_guard<std::mutex> Lock(m_QueuedPrintsMutex);
+        QueuedPrints.swap(m_QueuedPrints);
+    }
+
+    for (std::vector<SQueuedPrint>::iterator i = QueuedPrints.begin(); i != QueuedPrints.end(); i++)
+        Print((*i).Message, (*i).RealmId, (*i).ToMainBuffer);
+
     bool Connected = !m_GHost->m_BNETs.empty();
     if (Connected)
         Connected = IsConnected(0, true);
@@ -1310,6 +1408,24 @@ bool CCurses::IsConnected(uint32_t realmId, bool entry)
     return true;
 }
 
+CScrollback *CCurses::GetScrollback(BufferType type)
+{
+    if (type == B_ALL)
+        return &m_All;
+    else if (type == B_MAIN)
+        return &m_Main;
+
+    return &m_RealmData[m_RealmId].Messages;
+}
+
+uint32_t CCurses::GetBufferSize(BufferType type)
+{
+    if (type == B_ALL || type == B_MAIN || type == B_REALM)
+        return GetScrollback(type)->GetSize();
+
+    return m_Buffers[type]->size();
+}
+
 uint32_t CCurses::GetMessageFlag(std::string &message)
 {
     // message is in lowercase
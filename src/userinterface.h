@@ -3,6 +3,8 @@
 
 #include "includes.h"
 
+#include <mutex>
+
 #undef MOUSE_MOVED
 #include <pdcurses/curses.h>
 
@@ -25,6 +27,32 @@
 
 typedef std::vector<std::pair<std::string, int>> Buffer;
 
+//
+// CScrollback
+//
+
+// the last MAX_BUFFER_SIZE messages printed to the ALL, MAIN and realm tabs
+// they're kept in a ring so printing past the limit overwrites the oldest message instead of shifting all the others down
+// GetTotal counts every message ever added so a window can tell which messages it hasn't drawn yet
+
+class CScrollback
+{
+private:
+    std::vector<std::pair<std::string, int>> m_Lines; // the ring, it grows to MAX_BUFFER_SIZE and is then reused
+    uint32_t m_First;                                  // the index of the oldest message in m_Lines
+    uint32_t m_Total;                                  // the number of messages ever added
+
+public:
+    CScrollback();
+    ~CScrollback();
+
+    uint32_t GetSize() { return m_Lines.size(); }
+    uint32_t GetTotal() { return m_Total; }
+    std::pair<std::string, int> &GetLine(uint32_t n) { return m_Lines[(m_First + n) % m_Lines.size()]; } // 0 is the oldest message
+
+    void Add(const std::string &message, int flag);
+};
+
 enum BufferType
 {
     B_ALL = 0,
@@ -46,7 +74,7 @@ struct SRealmData
     std::string RealmAlias;
     std::string ChannelName;
     Buffer ChannelUsers;
-    Buffer Messages;
+    CScrollback Messages;
     Buffer Friends;
     Buffer Clan;
     Buffer Bans;
@@ -73,6 +101,8 @@ struct SWindowData
     std::string Title;
     bool IsWindowChanged;
     int Scroll;
+    CScrollback *Drawn;  // the scrollback drawn in the window (NULL if it isn't showing one)
+    uint32_t DrawnTotal; // Drawn->GetTotal() when it was drawn, the messages added since then are drawn without redrawing the window
 };
 
 enum TabType
@@ -93,6 +123,13 @@ struct STabData
     WindowType windowType;
 };
 
+struct SQueuedPrint
+{
+    std::string Message;
+    uint32_t RealmId;
+    bool ToMainBuffer;
+};
+
 //
 // CCurses
 //
@@ -107,6 +144,8 @@ private:
 
     // Buffers
     std::vector<Buffer *> m_Buffers; // pointers so updating is "automatic" and there is no useless copying
+    CScrollback m_All;               // messages for the ALL tab (B_ALL)
+    CScrollback m_Main;              // messages for the MAIN tab (B_MAIN), the realm messages are in m_RealmData (B_REALM)
 
     // RealmData
     std::vector<SRealmData> m_RealmData;
@@ -127,10 +166,13 @@ private:
     // Drawing
     void SetAttribute(SWindowData &data, std::string message, int flag, BufferType type, bool on);
     // on==true (before message), on==false (after message)
+    void DrawLine(SWindowData &data, std::pair<std::string, int> &line, BufferType type);
+    // draws a message (which is already in latin1) with its attribute
 
     void Draw();                                              // draws everything
     void DrawTabs(WindowType type);                           // draws tabs
     void DrawWindow(WindowType wType, BufferType bType);      // draws a window
+    void DrawScrollback(WindowType wType, BufferType bType);  // draws a window showing messages (only the new ones if it can)
     void DrawListWindow(WindowType wType, BufferType bType);  // draws a list (horizontal)
     void DrawListWindow2(WindowType wType, BufferType bType); // draws a list (vertical)
     void DrawHorizontalLine(WindowType type);                 // draws a horizontal line
@@ -161,6 +203,8 @@ private:
     void UpdateMouse(int c); // updates mouse clicks/scrolls
 
     // Misc
+    CScrollback *GetScrollback(BufferType type);    // scrollback of B_ALL, B_MAIN or B_REALM (the selected realm)
+    uint32_t GetBufferSize(BufferType type);        // number of lines in a buffer or scrollback
     uint32_t GetRealmId(std::string &realmAlias);   // id from alias
     uint32_t GetNextRealm(uint32_t realmId);        // next realm id
     bool IsConnected(uint32_t realmId, bool entry); // are we connected at all?
@@ -183,6 +227,11 @@ private:
 
     int exY, exX; // fixes scrolling
 
+    // Printing from other threads (database callables, replay saves, game threads)
+    std::thread::id m_MainThread;             // the thread that created us, the only one allowed to draw
+    std::mutex m_QueuedPrintsMutex;           // protects m_QueuedPrints
+    std::vector<SQueuedPrint> m_QueuedPrints; // messages printed from other threads waiting to be drawn by Update
+
 public:
     CCurses(int nTermWidth, int nTermHeight, bool nSplitView, int nListType);
     ~CCurses();
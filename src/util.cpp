@@ -21,9 +21,13 @@
 #include "util.h"
 #include "ghost.h"
 
+#include <cstring>
 #include <sys/stat.h>
 
-std::map<std::pair<char, char>, int> utf8_latin1;
+// the latin1 characters 128-255 are encoded in utf8 as a lead byte of 0xC2 or 0xC3 followed by a continuation byte with the low 6 bits
+// so this table maps each lead byte to the high bits of the latin1 character it starts (0 if it doesn't start one)
+
+unsigned char utf8_latin1[256];
 
 BYTEARRAY UTIL_CreateByteArray(unsigned char *a, int size)
 {
@@ -373,13 +377,10 @@ std::string UTIL_ToHexString(uint32_t i)
 
 void UTIL_Construct_UTF8_Latin1_Map()
 {
-    int c, d;
-    for (int i = 128; i < 256; ++i)
-    {
-        c                                        = (i >> 6) | 0xC0;
-        d                                        = (i & 0x3F) | 0x80;
-        utf8_latin1[std::pair<char, char>(c, d)] = i;
-    }
+    memset(utf8_latin1, 0, sizeof(utf8_latin1));
+
+    for (int i = 128; i < 256; i += 64)
+        utf8_latin1[(i >> 6) | 0xC0] = i;
 }
 
 std::string UTIL_Latin1ToUTF8(std::string &s)
@@ -405,15 +406,24 @@ std::string UTIL_Latin1ToUTF8(std::string &s)
 
 std::string UTIL_UTF8ToLatin1(std::string &s)
 {
-    std::string temp, result = s;
-    for (uint32_t k = 1; k < result.size(); ++k)
+    // one pass over the string, each two byte sequence for a latin1 character becomes that character and everything else is copied as is
+
+    std::string result;
+    result.reserve(s.size());
+
+    for (uint32_t k = 0; k < s.size(); ++k)
     {
-        if (utf8_latin1.find(std::pair<char, char>(result[k - 1], result[k])) != utf8_latin1.end())
+        unsigned char Lead = s[k];
+
+        if (utf8_latin1[Lead] && k + 1 < s.size() && ((unsigned char)s[k + 1] & 0xC0) == 0x80)
         {
-            temp = utf8_latin1[std::pair<char, char>(result[k - 1], result[k])];
-            result.replace(k - 1, 2, temp);
+            result += (char)(utf8_latin1[Lead] | ((unsigned char)s[k + 1] & 0x3F));
+            ++k;
         }
+        else
+            result += s[k];
     }
+
     return result;
 }
 
@@ -661,6 +671,42 @@ BYTEARRAY UTIL_DecodeStatString(BYTEARRAY &data)
     return Result;
 }
 
+bool UTIL_ParseIP(std::string ip, uint32_t &result)
+{
+    // parse a dotted IPv4 address into a uint32 with the first octet in the high byte so that address ranges compare naturally
+
+    uint32_t Address = 0;
+    uint32_t Octets  = 0;
+    uint32_t Octet   = 0;
+    uint32_t Digits  = 0;
+
+    for (std::string::iterator i = ip.begin(); i != ip.end(); i++)
+    {
+        if (*i >= '0' && *i <= '9')
+        {
+            Octet = Octet * 10 + (*i - '0');
+
+            if (++Digits > 3 || Octet > 255)
+                return false;
+        }
+        else if (*i == '.' && Digits > 0 && Octets < 3)
+        {
+            Address = (Address << 8) | Octet;
+            Octets++;
+            Octet  = 0;
+            Digits = 0;
+        }
+        else
+            return false;
+    }
+
+    if (Octets != 3 || Digits == 0)
+        return false;
+
+    result = (Address << 8) | Octet;
+    return true;
+}
+
 bool UTIL_IsLanIP(BYTEARRAY ip)
 {
     if (ip.size() != 4)
@@ -92,6 +92,7 @@ BYTEARRAY UTIL_DecodeStatString(BYTEARRAY &data);
 
 bool UTIL_IsLanIP(BYTEARRAY ip);
 bool UTIL_IsLocalIP(BYTEARRAY ip, std::vector<BYTEARRAY> &localIPs);
+bool UTIL_ParseIP(std::string ip, uint32_t &result);
 void UTIL_Replace(std::string &Text, std::string Key, std::string Value);
 std::vector<std::string> UTIL_Tokenize(std::string s, char delim);
 